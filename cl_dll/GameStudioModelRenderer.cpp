@@ -20,6 +20,8 @@
 #include <string.h>
 
 #include "studio_util.h"
+#include "studio_simd.h"
+#include "studio_threads.h"
 #include "r_studioint.h"
 
 #include "StudioModelRenderer.h"
@@ -71,6 +73,17 @@ int R_StudioDrawModel( int flags )
 	return g_StudioRenderer.StudioDrawModel( flags );
 }
 
+/*
+====================
+R_StudioCacheStats
+
+====================
+*/
+static void R_StudioCacheStats( void )
+{
+	g_StudioRenderer.StudioBoneCacheStats();
+}
+
 /*
 ====================
 R_StudioInit
@@ -80,6 +93,52 @@ R_StudioInit
 void R_StudioInit( void )
 {
 	g_StudioRenderer.Init();
+
+	gEngfuncs.pfnAddCommand( "r_studio_cachestats", R_StudioCacheStats );
+}
+
+/*
+====================
+R_StudioVidInit
+
+====================
+*/
+void R_StudioVidInit( void )
+{
+	g_StudioRenderer.VidInit();
+}
+
+/*
+====================
+R_StudioAddEntity
+
+====================
+*/
+void R_StudioAddEntity( cl_entity_t *ent )
+{
+	g_StudioRenderer.StudioAddPrepassEntity( ent );
+}
+
+/*
+====================
+R_StudioPrepass
+
+====================
+*/
+void R_StudioPrepass( void )
+{
+	g_StudioRenderer.StudioPrepass();
+}
+
+/*
+====================
+R_StudioShutdown
+
+====================
+*/
+void R_StudioShutdown( void )
+{
+	StudioThreads_Shutdown();
 }
 
 // The simple drawing interface we'll pass back to the engine
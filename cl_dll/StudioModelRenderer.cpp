@@ -18,10 +18,13 @@
 #include "dlight.h"
 #include "triangleapi.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "studio_util.h"
+#include "studio_simd.h"
+#include "studio_threads.h"
 #include "r_studioint.h"
 
 #include "StudioModelRenderer.h"
@@ -39,6 +42,8 @@
 // Global engine <-> studio model rendering code interface
 engine_studio_api_t IEngineStudio;
 
+extern "C" int CL_IsThirdPerson( void );
+
 float g_flSpinUpTime[33];
 float g_flSpinDownTime[33];
 
@@ -54,6 +59,11 @@ void CStudioModelRenderer::Init( void )
 	m_pCvarHiModels = IEngineStudio.GetCvar( "cl_himodels" );
 	m_pCvarDeveloper = IEngineStudio.GetCvar( "developer" );
 	m_pCvarDrawEntities = IEngineStudio.GetCvar( "r_drawentities" );
+	m_pCvarSimdBones = CVAR_CREATE( "r_studio_simd", "1", FCVAR_ARCHIVE );
+	m_pCvarBoneCache = CVAR_CREATE( "r_studio_bonecache", "1", FCVAR_ARCHIVE );
+	m_pCvarThreads = CVAR_CREATE( "r_studio_threads", "0", FCVAR_ARCHIVE );
+
+	gEngfuncs.Con_DPrintf( "Studio bone setup: %s\n", StudioPose_SimdName() );
 
 	m_pChromeSprite = IEngineStudio.GetChromeSprite();
 
@@ -66,6 +76,26 @@ void CStudioModelRenderer::Init( void )
 	m_protationmatrix = (float( * )[3][4])IEngineStudio.StudioGetRotationMatrix();
 }
 
+/*
+====================
+VidInit
+
+====================
+*/
+void CStudioModelRenderer::VidInit( void )
+{
+	// models may be reloaded at the same addresses
+	memset( m_BoneCache, 0, sizeof( m_BoneCache ) );
+	memset( m_ModelInfo, 0, sizeof( m_ModelInfo ) );
+	memset( m_MergeRemap, 0, sizeof( m_MergeRemap ) );
+
+	m_nCachedBones = 0;
+	m_pCachedBoneHeader = NULL;
+
+	m_nPrepassEntities = 0;
+	m_nPoseJobs = 0;
+}
+
 /*
 ====================
 CStudioModelRenderer
@@ -80,6 +110,21 @@ CStudioModelRenderer::CStudioModelRenderer( void )
 	m_pCvarHiModels = NULL;
 	m_pCvarDeveloper = NULL;
 	m_pCvarDrawEntities = NULL;
+	m_pCvarSimdBones = NULL;
+	m_pCvarBoneCache = NULL;
+	m_nBoneCacheHits = 0;
+	m_nBoneCacheMisses = 0;
+	m_fBoneKeyValid = 0;
+	m_pCvarThreads = NULL;
+	m_nPrepassEntities = 0;
+	m_nPoseJobs = 0;
+	m_nPoseJobHits = 0;
+	m_nPoseJobMisses = 0;
+	memset( m_BoneCache, 0, sizeof( m_BoneCache ) );
+	memset( m_ModelInfo, 0, sizeof( m_ModelInfo ) );
+	memset( m_MergeRemap, 0, sizeof( m_MergeRemap ) );
+	m_nCachedBones = 0;
+	m_pCachedBoneHeader = NULL;
 	m_pChromeSprite = NULL;
 	m_pStudioModelCount = NULL;
 	m_pModelsDrawn = NULL;
@@ -175,15 +220,14 @@ void CStudioModelRenderer::StudioCalcBoneAdj( float dadt, float *adj, const byte
 
 /*
 ====================
-StudioCalcBoneQuaterion
+StudioCalcBoneAngles
 
+Decode the rotation of one bone at frame and frame + 1
 ====================
 */
-void CStudioModelRenderer::StudioCalcBoneQuaterion( int frame, float s, mstudiobone_t *pbone, mstudioanim_t *panim, float *adj, float *q )
+static void StudioCalcBoneAngles( int frame, mstudiobone_t *pbone, mstudioanim_t *panim, float *adj, float *angle1, float *angle2 )
 {
 	int j, k;
-	vec4_t q1, q2;
-	vec3_t angle1, angle2;
 	mstudioanimvalue_t *panimvalue;
 
 	for ( j = 0; j < 3; j++ )
@@ -246,6 +290,20 @@ void CStudioModelRenderer::StudioCalcBoneQuaterion( int frame, float s, mstudiob
 			angle2[j] += adj[pbone->bonecontroller[j + 3]];
 		}
 	}
+}
+
+/*
+====================
+StudioCalcBoneQuaterion
+
+====================
+*/
+void CStudioModelRenderer::StudioCalcBoneQuaterion( int frame, float s, mstudiobone_t *pbone, mstudioanim_t *panim, float *adj, float *q )
+{
+	vec4_t q1, q2;
+	vec3_t angle1, angle2;
+
+	StudioCalcBoneAngles( frame, pbone, panim, adj, angle1, angle2 );
 
 	if ( !VectorCompare( angle1, angle2 ) )
 	{
@@ -261,11 +319,12 @@ void CStudioModelRenderer::StudioCalcBoneQuaterion( int frame, float s, mstudiob
 
 /*
 ====================
-StudioCalcBonePosition
+StudioCalcBoneOffset
 
+Decode the position of one bone, safe to call from any thread
 ====================
 */
-void CStudioModelRenderer::StudioCalcBonePosition( int frame, float s, mstudiobone_t *pbone, mstudioanim_t *panim, float *adj, float *pos )
+static void StudioCalcBoneOffset( int frame, float s, mstudiobone_t *pbone, mstudioanim_t *panim, const float *adj, float *pos )
 {
 	int j, k;
 	mstudioanimvalue_t *panimvalue;
@@ -327,6 +386,17 @@ void CStudioModelRenderer::StudioCalcBonePosition( int frame, float s, mstudiobo
 	}
 }
 
+/*
+====================
+StudioCalcBonePosition
+
+====================
+*/
+void CStudioModelRenderer::StudioCalcBonePosition( int frame, float s, mstudiobone_t *pbone, mstudioanim_t *panim, float *adj, float *pos )
+{
+	StudioCalcBoneOffset( frame, s, pbone, panim, adj, pos );
+}
+
 /*
 ====================
 StudioSlerpBones
@@ -656,6 +726,274 @@ void CStudioModelRenderer::StudioCalcRotations( float pos[][3], vec4_t *q, mstud
 	}
 }
 
+/*
+====================
+studioposescratch_t
+
+Intermediate poses of StudioEvaluatePose, one set per thread
+====================
+*/
+typedef struct studioposescratch_s
+{
+	studiopose_t pose2;
+	studiopose_t pose3;
+	studiopose_t pose4;
+	studiopose_t pose1b;
+	studiopose_t next;
+	byte slerp[MAXSTUDIOBONES];
+} studioposescratch_t;
+
+static studioposescratch_t s_PoseScratch[STUDIO_MAXTHREADS];
+
+/*
+====================
+StudioDecodePose
+
+StudioCalcRotations for the whole skeleton into a structure-of-arrays
+pose, safe to call from any thread
+====================
+*/
+static void StudioDecodePose( studiohdr_t *phdr, studioposescratch_t *scratch, studiopose_t *pose, mstudioseqdesc_t *pseqdesc, mstudioanim_t *panim, float f, float *adj, float framerate )
+{
+	int i;
+	int frame;
+	mstudiobone_t *pbone;
+
+	float s;
+
+	vec3_t angle1, angle2;
+	vec4_t q1;
+	float pos[3];
+
+	if ( f > pseqdesc->numframes - 1 )
+	{
+		f = 0.0f; // bah, fix this bug with changing sequences too fast
+	}
+	else if ( f < -0.01f )
+	{
+		f = -0.01f;
+	}
+
+	frame = (int)f;
+
+	s = ( f - frame );
+
+	pbone = (mstudiobone_t *)( (byte *)phdr + phdr->boneindex );
+
+	// decode every bone first, the frame to frame slerp is done for the whole skeleton at once
+	for ( i = 0; i < phdr->numbones; i++, pbone++, panim++ )
+	{
+		StudioCalcBoneAngles( frame, pbone, panim, adj, angle1, angle2 );
+
+		AngleQuaternion( angle1, q1 );
+		StudioPose_SetBone( pose, i, q1, NULL );
+
+		scratch->slerp[i] = !VectorCompare( angle1, angle2 );
+		if ( scratch->slerp[i] )
+		{
+			AngleQuaternion( angle2, q1 );
+			StudioPose_SetBone( &scratch->next, i, q1, NULL );
+		}
+
+		StudioCalcBoneOffset( frame, s, pbone, panim, adj, pos );
+		StudioPose_SetBone( pose, i, NULL, pos );
+	}
+
+	StudioPose_SlerpRotations( pose, &scratch->next, scratch->slerp, s, phdr->numbones );
+
+	if ( pseqdesc->motiontype & STUDIO_X )
+	{
+		pose->px[pseqdesc->motionbone] = 0.0f;
+	}
+	if ( pseqdesc->motiontype & STUDIO_Y )
+	{
+		pose->py[pseqdesc->motionbone] = 0.0f;
+	}
+	if ( pseqdesc->motiontype & STUDIO_Z )
+	{
+		pose->pz[pseqdesc->motionbone] = 0.0f;
+	}
+
+	s = 0 * ( ( 1.0f - ( f - (int)( f ) ) ) / ( pseqdesc->numframes ) ) * framerate;
+
+	if ( pseqdesc->motiontype & STUDIO_LX )
+	{
+		pose->px[pseqdesc->motionbone] += s * pseqdesc->linearmovement[0];
+	}
+	if ( pseqdesc->motiontype & STUDIO_LY )
+	{
+		pose->py[pseqdesc->motionbone] += s * pseqdesc->linearmovement[1];
+	}
+	if ( pseqdesc->motiontype & STUDIO_LZ )
+	{
+		pose->pz[pseqdesc->motionbone] += s * pseqdesc->linearmovement[2];
+	}
+}
+
+/*
+====================
+StudioEvaluatePose
+
+Sequence blends, blend from the last sequence and the gait layer of a
+prepared job into job->pose, safe to call from any thread
+====================
+*/
+static void StudioEvaluatePose( studioposejob_t *job, studioposescratch_t *scratch )
+{
+	int i, numbones;
+	studiohdr_t *phdr = job->header;
+	studiopose_t *pose = &job->pose;
+	mstudioseqdesc_t *pseqdesc;
+	mstudioanim_t *panim;
+
+	numbones = phdr->numbones;
+
+	pseqdesc = job->pseqdesc;
+	panim = job->panim;
+	StudioDecodePose( phdr, scratch, pose, pseqdesc, panim, job->frame, job->adj, job->framerate );
+
+	if ( pseqdesc->numblends > 1 )
+	{
+		panim += numbones;
+		StudioDecodePose( phdr, scratch, &scratch->pose2, pseqdesc, panim, job->frame, job->adj, job->framerate );
+
+		StudioPose_SlerpBones( pose, &scratch->pose2, job->blend[0], numbones );
+
+		if ( pseqdesc->numblends == 4 )
+		{
+			panim += numbones;
+			StudioDecodePose( phdr, scratch, &scratch->pose3, pseqdesc, panim, job->frame, job->adj, job->framerate );
+
+			panim += numbones;
+			StudioDecodePose( phdr, scratch, &scratch->pose4, pseqdesc, panim, job->frame, job->adj, job->framerate );
+
+			StudioPose_SlerpBones( &scratch->pose3, &scratch->pose4, job->blend[0], numbones );
+			StudioPose_SlerpBones( pose, &scratch->pose3, job->blend[1], numbones );
+		}
+	}
+
+	if ( job->blendprev )
+	{
+		pseqdesc = job->prevseqdesc;
+		panim = job->prevanim;
+		StudioDecodePose( phdr, scratch, &scratch->pose1b, pseqdesc, panim, job->prevframe, job->adj, job->framerate );
+
+		if ( pseqdesc->numblends > 1 )
+		{
+			panim += numbones;
+			StudioDecodePose( phdr, scratch, &scratch->pose2, pseqdesc, panim, job->prevframe, job->adj, job->framerate );
+
+			StudioPose_SlerpBones( &scratch->pose1b, &scratch->pose2, job->prevblend[0], numbones );
+
+			if ( pseqdesc->numblends == 4 )
+			{
+				panim += numbones;
+				StudioDecodePose( phdr, scratch, &scratch->pose3, pseqdesc, panim, job->prevframe, job->adj, job->framerate );
+
+				panim += numbones;
+				StudioDecodePose( phdr, scratch, &scratch->pose4, pseqdesc, panim, job->prevframe, job->adj, job->framerate );
+
+				StudioPose_SlerpBones( &scratch->pose3, &scratch->pose4, job->prevblend[0], numbones );
+				StudioPose_SlerpBones( &scratch->pose1b, &scratch->pose3, job->prevblend[1], numbones );
+			}
+		}
+
+		StudioPose_SlerpBones( pose, &scratch->pose1b, job->seqblend, numbones );
+	}
+
+	// calc gait animation
+	if ( job->gaitseqdesc )
+	{
+		StudioDecodePose( phdr, scratch, &scratch->pose2, job->gaitseqdesc, job->gaitanim, job->gaitframe, job->adj, job->framerate );
+
+		for ( i = 0; i < numbones; i++ )
+		{
+			if ( job->gaitmask[i] )
+			{
+				StudioPose_CopyBone( pose, &scratch->pose2, i );
+			}
+		}
+	}
+}
+
+/*
+====================
+StudioPoseJob
+
+StudioThreads_Run callback for the skeleton prepass
+====================
+*/
+static studioposejob_t *s_pPoseJobs;
+
+static void StudioPoseJob( int job, int thread )
+{
+	StudioEvaluatePose( &s_pPoseJobs[job], &s_PoseScratch[thread] );
+}
+
+/*
+====================
+StudioPreparePose
+
+====================
+*/
+void CStudioModelRenderer::StudioPreparePose( studioposejob_t *job )
+{
+	mstudioseqdesc_t *pseqdesc;
+	cl_entity_t *e = m_pCurrentEntity;
+	float dadt;
+
+	if ( e->curstate.sequence >= m_pStudioHeader->numseq )
+	{
+		e->curstate.sequence = 0;
+	}
+
+	pseqdesc = (mstudioseqdesc_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->seqindex ) + e->curstate.sequence;
+
+	job->header = m_pStudioHeader;
+	job->pseqdesc = pseqdesc;
+	job->panim = StudioGetAnim( m_pRenderModel, pseqdesc );
+	job->frame = StudioEstimateFrame( pseqdesc );
+	job->framerate = e->curstate.framerate;
+
+	// add in programtic controllers
+	dadt = StudioEstimateInterpolant();
+	StudioCalcBoneAdj( dadt, job->adj, e->curstate.controller, e->latched.prevcontroller, e->mouth.mouthopen );
+
+	job->blend[0] = ( e->curstate.blending[0] * dadt + e->latched.prevblending[0] * ( 1.0 - dadt ) ) / 255.0;
+	job->blend[1] = ( e->curstate.blending[1] * dadt + e->latched.prevblending[1] * ( 1.0 - dadt ) ) / 255.0;
+
+	job->blendprev = m_fDoInterp && e->latched.sequencetime && ( e->latched.sequencetime + 0.2 > m_clTime ) && ( e->latched.prevsequence < m_pStudioHeader->numseq );
+
+	if ( job->blendprev )
+	{
+		pseqdesc = (mstudioseqdesc_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->seqindex ) + e->latched.prevsequence;
+
+		job->prevseqdesc = pseqdesc;
+		job->prevanim = StudioGetAnim( m_pRenderModel, pseqdesc );
+		job->prevframe = e->latched.prevframe;
+		job->prevblend[0] = ( e->latched.prevseqblending[0] ) / 255.0;
+		job->prevblend[1] = ( e->latched.prevseqblending[1] ) / 255.0;
+		job->seqblend = 1.0 - ( m_clTime - e->latched.sequencetime ) / 0.2;
+	}
+
+	job->gaitseqdesc = NULL;
+
+	if ( m_pPlayerInfo && m_pPlayerInfo->gaitsequence != 0 )
+	{
+		if ( m_pPlayerInfo->gaitsequence >= m_pStudioHeader->numseq )
+		{
+			m_pPlayerInfo->gaitsequence = 0;
+		}
+
+		pseqdesc = (mstudioseqdesc_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->seqindex ) + m_pPlayerInfo->gaitsequence;
+
+		job->gaitseqdesc = pseqdesc;
+		job->gaitanim = StudioGetAnim( m_pRenderModel, pseqdesc );
+		job->gaitframe = m_pPlayerInfo->gaitframe;
+		memcpy( job->gaitmask, StudioGetModelInfo( m_pStudioHeader )->gaitmask, m_pStudioHeader->numbones );
+	}
+}
+
 /*
 ====================
 Studio_FxTransform
@@ -764,11 +1102,190 @@ float CStudioModelRenderer::StudioEstimateFrame( mstudioseqdesc_t *pseqdesc )
 
 /*
 ====================
-StudioSetupBones
+StudioHashBoneKey
+
+FNV-1a over the whole key
+====================
+*/
+static unsigned int StudioHashBoneKey( const studiobonekey_t *key )
+{
+	const byte *p = (const byte *)key;
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for ( i = 0; i < sizeof( *key ); i++ )
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+====================
+StudioSetupBones
+
+====================
+*/
+void CStudioModelRenderer::StudioSetupBones( void )
+{
+	int mode = m_pCvarSimdBones ? (int)m_pCvarSimdBones->value : 0;
+	int usecache = m_pCvarBoneCache && m_pCvarBoneCache->value;
+	studiobonecache_t *pcache = NULL;
+	unsigned int hash;
+	size_t size;
+
+	m_fBoneKeyValid = 0;
+
+	if ( mode != 2 && ( usecache || m_nPoseJobs ) )
+	{
+		m_fBoneKeyValid = StudioBuildBoneCacheKey( &m_BoneKey );
+	}
+
+	if ( m_fBoneKeyValid && usecache )
+	{
+		hash = StudioHashBoneKey( &m_BoneKey );
+		pcache = &m_BoneCache[hash & ( STUDIO_BONECACHE_SIZE - 1 )];
+		size = m_pStudioHeader->numbones * sizeof( pcache->bonetransform[0] );
+
+		if ( pcache->hash == hash && !memcmp( &pcache->key, &m_BoneKey, sizeof( m_BoneKey ) ) )
+		{
+			m_nBoneCacheHits++;
+
+			memcpy( ( *m_pbonetransform ), pcache->bonetransform, size );
+			memcpy( ( *m_plighttransform ), pcache->lighttransform, size );
+
+			// the only state the bone setup writes back
+			if ( !m_BoneKey.blendprev )
+				m_pCurrentEntity->latched.prevframe = m_BoneKey.frame;
+			return;
+		}
+
+		m_nBoneCacheMisses++;
+	}
+
+	if ( mode == 2 )
+		StudioCompareBones();
+	else if ( mode )
+		StudioSetupBonesSIMD();
+	else
+		StudioSetupBonesScalar();
+
+	if ( pcache )
+	{
+		pcache->hash = hash;
+		pcache->key = m_BoneKey;
+		memcpy( pcache->bonetransform, ( *m_pbonetransform ), size );
+		memcpy( pcache->lighttransform, ( *m_plighttransform ), size );
+	}
+}
+
+/*
+====================
+StudioBuildBoneCacheKey
+
+====================
+*/
+int CStudioModelRenderer::StudioBuildBoneCacheKey( studiobonekey_t *key )
+{
+	mstudioseqdesc_t *pseqdesc;
+	cl_entity_t *e = m_pCurrentEntity;
+
+	// these effects change the root bone on every draw
+	switch ( e->curstate.renderfx )
+	{
+	case kRenderFxDistort:
+	case kRenderFxHologram:
+	case kRenderFxExplode:
+		return 0;
+	}
+
+	// zero the padding too, keys are compared with memcmp
+	memset( key, 0, sizeof( *key ) );
+
+	if ( e->curstate.sequence >= m_pStudioHeader->numseq )
+	{
+		e->curstate.sequence = 0;
+	}
+
+	pseqdesc = (mstudioseqdesc_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->seqindex ) + e->curstate.sequence;
+
+	key->entity = e;
+	key->model = m_pRenderModel;
+	key->header = m_pStudioHeader;
+
+	key->sequence = e->curstate.sequence;
+	key->frame = StudioEstimateFrame( pseqdesc );
+	key->dadt = StudioEstimateInterpolant();
+	key->dointerp = m_fDoInterp;
+
+	memcpy( key->controller, e->curstate.controller, sizeof( key->controller ) );
+	memcpy( key->prevcontroller, e->latched.prevcontroller, sizeof( key->prevcontroller ) );
+	memcpy( key->blending, e->curstate.blending, sizeof( key->blending ) );
+	memcpy( key->prevblending, e->latched.prevblending, sizeof( key->prevblending ) );
+	key->mouthopen = e->mouth.mouthopen;
+
+	if ( m_fDoInterp && e->latched.sequencetime && ( e->latched.sequencetime + 0.2 > m_clTime ) && ( e->latched.prevsequence < m_pStudioHeader->numseq ) )
+	{
+		key->blendprev = 1;
+		key->prevsequence = e->latched.prevsequence;
+		key->prevframe = e->latched.prevframe;
+		memcpy( key->prevseqblending, e->latched.prevseqblending, sizeof( key->prevseqblending ) );
+		key->seqblend = 1.0 - ( m_clTime - e->latched.sequencetime ) / 0.2;
+	}
+
+	if ( m_pPlayerInfo && m_pPlayerInfo->gaitsequence != 0 )
+	{
+		if ( m_pPlayerInfo->gaitsequence >= m_pStudioHeader->numseq )
+		{
+			m_pPlayerInfo->gaitsequence = 0;
+		}
+
+		key->gaitsequence = m_pPlayerInfo->gaitsequence;
+		key->gaitframe = m_pPlayerInfo->gaitframe;
+	}
+
+	memcpy( key->rotationmatrix, ( *m_protationmatrix ), sizeof( key->rotationmatrix ) );
+
+	if ( !IEngineStudio.IsHardware() )
+	{
+		memcpy( key->aliastransform, ( *m_paliastransform ), sizeof( key->aliastransform ) );
+	}
+
+	return 1;
+}
+
+/*
+====================
+StudioBoneCacheStats
+
+====================
+*/
+void CStudioModelRenderer::StudioBoneCacheStats( void )
+{
+	int total = m_nBoneCacheHits + m_nBoneCacheMisses;
+
+	gEngfuncs.Con_Printf( "bone cache: %d hits, %d misses (%.1f%% hit rate)\n", m_nBoneCacheHits, m_nBoneCacheMisses, total ? m_nBoneCacheHits * 100.0f / total : 0.0f );
+
+	m_nBoneCacheHits = 0;
+	m_nBoneCacheMisses = 0;
+
+	total = m_nPoseJobHits + m_nPoseJobMisses;
+
+	gEngfuncs.Con_Printf( "pose prepass: %d hits, %d misses (%.1f%% hit rate)\n", m_nPoseJobHits, m_nPoseJobMisses, total ? m_nPoseJobHits * 100.0f / total : 0.0f );
+
+	m_nPoseJobHits = 0;
+	m_nPoseJobMisses = 0;
+}
+
+/*
+====================
+StudioSetupBonesScalar
 
 ====================
 */
-void CStudioModelRenderer::StudioSetupBones( void )
+void CStudioModelRenderer::StudioSetupBonesScalar( void )
 {
 	int i;
 	double f;
@@ -889,7 +1406,7 @@ void CStudioModelRenderer::StudioSetupBones( void )
 			m_pPlayerInfo->gaitsequence = 0;
 		}
 
-		int copy = 1;
+		const byte *gaitmask = StudioGetModelInfo( m_pStudioHeader )->gaitmask;
 
 		pseqdesc = (mstudioseqdesc_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->seqindex ) + m_pPlayerInfo->gaitsequence;
 
@@ -898,16 +1415,7 @@ void CStudioModelRenderer::StudioSetupBones( void )
 
 		for ( i = 0; i < m_pStudioHeader->numbones; i++ )
 		{
-			if ( !strcmp( pbones[i].name, "Bip01 Spine" ) )
-			{
-				copy = 0;
-			}
-			else if ( !strcmp( pbones[pbones[i].parent].name, "Bip01 Pelvis" ) )
-			{
-				copy = 1;
-			}
-
-			if ( copy )
+			if ( gaitmask[i] )
 			{
 				memcpy( pos[i], pos2[i], sizeof( pos[i] ) );
 				memcpy( q[i], q2[i], sizeof( q[i] ) );
@@ -950,6 +1458,300 @@ void CStudioModelRenderer::StudioSetupBones( void )
 	}
 }
 
+/*
+====================
+StudioSetupBonesSIMD
+
+Same steps as StudioSetupBonesScalar, but each step runs over
+the whole skeleton instead of one bone at a time
+====================
+*/
+void CStudioModelRenderer::StudioSetupBonesSIMD( void )
+{
+	int i, numbones;
+	mstudiobone_t *pbones;
+	studioposejob_t *job;
+
+	static studioposejob_t local;
+	static float bonematrix[MAXSTUDIOBONES][3][4];
+
+	job = StudioFindPoseJob();
+
+	if ( !job )
+	{
+		job = &local;
+		StudioPreparePose( job );
+		StudioEvaluatePose( job, &s_PoseScratch[0] );
+	}
+
+	if ( !job->blendprev )
+	{
+		m_pCurrentEntity->latched.prevframe = job->frame;
+	}
+
+	numbones = m_pStudioHeader->numbones;
+	pbones = (mstudiobone_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->boneindex );
+
+	StudioPose_BoneMatrices( &job->pose, bonematrix, numbones );
+
+	for ( i = 0; i < numbones; i++ )
+	{
+		if ( pbones[i].parent == -1 )
+		{
+			if ( IEngineStudio.IsHardware() )
+			{
+				StudioPose_ConcatTransforms( ( *m_protationmatrix ), bonematrix[i], ( *m_pbonetransform )[i] );
+				MatrixCopy( ( *m_pbonetransform )[i], ( *m_plighttransform )[i] );
+			}
+			else
+			{
+				StudioPose_ConcatTransforms( ( *m_paliastransform ), bonematrix[i], ( *m_pbonetransform )[i] );
+				StudioPose_ConcatTransforms( ( *m_protationmatrix ), bonematrix[i], ( *m_plighttransform )[i] );
+			}
+
+			// Apply client-side effects to the transformation matrix
+			StudioFxTransform( m_pCurrentEntity, ( *m_pbonetransform )[i] );
+		}
+		else
+		{
+			StudioPose_ConcatTransforms( ( *m_pbonetransform )[pbones[i].parent], bonematrix[i], ( *m_pbonetransform )[i] );
+			StudioPose_ConcatTransforms( ( *m_plighttransform )[pbones[i].parent], bonematrix[i], ( *m_plighttransform )[i] );
+		}
+	}
+}
+
+/*
+====================
+StudioHashPoseJob
+
+Entities mostly live in one array, so the element index spreads well
+====================
+*/
+static unsigned int StudioHashPoseJob( const cl_entity_t *ent )
+{
+	return (unsigned int)( (size_t)ent / sizeof( cl_entity_t ) ) & ( STUDIO_POSEJOBHASH_SIZE - 1 );
+}
+
+/*
+====================
+StudioFindPoseJob
+
+====================
+*/
+studioposejob_t *CStudioModelRenderer::StudioFindPoseJob( void )
+{
+	studioposejob_t *job;
+	unsigned int i;
+
+	if ( !m_nPoseJobs )
+		return NULL;
+
+	if ( m_fBoneKeyValid )
+	{
+		for ( i = StudioHashPoseJob( m_BoneKey.entity ); m_PoseJobHash[i]; i = ( i + 1 ) & ( STUDIO_POSEJOBHASH_SIZE - 1 ) )
+		{
+			job = &m_PoseJobs[m_PoseJobHash[i] - 1];
+
+			if ( job->key.entity != m_BoneKey.entity )
+				continue;
+
+			// the prepass guessed the draw time state wrong, e.g. a player
+			// whose gait changed in between, evaluate again
+			if ( memcmp( &job->key, &m_BoneKey, STUDIO_POSEKEY_SIZE ) )
+				break;
+
+			m_nPoseJobHits++;
+			return job;
+		}
+	}
+
+	m_nPoseJobMisses++;
+	return NULL;
+}
+
+/*
+====================
+StudioAddPrepassEntity
+
+====================
+*/
+void CStudioModelRenderer::StudioAddPrepassEntity( cl_entity_t *ent )
+{
+	if ( !m_pCvarThreads || m_pCvarThreads->value < 1 )
+		return;
+
+	// only the SIMD bone setup consumes the prepass
+	if ( !m_pCvarSimdBones || (int)m_pCvarSimdBones->value != 1 )
+		return;
+
+	if ( m_nPrepassEntities >= STUDIO_MAXPOSEJOBS )
+		return;
+
+	if ( !ent->model || ent->model->type != mod_studio )
+		return;
+
+	// not drawn from the first person view
+	if ( ent == gEngfuncs.GetLocalPlayer() && !CL_IsThirdPerson() )
+		return;
+
+	// attached models copy their bones, dead players are drawn from another entity
+	if ( ent->curstate.movetype == MOVETYPE_FOLLOW || ent->curstate.renderfx == kRenderFxDeadPlayer )
+		return;
+
+	m_pPrepassEntities[m_nPrepassEntities++] = ent;
+}
+
+/*
+====================
+StudioPrepass
+
+====================
+*/
+void CStudioModelRenderer::StudioPrepass( void )
+{
+	int i;
+
+	m_nPoseJobs = 0;
+	memset( m_PoseJobHash, 0, sizeof( m_PoseJobHash ) );
+
+	if ( !m_nPrepassEntities )
+		return;
+
+	IEngineStudio.GetTimes( &m_nFrameCount, &m_clTime, &m_clOldTime );
+
+	// everything that needs the engine happens here, on the main thread
+	for ( i = 0; i < m_nPrepassEntities; i++ )
+	{
+		StudioPrepassEntity( m_pPrepassEntities[i] );
+	}
+
+	m_nPrepassEntities = 0;
+
+	s_pPoseJobs = m_PoseJobs;
+	StudioThreads_Run( (int)m_pCvarThreads->value, m_nPoseJobs, StudioPoseJob );
+}
+
+/*
+====================
+StudioPrepassEntity
+
+Players run the same gait and controller setup as StudioDrawPlayer, on
+copies so nothing is changed before the real draw
+====================
+*/
+void CStudioModelRenderer::StudioPrepassEntity( cl_entity_t *ent )
+{
+	studioposejob_t *job = &m_PoseJobs[m_nPoseJobs];
+	entity_state_t *pplayer;
+	cl_entity_t player;
+	player_info_t playerinfo;
+	float gaitmovement = m_flGaitMovement;
+	unsigned int i;
+
+	m_pPlayerInfo = NULL;
+
+	if ( ent->player )
+	{
+		m_nPlayerIndex = ent->index - 1;
+
+		if ( m_nPlayerIndex < 0 || m_nPlayerIndex >= gEngfuncs.GetMaxClients() )
+			return;
+
+		pplayer = IEngineStudio.GetPlayerState( m_nPlayerIndex );
+
+		m_pRenderModel = StudioGetPlayerModel( pplayer );
+		if ( !m_pRenderModel )
+			return;
+
+		m_pStudioHeader = (studiohdr_t *)IEngineStudio.Mod_Extradata( m_pRenderModel );
+		if ( !m_pStudioHeader || m_pStudioHeader->numbodyparts == 0 )
+			return;
+
+		player = *ent;
+		playerinfo = *IEngineStudio.PlayerInfo( m_nPlayerIndex );
+		// first draw of this frame
+		playerinfo.renderframe = -1;
+
+		m_pCurrentEntity = &player;
+		m_pPlayerInfo = &playerinfo;
+
+		if ( pplayer->gaitsequence )
+		{
+			StudioProcessGait( pplayer );
+			playerinfo.gaitsequence = pplayer->gaitsequence;
+		}
+		else
+		{
+			for ( i = 0; i < 4; i++ )
+			{
+				player.curstate.controller[i] = 127;
+				player.latched.prevcontroller[i] = 127;
+			}
+			playerinfo.gaitsequence = 0;
+		}
+
+		m_flGaitMovement = gaitmovement;
+	}
+	else
+	{
+		m_pCurrentEntity = ent;
+		m_pRenderModel = ent->model;
+		m_pStudioHeader = (studiohdr_t *)IEngineStudio.Mod_Extradata( m_pRenderModel );
+
+		if ( !m_pStudioHeader || m_pStudioHeader->numbodyparts == 0 )
+			return;
+	}
+
+	if ( StudioBuildBoneCacheKey( &job->key ) )
+	{
+		job->key.entity = ent;
+		StudioPreparePose( job );
+
+		for ( i = StudioHashPoseJob( ent ); m_PoseJobHash[i]; i = ( i + 1 ) & ( STUDIO_POSEJOBHASH_SIZE - 1 ) )
+			;
+		m_PoseJobHash[i] = ++m_nPoseJobs;
+	}
+
+	m_pCurrentEntity = NULL;
+	m_pPlayerInfo = NULL;
+}
+
+/*
+====================
+StudioCompareBones
+
+r_studio_simd 2, renders the scalar result
+====================
+*/
+void CStudioModelRenderer::StudioCompareBones( void )
+{
+	int i, numbones;
+	static float bonetransform[MAXSTUDIOBONES][3][4];
+	static float lighttransform[MAXSTUDIOBONES][3][4];
+
+	numbones = m_pStudioHeader->numbones;
+
+	StudioSetupBonesSIMD();
+	memcpy( bonetransform, ( *m_pbonetransform ), numbones * sizeof( bonetransform[0] ) );
+	memcpy( lighttransform, ( *m_plighttransform ), numbones * sizeof( lighttransform[0] ) );
+
+	StudioSetupBonesScalar();
+
+	// these are randomized per call
+	if ( m_pCurrentEntity->curstate.renderfx == kRenderFxDistort || m_pCurrentEntity->curstate.renderfx == kRenderFxHologram )
+		return;
+
+	for ( i = 0; i < numbones; i++ )
+	{
+		if ( memcmp( bonetransform[i], ( *m_pbonetransform )[i], sizeof( bonetransform[i] ) )
+			|| memcmp( lighttransform[i], ( *m_plighttransform )[i], sizeof( lighttransform[i] ) ) )
+		{
+			gEngfuncs.Con_Printf( "r_studio_simd: %s bone %d differs\n", m_pRenderModel->name, i );
+			break;
+		}
+	}
+}
+
 /*
 ====================
 StudioSaveBones
@@ -960,14 +1762,11 @@ void CStudioModelRenderer::StudioSaveBones( void )
 {
 	int i;
 
-	mstudiobone_t *pbones;
-	pbones = (mstudiobone_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->boneindex );
-
 	m_nCachedBones = m_pStudioHeader->numbones;
+	m_pCachedBoneHeader = m_pStudioHeader;
 
 	for ( i = 0; i < m_pStudioHeader->numbones; i++ )
 	{
-		strcpy( m_nCachedBoneNames[i], pbones[i].name );
 		MatrixCopy( ( *m_pbonetransform )[i], m_rgCachedBoneTransform[i] );
 		MatrixCopy( ( *m_plighttransform )[i], m_rgCachedLightTransform[i] );
 	}
@@ -984,6 +1783,7 @@ void CStudioModelRenderer::StudioMergeBones( model_t *m_pSubModel )
 	int i, j;
 	double f;
 	int do_hunt = true;
+	const short *remap;
 
 	mstudiobone_t *pbones;
 	mstudioseqdesc_t *pseqdesc;
@@ -1012,18 +1812,18 @@ void CStudioModelRenderer::StudioMergeBones( model_t *m_pSubModel )
 
 	pbones = (mstudiobone_t *)( (byte *)m_pStudioHeader + m_pStudioHeader->boneindex );
 
+	remap = StudioGetMergeRemap( m_pCachedBoneHeader, m_pStudioHeader );
+
 	for ( i = 0; i < m_pStudioHeader->numbones; i++ )
 	{
-		for ( j = 0; j < m_nCachedBones; j++ )
+		j = remap ? remap[i] : -1;
+
+		if ( j >= 0 && j < m_nCachedBones )
 		{
-			if ( stricmp( pbones[i].name, m_nCachedBoneNames[j] ) == 0 )
-			{
-				MatrixCopy( m_rgCachedBoneTransform[j], ( *m_pbonetransform )[i] );
-				MatrixCopy( m_rgCachedLightTransform[j], ( *m_plighttransform )[i] );
-				break;
-			}
+			MatrixCopy( m_rgCachedBoneTransform[j], ( *m_pbonetransform )[i] );
+			MatrixCopy( m_rgCachedLightTransform[j], ( *m_plighttransform )[i] );
 		}
-		if ( j >= m_nCachedBones )
+		else
 		{
 			QuaternionMatrix( q[i], bonematrix );
 
@@ -1059,6 +1859,90 @@ void CStudioModelRenderer::StudioMergeBones( model_t *m_pSubModel )
 	}
 }
 
+/*
+====================
+StudioGetModelInfo
+
+====================
+*/
+studiomodelinfo_t *CStudioModelRenderer::StudioGetModelInfo( studiohdr_t *phdr )
+{
+	studiomodelinfo_t *pinfo;
+	mstudiobone_t *pbones;
+	int i, copy;
+
+	pinfo = &m_ModelInfo[( (size_t)phdr >> 4 ) & ( STUDIO_MODELINFO_SIZE - 1 )];
+
+	if ( pinfo->header == phdr )
+		return pinfo;
+
+	pinfo->header = phdr;
+	pbones = (mstudiobone_t *)( (byte *)phdr + phdr->boneindex );
+
+	// legs follow the gait sequence up to the spine, arms and head
+	// don't, until a bone hangs off the pelvis again
+	copy = 1;
+	for ( i = 0; i < phdr->numbones; i++ )
+	{
+		if ( !strcmp( pbones[i].name, "Bip01 Spine" ) )
+		{
+			copy = 0;
+		}
+		else if ( pbones[i].parent != -1 && !strcmp( pbones[pbones[i].parent].name, "Bip01 Pelvis" ) )
+		{
+			copy = 1;
+		}
+
+		pinfo->gaitmask[i] = copy;
+	}
+
+	return pinfo;
+}
+
+/*
+====================
+StudioGetMergeRemap
+
+====================
+*/
+const short *CStudioModelRenderer::StudioGetMergeRemap( studiohdr_t *pparent, studiohdr_t *pchild )
+{
+	studiomergeremap_t *pmerge;
+	mstudiobone_t *pparentbones;
+	mstudiobone_t *pchildbones;
+	int i, j;
+
+	if ( !pparent || !pchild )
+		return NULL;
+
+	pmerge = &m_MergeRemap[( ( (size_t)pparent >> 4 ) ^ ( (size_t)pchild >> 4 ) * 31 ) & ( STUDIO_MERGEREMAP_SIZE - 1 )];
+
+	if ( pmerge->parent == pparent && pmerge->child == pchild )
+		return pmerge->remap;
+
+	pmerge->parent = pparent;
+	pmerge->child = pchild;
+
+	pparentbones = (mstudiobone_t *)( (byte *)pparent + pparent->boneindex );
+	pchildbones = (mstudiobone_t *)( (byte *)pchild + pchild->boneindex );
+
+	for ( i = 0; i < pchild->numbones; i++ )
+	{
+		pmerge->remap[i] = -1;
+
+		for ( j = 0; j < pparent->numbones; j++ )
+		{
+			if ( stricmp( pchildbones[i].name, pparentbones[j].name ) == 0 )
+			{
+				pmerge->remap[i] = j;
+				break;
+			}
+		}
+	}
+
+	return pmerge->remap;
+}
+
 #include "pm_shared.h"
 const Vector &GetTeamColor( int team_no );
 #define IS_FIRSTPERSON_SPEC ( g_iUser1 == OBS_IN_EYE || ( g_iUser1 && ( gHUD.m_Spectator.m_pip->value == INSET_IN_EYE ) ) )
@@ -1560,6 +2444,30 @@ const char *ReturnCorrectedModelString( int iSwitchClass )
 	}
 }
 
+/*
+====================
+StudioGetPlayerModel
+
+====================
+*/
+model_t *CStudioModelRenderer::StudioGetPlayerModel( entity_state_t *pplayer )
+{
+	int modelindex;
+	int iSwitchClass = pplayer->playerclass;
+
+	if ( iSwitchClass == PC_SPY )
+		iSwitchClass = ReturnDiguisedClass( pplayer->number - 1 );
+
+	// do we have a "replacement_model" for this player?
+	if ( pplayer->fuser1 )
+	{
+		return IEngineStudio.SetupPlayerModel( pplayer->number - 1 );
+	}
+
+	// get the model pointer using a "corrected" model string based on tfc_newmodels
+	return gEngfuncs.CL_LoadModel( ReturnCorrectedModelString( iSwitchClass ), &modelindex );
+}
+
 /*
 ====================
 StudioDrawPlayer
@@ -1588,21 +2496,8 @@ int CStudioModelRenderer::StudioDrawPlayer( int flags, entity_state_t *pplayer )
 		return 0;
 
 	int modelindex;
-	int iSwitchClass = pplayer->playerclass;
-
-	if ( iSwitchClass == PC_SPY )
-		iSwitchClass = ReturnDiguisedClass( m_nPlayerIndex );
 
-	// do we have a "replacement_model" for this player?
-	if ( pplayer->fuser1 )
-	{
-		m_pRenderModel = IEngineStudio.SetupPlayerModel( m_nPlayerIndex );
-	}
-	else
-	{
-		// get the model pointer using a "corrected" model string based on tfc_newmodels
-		m_pRenderModel = gEngfuncs.CL_LoadModel( ReturnCorrectedModelString( iSwitchClass ), &modelindex );
-	}
+	m_pRenderModel = StudioGetPlayerModel( pplayer );
 
 	if ( m_pRenderModel == NULL )
 		return 0;
@@ -8,6 +8,133 @@
 #ifndef __STUDIOMODELRENDERER_H__
 #define __STUDIOMODELRENDERER_H__
 
+// Number of entities whose bone transforms are kept between draws, power of two
+#define STUDIO_BONECACHE_SIZE 64
+
+/*
+====================
+studiobonekey_t
+
+Everything StudioSetupBones reads, compared byte for byte on lookup
+====================
+*/
+typedef struct studiobonekey_s
+{
+	struct cl_entity_s *entity;
+	model_t *model;
+	studiohdr_t *header;
+
+	int sequence;
+	double frame;
+	float dadt;
+	int dointerp;
+
+	byte controller[4];
+	byte prevcontroller[4];
+	byte blending[2];
+	byte prevblending[2];
+	byte mouthopen;
+
+	// blend from last sequence
+	int blendprev;
+	int prevsequence;
+	float prevframe;
+	byte prevseqblending[2];
+	float seqblend;
+
+	int gaitsequence;
+	float gaitframe;
+
+	float rotationmatrix[3][4];
+	float aliastransform[3][4];
+} studiobonekey_t;
+
+typedef struct studiobonecache_s
+{
+	unsigned int hash;
+	studiobonekey_t key;
+	float bonetransform[MAXSTUDIOBONES][3][4];
+	float lighttransform[MAXSTUDIOBONES][3][4];
+} studiobonecache_t;
+
+// Direct mapped per-model metadata tables, powers of two
+#define STUDIO_MODELINFO_SIZE 256
+#define STUDIO_MERGEREMAP_SIZE 64
+
+/*
+====================
+studiomodelinfo_t
+
+Bone metadata derived from bone names, built once per studiohdr_t
+====================
+*/
+typedef struct studiomodelinfo_s
+{
+	studiohdr_t *header;
+	// bones that take the player gait animation
+	byte gaitmask[MAXSTUDIOBONES];
+} studiomodelinfo_t;
+
+/*
+====================
+studiomergeremap_t
+
+For each bone of an attached model, the same named bone of the model
+it follows or -1
+====================
+*/
+typedef struct studiomergeremap_s
+{
+	studiohdr_t *parent;
+	studiohdr_t *child;
+	short remap[MAXSTUDIOBONES];
+} studiomergeremap_t;
+
+// Studio entities whose pose is evaluated ahead of drawing, per frame
+#define STUDIO_MAXPOSEJOBS 256
+#define STUDIO_POSEJOBHASH_SIZE 512
+
+// The part of the bone key that decides the local pose, the matrices
+// after it only move the finished skeleton
+#define STUDIO_POSEKEY_SIZE offsetof( studiobonekey_t, rotationmatrix )
+
+/*
+====================
+studioposejob_t
+
+Everything needed to evaluate one local pose without touching the
+engine or the renderer, filled in on the main thread by StudioPreparePose
+====================
+*/
+typedef struct studioposejob_s
+{
+	studiobonekey_t key;
+	studiohdr_t *header;
+
+	mstudioseqdesc_t *pseqdesc;
+	mstudioanim_t *panim;
+	double frame;
+	float framerate;
+	float blend[2];
+	float adj[MAXSTUDIOCONTROLLERS];
+
+	// blend from last sequence
+	int blendprev;
+	mstudioseqdesc_t *prevseqdesc;
+	mstudioanim_t *prevanim;
+	float prevframe;
+	float prevblend[2];
+	float seqblend;
+
+	// player gait, gaitseqdesc is NULL if there is none
+	mstudioseqdesc_t *gaitseqdesc;
+	mstudioanim_t *gaitanim;
+	float gaitframe;
+	byte gaitmask[MAXSTUDIOBONES];
+
+	studiopose_t pose;
+} studioposejob_t;
+
 /*
 ====================
 CStudioModelRenderer
@@ -24,6 +151,9 @@ public:
 	// Initialization
 	virtual void Init( void );
 
+	// Level change / video restart, drop anything tied to model data
+	virtual void VidInit( void );
+
 public:
 	// Public Interfaces
 	virtual int StudioDrawModel( int flags );
@@ -42,6 +172,36 @@ public:
 	// Set up model bone positions
 	virtual void StudioSetupBones( void );
 
+	// Reference one-bone-at-a-time bone setup
+	virtual void StudioSetupBonesScalar( void );
+
+	// Batched bone setup on structure-of-arrays poses
+	virtual void StudioSetupBonesSIMD( void );
+
+	// Run both bone setups and report any bone that differs
+	virtual void StudioCompareBones( void );
+
+	// Fill in the bone cache key for the current entity, returns 0 if it can't be cached
+	virtual int StudioBuildBoneCacheKey( studiobonekey_t *key );
+
+	// Print and reset bone cache counters
+	virtual void StudioBoneCacheStats( void );
+
+	// Resolve animation data and blend weights for the current entity
+	virtual void StudioPreparePose( studioposejob_t *job );
+
+	// Prepass result for the current entity, if its key still matches
+	virtual studioposejob_t *StudioFindPoseJob( void );
+
+	// Queue an entity for the skeleton prepass
+	virtual void StudioAddPrepassEntity( cl_entity_t *ent );
+
+	// Evaluate the poses of all queued entities, on r_studio_threads threads
+	virtual void StudioPrepass( void );
+
+	// Set up a pose job for one queued entity
+	virtual void StudioPrepassEntity( cl_entity_t *ent );
+
 	// Find final attachment points
 	virtual void StudioCalcAttachments( void );
 
@@ -51,6 +211,10 @@ public:
 	// Merge cached bones with current bones for model
 	virtual void StudioMergeBones( model_t *m_pSubModel );
 
+	// Per model bone metadata
+	virtual studiomodelinfo_t *StudioGetModelInfo( studiohdr_t *phdr );
+	virtual const short *StudioGetMergeRemap( studiohdr_t *pparent, studiohdr_t *pchild );
+
 	// Determine interpolation fraction
 	virtual float StudioEstimateInterpolant( void );
 
@@ -97,6 +261,9 @@ public:
 
 	virtual int ReturnDiguisedClass( int iPlayerIndex );
 
+	// Model a player is drawn with
+	virtual model_t *StudioGetPlayerModel( entity_state_t *pplayer );
+
 public:
 	// Client clock
 	double m_clTime;
@@ -119,6 +286,8 @@ public:
 	cvar_t *m_pCvarDeveloper;
 	// Draw entities bone hit boxes, etc?
 	cvar_t *m_pCvarDrawEntities;
+	// Bone setup path: 0 = scalar, 1 = SIMD, 2 = compare both
+	cvar_t *m_pCvarSimdBones;
 
 	// The entity which we are currently rendering.
 	cl_entity_t *m_pCurrentEntity;
@@ -153,12 +322,37 @@ public:
 	// Caching
 	// Number of bones in bone cache
 	int m_nCachedBones;
-	// Names of cached bones
-	char m_nCachedBoneNames[MAXSTUDIOBONES][32];
+	// Model the cached bones belong to
+	studiohdr_t *m_pCachedBoneHeader;
 	// Cached bone & light transformation matrices
 	float m_rgCachedBoneTransform[MAXSTUDIOBONES][3][4];
 	float m_rgCachedLightTransform[MAXSTUDIOBONES][3][4];
 
+	// Per entity bone transforms, reused while the animation state doesn't change
+	cvar_t *m_pCvarBoneCache;
+	studiobonecache_t m_BoneCache[STUDIO_BONECACHE_SIZE];
+	int m_nBoneCacheHits;
+	int m_nBoneCacheMisses;
+
+	// Key of the entity in StudioSetupBones
+	studiobonekey_t m_BoneKey;
+	int m_fBoneKeyValid;
+
+	// Skeleton prepass, 0 = off, 1 = on the main thread, more = worker threads
+	cvar_t *m_pCvarThreads;
+	cl_entity_t *m_pPrepassEntities[STUDIO_MAXPOSEJOBS];
+	int m_nPrepassEntities;
+	// Poses evaluated this frame, hashed on the entity
+	studioposejob_t m_PoseJobs[STUDIO_MAXPOSEJOBS];
+	int m_nPoseJobs;
+	short m_PoseJobHash[STUDIO_POSEJOBHASH_SIZE];
+	int m_nPoseJobHits;
+	int m_nPoseJobMisses;
+
+	// Bone name derived tables, valid until the next VidInit
+	studiomodelinfo_t m_ModelInfo[STUDIO_MODELINFO_SIZE];
+	studiomergeremap_t m_MergeRemap[STUDIO_MERGEREMAP_SIZE];
+
 	// Software renderer scale factors
 	float m_fSoftwareXScale, m_fSoftwareYScale;
 
@@ -70,6 +70,7 @@ void CL_UnloadMainUI( void );
 
 void InitInput( void );
 void EV_HookEvents( void );
+void R_StudioVidInit( void );
 void IN_Commands( void );
 
 /*
@@ -221,6 +222,7 @@ so the HUD can reinitialize itself.
 int DLLEXPORT HUD_VidInit( void )
 {
 	gHUD.VidInit();
+	R_StudioVidInit();
 
 	VGui_Startup();
 
@@ -242,6 +244,8 @@ void DLLEXPORT HUD_Init( void )
 	InitInput();
 	gHUD.Init();
 	Scheme_Init();
+
+	gEngfuncs.pfnAddCommand( "pm_texturebench", PM_TextureTypeBenchmark );
 }
 
 /*
@@ -26,6 +26,8 @@ extern IParticleMan *g_pParticleMan;
 #endif
 
 void Game_AddObjects( void );
+void R_StudioAddEntity( struct cl_entity_s *ent );
+void R_StudioPrepass( void );
 
 extern vec3_t v_origin;
 
@@ -78,6 +80,9 @@ int DLLEXPORT HUD_AddEntity( int type, struct cl_entity_s *ent, const char *mode
 			return 0; // don't draw the player we are following in eye
 	}
 
+	// evaluated ahead of drawing in HUD_CreateEntities
+	R_StudioAddEntity( ent );
+
 	return 1;
 }
 
@@ -249,6 +254,9 @@ void DLLEXPORT HUD_CreateEntities( void )
 	Game_AddObjects();
 
 	GetClientVoiceMgr()->CreateEntities();
+
+	// all visible entities are in, set up their skeletons
+	R_StudioPrepass();
 }
 
 /*
@@ -317,6 +325,7 @@ void DLLEXPORT HUD_TempEntUpdate(
 	TEMPENTITY *pTemp, *pnext, *pprev;
 	float /*freq,*/ gravity, gravitySlow, life, fastFreq;
 	Vector vAngles;
+	int pushed = 0;
 
 	gEngfuncs.GetViewAngles( (float *)vAngles );
 
@@ -329,18 +338,6 @@ void DLLEXPORT HUD_TempEntUpdate(
 	if ( !*ppTempEntActive )
 		return;
 
-	// in order to have tents collide with players, we have to run the player prediction code so
-	// that the client has the player list. We run this code once when we detect any COLLIDEALL
-	// tent, then set this BOOL to true so the code doesn't get run again if there's more than
-	// one COLLIDEALL ent for this update. (often are).
-	gEngfuncs.pEventAPI->EV_SetUpPlayerPrediction( false, true );
-
-	// Store off the old count
-	gEngfuncs.pEventAPI->EV_PushPMStates();
-
-	// Now add in all of the players.
-	gEngfuncs.pEventAPI->EV_SetSolidPlayers( -1 );
-
 	// !!!BUGBUG	-- This needs to be time based
 	gTempEntFrame = ( gTempEntFrame + 1 ) & 31;
 
@@ -400,6 +397,23 @@ void DLLEXPORT HUD_TempEntUpdate(
 		{
 			pprev = pTemp;
 
+			// in order to have tents collide with players, we have to run the player prediction code so
+			// that the client has the player list. We run this code once when we detect any COLLIDEALL
+			// tent ( or anything that calls back into game code ), then set pushed so the code doesn't
+			// get run again if there's more than one for this update. (often are).
+			if ( !pushed && ( ( pTemp->flags & ( FTENT_COLLIDEALL | FTENT_CLIENTCUSTOM ) ) || pTemp->hitcallback ) )
+			{
+				gEngfuncs.pEventAPI->EV_SetUpPlayerPrediction( false, true );
+
+				// Store off the old count
+				gEngfuncs.pEventAPI->EV_PushPMStates();
+
+				// Now add in all of the players.
+				gEngfuncs.pEventAPI->EV_SetSolidPlayers( -1 );
+
+				pushed = 1;
+			}
+
 			VectorCopy( pTemp->entity.origin, pTemp->entity.prevstate.origin );
 
 			if ( pTemp->flags & FTENT_SPARKSHOWER )
@@ -663,8 +677,11 @@ void DLLEXPORT HUD_TempEntUpdate(
 		pTemp = pnext;
 	}
 finish:
-	// Restore state info
-	gEngfuncs.pEventAPI->EV_PopPMStates();
+	if ( pushed )
+	{
+		// Restore state info
+		gEngfuncs.pEventAPI->EV_PopPMStates();
+	}
 }
 
 /*
@@ -87,8 +87,10 @@ extern client_sprite_t *GetSpriteList( client_sprite_t *pList, const char *psz,
 
 extern cvar_t *sensitivity;
 cvar_t *cl_lw = NULL;
+cvar_t *cl_lw_cache = NULL;
 cvar_t *tfc_newmodels;
 void ShutdownInput( void );
+void HUD_PredictionCacheStats( void );
 
 #include "progdefs.h"
 #include "screenfade.h"
@@ -131,6 +133,11 @@ int __MsgFunc_Concuss( const char *pszName, int iSize, void *pbuf )
 	return gHUD.MsgFunc_Concuss( pszName, iSize, pbuf );
 }
 
+int __MsgFunc_HudBatch( const char *pszName, int iSize, void *pbuf )
+{
+	return gHUD.MsgFunc_HudBatch( pszName, iSize, pbuf );
+}
+
 int __MsgFunc_GameMode( const char *pszName, int iSize, void *pbuf )
 {
 	return gHUD.MsgFunc_GameMode( pszName, iSize, pbuf );
@@ -330,6 +337,7 @@ void CHud::Init( void )
 	HOOK_MESSAGE( ViewMode );
 	HOOK_MESSAGE( SetFOV );
 	HOOK_MESSAGE( Concuss );
+	HOOK_MESSAGE( HudBatch );
 
 	HOOK_COMMAND( "+commandmenu", OpenCommandMenu );
 	HOOK_COMMAND( "-commandmenu", CloseCommandMenu );
@@ -368,10 +376,13 @@ void CHud::Init( void )
 
 	CVAR_CREATE( "zoom_sensitivity_ratio", "1.2", FCVAR_ARCHIVE );
 	CVAR_CREATE( "cl_autowepswitch", "1", FCVAR_ARCHIVE | FCVAR_USERINFO );
+	CVAR_CREATE( "cl_hudbatch", "1", FCVAR_ARCHIVE | FCVAR_USERINFO ); // tells the server this HUD reads HudBatch
 	default_fov = CVAR_CREATE( "default_fov", "90", FCVAR_ARCHIVE );
 	m_pCvarStealMouse = CVAR_CREATE( "hud_capturemouse", "1", FCVAR_ARCHIVE );
 	m_pCvarDraw = CVAR_CREATE( "hud_draw", "1", FCVAR_ARCHIVE );
 	cl_lw = gEngfuncs.pfnGetCvarPointer( "cl_lw" );
+	cl_lw_cache = CVAR_CREATE( "cl_lw_cache", "1", FCVAR_ARCHIVE ); // reuse weapon prediction for commands re-run from an unchanged state
+	gEngfuncs.pfnAddCommand( "cl_lw_cachestats", HUD_PredictionCacheStats );
 	m_pSpriteList = NULL;
 
 	// Clear any old HUD list
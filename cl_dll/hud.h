@@ -666,6 +666,7 @@ public:
 	void _cdecl MsgFunc_ViewMode( const char *pszName, int iSize, void *pbuf );
 	int _cdecl MsgFunc_SetFOV( const char *pszName, int iSize, void *pbuf );
 	int _cdecl MsgFunc_Concuss( const char *pszName, int iSize, void *pbuf );
+	int _cdecl MsgFunc_HudBatch( const char *pszName, int iSize, void *pbuf );
 
 	// Screen information
 	SCREENINFO m_scrinfo;
@@ -140,3 +140,74 @@ int CHud::MsgFunc_Concuss( const char *pszName, int iSize, void *pbuf )
 
 	return 1;
 }
+
+// HudBatch fields, indexed by their bit in the mask. Ammo is the bit
+// after the last of these. Both have to match dlls/hudbatch.h.
+#define HUDBATCH_AMMO		( 1 << 6 )
+
+typedef int ( *pfnHudBatchMsg )( const char *pszName, int iSize, void *pbuf );
+
+extern int __MsgFunc_Health( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_Battery( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_FlashBat( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_Train( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_Geiger( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_Damage( const char *pszName, int iSize, void *pbuf );
+extern int __MsgFunc_AmmoX( const char *pszName, int iSize, void *pbuf );
+
+static const struct
+{
+	const char *pszName;
+	int iSize;
+	pfnHudBatchMsg pfnMsg;
+} s_HudBatchFields[] =
+{
+	{ "Health", 1, __MsgFunc_Health },
+	{ "Battery", 2, __MsgFunc_Battery },
+	{ "FlashBat", 1, __MsgFunc_FlashBat },
+	{ "Train", 1, __MsgFunc_Train },
+	{ "Geiger", 1, __MsgFunc_Geiger },
+	{ "Damage", 12, __MsgFunc_Damage },
+};
+
+// Every field is handed to the handler of the message it replaces. Those
+// start their own BEGIN_READ, so the batch is walked by offset instead.
+int CHud::MsgFunc_HudBatch( const char *pszName, int iSize, void *pbuf )
+{
+	byte *pData = (byte *)pbuf;
+	int iRead, iFields, i, j, count;
+
+	if ( iSize < 2 )
+		return 0;
+
+	iFields = pData[0] | ( pData[1] << 8 );
+	iRead = 2;
+
+	for ( i = 0; i < (int)( sizeof( s_HudBatchFields ) / sizeof( s_HudBatchFields[0] ) ); i++ )
+	{
+		if ( !( iFields & ( 1 << i ) ) )
+			continue;
+
+		if ( iRead + s_HudBatchFields[i].iSize > iSize )
+			return 0;
+
+		s_HudBatchFields[i].pfnMsg( s_HudBatchFields[i].pszName, s_HudBatchFields[i].iSize, pData + iRead );
+		iRead += s_HudBatchFields[i].iSize;
+	}
+
+	if ( iFields & HUDBATCH_AMMO )
+	{
+		if ( iRead >= iSize )
+			return 0;
+
+		count = pData[iRead++];
+
+		for ( j = 0; j < count && iRead + 2 <= iSize; j++ )
+		{
+			__MsgFunc_AmmoX( "AmmoX", 2, pData + iRead );
+			iRead += 2;
+		}
+	}
+
+	return 1;
+}
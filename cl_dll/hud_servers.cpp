@@ -30,12 +30,13 @@ static int context_id;
 // File where we really should look for master servers
 #define MASTER_PARSE_FILE "valvecomm.lst"
 
-#define MAX_QUERIES 20
-
 #define NET_API gEngfuncs.pNetAPI
 
 static CHudServers *g_pServers = NULL;
 
+static cvar_t *cl_browser_window;
+static cvar_t *cl_browser_retries;
+
 /*
 ===================
 ListResponse
@@ -118,7 +119,6 @@ ListResponse
 void CHudServers::ListResponse( struct net_response_s *response )
 {
 	request_t *list;
-	request_t *p;
 	int c = 0;
 
 	if ( !( response->error == NET_SUCCESS ) )
@@ -134,15 +134,7 @@ void CHudServers::ListResponse( struct net_response_s *response )
 		{
 			c++;
 
-			// if ( c < 40 )
-			{
-				// Copy from parsed stuff
-				p = new request_t;
-				p->context = -1;
-				p->remote_address = list->remote_address;
-				p->next = m_pServerList;
-				m_pServerList = p;
-			}
+			Sched_Queue( &m_Sched, &list->remote_address );
 
 			// Move on
 			list = list->next;
@@ -151,8 +143,9 @@ void CHudServers::ListResponse( struct net_response_s *response )
 
 	gEngfuncs.Con_Printf( "got list\n" );
 
+	Sched_Start( &m_Sched, (int)cl_browser_window->value, 1 + (int)cl_browser_retries->value, m_fElapsed );
+
 	m_nQuerying = 1;
-	m_nActiveQueries = 0;
 }
 
 /*
@@ -164,18 +157,10 @@ ServerResponse
 void CHudServers::ServerResponse( struct net_response_s *response )
 {
 	char *szresponse;
-	request_t *p;
-	server_t *browser;
 	int len;
-	char sz[32];
 
-	// Remove from active list
-	p = FindRequest( response->context, m_pActiveList );
-	if ( p )
-	{
-		RemoveServerFromList( &m_pActiveList, p );
-		m_nActiveQueries--;
-	}
+	// Retire from the scheduler, broadcast answers are not tracked there
+	Sched_Response( &m_Sched, response->context, response->error == NET_SUCCESS, m_fElapsed );
 
 	if ( response->error != NET_SUCCESS )
 		return;
@@ -187,18 +172,8 @@ void CHudServers::ServerResponse( struct net_response_s *response )
 		{
 			szresponse = (char *)response->response;
 			len = strlen( szresponse ) + 100 + 1;
-			sprintf( sz, "%i", (int)( 1000.0 * response->ping ) );
-
-			browser = new server_t;
-			browser->remote_address = response->remote_address;
-			browser->info = new char[len];
-			browser->ping = (int)( 1000.0 * response->ping );
-			strcpy( browser->info, szresponse );
 
-			NET_API->SetValueForKey( browser->info, "address", gEngfuncs.pNetAPI->AdrToString( &response->remote_address ), len );
-			NET_API->SetValueForKey( browser->info, "ping", sz, len );
-
-			AddServer( &m_pServers, browser );
+			AddServer( &response->remote_address, szresponse, len, (int)( 1000.0 * response->ping ) );
 		}
 		break;
 	default:
@@ -289,88 +264,45 @@ void CHudServers::PlayersResponse( struct net_response_s *response )
 
 /*
 ===================
-CompareServers
+AddServer
 
-Return 1 if p1 is "less than" p2, 0 otherwise
+Append a row to the server table, orderings pick it up on their next access
 ===================
 */
-int CHudServers::CompareServers( server_t *p1, server_t *p2 )
+void CHudServers::AddServer( const netadr_t *adr, const char *info, int len, int ping )
 {
-	const char *n1, *n2;
-
-	if ( p1->ping < p2->ping )
-		return 1;
+	server_t *p;
+	const char *hostname;
+	char sz[32];
 
-	if ( p1->ping == p2->ping )
+	if ( m_nServerCount >= m_nServerMax )
 	{
-		// Pings equal, sort by second key:  hostname
-		if ( p1->info && p2->info )
-		{
-			n1 = NET_API->ValueForKey( p1->info, "hostname" );
-			n2 = NET_API->ValueForKey( p2->info, "hostname" );
-
-			if ( n1 && n2 )
-			{
-				if ( stricmp( n1, n2 ) < 0 )
-					return 1;
-			}
-		}
-	}
-
-	return 0;
-}
-
-/*
-===================
-AddServer
+		int servermax = m_nServerMax ? m_nServerMax * 2 : 256;
+		server_t *servers = (server_t *)realloc( m_pServers, servermax * sizeof( server_t ) );
 
-===================
-*/
-void CHudServers::AddServer( server_t **ppList, server_t *p )
-{
-	server_t *list;
-
-	if ( !ppList || !p )
-		return;
+		// out of memory, the row is dropped and the table stays as it was
+		if ( !servers )
+			return;
 
-	m_nServerCount++;
+		m_pServers = servers;
+		m_nServerMax = servermax;
+	}
 
-	// What sort key?  Ping?
-	list = *ppList;
+	p = &m_pServers[m_nServerCount++];
 
-	// Head of list?
-	if ( !list )
-	{
-		p->next = NULL;
-		*ppList = p;
-		return;
-	}
+	p->remote_address = *adr;
+	p->ping = ping;
+	p->info = new char[len];
+	strcpy( p->info, info );
 
-	// Put on head of list
-	if ( CompareServers( p, list ) )
-	{
-		p->next = *ppList;
-		*ppList = p;
-	}
-	else
-	{
-		while ( list->next )
-		{
-			// Insert before list next
-			if ( CompareServers( p, list->next ) )
-			{
-				p->next = list->next->next;
-				list->next = p;
-				return;
-			}
+	sprintf( sz, "%i", ping );
 
-			list = list->next;
-		}
+	NET_API->SetValueForKey( p->info, "address", NET_API->AdrToString( (netadr_t *)adr ), len );
+	NET_API->SetValueForKey( p->info, "ping", sz, len );
 
-		// Just add at end
-		p->next = NULL;
-		list->next = p;
-	}
+	hostname = NET_API->ValueForKey( p->info, "hostname" );
+	strncpy( p->hostname, hostname ? hostname : "", SORT_VALUE_LEN - 1 );
+	p->hostname[SORT_VALUE_LEN - 1] = 0;
 }
 
 /*
@@ -394,64 +326,51 @@ void CHudServers::Think( double time )
 	if ( ServerListSize() > 0 )
 		return;
 
+	PrintRefreshStats();
+
 	m_dStarted = 0.0;
 	m_nRequesting = 0;
 	m_nDone = 0;
 	m_nQuerying = 0;
-	m_nActiveQueries = 0;
 }
 
 /*
 ===================
-QueryThink
+PrintRefreshStats
 
 ===================
 */
-void CHudServers::QueryThink( void )
+void CHudServers::PrintRefreshStats( void )
 {
-	request_t *p;
-
-	if ( !m_nRequesting || m_nDone )
-		return;
-
-	if ( !m_nQuerying )
-		return;
+	const schedstats_t *st = &m_Sched.stats;
+	double elapsed;
 
-	if ( m_nActiveQueries > MAX_QUERIES )
+	if ( !st->queued )
 		return;
 
-	// Nothing left
-	if ( !m_pServerList )
-		return;
-
-	while ( 1 )
-	{
-		p = m_pServerList;
+	elapsed = st->finished - st->started;
 
-		// No more in list?
-		if ( !p )
-			break;
-
-		// Move to next
-		m_pServerList = m_pServerList->next;
-
-		// Setup context_id
-		p->context = context_id;
+	gEngfuncs.Con_DPrintf( "server refresh: %i servers, %i answered, %i failed in %.2fs (%.1f/s)\n",
+		st->queued, st->answered, st->failed, elapsed, elapsed > 0.0 ? st->answered / elapsed : 0.0 );
+	gEngfuncs.Con_DPrintf( "  %i queries sent, %i timeouts, %i retries, window peaked at %i, rtt %.0f ms\n",
+		st->sent, st->timeouts, st->retries, st->maxwindow, 1000.0 * m_Sched.rtt );
+}
 
-		// Start up query on this one
-		NET_API->SendRequest( context_id++, NETAPI_REQUEST_DETAILS, 0, 2.0, &p->remote_address, ::ServerResponse );
+/*
+===================
+QueryThink
 
-		// Increment active list
-		m_nActiveQueries++;
+===================
+*/
+void CHudServers::QueryThink( void )
+{
+	if ( !m_nRequesting || m_nDone )
+		return;
 
-		// Add to active list
-		p->next = m_pActiveList;
-		m_pActiveList = p;
+	if ( !m_nQuerying )
+		return;
 
-		// Too many active?
-		if ( m_nActiveQueries > MAX_QUERIES )
-			break;
-	}
+	Sched_Think( &m_Sched, m_fElapsed );
 }
 
 /*
@@ -463,250 +382,264 @@ ServerListSize
 */
 int CHudServers::ServerListSize( void )
 {
-	int c = 0;
-	request_t *p;
+	return Sched_Remaining( &m_Sched );
+}
 
-	p = m_pServerList;
-	while ( p )
+/*
+===================
+ClearServerList
+
+===================
+*/
+void CHudServers::ClearServerList( void )
+{
+	sortcache_t *cache;
+	int i;
+
+	for ( i = 0; i < m_nServerCount; i++ )
 	{
-		c++;
-		p = p->next;
+		delete[] m_pServers[i].info;
 	}
 
-	p = m_pActiveList;
-	while ( p )
+	free( m_pServers );
+	m_pServers = NULL;
+	m_nServerCount = 0;
+	m_nServerMax = 0;
+
+	for ( i = 0, cache = m_SortCache; i < MAX_SORT_CACHE; i++, cache++ )
 	{
-		c++;
-		p = p->next;
+		free( cache->perm );
+		free( cache->num );
+		free( cache->str );
 	}
 
-	return c;
+	memset( m_SortCache, 0, sizeof( m_SortCache ) );
+	m_pCurrentSort = NULL;
 }
 
+// Context for the qsort callbacks
+static CHudServers::server_t *g_pSortServers;
+static CHudServers::sortcache_t *g_pSortCache;
+
 /*
 ===================
-FindRequest
+CompareRows
 
-Look up a request by context id
+Default order, ping then hostname. Otherwise the old CompareField rules:
+numeric if both values parse to non-zero numbers, text otherwise
 ===================
 */
-CHudServers::request_t *CHudServers::FindRequest( int context, request_t *pList )
+static int CompareRows( int r1, int r2 )
 {
-	request_t *p;
-	p = pList;
-	while ( p )
+	CHudServers::sortcache_t *cache = g_pSortCache;
+	float fv1, fv2;
+
+	if ( !cache->fieldname[0] )
 	{
-		if ( context == p->context )
-			return p;
+		if ( g_pSortServers[r1].ping != g_pSortServers[r2].ping )
+			return ( g_pSortServers[r1].ping < g_pSortServers[r2].ping ) ? -1 : 1;
 
-		p = p->next;
+		return stricmp( g_pSortServers[r1].hostname, g_pSortServers[r2].hostname );
 	}
-	return NULL;
+
+	fv1 = cache->num[r1];
+	fv2 = cache->num[r2];
+
+	if ( fv1 && fv2 )
+	{
+		if ( fv1 > fv2 )
+			return 1;
+		else if ( fv1 < fv2 )
+			return -1;
+		else
+			return 0;
+	}
+
+	// String compare
+	return stricmp( cache->str[r1], cache->str[r2] );
+}
+
+int __cdecl FnServerCompare( const void *elem1, const void *elem2 )
+{
+	return CompareRows( *(const int *)elem1, *(const int *)elem2 );
 }
 
 /*
 ===================
-RemoveServerFromList
+FindSortCache
 
-Remote, but don't delete, item from *ppList
+Ordering for fieldname, the least recently used one is recycled
 ===================
 */
-void CHudServers::RemoveServerFromList( request_t **ppList, request_t *item )
+CHudServers::sortcache_t *CHudServers::FindSortCache( const char *fieldname )
 {
-	request_t *p, *n;
-	request_t *newlist = NULL;
-
-	if ( !ppList )
-		return;
+	sortcache_t *cache, *oldest = NULL;
+	int i;
 
-	p = *ppList;
-	while ( p )
+	for ( i = 0, cache = m_SortCache; i < MAX_SORT_CACHE; i++, cache++ )
 	{
-		n = p->next;
-		if ( p != item )
+		if ( cache->perm && !stricmp( cache->fieldname, fieldname ) )
 		{
-			p->next = newlist;
-			newlist = p;
+			cache->lastused = ++m_nSortSequence;
+			return cache;
 		}
-		p = n;
+
+		if ( !oldest || cache->lastused < oldest->lastused )
+			oldest = cache;
 	}
-	*ppList = newlist;
-}
 
-/*
-===================
-ClearRequestList
+	cache = oldest;
+	if ( cache == m_pCurrentSort )
+		m_pCurrentSort = NULL;
 
-===================
-*/
-void CHudServers::ClearRequestList( request_t **ppList )
-{
-	request_t *p, *n;
+	free( cache->perm );
+	free( cache->num );
+	free( cache->str );
+	memset( cache, 0, sizeof( *cache ) );
 
-	if ( !ppList )
-		return;
+	strncpy( cache->fieldname, fieldname, sizeof( cache->fieldname ) - 1 );
+	cache->lastused = ++m_nSortSequence;
 
-	p = *ppList;
-	while ( p )
-	{
-		n = p->next;
-		delete p;
-		p = n;
-	}
-	*ppList = NULL;
+	return cache;
 }
 
 /*
 ===================
-ClearServerList
+UpdateSortCache
 
+Parse the column for rows added since the last update, sort just those
+and merge them into the cached permutation
 ===================
 */
-void CHudServers::ClearServerList( server_t **ppList )
+void CHudServers::UpdateSortCache( sortcache_t *cache )
 {
-	server_t *p, *n;
+	int i, j, k, first, added, *merged;
+	const char *value;
 
-	if ( !ppList )
+	if ( cache->perm && cache->count == m_nServerCount )
 		return;
 
-	p = *ppList;
-	while ( p )
+	first = cache->count;
+	added = m_nServerCount - first;
+
+	if ( m_nServerCount > cache->capacity || !cache->perm )
 	{
-		n = p->next;
-		delete[] p->info;
-		delete p;
-		p = n;
-	}
-	*ppList = NULL;
-}
+		int capacity = m_nServerMax ? m_nServerMax : 1;
+		int *perm;
 
-int CompareField( CHudServers::server_t *p1, CHudServers::server_t *p2, const char *fieldname, int iSortOrder )
-{
-	const char *sz1, *sz2;
-	float fv1, fv2;
+		// out of memory, the ordering keeps the rows it already has
+		perm = (int *)realloc( cache->perm, capacity * sizeof( int ) );
+		if ( !perm )
+			return;
+		cache->perm = perm;
+
+		if ( cache->fieldname[0] )
+		{
+			float *num = (float *)realloc( cache->num, capacity * sizeof( float ) );
+			if ( !num )
+				return;
+			cache->num = num;
 
-	sz1 = NET_API->ValueForKey( p1->info, fieldname );
-	sz2 = NET_API->ValueForKey( p2->info, fieldname );
+			char( *str )[SORT_VALUE_LEN] = (char( * )[SORT_VALUE_LEN])realloc( cache->str, capacity * SORT_VALUE_LEN );
+			if ( !str )
+				return;
+			cache->str = str;
+		}
 
-	fv1 = atof( sz1 );
-	fv2 = atof( sz2 );
+		cache->capacity = capacity;
+	}
 
-	if ( fv1 && fv2 )
+	if ( cache->fieldname[0] )
 	{
-		if ( fv1 > fv2 )
-			return iSortOrder;
-		else if ( fv1 < fv2 )
-			return -iSortOrder;
-		else
-			return 0;
+		for ( i = first; i < m_nServerCount; i++ )
+		{
+			value = NET_API->ValueForKey( m_pServers[i].info, cache->fieldname );
+			if ( !value )
+				value = "";
+
+			cache->num[i] = atof( value );
+			strncpy( cache->str[i], value, SORT_VALUE_LEN - 1 );
+			cache->str[i][SORT_VALUE_LEN - 1] = 0;
+		}
 	}
 
-	// String compare
-	return stricmp( sz1, sz2 );
-}
+	g_pSortServers = m_pServers;
+	g_pSortCache = cache;
 
-int ServerListCompareFunc( CHudServers::server_t *p1, CHudServers::server_t *p2, const char *fieldname )
-{
-	if ( !p1 || !p2 ) // No meaningful comparison
-		return 0;
+	// Sort the new rows on their own at the tail
+	for ( i = first; i < m_nServerCount; i++ )
+		cache->perm[i] = i;
 
-	int iSortOrder = 1;
+	qsort( cache->perm + first, (size_t)added, sizeof( int ), FnServerCompare );
 
-	int retval = 0;
+	// and merge, older rows go first on ties
+	if ( first > 0 )
+	{
+		merged = (int *)malloc( m_nServerCount * sizeof( int ) );
+		if ( !merged )
+			return;
+
+		i = 0;
+		j = first;
+		k = 0;
+		while ( i < first && j < m_nServerCount )
+		{
+			if ( CompareRows( cache->perm[i], cache->perm[j] ) <= 0 )
+				merged[k++] = cache->perm[i++];
+			else
+				merged[k++] = cache->perm[j++];
+		}
+		while ( i < first )
+			merged[k++] = cache->perm[i++];
+		while ( j < m_nServerCount )
+			merged[k++] = cache->perm[j++];
 
-	retval = CompareField( p1, p2, fieldname, iSortOrder );
+		memcpy( cache->perm, merged, m_nServerCount * sizeof( int ) );
+		free( merged );
+	}
 
-	return retval;
+	cache->count = m_nServerCount;
 }
 
-static char g_fieldname[256];
-int __cdecl FnServerCompare( const void *elem1, const void *elem2 )
-{
-	CHudServers::server_t *list1, *list2;
-
-	list1 = *(CHudServers::server_t **)elem1;
-	list2 = *(CHudServers::server_t **)elem2;
-
-	return ServerListCompareFunc( list1, list2, g_fieldname );
-}
+/*
+===================
+SortServers
 
+Switch the browser to the ordering for fieldname
+===================
+*/
 void CHudServers::SortServers( const char *fieldname )
 {
-	server_t *p;
-	// Create a list
-	if ( !m_pServers )
+	if ( !m_nServerCount )
 		return;
 
-	strcpy( g_fieldname, fieldname );
-
-	int i;
-	int c = 0;
-
-	p = m_pServers;
-	while ( p )
-	{
-		c++;
-		p = p->next;
-	}
-
-	server_t **pSortArray;
-
-	pSortArray = new server_t *[c];
-	memset( pSortArray, 0, c * sizeof( server_t * ) );
-
-	// Now copy the list into the pSortArray:
-	p = m_pServers;
-	i = 0;
-	while ( p )
-	{
-		pSortArray[i++] = p;
-		p = p->next;
-	}
-
-	// Now do that actual sorting.
-	size_t nCount = c;
-	size_t nSize = sizeof( server_t * );
-
-	qsort(
-	    pSortArray,
-	    (size_t)nCount,
-	    (size_t)nSize,
-	    FnServerCompare );
-
-	// Now rebuild the list.
-	m_pServers = pSortArray[0];
-	for ( i = 0; i < c - 1; i++ )
-	{
-		pSortArray[i]->next = pSortArray[i + 1];
-	}
-	pSortArray[c - 1]->next = NULL;
-
-	// Clean Up.
-	delete[] pSortArray;
+	m_pCurrentSort = FindSortCache( fieldname );
+	UpdateSortCache( m_pCurrentSort );
 }
 
 /*
 ===================
 GetServer
 
-Return particular server
+Return particular server, in the current order
 ===================
 */
 CHudServers::server_t *CHudServers::GetServer( int server )
 {
-	int c = 0;
-	server_t *p;
+	if ( server < 0 || server >= m_nServerCount )
+		return NULL;
 
-	p = m_pServers;
-	while ( p )
-	{
-		if ( c == server )
-			return p;
+	if ( !m_pCurrentSort )
+		m_pCurrentSort = FindSortCache( "" );
 
-		c++;
-		p = p->next;
-	}
-	return NULL;
+	// New responses since the last access
+	UpdateSortCache( m_pCurrentSort );
+
+	// rows the ordering couldn't make room for
+	if ( server >= m_pCurrentSort->count )
+		return NULL;
+
+	return &m_pServers[m_pCurrentSort->perm[server]];
 }
 
 /*
@@ -897,11 +830,8 @@ void CHudServers::RequestList( void )
 		return;
 	}
 
-	ClearRequestList( &m_pActiveList );
-	ClearRequestList( &m_pServerList );
-	ClearServerList( &m_pServers );
-
-	m_nServerCount = 0;
+	Sched_Clear( &m_Sched );
+	ClearServerList();
 
 	// Make sure networking system has started.
 	NET_API->InitNetworking();
@@ -924,11 +854,8 @@ void CHudServers::RequestBroadcastList( int clearpending )
 
 	if ( clearpending )
 	{
-		ClearRequestList( &m_pActiveList );
-		ClearRequestList( &m_pServerList );
-		ClearServerList( &m_pServers );
-
-		m_nServerCount = 0;
+		Sched_Clear( &m_Sched );
+		ClearServerList();
 	}
 
 	// Make sure to byte swap server if necessary ( using "host" to "net" conversion
@@ -1016,6 +943,27 @@ int CHudServers::GetServerCount( void )
 	return m_nServerCount;
 }
 
+/*
+===================
+SchedSend
+
+Scheduler callbacks
+===================
+*/
+static int SchedSend( void *owner, const netadr_t *adr, double timeout )
+{
+	int context = context_id++;
+
+	NET_API->SendRequest( context, NETAPI_REQUEST_DETAILS, 0, timeout, (netadr_t *)adr, ::ServerResponse );
+
+	return context;
+}
+
+static void SchedCancel( void *owner, int context )
+{
+	NET_API->CancelRequest( context );
+}
+
 /*
 ===================
 CHudServers
@@ -1027,11 +975,20 @@ CHudServers::CHudServers( void )
 	m_nRequesting = 0;
 	m_dStarted = 0.0;
 	m_nDone = 0;
-	m_pServerList = NULL;
-	m_pServers = NULL;
-	m_pActiveList = NULL;
 	m_nQuerying = 0;
-	m_nActiveQueries = 0;
+
+	cl_browser_window = CVAR_CREATE( "cl_browser_window", "48", FCVAR_ARCHIVE );
+	cl_browser_retries = CVAR_CREATE( "cl_browser_retries", "1", FCVAR_ARCHIVE );
+
+	Sched_Init( &m_Sched, SchedSend, SchedCancel, this );
+
+	m_pServers = NULL;
+	m_nServerCount = 0;
+	m_nServerMax = 0;
+
+	memset( m_SortCache, 0, sizeof( m_SortCache ) );
+	m_pCurrentSort = NULL;
+	m_nSortSequence = 0;
 
 	m_fElapsed = 0.0;
 
@@ -1048,11 +1005,8 @@ CHudServers::CHudServers( void )
 */
 CHudServers::~CHudServers( void )
 {
-	ClearRequestList( &m_pActiveList );
-	ClearRequestList( &m_pServerList );
-	ClearServerList( &m_pServers );
-
-	m_nServerCount = 0;
+	Sched_Clear( &m_Sched );
+	ClearServerList();
 
 	if ( m_pPingRequest )
 	{
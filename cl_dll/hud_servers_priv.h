@@ -9,6 +9,10 @@
 #define __HUD_SERVERS_PRIV_H__
 
 #include "netadr.h"
+#include "hud_servers_sched.h"
+
+#define MAX_SORT_CACHE 8  // orderings kept around for the browser columns
+#define SORT_VALUE_LEN 64 // compared part of a pre-parsed string column
 
 class CHudServers
 {
@@ -20,19 +24,34 @@ public:
 		int context;
 	} request_t;
 
+	// Row of the server table
 	typedef struct server_s
 	{
-		struct server_s *next;
 		netadr_t remote_address;
 		char *info;
 		int ping;
+		char hostname[SORT_VALUE_LEN]; // pre-parsed for the default ping order
 	} server_t;
 
+	// Cached ordering of the server table by one field, rows that arrive
+	// later are sorted on their own and merged in on the next access
+	typedef struct sortcache_s
+	{
+		char fieldname[64]; // empty for the default ping / hostname order
+		int count;          // rows merged into perm so far
+		int capacity;
+		int *perm;
+		float *num;                    // pre-parsed column, indexed by row
+		char ( *str )[SORT_VALUE_LEN]; // same, as text
+		int lastused;
+	} sortcache_t;
+
 	CHudServers();
 	~CHudServers();
 
 	void Think( double time );
 	void QueryThink( void );
+	void PrintRefreshStats( void );
 	int isQuerying( void );
 
 	int LoadMasterAddresses( int maxservers, int *count, netadr_t *padr );
@@ -46,16 +65,9 @@ public:
 
 	void CancelRequest( void );
 
-	int CompareServers( server_t *p1, server_t *p2 );
-
-	void ClearServerList( server_t **ppList );
-	void ClearRequestList( request_t **ppList );
-
-	void AddServer( server_t **ppList, server_t *p );
+	void ClearServerList( void );
 
-	void RemoveServerFromList( request_t **ppList, request_t *item );
-
-	request_t *FindRequest( int context, request_t *pList );
+	void AddServer( const netadr_t *adr, const char *info, int len, int ping );
 
 	int ServerListSize( void );
 	char *GetServerInfo( int server );
@@ -71,6 +83,9 @@ public:
 private:
 	server_t *GetServer( int server );
 
+	sortcache_t *FindSortCache( const char *fieldname );
+	void UpdateSortCache( sortcache_t *cache );
+
 	//
 	char m_szToken[1024];
 	int m_nRequesting;
@@ -78,14 +93,16 @@ private:
 
 	double m_dStarted;
 
-	request_t *m_pServerList;
-	request_t *m_pActiveList;
+	querysched_t m_Sched;
 
 	server_t *m_pServers;
-
 	int m_nServerCount;
+	int m_nServerMax;
+
+	sortcache_t m_SortCache[MAX_SORT_CACHE];
+	sortcache_t *m_pCurrentSort;
+	int m_nSortSequence;
 
-	int m_nActiveQueries;
 	int m_nQuerying;
 	double m_fElapsed;
 
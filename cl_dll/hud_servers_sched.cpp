@@ -0,0 +1,511 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Detail query scheduler for the server browser
+//
+// $NoKeywords: $
+//=============================================================================
+
+// hud_servers_sched.cpp
+//
+// Keeps a window of detail queries in flight. Requests are found by context
+// id through a small hash, deadlines and resend times live in one min-heap.
+// The window grows with every answer and is cut back when timeouts outnumber
+// answers, the deadline follows the smoothed response time of the servers.
+// Nothing in here talks to the engine, sends and cancels go through the
+// callbacks so the scheduler can be driven outside the client as well.
+
+#include <stdlib.h>
+#include <string.h>
+#include "hud_servers_sched.h"
+
+#define SCHED_START_WINDOW 16
+#define SCHED_GROWTH       0.5f  // window increase per answer
+#define SCHED_SHRINK       0.75f // window scale when timeouts dominate, once per rtt
+#define SCHED_RETRY_DELAY  0.25  // first resend delay, doubled per try
+#define SCHED_ENGINE_SLACK 0.5   // engine timeout past our own deadline
+
+/*
+===================
+Heap helpers
+
+===================
+*/
+static void Sched_HeapSet( querysched_t *s, int i, schedreq_t *r )
+{
+	s->heap[i] = r;
+	r->heapindex = i;
+}
+
+static void Sched_HeapUp( querysched_t *s, int i )
+{
+	schedreq_t *r = s->heap[i];
+	int parent;
+
+	while ( i > 0 )
+	{
+		parent = ( i - 1 ) >> 1;
+		if ( s->heap[parent]->due <= r->due )
+			break;
+
+		Sched_HeapSet( s, i, s->heap[parent] );
+		i = parent;
+	}
+
+	Sched_HeapSet( s, i, r );
+}
+
+static void Sched_HeapDown( querysched_t *s, int i )
+{
+	schedreq_t *r = s->heap[i];
+	int child;
+
+	while ( 1 )
+	{
+		child = 2 * i + 1;
+		if ( child >= s->heapcount )
+			break;
+
+		if ( child + 1 < s->heapcount && s->heap[child + 1]->due < s->heap[child]->due )
+			child++;
+
+		if ( r->due <= s->heap[child]->due )
+			break;
+
+		Sched_HeapSet( s, i, s->heap[child] );
+		i = child;
+	}
+
+	Sched_HeapSet( s, i, r );
+}
+
+// Returns 0 when the heap couldn't grow, the request isn't in it then
+static int Sched_HeapPush( querysched_t *s, schedreq_t *r )
+{
+	if ( s->heapcount >= s->heapmax )
+	{
+		int heapmax = s->heapmax ? s->heapmax * 2 : 64;
+		schedreq_t **heap = (schedreq_t **)realloc( s->heap, heapmax * sizeof( schedreq_t * ) );
+
+		if ( !heap )
+			return 0;
+
+		s->heap = heap;
+		s->heapmax = heapmax;
+	}
+
+	Sched_HeapSet( s, s->heapcount++, r );
+	Sched_HeapUp( s, r->heapindex );
+
+	return 1;
+}
+
+static void Sched_HeapRemove( querysched_t *s, schedreq_t *r )
+{
+	int i = r->heapindex;
+
+	if ( i < 0 )
+		return;
+
+	r->heapindex = -1;
+	s->heapcount--;
+
+	if ( i == s->heapcount )
+		return;
+
+	Sched_HeapSet( s, i, s->heap[s->heapcount] );
+	Sched_HeapUp( s, i );
+	Sched_HeapDown( s, s->heap[i]->heapindex );
+}
+
+/*
+===================
+Active hash
+
+===================
+*/
+static void Sched_HashAdd( querysched_t *s, schedreq_t *r )
+{
+	schedreq_t **bucket = &s->active[r->context & ( SCHED_HASH_SIZE - 1 )];
+
+	r->hashnext = *bucket;
+	*bucket = r;
+	s->numactive++;
+}
+
+static schedreq_t *Sched_HashRemove( querysched_t *s, int context )
+{
+	schedreq_t **link = &s->active[context & ( SCHED_HASH_SIZE - 1 )];
+	schedreq_t *r;
+
+	for ( r = *link; r; link = &r->hashnext, r = r->hashnext )
+	{
+		if ( r->context == context )
+		{
+			*link = r->hashnext;
+			r->hashnext = NULL;
+			s->numactive--;
+			return r;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+===================
+Sched_Timeout
+
+Current deadline for a try, from the smoothed response time
+===================
+*/
+static double Sched_Timeout( const querysched_t *s, int tries )
+{
+	double timeout;
+
+	if ( s->rtt <= 0.0 )
+		timeout = SCHED_MAX_TIMEOUT;
+	else
+		timeout = s->rtt + 4.0 * s->rttvar;
+
+	if ( timeout < SCHED_MIN_TIMEOUT )
+		timeout = SCHED_MIN_TIMEOUT;
+	else if ( timeout > SCHED_MAX_TIMEOUT )
+		timeout = SCHED_MAX_TIMEOUT;
+
+	// Back off on resends
+	while ( --tries > 0 && timeout < 2.0 * SCHED_MAX_TIMEOUT )
+		timeout *= 2.0;
+
+	return timeout;
+}
+
+/*
+===================
+Sched_Send
+
+===================
+*/
+static void Sched_Send( querysched_t *s, schedreq_t *r, double now )
+{
+	double timeout;
+
+	r->tries++;
+	timeout = Sched_Timeout( s, r->tries );
+
+	r->state = SCHED_ACTIVE;
+	r->sent = now;
+	r->due = now + timeout;
+	r->context = s->Send( s->owner, &r->remote_address, timeout + SCHED_ENGINE_SLACK );
+
+	s->stats.sent++;
+
+	// Without a deadline it would never expire, give up on it now
+	if ( !Sched_HeapPush( s, r ) )
+	{
+		s->Cancel( s->owner, r->context );
+		s->stats.failed++;
+		delete r;
+		return;
+	}
+
+	Sched_HashAdd( s, r );
+}
+
+/*
+===================
+Sched_Adjust
+
+A share of dead servers is normal in a master list, so the window is only
+cut, at most once per round trip, when timeouts outnumber the answers seen
+since the last check
+===================
+*/
+static void Sched_Adjust( querysched_t *s, double now )
+{
+	if ( now - s->lastshrink < ( s->rtt > 0.0 ? s->rtt : SCHED_MAX_TIMEOUT ) )
+		return;
+
+	if ( s->recenttimeouts > s->recentanswers )
+	{
+		s->window *= SCHED_SHRINK;
+		if ( s->window < SCHED_MIN_WINDOW )
+			s->window = SCHED_MIN_WINDOW;
+	}
+
+	s->recentanswers = 0;
+	s->recenttimeouts = 0;
+	s->lastshrink = now;
+}
+
+/*
+===================
+Sched_Expire
+
+Request got no answer, resend later or give up on it
+===================
+*/
+static void Sched_Expire( querysched_t *s, schedreq_t *r, double now )
+{
+	int i;
+
+	s->stats.timeouts++;
+	s->recenttimeouts++;
+
+	Sched_Adjust( s, now );
+
+	if ( r->tries >= s->maxtries )
+	{
+		s->stats.failed++;
+		delete r;
+		return;
+	}
+
+	r->state = SCHED_BACKOFF;
+	r->due = now + SCHED_RETRY_DELAY;
+	for ( i = 1; i < r->tries; i++ )
+		r->due += SCHED_RETRY_DELAY * ( 1 << i );
+
+	if ( !Sched_HeapPush( s, r ) )
+	{
+		s->stats.failed++;
+		delete r;
+		return;
+	}
+
+	s->stats.retries++;
+}
+
+/*
+===================
+Sched_CheckDone
+
+===================
+*/
+static void Sched_CheckDone( querysched_t *s, double now )
+{
+	if ( !Sched_Remaining( s ) && s->stats.queued && !s->stats.finished )
+		s->stats.finished = now;
+}
+
+/*
+===================
+Sched_Init
+
+===================
+*/
+void Sched_Init( querysched_t *s, schedsend_t send, schedcancel_t cancel, void *owner )
+{
+	memset( s, 0, sizeof( *s ) );
+
+	s->Send = send;
+	s->Cancel = cancel;
+	s->owner = owner;
+
+	s->window = SCHED_START_WINDOW;
+	s->maxwindow = SCHED_START_WINDOW;
+	s->maxtries = 1;
+}
+
+/*
+===================
+Sched_Clear
+
+Drop every request, the caller cancels them in the engine
+===================
+*/
+void Sched_Clear( querysched_t *s )
+{
+	schedreq_t *r, *n;
+	int i;
+
+	for ( r = s->pending; r; r = n )
+	{
+		n = r->next;
+		delete r;
+	}
+
+	for ( i = 0; i < s->heapcount; i++ )
+	{
+		delete s->heap[i];
+	}
+
+	s->pending = s->pendingtail = NULL;
+	s->numpending = 0;
+
+	memset( s->active, 0, sizeof( s->active ) );
+	s->numactive = 0;
+
+	free( s->heap );
+	s->heap = NULL;
+	s->heapcount = s->heapmax = 0;
+}
+
+/*
+===================
+Sched_Start
+
+Begin a refresh
+===================
+*/
+void Sched_Start( querysched_t *s, int maxwindow, int maxtries, double now )
+{
+	s->maxwindow = ( maxwindow < SCHED_MIN_WINDOW ) ? SCHED_MIN_WINDOW : maxwindow;
+	s->maxtries = ( maxtries < 1 ) ? 1 : maxtries;
+
+	s->window = ( s->maxwindow < SCHED_START_WINDOW ) ? s->maxwindow : SCHED_START_WINDOW;
+	s->rtt = 0.0;
+	s->rttvar = 0.0;
+	s->lastshrink = now;
+	s->recentanswers = 0;
+	s->recenttimeouts = 0;
+
+	// Anything queued before the start counts towards this refresh
+	memset( &s->stats, 0, sizeof( s->stats ) );
+	s->stats.queued = s->numpending;
+	s->stats.started = now;
+	s->stats.maxwindow = (int)s->window;
+}
+
+/*
+===================
+Sched_Queue
+
+===================
+*/
+void Sched_Queue( querysched_t *s, const netadr_t *adr )
+{
+	schedreq_t *r = new schedreq_t;
+
+	memset( r, 0, sizeof( *r ) );
+	r->remote_address = *adr;
+	r->context = -1;
+	r->state = SCHED_PENDING;
+	r->heapindex = -1;
+
+	if ( s->pendingtail )
+		s->pendingtail->next = r;
+	else
+		s->pending = r;
+
+	s->pendingtail = r;
+	s->numpending++;
+	s->stats.queued++;
+}
+
+/*
+===================
+Sched_Think
+
+===================
+*/
+void Sched_Think( querysched_t *s, double now )
+{
+	schedreq_t *r;
+
+	// Deadlines and resends that came due
+	while ( s->heapcount && s->heap[0]->due <= now )
+	{
+		r = s->heap[0];
+		Sched_HeapRemove( s, r );
+
+		if ( r->state == SCHED_ACTIVE )
+		{
+			Sched_HashRemove( s, r->context );
+			s->Cancel( s->owner, r->context );
+			Sched_Expire( s, r, now );
+		}
+		else
+		{
+			// Resends go ahead of fresh servers
+			r->state = SCHED_PENDING;
+			r->next = s->pending;
+			s->pending = r;
+			if ( !s->pendingtail )
+				s->pendingtail = r;
+			s->numpending++;
+		}
+	}
+
+	// Fill the window
+	while ( s->pending && s->numactive < (int)s->window )
+	{
+		r = s->pending;
+		s->pending = r->next;
+		if ( !s->pending )
+			s->pendingtail = NULL;
+		s->numpending--;
+
+		r->next = NULL;
+		Sched_Send( s, r, now );
+	}
+
+	Sched_CheckDone( s, now );
+}
+
+/*
+===================
+Sched_Response
+
+===================
+*/
+int Sched_Response( querysched_t *s, int context, int success, double now )
+{
+	schedreq_t *r;
+	double sample, delta;
+
+	r = Sched_HashRemove( s, context );
+	if ( !r )
+		return 0;
+
+	Sched_HeapRemove( s, r );
+
+	if ( !success )
+	{
+		Sched_Expire( s, r, now );
+		Sched_CheckDone( s, now );
+		return 1;
+	}
+
+	// Smoothed response time and deviation, weights as in TCP
+	sample = now - r->sent;
+	if ( s->rtt <= 0.0 )
+	{
+		s->rtt = sample;
+		s->rttvar = sample * 0.5;
+	}
+	else
+	{
+		delta = sample - s->rtt;
+		s->rtt += delta * 0.125;
+		s->rttvar += ( ( delta < 0.0 ? -delta : delta ) - s->rttvar ) * 0.25;
+	}
+
+	s->window += SCHED_GROWTH;
+	if ( s->window > s->maxwindow )
+		s->window = (float)s->maxwindow;
+
+	if ( (int)s->window > s->stats.maxwindow )
+		s->stats.maxwindow = (int)s->window;
+
+	s->stats.answered++;
+	s->recentanswers++;
+	delete r;
+
+	Sched_Adjust( s, now );
+
+	Sched_CheckDone( s, now );
+
+	return 1;
+}
+
+/*
+===================
+Sched_Remaining
+
+===================
+*/
+int Sched_Remaining( const querysched_t *s )
+{
+	// Heap holds the active and the backing off requests
+	return s->numpending + s->heapcount;
+}
@@ -0,0 +1,102 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Detail query scheduler for the server browser
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef __HUD_SERVERS_SCHED_H__
+#define __HUD_SERVERS_SCHED_H__
+
+#include "netadr.h"
+
+#define SCHED_HASH_SIZE 256 // context id -> request buckets, power of two
+
+#define SCHED_MIN_WINDOW 8
+#define SCHED_MIN_TIMEOUT 0.5
+#define SCHED_MAX_TIMEOUT 2.0
+
+enum
+{
+	SCHED_PENDING = 0, // waiting for a slot in the window
+	SCHED_ACTIVE,      // sent, deadline in the heap
+	SCHED_BACKOFF      // timed out, resend time in the heap
+};
+
+typedef struct schedreq_s
+{
+	netadr_t remote_address;
+	int context;
+	int state;
+	int tries;
+	double sent;
+	double due;    // deadline while active, resend time while backing off
+	int heapindex; // -1 when not in the heap
+	struct schedreq_s *next;     // pending queue
+	struct schedreq_s *hashnext; // active bucket
+} schedreq_t;
+
+typedef struct schedstats_s
+{
+	int queued;
+	int sent;
+	int answered;
+	int failed;
+	int retries;
+	int timeouts;
+	int maxwindow; // largest window reached
+	double started;
+	double finished;
+} schedstats_t;
+
+// Sends a detail request with the engine timeout, returns the context id used
+typedef int ( *schedsend_t )( void *owner, const netadr_t *adr, double timeout );
+typedef void ( *schedcancel_t )( void *owner, int context );
+
+typedef struct querysched_s
+{
+	schedreq_t *pending;
+	schedreq_t *pendingtail;
+	int numpending;
+
+	schedreq_t *active[SCHED_HASH_SIZE];
+	int numactive;
+
+	// Min-heap on due, holds active and backing off requests
+	schedreq_t **heap;
+	int heapcount;
+	int heapmax;
+
+	float window;  // current in-flight target
+	int maxwindow; // upper bound, cl_browser_window
+	int maxtries;  // sends per server, 1 + retries
+
+	double rtt;        // smoothed response time
+	double rttvar;     // and its mean deviation
+	double lastshrink; // last window check
+	int recentanswers; // since then
+	int recenttimeouts;
+
+	schedsend_t Send;
+	schedcancel_t Cancel;
+	void *owner;
+
+	schedstats_t stats;
+} querysched_t;
+
+void Sched_Init( querysched_t *s, schedsend_t send, schedcancel_t cancel, void *owner );
+void Sched_Clear( querysched_t *s );
+void Sched_Start( querysched_t *s, int maxwindow, int maxtries, double now );
+
+void Sched_Queue( querysched_t *s, const netadr_t *adr );
+
+// Fill the window and expire deadlines, call once per frame
+void Sched_Think( querysched_t *s, double now );
+
+// Engine answered or gave up on context, returns 0 when the context is not ours
+int Sched_Response( querysched_t *s, int context, int success, double now );
+
+// Requests not yet answered or given up on
+int Sched_Remaining( const querysched_t *s );
+
+#endif // __HUD_SERVERS_SCHED_H__
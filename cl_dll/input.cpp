@@ -55,6 +55,7 @@ void V_Init( void );
 void VectorAngles( const float *forward, float *angles );
 int CL_ButtonBits( int );
 void ClearEventList( void );
+void R_StudioShutdown( void );
 // xxx need client dll function to get and clear impuse
 extern cvar_t *in_joystick;
 
@@ -1256,6 +1257,8 @@ void DLLEXPORT HUD_Shutdown( void )
 
 	ClearEventList();
 
+	R_StudioShutdown();
+
 #ifdef USE_PARTICLEMAN
 	CL_UnloadParticleMan();
 #endif
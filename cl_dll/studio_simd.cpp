@@ -0,0 +1,465 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Structure-of-arrays bone pose and vectorized bone setup kernels
+//
+// $NoKeywords: $
+//=============================================================================
+
+// Every kernel evaluates its expressions in the same order as the scalar
+// helpers in studio_util.cpp, one bone per lane, so both paths produce
+// identical bits. Transcendentals are still computed per lane with the
+// same libm calls.
+
+#include "hud.h"
+#include "cl_util.h"
+#include "const.h"
+#include "com_model.h"
+#include "studio.h"
+
+#include <string.h>
+
+#include "studio_util.h"
+#include "studio_simd.h"
+
+#if STUDIO_SIMD_SSE2
+#include <emmintrin.h>
+
+typedef __m128 vec4f;
+
+#define V4_Load( p )		_mm_loadu_ps( p )
+#define V4_Store( p, v )	_mm_storeu_ps( p, v )
+#define V4_Set1( f )		_mm_set1_ps( f )
+#define V4_Add( a, b )		_mm_add_ps( a, b )
+#define V4_Sub( a, b )		_mm_sub_ps( a, b )
+#define V4_Mul( a, b )		_mm_mul_ps( a, b )
+#define V4_CmpGt( a, b )	_mm_cmpgt_ps( a, b )
+#define V4_Select( m, a, b )	_mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) )
+#define V4_Neg( a )		_mm_xor_ps( a, _mm_set1_ps( -0.0f ) )
+#define V4_MaskW()		_mm_castsi128_ps( _mm_set_epi32( -1, 0, 0, 0 ) )
+#elif STUDIO_SIMD_NEON
+#include <arm_neon.h>
+
+typedef float32x4_t vec4f;
+
+static inline vec4f V4_MaskW( void )
+{
+	static const unsigned int mask[4] = { 0, 0, 0, 0xFFFFFFFFu };
+	return vreinterpretq_f32_u32( vld1q_u32( mask ) );
+}
+
+#define V4_Load( p )		vld1q_f32( p )
+#define V4_Store( p, v )	vst1q_f32( p, v )
+#define V4_Set1( f )		vdupq_n_f32( f )
+#define V4_Add( a, b )		vaddq_f32( a, b )
+#define V4_Sub( a, b )		vsubq_f32( a, b )
+#define V4_Mul( a, b )		vmulq_f32( a, b )
+#define V4_CmpGt( a, b )	vreinterpretq_f32_u32( vcgtq_f32( a, b ) )
+#define V4_Select( m, a, b )	vbslq_f32( vreinterpretq_u32_f32( m ), a, b )
+#define V4_Neg( a )		vnegq_f32( a )
+#endif
+
+#if STUDIO_SIMD_SSE2 || STUDIO_SIMD_NEON
+#define STUDIO_SIMD 1
+#endif
+
+/*
+====================
+StudioPose_SimdName
+
+====================
+*/
+const char *StudioPose_SimdName( void )
+{
+#if STUDIO_SIMD_SSE2
+	return "SSE2";
+#elif STUDIO_SIMD_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+/*
+====================
+StudioPose_CopyBone
+
+====================
+*/
+void StudioPose_CopyBone( studiopose_t *dst, const studiopose_t *src, int bone )
+{
+	dst->qx[bone] = src->qx[bone];
+	dst->qy[bone] = src->qy[bone];
+	dst->qz[bone] = src->qz[bone];
+	dst->qw[bone] = src->qw[bone];
+	dst->px[bone] = src->px[bone];
+	dst->py[bone] = src->py[bone];
+	dst->pz[bone] = src->pz[bone];
+}
+
+/*
+====================
+StudioPose_SetBone
+
+====================
+*/
+void StudioPose_SetBone( studiopose_t *pose, int bone, const float *q, const float *pos )
+{
+	if ( q )
+	{
+		pose->qx[bone] = q[0];
+		pose->qy[bone] = q[1];
+		pose->qz[bone] = q[2];
+		pose->qw[bone] = q[3];
+	}
+
+	if ( pos )
+	{
+		pose->px[bone] = pos[0];
+		pose->py[bone] = pos[1];
+		pose->pz[bone] = pos[2];
+	}
+}
+
+/*
+====================
+StudioPose_GetBone
+
+====================
+*/
+void StudioPose_GetBone( const studiopose_t *pose, int bone, float *q, float *pos )
+{
+	if ( q )
+	{
+		q[0] = pose->qx[bone];
+		q[1] = pose->qy[bone];
+		q[2] = pose->qz[bone];
+		q[3] = pose->qw[bone];
+	}
+
+	if ( pos )
+	{
+		pos[0] = pose->px[bone];
+		pos[1] = pose->py[bone];
+		pos[2] = pose->pz[bone];
+	}
+}
+
+#if STUDIO_SIMD
+/*
+====================
+StudioPose_SlerpLanes
+
+QuaternionSlerp for STUDIO_SIMD_WIDTH bones starting at first.
+Lanes past numbones or with a clear mask byte are left untouched.
+====================
+*/
+static void StudioPose_SlerpLanes( studiopose_t *p, const studiopose_t *q, const byte *mask, float t, int first, int numbones )
+{
+	vec4f p0, p1, p2, p3;
+	vec4f q0, q1, q2, q3;
+	vec4f d, a, b, flip;
+	vec4f sclp, sclq;
+	float cosom[STUDIO_SIMD_WIDTH];
+	float lanep[STUDIO_SIMD_WIDTH];
+	float laneq[STUDIO_SIMD_WIDTH];
+	float flipped[4][STUDIO_SIMD_WIDTH];
+	float result[4][STUDIO_SIMD_WIDTH];
+	int antipodal[STUDIO_SIMD_WIDTH];
+	int i, k, active;
+
+	active = 0;
+	for ( k = 0; k < STUDIO_SIMD_WIDTH; k++ )
+	{
+		if ( first + k < numbones && ( !mask || mask[first + k] ) )
+			active |= 1 << k;
+	}
+
+	if ( !active )
+		return;
+
+	p0 = V4_Load( &p->qx[first] );
+	p1 = V4_Load( &p->qy[first] );
+	p2 = V4_Load( &p->qz[first] );
+	p3 = V4_Load( &p->qw[first] );
+	q0 = V4_Load( &q->qx[first] );
+	q1 = V4_Load( &q->qy[first] );
+	q2 = V4_Load( &q->qz[first] );
+	q3 = V4_Load( &q->qw[first] );
+
+	// decide if one of the quaternions is backwards
+	d = V4_Sub( p0, q0 );
+	a = V4_Mul( d, d );
+	d = V4_Sub( p1, q1 );
+	a = V4_Add( a, V4_Mul( d, d ) );
+	d = V4_Sub( p2, q2 );
+	a = V4_Add( a, V4_Mul( d, d ) );
+	d = V4_Sub( p3, q3 );
+	a = V4_Add( a, V4_Mul( d, d ) );
+
+	d = V4_Add( p0, q0 );
+	b = V4_Mul( d, d );
+	d = V4_Add( p1, q1 );
+	b = V4_Add( b, V4_Mul( d, d ) );
+	d = V4_Add( p2, q2 );
+	b = V4_Add( b, V4_Mul( d, d ) );
+	d = V4_Add( p3, q3 );
+	b = V4_Add( b, V4_Mul( d, d ) );
+
+	flip = V4_CmpGt( a, b );
+	q0 = V4_Select( flip, V4_Neg( q0 ), q0 );
+	q1 = V4_Select( flip, V4_Neg( q1 ), q1 );
+	q2 = V4_Select( flip, V4_Neg( q2 ), q2 );
+	q3 = V4_Select( flip, V4_Neg( q3 ), q3 );
+
+	d = V4_Add( V4_Add( V4_Add( V4_Mul( p0, q0 ), V4_Mul( p1, q1 ) ), V4_Mul( p2, q2 ) ), V4_Mul( p3, q3 ) );
+	V4_Store( cosom, d );
+
+	for ( k = 0; k < STUDIO_SIMD_WIDTH; k++ )
+	{
+		antipodal[k] = 0;
+		lanep[k] = 0.0f;
+		laneq[k] = 0.0f;
+
+		if ( !( active & ( 1 << k ) ) )
+			continue;
+
+		if ( ( 1.0f + cosom[k] ) > 0.000001f )
+		{
+			if ( ( 1.0f - cosom[k] ) > 0.000001f )
+			{
+				float omega, sinom;
+
+				omega = acos( cosom[k] );
+				sinom = sin( omega );
+				lanep[k] = sin( ( 1.0f - t ) * omega ) / sinom;
+				laneq[k] = sin( t * omega ) / sinom;
+			}
+			else
+			{
+				lanep[k] = 1.0f - t;
+				laneq[k] = t;
+			}
+		}
+		else
+		{
+			antipodal[k] = 1;
+		}
+	}
+
+	sclp = V4_Load( lanep );
+	sclq = V4_Load( laneq );
+
+	V4_Store( result[0], V4_Add( V4_Mul( sclp, p0 ), V4_Mul( sclq, q0 ) ) );
+	V4_Store( result[1], V4_Add( V4_Mul( sclp, p1 ), V4_Mul( sclq, q1 ) ) );
+	V4_Store( result[2], V4_Add( V4_Mul( sclp, p2 ), V4_Mul( sclq, q2 ) ) );
+	V4_Store( result[3], V4_Add( V4_Mul( sclp, p3 ), V4_Mul( sclq, q3 ) ) );
+
+	V4_Store( flipped[0], q0 );
+	V4_Store( flipped[1], q1 );
+	V4_Store( flipped[2], q2 );
+	V4_Store( flipped[3], q3 );
+
+	for ( k = 0; k < STUDIO_SIMD_WIDTH; k++ )
+	{
+		if ( !( active & ( 1 << k ) ) )
+			continue;
+
+		i = first + k;
+
+		if ( antipodal[k] )
+		{
+			float sp, sq;
+
+			// quaternions are nearly opposite, rotate around a perpendicular axis
+			sp = sin( ( 1.0f - t ) * ( 0.5f * M_PI_F ) );
+			sq = sin( t * ( 0.5f * M_PI_F ) );
+			p->qx[i] = sp * p->qx[i] + sq * -flipped[1][k];
+			p->qy[i] = sp * p->qy[i] + sq * flipped[0][k];
+			p->qz[i] = sp * p->qz[i] + sq * -flipped[3][k];
+			p->qw[i] = flipped[2][k];
+			continue;
+		}
+
+		p->qx[i] = result[0][k];
+		p->qy[i] = result[1][k];
+		p->qz[i] = result[2][k];
+		p->qw[i] = result[3][k];
+	}
+}
+#endif // STUDIO_SIMD
+
+/*
+====================
+StudioPose_SlerpRotations
+
+====================
+*/
+void StudioPose_SlerpRotations( studiopose_t *q1, const studiopose_t *q2, const byte *mask, float s, int numbones )
+{
+	int i;
+
+#if STUDIO_SIMD
+	for ( i = 0; i < numbones; i += STUDIO_SIMD_WIDTH )
+		StudioPose_SlerpLanes( q1, q2, mask, s, i, numbones );
+#else
+	vec4_t a, b, c;
+
+	for ( i = 0; i < numbones; i++ )
+	{
+		if ( mask && !mask[i] )
+			continue;
+
+		StudioPose_GetBone( q1, i, a, NULL );
+		StudioPose_GetBone( q2, i, b, NULL );
+		QuaternionSlerp( a, b, s, c );
+		StudioPose_SetBone( q1, i, c, NULL );
+	}
+#endif
+}
+
+/*
+====================
+StudioPose_SlerpBones
+
+====================
+*/
+void StudioPose_SlerpBones( studiopose_t *p1, const studiopose_t *p2, float s, int numbones )
+{
+	int i;
+	float s1;
+
+	if ( s < 0.0f )
+		s = 0.0f;
+	else if ( s > 1.0f )
+		s = 1.0f;
+
+	s1 = 1.0f - s;
+
+	StudioPose_SlerpRotations( p1, p2, NULL, s, numbones );
+
+#if STUDIO_SIMD
+	vec4f vs = V4_Set1( s );
+	vec4f vs1 = V4_Set1( s1 );
+
+	for ( i = 0; i < numbones; i += STUDIO_SIMD_WIDTH )
+	{
+		V4_Store( &p1->px[i], V4_Add( V4_Mul( V4_Load( &p1->px[i] ), vs1 ), V4_Mul( V4_Load( &p2->px[i] ), vs ) ) );
+		V4_Store( &p1->py[i], V4_Add( V4_Mul( V4_Load( &p1->py[i] ), vs1 ), V4_Mul( V4_Load( &p2->py[i] ), vs ) ) );
+		V4_Store( &p1->pz[i], V4_Add( V4_Mul( V4_Load( &p1->pz[i] ), vs1 ), V4_Mul( V4_Load( &p2->pz[i] ), vs ) ) );
+	}
+#else
+	for ( i = 0; i < numbones; i++ )
+	{
+		p1->px[i] = p1->px[i] * s1 + p2->px[i] * s;
+		p1->py[i] = p1->py[i] * s1 + p2->py[i] * s;
+		p1->pz[i] = p1->pz[i] * s1 + p2->pz[i] * s;
+	}
+#endif
+}
+
+/*
+====================
+StudioPose_BoneMatrices
+
+====================
+*/
+void StudioPose_BoneMatrices( const studiopose_t *pose, float bonematrix[][3][4], int numbones )
+{
+	int i;
+
+#if STUDIO_SIMD
+	vec4f one = V4_Set1( 1.0f );
+	vec4f two = V4_Set1( 2.0f );
+	float m[3][4][STUDIO_SIMD_WIDTH];
+	int k, count;
+
+	for ( i = 0; i < numbones; i += STUDIO_SIMD_WIDTH )
+	{
+		vec4f x = V4_Load( &pose->qx[i] );
+		vec4f y = V4_Load( &pose->qy[i] );
+		vec4f z = V4_Load( &pose->qz[i] );
+		vec4f w = V4_Load( &pose->qw[i] );
+		vec4f x2 = V4_Mul( two, x );
+		vec4f y2 = V4_Mul( two, y );
+		vec4f w2 = V4_Mul( two, w );
+
+		V4_Store( m[0][0], V4_Sub( V4_Sub( one, V4_Mul( y2, y ) ), V4_Mul( V4_Mul( two, z ), z ) ) );
+		V4_Store( m[1][0], V4_Add( V4_Mul( x2, y ), V4_Mul( w2, z ) ) );
+		V4_Store( m[2][0], V4_Sub( V4_Mul( x2, z ), V4_Mul( w2, y ) ) );
+
+		V4_Store( m[0][1], V4_Sub( V4_Mul( x2, y ), V4_Mul( w2, z ) ) );
+		V4_Store( m[1][1], V4_Sub( V4_Sub( one, V4_Mul( x2, x ) ), V4_Mul( V4_Mul( two, z ), z ) ) );
+		V4_Store( m[2][1], V4_Add( V4_Mul( y2, z ), V4_Mul( w2, x ) ) );
+
+		V4_Store( m[0][2], V4_Add( V4_Mul( x2, z ), V4_Mul( w2, y ) ) );
+		V4_Store( m[1][2], V4_Sub( V4_Mul( y2, z ), V4_Mul( w2, x ) ) );
+		V4_Store( m[2][2], V4_Sub( V4_Sub( one, V4_Mul( x2, x ) ), V4_Mul( y2, y ) ) );
+
+		V4_Store( m[0][3], V4_Load( &pose->px[i] ) );
+		V4_Store( m[1][3], V4_Load( &pose->py[i] ) );
+		V4_Store( m[2][3], V4_Load( &pose->pz[i] ) );
+
+		count = numbones - i;
+		if ( count > STUDIO_SIMD_WIDTH )
+			count = STUDIO_SIMD_WIDTH;
+
+		for ( k = 0; k < count; k++ )
+		{
+			float( *out )[4] = bonematrix[i + k];
+
+			out[0][0] = m[0][0][k];
+			out[0][1] = m[0][1][k];
+			out[0][2] = m[0][2][k];
+			out[0][3] = m[0][3][k];
+			out[1][0] = m[1][0][k];
+			out[1][1] = m[1][1][k];
+			out[1][2] = m[1][2][k];
+			out[1][3] = m[1][3][k];
+			out[2][0] = m[2][0][k];
+			out[2][1] = m[2][1][k];
+			out[2][2] = m[2][2][k];
+			out[2][3] = m[2][3][k];
+		}
+	}
+#else
+	vec4_t q;
+
+	for ( i = 0; i < numbones; i++ )
+	{
+		StudioPose_GetBone( pose, i, q, NULL );
+		QuaternionMatrix( q, bonematrix[i] );
+
+		bonematrix[i][0][3] = pose->px[i];
+		bonematrix[i][1][3] = pose->py[i];
+		bonematrix[i][2][3] = pose->pz[i];
+	}
+#endif
+}
+
+/*
+====================
+StudioPose_ConcatTransforms
+
+====================
+*/
+void StudioPose_ConcatTransforms( float in1[3][4], float in2[3][4], float out[3][4] )
+{
+#if STUDIO_SIMD
+	vec4f r0 = V4_Load( in2[0] );
+	vec4f r1 = V4_Load( in2[1] );
+	vec4f r2 = V4_Load( in2[2] );
+	vec4f maskw = V4_MaskW();
+	vec4f t;
+	int k;
+
+	for ( k = 0; k < 3; k++ )
+	{
+		t = V4_Add( V4_Add( V4_Mul( V4_Set1( in1[k][0] ), r0 ), V4_Mul( V4_Set1( in1[k][1] ), r1 ) ), V4_Mul( V4_Set1( in1[k][2] ), r2 ) );
+		// translation column picks up the parent offset, others stay untouched
+		t = V4_Select( maskw, V4_Add( t, V4_Set1( in1[k][3] ) ), t );
+		V4_Store( out[k], t );
+	}
+#else
+	ConcatTransforms( in1, in2, out );
+#endif
+}
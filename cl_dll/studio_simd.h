@@ -0,0 +1,64 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Structure-of-arrays bone pose and vectorized bone setup kernels
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef __STUDIO_SIMD_H__
+#define __STUDIO_SIMD_H__
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define STUDIO_SIMD_SSE2 1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define STUDIO_SIMD_NEON 1
+#endif
+
+// number of bones processed by one vector operation
+#define STUDIO_SIMD_WIDTH 4
+
+/*
+====================
+studiopose_t
+
+Bone rotations and positions for a whole skeleton, one array per
+component, so consecutive bones share a vector register.
+MAXSTUDIOBONES is a multiple of STUDIO_SIMD_WIDTH, kernels may touch
+the padding bones past numbones.
+====================
+*/
+typedef struct studiopose_s
+{
+	float qx[MAXSTUDIOBONES];
+	float qy[MAXSTUDIOBONES];
+	float qz[MAXSTUDIOBONES];
+	float qw[MAXSTUDIOBONES];
+
+	float px[MAXSTUDIOBONES];
+	float py[MAXSTUDIOBONES];
+	float pz[MAXSTUDIOBONES];
+} studiopose_t;
+
+// Name of the instruction set used by the kernels, for diagnostics
+const char *StudioPose_SimdName( void );
+
+// Copy one bone between poses
+void StudioPose_CopyBone( studiopose_t *dst, const studiopose_t *src, int bone );
+
+// Store / fetch a single bone in AoS form
+void StudioPose_SetBone( studiopose_t *pose, int bone, const float *q, const float *pos );
+void StudioPose_GetBone( const studiopose_t *pose, int bone, float *q, float *pos );
+
+// Per bone QuaternionSlerp( q1, q2, s ) into q1 where mask[bone] is set, positions untouched
+void StudioPose_SlerpRotations( studiopose_t *q1, const studiopose_t *q2, const byte *mask, float s, int numbones );
+
+// Same as CStudioModelRenderer::StudioSlerpBones, blends q2/pos2 into q1/pos1
+void StudioPose_SlerpBones( studiopose_t *p1, const studiopose_t *p2, float s, int numbones );
+
+// QuaternionMatrix plus translation for every bone
+void StudioPose_BoneMatrices( const studiopose_t *pose, float bonematrix[][3][4], int numbones );
+
+// Vectorized ConcatTransforms, same operation order as the scalar version
+void StudioPose_ConcatTransforms( float in1[3][4], float in2[3][4], float out[3][4] );
+
+#endif // __STUDIO_SIMD_H__
@@ -0,0 +1,278 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Small worker pool for data-parallel studio model work
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifdef _WIN32
+#define HSPRITE HSPRITE_win32
+#include <windows.h>
+#undef HSPRITE
+#else
+#include <pthread.h>
+#endif
+
+#include <atomic>
+
+#include "studio_threads.h"
+
+// Jobs are handed out through an atomic counter, so each job runs exactly
+// once no matter how many threads take part. Every worker wakes exactly
+// once per run and the caller waits for all of them, so no worker can
+// still be looking at the counter when the next run starts. Workers never
+// touch engine state, the job function is responsible for that.
+//
+// When fewer workers could be created than were asked for, the pool
+// keeps the ones it got and runs degraded. It's only started again
+// once a different thread count is asked for.
+static struct
+{
+	bool started;
+	int requested;  // workers asked for when the pool was started
+	int numworkers; // workers actually running
+	bool quit;
+
+	studiojobfunc_t func;
+	int count;
+	std::atomic<int> next;
+	std::atomic<int> remaining;
+
+#ifdef _WIN32
+	HANDLE threads[STUDIO_MAXTHREADS];
+	HANDLE start[STUDIO_MAXTHREADS]; // auto-reset, one per worker
+	HANDLE done;                     // auto-reset, set by the last worker
+#else
+	pthread_t threads[STUDIO_MAXTHREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	int generation;
+#endif
+} s_pool;
+
+/*
+====================
+StudioThreads_Work
+
+Run jobs until there are none left
+====================
+*/
+static void StudioThreads_Work( int thread )
+{
+	int job;
+
+	while ( ( job = s_pool.next++ ) < s_pool.count )
+		s_pool.func( job, thread );
+}
+
+#ifdef _WIN32
+/*
+====================
+StudioThreads_Worker
+
+====================
+*/
+static DWORD WINAPI StudioThreads_Worker( LPVOID param )
+{
+	int thread = (int)(size_t)param;
+
+	while ( 1 )
+	{
+		WaitForSingleObject( s_pool.start[thread], INFINITE );
+
+		if ( s_pool.quit )
+			break;
+
+		StudioThreads_Work( thread );
+
+		if ( --s_pool.remaining == 0 )
+			SetEvent( s_pool.done );
+	}
+
+	return 0;
+}
+#else
+/*
+====================
+StudioThreads_Worker
+
+====================
+*/
+static void *StudioThreads_Worker( void *param )
+{
+	int thread = (int)(size_t)param;
+	int seen = 0;
+
+	while ( 1 )
+	{
+		pthread_mutex_lock( &s_pool.lock );
+		while ( s_pool.generation == seen && !s_pool.quit )
+			pthread_cond_wait( &s_pool.wake, &s_pool.lock );
+		seen = s_pool.generation;
+		pthread_mutex_unlock( &s_pool.lock );
+
+		if ( s_pool.quit )
+			break;
+
+		StudioThreads_Work( thread );
+
+		if ( --s_pool.remaining == 0 )
+		{
+			pthread_mutex_lock( &s_pool.lock );
+			pthread_cond_signal( &s_pool.done );
+			pthread_mutex_unlock( &s_pool.lock );
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+/*
+====================
+StudioThreads_Start
+
+====================
+*/
+static void StudioThreads_Start( int numworkers )
+{
+	int i;
+
+	s_pool.started = true;
+	s_pool.requested = numworkers;
+	s_pool.quit = false;
+	s_pool.numworkers = 0;
+
+#ifdef _WIN32
+	s_pool.done = CreateEvent( NULL, FALSE, FALSE, NULL );
+
+	for ( i = 0; i < numworkers; i++ )
+	{
+		s_pool.start[i + 1] = CreateEvent( NULL, FALSE, FALSE, NULL );
+		s_pool.threads[i] = CreateThread( NULL, 0, StudioThreads_Worker, (LPVOID)(size_t)( i + 1 ), 0, NULL );
+		if ( !s_pool.threads[i] )
+		{
+			CloseHandle( s_pool.start[i + 1] );
+			break;
+		}
+		s_pool.numworkers++;
+	}
+#else
+	pthread_mutex_init( &s_pool.lock, NULL );
+	pthread_cond_init( &s_pool.wake, NULL );
+	pthread_cond_init( &s_pool.done, NULL );
+	s_pool.generation = 0;
+
+	for ( i = 0; i < numworkers; i++ )
+	{
+		if ( pthread_create( &s_pool.threads[i], NULL, StudioThreads_Worker, (void *)(size_t)( i + 1 ) ) != 0 )
+			break;
+		s_pool.numworkers++;
+	}
+#endif
+}
+
+/*
+====================
+StudioThreads_Shutdown
+
+====================
+*/
+void StudioThreads_Shutdown( void )
+{
+	int i;
+
+	if ( !s_pool.started )
+		return;
+
+	s_pool.quit = true;
+
+#ifdef _WIN32
+	for ( i = 0; i < s_pool.numworkers; i++ )
+		SetEvent( s_pool.start[i + 1] );
+
+	for ( i = 0; i < s_pool.numworkers; i++ )
+	{
+		WaitForSingleObject( s_pool.threads[i], INFINITE );
+		CloseHandle( s_pool.threads[i] );
+		CloseHandle( s_pool.start[i + 1] );
+	}
+
+	CloseHandle( s_pool.done );
+#else
+	pthread_mutex_lock( &s_pool.lock );
+	pthread_cond_broadcast( &s_pool.wake );
+	pthread_mutex_unlock( &s_pool.lock );
+
+	for ( i = 0; i < s_pool.numworkers; i++ )
+		pthread_join( s_pool.threads[i], NULL );
+
+	pthread_cond_destroy( &s_pool.done );
+	pthread_cond_destroy( &s_pool.wake );
+	pthread_mutex_destroy( &s_pool.lock );
+#endif
+
+	s_pool.numworkers = 0;
+	s_pool.requested = 0;
+	s_pool.started = false;
+}
+
+/*
+====================
+StudioThreads_Run
+
+====================
+*/
+void StudioThreads_Run( int numthreads, int count, studiojobfunc_t func )
+{
+	int i;
+
+	if ( count <= 0 )
+		return;
+
+	if ( numthreads > STUDIO_MAXTHREADS )
+		numthreads = STUDIO_MAXTHREADS;
+
+	// deterministic single thread fallback
+	if ( numthreads <= 1 || count == 1 )
+	{
+		for ( i = 0; i < count; i++ )
+			func( i, 0 );
+		return;
+	}
+
+	if ( !s_pool.started || s_pool.requested != numthreads - 1 )
+	{
+		StudioThreads_Shutdown();
+		StudioThreads_Start( numthreads - 1 );
+	}
+
+	// everything below is published to the workers by the wake up
+	s_pool.func = func;
+	s_pool.count = count;
+	s_pool.next = 0;
+	s_pool.remaining = s_pool.numworkers;
+
+#ifdef _WIN32
+	for ( i = 0; i < s_pool.numworkers; i++ )
+		SetEvent( s_pool.start[i + 1] );
+
+	StudioThreads_Work( 0 );
+
+	if ( s_pool.numworkers )
+		WaitForSingleObject( s_pool.done, INFINITE );
+#else
+	pthread_mutex_lock( &s_pool.lock );
+	s_pool.generation++;
+	pthread_cond_broadcast( &s_pool.wake );
+	pthread_mutex_unlock( &s_pool.lock );
+
+	StudioThreads_Work( 0 );
+
+	pthread_mutex_lock( &s_pool.lock );
+	while ( s_pool.remaining > 0 )
+		pthread_cond_wait( &s_pool.done, &s_pool.lock );
+	pthread_mutex_unlock( &s_pool.lock );
+#endif
+}
@@ -0,0 +1,25 @@
+//========= Copyright (c) 1996-2002, Valve LLC, All rights reserved. ============
+//
+// Purpose: Small worker pool for data-parallel studio model work
+//
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef __STUDIO_THREADS_H__
+#define __STUDIO_THREADS_H__
+
+// Including the calling thread
+#define STUDIO_MAXTHREADS 16
+
+// Called once per job, thread is 0 for the calling thread and
+// 1 .. numthreads - 1 for the workers
+typedef void ( *studiojobfunc_t )( int job, int thread );
+
+// Run func for jobs 0 .. count - 1 and wait for all of them.
+// numthreads <= 1 runs every job in order on the calling thread.
+void StudioThreads_Run( int numthreads, int count, studiojobfunc_t func );
+
+// Stop and join the workers
+void StudioThreads_Shutdown( void );
+
+#endif // __STUDIO_THREADS_H__
@@ -66,6 +66,92 @@ struct laserdot_info_t
 
 static laserdot_info_t g_laserdot;
 
+#define PREDCACHE_SIZE 128 // must be a power of two
+#define PREDCACHE_WAYS 4   // entries per set, commands in flight are told apart by their full seed
+
+// Everything HUD_WeaponsPostThink reads when re-predicting a command
+struct predinput_t
+{
+	unsigned int random_seed;
+	int msec;
+	int buttons;
+	int weaponselect;
+	int dead;
+	int user1;
+
+	int oldbuttons;
+	int playerclass;
+
+	int m_iId;
+	vec3_t velocity;
+	int flags;
+	int deadflag;
+	int waterlevel;
+	float maxspeed;
+	int tfstate;
+	int fov;
+	int weaponanim;
+	int viewmodel;
+	float m_flNextAttack;
+	int ammo_nails;
+	int ammo_shells;
+	int ammo_rockets;
+	int ammo_cells;
+
+	weapon_data_t weapondata[32];
+};
+
+// Client weapon and player state that outlives a HUD_WeaponsPostThink call
+// but isn't part of local_state_s, read by the next run and kept per entry
+struct predpersist_t
+{
+	CBasePlayerItem *m_pActiveItem;
+	CBasePlayerItem *m_pLastItem;
+	int m_iFOV;
+	int m_iSpotActive;
+	BOOL m_bHullHit[4];
+
+	int m_iPlayEmptySound[32];
+	int m_fFireOnEmpty[32];
+};
+
+// What it wrote back into the predicted state
+struct predoutput_t
+{
+	int playerclass;
+	int tfstate;
+	int m_iId;
+	int viewmodel;
+	int fov;
+	int weaponanim;
+	float m_flNextAttack;
+	float maxspeed;
+	int ammo_nails;
+	int ammo_shells;
+	int ammo_cells;
+	int ammo_rockets;
+
+	weapon_data_t weapondata[32];
+};
+
+struct predcache_t
+{
+	qboolean valid;
+	unsigned int stamp; // last use, the oldest entry of a set is replaced
+	predinput_t in;
+	predpersist_t inpersist;
+	predoutput_t out;
+	predpersist_t outpersist;
+};
+
+static predcache_t g_PredCache[PREDCACHE_SIZE];
+static predinput_t g_PredInput;
+static predpersist_t g_PredPersist;
+static unsigned int g_nPredStamp;
+static int g_nPredSimulated;
+static int g_nPredReused;
+static int g_nPredInvalidated;
+
 CTFShotgun g_Gun;
 CTFSuperShotgun g_Super;
 CTFNailgun g_NG;
@@ -1188,6 +1274,264 @@ void HUD_WeaponsPostThink( local_state_s *from, local_state_s *to, usercmd_t *cm
 	*/
 }
 
+/*
+=====================
+HUD_BuildPredictionInput
+
+Gather the weapon prediction inputs for a command so a re-run can be matched
+against the snapshot taken the last time it was predicted.
+=====================
+*/
+static void HUD_BuildPredictionInput( predinput_t *in, local_state_s *from, usercmd_t *cmd, unsigned int random_seed )
+{
+	// zero the padding too, entries are compared with memcmp
+	memset( in, 0, sizeof( *in ) );
+
+	in->random_seed = random_seed;
+	in->msec = cmd->msec;
+	in->buttons = cmd->buttons;
+	in->weaponselect = cmd->weaponselect;
+	in->dead = CL_IsDead();
+	in->user1 = g_iUser1;
+
+	in->oldbuttons = from->playerstate.oldbuttons;
+	in->playerclass = from->playerstate.playerclass;
+
+	in->m_iId = from->client.m_iId;
+	in->velocity = from->client.velocity;
+	in->flags = from->client.flags;
+	in->deadflag = from->client.deadflag;
+	in->waterlevel = from->client.waterlevel;
+	in->maxspeed = from->client.maxspeed;
+	in->tfstate = from->client.tfstate;
+	in->fov = from->client.fov;
+	in->weaponanim = from->client.weaponanim;
+	in->viewmodel = from->client.viewmodel;
+	in->m_flNextAttack = from->client.m_flNextAttack;
+	in->ammo_nails = from->client.ammo_nails;
+	in->ammo_shells = from->client.ammo_shells;
+	in->ammo_rockets = from->client.ammo_rockets;
+	in->ammo_cells = from->client.ammo_cells;
+
+	memcpy( in->weapondata, from->weapondata, sizeof( in->weapondata ) );
+}
+
+/*
+=====================
+HUD_SavePredictionPersist
+=====================
+*/
+static void HUD_SavePredictionPersist( predpersist_t *persist )
+{
+	CBasePlayerWeapon *pCurrent;
+	CTFAxe *pAxes[4] = { &g_Crowbar, &g_Knife, &g_Spanner, &g_Medkit };
+	int i;
+
+	memset( persist, 0, sizeof( *persist ) );
+
+	persist->m_pActiveItem = player.m_pActiveItem;
+	persist->m_pLastItem = player.m_pLastItem;
+	persist->m_iFOV = player.m_iFOV;
+	persist->m_iSpotActive = g_Sniper.m_iSpotActive;
+
+	for ( i = 0; i < 4; i++ )
+		persist->m_bHullHit[i] = pAxes[i]->m_bHullHit;
+
+	for ( i = 0; i < 32; i++ )
+	{
+		pCurrent = g_pWpns[i];
+		if ( !pCurrent )
+			continue;
+
+		persist->m_iPlayEmptySound[i] = pCurrent->m_iPlayEmptySound;
+		persist->m_fFireOnEmpty[i] = pCurrent->m_fFireOnEmpty;
+	}
+}
+
+/*
+=====================
+HUD_RestorePredictionPersist
+=====================
+*/
+static void HUD_RestorePredictionPersist( const predpersist_t *persist )
+{
+	CBasePlayerWeapon *pCurrent;
+	CTFAxe *pAxes[4] = { &g_Crowbar, &g_Knife, &g_Spanner, &g_Medkit };
+	int i;
+
+	player.m_pActiveItem = persist->m_pActiveItem;
+	player.m_pLastItem = persist->m_pLastItem;
+	player.m_iFOV = persist->m_iFOV;
+	g_Sniper.m_iSpotActive = persist->m_iSpotActive;
+
+	for ( i = 0; i < 4; i++ )
+		pAxes[i]->m_bHullHit = persist->m_bHullHit[i];
+
+	for ( i = 0; i < 32; i++ )
+	{
+		pCurrent = g_pWpns[i];
+		if ( !pCurrent )
+			continue;
+
+		pCurrent->m_iPlayEmptySound = persist->m_iPlayEmptySound[i];
+		pCurrent->m_fFireOnEmpty = persist->m_fFireOnEmpty[i];
+	}
+}
+
+/*
+=====================
+HUD_FindPredictionEntry
+
+The set's entry for this seed, or the one to replace with it
+=====================
+*/
+static predcache_t *HUD_FindPredictionEntry( unsigned int random_seed )
+{
+	predcache_t *set, *oldest;
+	int i;
+
+	set = &g_PredCache[( ( random_seed ^ ( random_seed >> 16 ) ) * PREDCACHE_WAYS ) & ( PREDCACHE_SIZE - 1 )];
+	oldest = set;
+
+	for ( i = 0; i < PREDCACHE_WAYS; i++ )
+	{
+		if ( set[i].valid && set[i].in.random_seed == random_seed )
+			return &set[i];
+
+		if ( !set[i].valid || ( oldest->valid && set[i].stamp < oldest->stamp ) )
+			oldest = &set[i];
+	}
+
+	oldest->valid = false;
+	return oldest;
+}
+
+/*
+=====================
+HUD_StorePredictionOutput
+=====================
+*/
+static void HUD_StorePredictionOutput( predoutput_t *out, local_state_s *to )
+{
+	out->playerclass = to->playerstate.playerclass;
+	out->tfstate = to->client.tfstate;
+	out->m_iId = to->client.m_iId;
+	out->viewmodel = to->client.viewmodel;
+	out->fov = to->client.fov;
+	out->weaponanim = to->client.weaponanim;
+	out->m_flNextAttack = to->client.m_flNextAttack;
+	out->maxspeed = to->client.maxspeed;
+	out->ammo_nails = to->client.ammo_nails;
+	out->ammo_shells = to->client.ammo_shells;
+	out->ammo_cells = to->client.ammo_cells;
+	out->ammo_rockets = to->client.ammo_rockets;
+
+	memcpy( out->weapondata, to->weapondata, sizeof( out->weapondata ) );
+}
+
+/*
+=====================
+HUD_RestorePredictionOutput
+=====================
+*/
+static void HUD_RestorePredictionOutput( const predoutput_t *out, local_state_s *to )
+{
+	to->playerstate.playerclass = out->playerclass;
+	to->client.tfstate = out->tfstate;
+	to->client.m_iId = out->m_iId;
+	to->client.viewmodel = out->viewmodel;
+	to->client.fov = out->fov;
+	to->client.weaponanim = out->weaponanim;
+	to->client.m_flNextAttack = out->m_flNextAttack;
+	to->client.maxspeed = out->maxspeed;
+	to->client.ammo_nails = out->ammo_nails;
+	to->client.ammo_shells = out->ammo_shells;
+	to->client.ammo_cells = out->ammo_cells;
+	to->client.ammo_rockets = out->ammo_rockets;
+
+	memcpy( to->weapondata, out->weapondata, sizeof( out->weapondata ) );
+
+	// HUD_WeaponsPostThink would have done this too
+	g_finalstate = to;
+	HUD_SetLastOrg();
+	g_finalstate = NULL;
+}
+
+/*
+=====================
+HUD_PredictWeapons
+
+The engine re-predicts every unacknowledged command each frame. Commands that
+were already predicted from exactly the same state (i.e. the server agreed with
+us up to here) reuse the snapshot instead of running the weapon code again.
+The state kept in the client weapons themselves is part of the match and is
+put back as the run left it. First-time predictions always run, they are the
+only ones that play effects.
+=====================
+*/
+static void HUD_PredictWeapons( local_state_s *from, local_state_s *to, usercmd_t *cmd, int runfuncs, double time, unsigned int random_seed )
+{
+	predcache_t *entry;
+	predinput_t *in = &g_PredInput;
+	predpersist_t *persist = &g_PredPersist;
+
+	if ( !cl_lw_cache || !cl_lw_cache->value )
+	{
+		g_nPredSimulated++;
+		HUD_WeaponsPostThink( from, to, cmd, time, random_seed );
+		return;
+	}
+
+	// the weapons are set up on the first run, before that there's nothing to match
+	HUD_InitClientWeapons();
+
+	HUD_BuildPredictionInput( in, from, cmd, random_seed );
+	HUD_SavePredictionPersist( persist );
+
+	entry = HUD_FindPredictionEntry( random_seed );
+	entry->stamp = ++g_nPredStamp;
+
+	if ( entry->valid && !memcmp( &entry->in, in, sizeof( *in ) ) && !memcmp( &entry->inpersist, persist, sizeof( *persist ) ) )
+	{
+		if ( !runfuncs )
+		{
+			g_nPredReused++;
+			HUD_RestorePredictionOutput( &entry->out, to );
+			HUD_RestorePredictionPersist( &entry->outpersist );
+			return;
+		}
+	}
+	else if ( entry->valid )
+	{
+		// server correction changed the state this command starts from
+		g_nPredInvalidated++;
+	}
+
+	g_nPredSimulated++;
+	HUD_WeaponsPostThink( from, to, cmd, time, random_seed );
+
+	entry->valid = true;
+	entry->in = *in;
+	entry->inpersist = *persist;
+	HUD_StorePredictionOutput( &entry->out, to );
+	HUD_SavePredictionPersist( &entry->outpersist );
+}
+
+/*
+=====================
+HUD_PredictionCacheStats
+=====================
+*/
+void HUD_PredictionCacheStats( void )
+{
+	int total = g_nPredSimulated + g_nPredReused;
+
+	gEngfuncs.Con_Printf( "weapon prediction: %d commands simulated, %d reused (%.1f%%), %d invalidated by server state\n",
+		g_nPredSimulated, g_nPredReused, total ? 100.0f * g_nPredReused / total : 0.0f, g_nPredInvalidated );
+
+	g_nPredSimulated = g_nPredReused = g_nPredInvalidated = 0;
+}
+
 /*
 =====================
 HUD_PostRunCmd
@@ -1207,7 +1551,7 @@ void _DLLEXPORT HUD_PostRunCmd( struct local_state_s *from, struct local_state_s
 	if ( cl_lw && cl_lw->value )
 	{
 		if ( !to->client.iuser4 )
-			HUD_WeaponsPostThink( from, to, cmd, time, random_seed );
+			HUD_PredictWeapons( from, to, cmd, runfuncs, time, random_seed );
 		g_lastFOV = to->client.fov;
 	}
 	else
@@ -21,6 +21,8 @@
 #include	"decals.h"
 #include	"gamerules.h"
 #include	"game.h"
+#include	"nameindex.h"
+#include	"frameprof.h"
 
 void EntvarsKeyvalue( entvars_t *pev, KeyValueData *pkvd );
 
@@ -166,6 +168,9 @@ int DispatchSpawn( edict_t *pent )
 		// that would touch too much code for me to do that right now.
 		pEntity = (CBaseEntity *)GET_PRIVATE( pent );
 
+		// FireTargets can find it from here on
+		NameIndex_Link( pent );
+
 		if( pEntity )
 		{
 			if( g_pGameRules && !g_pGameRules->IsAllowedToSpawn( pEntity ) )
@@ -206,6 +211,8 @@ void DispatchKeyValue( edict_t *pentKeyvalue, KeyValueData *pkvd )
 		return;
 
 	EntvarsKeyvalue( VARS( pentKeyvalue ), pkvd );
+	if( pkvd->fHandled )
+		NameIndex_Link( pentKeyvalue );
 
 	// If the key was an entity variable, or there's no class set yet, don't look for the object, it may
 	// not exist yet.
@@ -234,7 +241,15 @@ void DispatchTouch( edict_t *pentTouched, edict_t *pentOther )
 	CBaseEntity *pOther = (CBaseEntity *)GET_PRIVATE( pentOther );
 
 	if( pEntity && pOther && ! ( ( pEntity->pev->flags | pOther->pev->flags ) & FL_KILLME ) )
+	{
+		if( g_fFrameProf )
+			FrameProf_Begin( pentTouched, FRAMEPROF_TOUCH );
+
 		pEntity->Touch( pOther );
+
+		if( g_fFrameProf )
+			FrameProf_End();
+	}
 }
 
 void DispatchUse( edict_t *pentUsed, edict_t *pentOther )
@@ -243,7 +258,15 @@ void DispatchUse( edict_t *pentUsed, edict_t *pentOther )
 	CBaseEntity *pOther = (CBaseEntity *)GET_PRIVATE( pentOther );
 
 	if( pEntity && !( pEntity->pev->flags & FL_KILLME ) )
+	{
+		if( g_fFrameProf )
+			FrameProf_Begin( pentUsed, FRAMEPROF_USE );
+
 		pEntity->Use( pOther, pOther, USE_TOGGLE, 0 );
+
+		if( g_fFrameProf )
+			FrameProf_End();
+	}
 }
 
 void DispatchThink( edict_t *pent )
@@ -254,7 +277,13 @@ void DispatchThink( edict_t *pent )
 		if( FBitSet( pEntity->pev->flags, FL_DORMANT ) )
 			ALERT( at_error, "Dormant entity %s is thinking!!\n", STRING( pEntity->pev->classname ) );
 
+		if( g_fFrameProf )
+			FrameProf_Begin( pent, FRAMEPROF_THINK );
+
 		pEntity->Think();
+
+		if( g_fFrameProf )
+			FrameProf_End();
 	}
 }
 
@@ -264,7 +293,15 @@ void DispatchBlocked( edict_t *pentBlocked, edict_t *pentOther )
 	CBaseEntity *pOther = (CBaseEntity *)GET_PRIVATE( pentOther );
 
 	if( pEntity )
+	{
+		if( g_fFrameProf )
+			FrameProf_Begin( pentBlocked, FRAMEPROF_BLOCKED );
+
 		pEntity->Blocked( pOther );
+
+		if( g_fFrameProf )
+			FrameProf_End();
+	}
 }
 
 void OnFreeEntPrivateData( edict_t *pEdict )
@@ -39,6 +39,12 @@
 #include "usercmd.h"
 #include "netadr.h"
 #include "pm_shared.h"
+#include "entgrid.h"
+#include "nameindex.h"
+#include "sightcache.h"
+#include "frameprof.h"
+#include "hudbatch.h"
+#include "netdelta.h"
 
 #include "tf_defs.h"
 
@@ -146,6 +152,9 @@ GLOBALS ASSUMED SET:  g_fGameOver
 */
 void ClientDisconnect( edict_t *pEntity )
 {
+	EntGrid_ClientActive( pEntity, 0 );
+	HudBatch_ClientActive( pEntity, 0 );
+
 	if( g_fGameOver )
 		return;
 
@@ -236,6 +245,9 @@ void ClientPutInServer( edict_t *pEntity )
 
 	entvars_t *pev = &pEntity->v;
 
+	EntGrid_ClientActive( pEntity, 1 );
+	HudBatch_ClientActive( pEntity, 1 );
+
 	pPlayer = GetClassPtr( (CBasePlayer *)pev );
 	pPlayer->SetCustomDecalFrames( -1 ); // Assume none;
 	pPlayer->SetPrefsFromUserinfo( g_engfuncs.pfnGetInfoKeyBuffer( pEntity ) );
@@ -682,6 +694,8 @@ it gets sent into the rest of the engine.
 */
 void ClientUserInfoChanged( edict_t *pEntity, char *infobuffer )
 {
+	HudBatch_UserInfo( pEntity, infobuffer );
+
 	// Is the client spawned yet?
 	if( !pEntity->pvPrivateData )
 		return;
@@ -756,6 +770,8 @@ void ServerDeactivate( void )
 
 	// Peform any shutdown operations here...
 	//
+	EntGrid_Clear();
+	NameIndex_Clear();
 }
 
 void ServerActivate( edict_t *pEdictList, int edictCount, int clientMax )
@@ -768,6 +784,9 @@ void ServerActivate( edict_t *pEdictList, int edictCount, int clientMax )
 	// Every call to ServerActivate should be matched by a call to ServerDeactivate
 	g_serveractive = 1;
 
+	NetDelta_LevelInit();
+	FrameProf_LevelInit();
+
 	// Clients have not been initialized yet
 	for( i = 0; i < edictCount; i++ )
 	{
@@ -807,8 +826,19 @@ void PlayerPreThink( edict_t *pEntity )
 
 	CBasePlayer *pPlayer = (CBasePlayer *)GET_PRIVATE( pEntity );
 
+	// this player is about to move, blasts before and after don't see the same world
+	ClearBlastTraces();
+
 	if( pPlayer )
+	{
+		if( g_fFrameProf )
+			FrameProf_Begin( pEntity, FRAMEPROF_PRETHINK );
+
 		pPlayer->PreThink();
+
+		if( g_fFrameProf )
+			FrameProf_End();
+	}
 }
 
 /*
@@ -825,7 +855,21 @@ void PlayerPostThink( edict_t *pEntity )
 	CBasePlayer *pPlayer = (CBasePlayer *)GET_PRIVATE( pEntity );
 
 	if( pPlayer )
+	{
+		if( g_fFrameProf )
+			FrameProf_Begin( pEntity, FRAMEPROF_POSTTHINK );
+
 		pPlayer->PostThink();
+
+		if( g_fFrameProf )
+			FrameProf_End();
+	}
+
+	// the usercmd moved the player by however long it ran
+	EntGrid_Link( pEntity );
+
+	// whatever the HUD picked up this frame goes out as one message
+	HudBatch_Flush( pEntity );
 }
 
 void ParmsNewLevel( void )
@@ -850,6 +894,17 @@ void StartFrame( void )
 	float ceasefire_time;
 	//ALERT( at_console, "SV_Physics( %g, frametime %g )\n", gpGlobals->time, gpGlobals->frametime );
 
+	FrameProf_Frame();
+
+	// before the game over return, entities still think and get packed
+	// during intermission and the per frame caches keyed on this must expire
+	g_ulFrameCount++;
+
+	// Pick up everything the engine moved last frame
+	EntGrid_Frame();
+	NameIndex_Frame();
+	SightCache_Frame();
+
 	if ( g_pGameRules )
 		g_pGameRules->Think();
 
@@ -897,8 +952,6 @@ void StartFrame( void )
 	if ( last_cease_fire )
 		Check_Ceasefire();
 
-	g_ulFrameCount++;
-
 	g_iSkillLevel = 1; // Velaron: ?
 }
 
@@ -1285,81 +1338,215 @@ void SetupVisibility( edict_t *pViewEntity, edict_t *pClient, unsigned char **pv
 #include "entity_state.h"
 
 /*
-AddToFullPack
+Packing metadata
 
-Return 1 if the entity state has been filled in for the ent and the entity will be propagated to the client, 0 otherwise
-
-state is the server maintained copy of the state info that is transmitted to the client
-a MOD could alter values copied into state to send the "host" a different look for a particular entity update, etc.
-e and ent are the entity that is being added to the update, if 1 is returned
-host is the player's edict of the player whom we are sending the update to
-player is 1 if the ent/e is a player and 0 otherwise
-pSet is either the PAS or PVS that we previous set up.  We can use it to ask the engine to filter the entity against the PAS or PVS.
-we could also use the pas/ pvs that we set in SetupVisibility, if we wanted to.  Caching the value is valid in that case, but still only for the current frame
+Everything AddToFullPack tests that only depends on the entity is gathered the
+first time the entity is offered in a frame, every other client that frame
+just tests bits. sv_packstats 1 times the packing and counts why entities were
+left out, reported once a second.
 */
-int AddToFullPack( struct entity_state_s *state, int e, edict_t *ent, edict_t *host, int hostflags, int player, unsigned char *pSet )
+#define PACK_NOMODEL	( 1 << 0 )
+#define PACK_NODRAW	( 1 << 1 )
+#define PACK_SPECTATOR	( 1 << 2 )
+#define PACK_ALWAYS	( 1 << 3 )	// env_sky, sent even outside the PVS
+#define PACK_CUSTOM	( 1 << 4 )	// FL_CUSTOMENTITY, goes out as a beam
+#define PACK_SKIPLOCAL	( 1 << 5 )	// FL_SKIPLOCALHOST
+
+typedef struct packinfo_s
 {
-	int i;
+	ULONG	frame;		// g_ulFrameCount the rest was filled in
+	int	flags;
+	int	groupinfo;
+	int	policy;		// netquant.txt policy, -1 for none
+} packinfo_t;
 
-	// don't send if flagged for NODRAW and it's not the host getting the message
-	if( ( ent->v.effects & EF_NODRAW ) && ( ent != host ) )
-		return 0;
+static packinfo_t	*g_pPackInfo;
+static int		g_iPackInfoSize;
+
+// Why an entity was left out of a client's update
+enum
+{
+	PACK_REJECT_NODRAW = 0,
+	PACK_REJECT_NOMODEL,
+	PACK_REJECT_SPECTATOR,
+	PACK_REJECT_PVS,
+	PACK_REJECT_LOCALHOST,
+	PACK_REJECT_GROUP,
+	PACK_REJECTS,
+	PACK_SENT = PACK_REJECTS
+};
+
+static const char *g_szPackReject[PACK_REJECTS] =
+{
+	"nodraw",
+	"nomodel",
+	"spectator",
+	"pvs",
+	"localhost",
+	"group",
+};
+
+typedef struct packstats_s
+{
+	ULONG	lastframe;
+	int	ticks;
+	int	built;
+	int	offered;
+	int	sent;
+	int	rejects[PACK_REJECTS];
+	double	time;
+	float	next;
+} packstats_t;
+
+static packstats_t	g_PackStats;
+
+static packinfo_t *PackInfo_Get( int e, edict_t *ent )
+{
+	static packinfo_t scratch;
+	packinfo_t *info;
+	int flags;
+
+	if( e >= g_iPackInfoSize )
+	{
+		int size = gpGlobals->maxEntities > e ? gpGlobals->maxEntities : e + 1;
+		packinfo_t *pPackInfo = (packinfo_t *)realloc( g_pPackInfo, size * sizeof( packinfo_t ) );
+
+		if( pPackInfo )
+		{
+			memset( pPackInfo + g_iPackInfoSize, 0xff, ( size - g_iPackInfoSize ) * sizeof( packinfo_t ) );
+			g_pPackInfo = pPackInfo;
+			g_iPackInfoSize = size;
+		}
+	}
+
+	if( e < g_iPackInfoSize )
+	{
+		info = &g_pPackInfo[e];
+		if( info->frame == g_ulFrameCount )
+			return info;
+	}
+	else
+	{
+		// out of memory, built for this call only and not kept
+		info = &scratch;
+	}
+
+	flags = 0;
 
-	// Ignore ents without valid / visible models
 	if( !ent->v.modelindex || !STRING( ent->v.model ) )
-		return 0;
+		flags |= PACK_NOMODEL;
+
+	if( ent->v.effects & EF_NODRAW )
+		flags |= PACK_NODRAW;
+
+	if( ent->v.flags & FL_SPECTATOR )
+		flags |= PACK_SPECTATOR;
+
+	if( ent->v.flags & FL_CUSTOMENTITY )
+		flags |= PACK_CUSTOM;
+
+	if( ent->v.flags & FL_SKIPLOCALHOST )
+		flags |= PACK_SKIPLOCAL;
+
+	// env_sky is visible always
+	if( !( flags & ( PACK_NOMODEL | PACK_NODRAW ) ) && FClassnameIs( ent, "env_sky" ) )
+		flags |= PACK_ALWAYS;
+
+	info->frame = g_ulFrameCount;
+	info->flags = flags;
+	info->groupinfo = ent->v.groupinfo;
+	info->policy = NetDelta_Policy( ent );
+
+	g_PackStats.built++;
 
-	// Don't send spectators to other players
-	if( ( ent->v.flags & FL_SPECTATOR ) && ( ent != host ) )
+	return info;
+}
+
+static void PackStats_Add( int result, double time )
+{
+	packstats_t *ps = &g_PackStats;
+	int i;
+
+	if( ps->lastframe != g_ulFrameCount )
 	{
-		return 0;
+		ps->lastframe = g_ulFrameCount;
+		ps->ticks++;
 	}
 
-	// Ignore if not the host and not touching a PVS/PAS leaf
-	// If pSet is NULL, then the test will always succeed and the entity will be added to the update
-	if( ent != host )
+	ps->offered++;
+	ps->time += time;
+
+	if( result == PACK_SENT )
+		ps->sent++;
+	else
+		ps->rejects[result]++;
+
+	if( gpGlobals->time < ps->next )
+		return;
+
+	if( ps->ticks > 1 )
 	{
-		if( !ENGINE_CHECK_VISIBILITY( (const struct edict_s *)ent, pSet ) )
+		char reasons[256];
+		int len = 0;
+		float scale = 1.0f / ps->ticks;
+
+		reasons[0] = '\0';
+		for( i = 0; i < PACK_REJECTS; i++ )
 		{
-			// env_sky is visible always
-			if( !FClassnameIs( ent, "env_sky" ) )
-			{
-				return 0;
-			}
+			len += snprintf( reasons + len, sizeof( reasons ) - len, " %s %.1f", g_szPackReject[i], ps->rejects[i] * scale );
+			if( len >= (int)sizeof( reasons ) )
+				break;
 		}
+
+		ALERT( at_console, "pack: %.1f us/tick, %.1f offered %.1f sent %.1f built per tick, rejects%s\n",
+			ps->time * 1e6 * scale, ps->offered * scale, ps->sent * scale, ps->built * scale, reasons );
+	}
+
+	memset( ps, 0, sizeof( *ps ) );
+	ps->lastframe = g_ulFrameCount;
+	ps->ticks = 1;
+	ps->next = gpGlobals->time + 1.0f;
+}
+
+static int PackEntity( struct entity_state_s *state, int e, edict_t *ent, edict_t *host, int hostflags, int player, unsigned char *pSet )
+{
+	packinfo_t *info = PackInfo_Get( e, ent );
+	int flags = info->flags;
+	int i;
+
+	// don't send if flagged for NODRAW and it's not the host getting the message
+	if( ( flags & PACK_NODRAW ) && ( ent != host ) )
+		return PACK_REJECT_NODRAW;
+
+	// Ignore ents without valid / visible models
+	if( flags & PACK_NOMODEL )
+		return PACK_REJECT_NOMODEL;
+
+	if( ent != host )
+	{
+		// Don't send spectators to other players
+		if( flags & PACK_SPECTATOR )
+			return PACK_REJECT_SPECTATOR;
+
+		// Ignore if not touching a PVS/PAS leaf
+		// If pSet is NULL, then the test will always succeed and the entity will be added to the update
+		if( !( flags & PACK_ALWAYS ) && !ENGINE_CHECK_VISIBILITY( (const struct edict_s *)ent, pSet ) )
+			return PACK_REJECT_PVS;
 	}
 
 	// Don't send entity to local client if the client says it's predicting the entity itself.
-	if( ent->v.flags & FL_SKIPLOCALHOST )
+	if( flags & PACK_SKIPLOCAL )
 	{
 		if( hostflags & 4 )
-			return 0; // it's a portal pass
+			return PACK_REJECT_LOCALHOST; // it's a portal pass
 
 		if( ( hostflags & 1 ) && ( ent->v.owner == host ) )
-			return 0;
+			return PACK_REJECT_LOCALHOST;
 	}
-	
-	if( host->v.groupinfo )
-	{
-		UTIL_SetGroupTrace( host->v.groupinfo, GROUP_OP_AND );
 
-		// Should always be set, of course
-		if( ent->v.groupinfo )
-		{
-			if( g_groupop == GROUP_OP_AND )
-			{
-				if( !( ent->v.groupinfo & host->v.groupinfo ) )
-					return 0;
-			}
-			else if( g_groupop == GROUP_OP_NAND )
-			{
-				if( ent->v.groupinfo & host->v.groupinfo )
-					return 0;
-			}
-		}
-
-		UTIL_UnsetGroupTrace();
-	}
+	// Same test an AND group trace with the host's groupinfo would make
+	if( host->v.groupinfo && info->groupinfo && !( info->groupinfo & host->v.groupinfo ) )
+		return PACK_REJECT_GROUP;
 
 	memset( state, 0, sizeof(*state) );
 
@@ -1369,7 +1556,7 @@ int AddToFullPack( struct entity_state_s *state, int e, edict_t *ent, edict_t *h
 	state->entityType = ENTITY_NORMAL;
 
 	// Flag custom entities.
-	if( ent->v.flags & FL_CUSTOMENTITY )
+	if( flags & PACK_CUSTOM )
 	{
 		state->entityType = ENTITY_BEAM;
 	}
@@ -1485,7 +1672,39 @@ int AddToFullPack( struct entity_state_s *state, int e, edict_t *ent, edict_t *h
 		state->health		= (int)ent->v.health;
 	}
 
-	return 1;
+	// Coarser values for this class, see netdelta.cpp
+	if( info->policy >= 0 )
+		NetDelta_Quantize( info->policy, state );
+
+	return PACK_SENT;
+}
+
+/*
+AddToFullPack
+
+Return 1 if the entity state has been filled in for the ent and the entity will be propagated to the client, 0 otherwise
+
+state is the server maintained copy of the state info that is transmitted to the client
+a MOD could alter values copied into state to send the "host" a different look for a particular entity update, etc.
+e and ent are the entity that is being added to the update, if 1 is returned
+host is the player's edict of the player whom we are sending the update to
+player is 1 if the ent/e is a player and 0 otherwise
+pSet is either the PAS or PVS that we previous set up.  We can use it to ask the engine to filter the entity against the PAS or PVS.
+we could also use the pas/ pvs that we set in SetupVisibility, if we wanted to.  Caching the value is valid in that case, but still only for the current frame
+*/
+int AddToFullPack( struct entity_state_s *state, int e, edict_t *ent, edict_t *host, int hostflags, int player, unsigned char *pSet )
+{
+	double start;
+	int result;
+
+	if( !sv_packstats.value )
+		return PackEntity( state, e, ent, host, hostflags, player, pSet ) == PACK_SENT;
+
+	start = UTIL_PerfTime();
+	result = PackEntity( state, e, ent, host, hostflags, player, pSet );
+	PackStats_Add( result, UTIL_PerfTime() - start );
+
+	return result == PACK_SENT;
 }
 
 // defaults for clientinfo messages
@@ -1545,12 +1764,6 @@ void CreateBaseline( int player, int eindex, struct entity_state_s *baseline, st
 	}
 }
 
-typedef struct
-{
-	char name[32];
-	int field;
-} entity_field_alias_t;
-
 #define FIELD_ORIGIN0			0
 #define FIELD_ORIGIN1			1
 #define FIELD_ORIGIN2			2
@@ -1558,6 +1771,10 @@ typedef struct
 #define FIELD_ANGLES1			4
 #define FIELD_ANGLES2			5
 
+// Unset or force a field by alias, and keep track of it for sv_deltastats
+#define ENCODE_UNSET( alias, i )	( DELTA_UNSETBYINDEX( pFields, alias[i].field ), unset |= ( 1 << ( i ) ), forced &= ~( 1 << ( i ) ) )
+#define ENCODE_SET( alias, i )		( DELTA_SETBYINDEX( pFields, alias[i].field ), forced |= ( 1 << ( i ) ), unset &= ~( 1 << ( i ) ) )
+
 static entity_field_alias_t entity_field_alias[] =
 {
 	{ "origin[0]",			0 },
@@ -1568,16 +1785,6 @@ static entity_field_alias_t entity_field_alias[] =
 	{ "angles[2]",			0 },
 };
 
-void Entity_FieldInit( struct delta_s *pFields )
-{
-	entity_field_alias[FIELD_ORIGIN0].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ORIGIN0].name );
-	entity_field_alias[FIELD_ORIGIN1].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ORIGIN1].name );
-	entity_field_alias[FIELD_ORIGIN2].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ORIGIN2].name );
-	entity_field_alias[FIELD_ANGLES0].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ANGLES0].name );
-	entity_field_alias[FIELD_ANGLES1].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ANGLES1].name );
-	entity_field_alias[FIELD_ANGLES2].field		= DELTA_FINDFIELD( pFields, entity_field_alias[FIELD_ANGLES2].name );
-}
-
 /*
 ==================
 Entity_Encode
@@ -1590,13 +1797,10 @@ void Entity_Encode( struct delta_s *pFields, const unsigned char *from, const un
 {
 	entity_state_t *f, *t;
 	int localplayer = 0;
-	static int initialized = 0;
+	int unset = 0, forced = 0;
+	static struct delta_s *bound = NULL;
 
-	if( !initialized )
-	{
-		Entity_FieldInit( pFields );
-		initialized = 1;
-	}
+	NetDelta_BindAliases( pFields, &bound, entity_field_alias, ARRAYSIZE( entity_field_alias ) );
 
 	f = (entity_state_t *)from;
 	t = (entity_state_t *)to;
@@ -1605,35 +1809,38 @@ void Entity_Encode( struct delta_s *pFields, const unsigned char *from, const un
 	localplayer = ( t->number - 1 ) == ENGINE_CURRENT_PLAYER();
 	if( localplayer )
 	{
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN0 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN1 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN2 );
 	}
 
 	if( ( t->impacttime != 0 ) && ( t->starttime != 0 ) )
 	{
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN0 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN1 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN2 );
 
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ANGLES0].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ANGLES1].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ANGLES2].field );
+		ENCODE_UNSET( entity_field_alias, FIELD_ANGLES0 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ANGLES1 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ANGLES2 );
 	}
 
 	if( ( t->movetype == MOVETYPE_FOLLOW ) &&
 		( t->aiment != 0 ) )
 	{
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN0 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN1 );
+		ENCODE_UNSET( entity_field_alias, FIELD_ORIGIN2 );
 	}
 	else if( t->aiment != f->aiment )
 	{
-		DELTA_SETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN0].field );
-		DELTA_SETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN1].field );
-		DELTA_SETBYINDEX( pFields, entity_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_SET( entity_field_alias, FIELD_ORIGIN0 );
+		ENCODE_SET( entity_field_alias, FIELD_ORIGIN1 );
+		ENCODE_SET( entity_field_alias, FIELD_ORIGIN2 );
 	}
+
+	if( sv_deltastats.value )
+		NetDelta_Record( NETDELTA_ENTITY, f, t, entity_field_alias, unset, forced );
 }
 
 static entity_field_alias_t player_field_alias[] =
@@ -1643,13 +1850,6 @@ static entity_field_alias_t player_field_alias[] =
 	{ "origin[2]",			0 },
 };
 
-void Player_FieldInit( struct delta_s *pFields )
-{
-	player_field_alias[FIELD_ORIGIN0].field		= DELTA_FINDFIELD( pFields, player_field_alias[FIELD_ORIGIN0].name );
-	player_field_alias[FIELD_ORIGIN1].field		= DELTA_FINDFIELD( pFields, player_field_alias[FIELD_ORIGIN1].name );
-	player_field_alias[FIELD_ORIGIN2].field		= DELTA_FINDFIELD( pFields, player_field_alias[FIELD_ORIGIN2].name );
-}
-
 /*
 ==================
 Player_Encode
@@ -1661,13 +1861,10 @@ void Player_Encode( struct delta_s *pFields, const unsigned char *from, const un
 {
 	entity_state_t *f, *t;
 	int localplayer = 0;
-	static int initialized = 0;
+	int unset = 0, forced = 0;
+	static struct delta_s *bound = NULL;
 
-	if( !initialized )
-	{
-		Player_FieldInit( pFields );
-		initialized = 1;
-	}
+	NetDelta_BindAliases( pFields, &bound, player_field_alias, ARRAYSIZE( player_field_alias ) );
 
 	f = (entity_state_t *)from;
 	t = (entity_state_t *)to;
@@ -1676,24 +1873,27 @@ void Player_Encode( struct delta_s *pFields, const unsigned char *from, const un
 	localplayer = ( t->number - 1 ) == ENGINE_CURRENT_PLAYER();
 	if( localplayer )
 	{
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN0 );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN1 );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN2 );
 	}
 
 	if( ( t->movetype == MOVETYPE_FOLLOW ) &&
 		 ( t->aiment != 0 ) )
 	{
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN0 );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN1 );
+		ENCODE_UNSET( player_field_alias, FIELD_ORIGIN2 );
 	}
 	else if( t->aiment != f->aiment )
 	{
-		DELTA_SETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN0].field );
-		DELTA_SETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN1].field );
-		DELTA_SETBYINDEX( pFields, player_field_alias[FIELD_ORIGIN2].field );
+		ENCODE_SET( player_field_alias, FIELD_ORIGIN0 );
+		ENCODE_SET( player_field_alias, FIELD_ORIGIN1 );
+		ENCODE_SET( player_field_alias, FIELD_ORIGIN2 );
 	}
+
+	if( sv_deltastats.value )
+		NetDelta_Record( NETDELTA_PLAYER, f, t, player_field_alias, unset, forced );
 }
 
 #define CUSTOMFIELD_ORIGIN0			0
@@ -1719,19 +1919,6 @@ entity_field_alias_t custom_entity_field_alias[] =
 	{ "animtime",			0 },
 };
 
-void Custom_Entity_FieldInit( struct delta_s *pFields )
-{
-	custom_entity_field_alias[CUSTOMFIELD_ORIGIN0].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN0].name );
-	custom_entity_field_alias[CUSTOMFIELD_ORIGIN1].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN1].name );
-	custom_entity_field_alias[CUSTOMFIELD_ORIGIN2].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN2].name );
-	custom_entity_field_alias[CUSTOMFIELD_ANGLES0].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES0].name );
-	custom_entity_field_alias[CUSTOMFIELD_ANGLES1].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES1].name );
-	custom_entity_field_alias[CUSTOMFIELD_ANGLES2].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES2].name );
-	custom_entity_field_alias[CUSTOMFIELD_SKIN].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_SKIN].name );
-	custom_entity_field_alias[CUSTOMFIELD_SEQUENCE].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_SEQUENCE].name );
-	custom_entity_field_alias[CUSTOMFIELD_ANIMTIME].field = DELTA_FINDFIELD( pFields, custom_entity_field_alias[CUSTOMFIELD_ANIMTIME].name );
-}
-
 /*
 ==================
 Custom_Encode
@@ -1744,13 +1931,10 @@ void Custom_Encode( struct delta_s *pFields, const unsigned char *from, const un
 {
 	entity_state_t *f, *t;
 	int beamType;
-	static int initialized = 0;
+	int unset = 0, forced = 0;
+	static struct delta_s *bound = NULL;
 
-	if( !initialized )
-	{
-		Custom_Entity_FieldInit( pFields );
-		initialized = 1;
-	}
+	NetDelta_BindAliases( pFields, &bound, custom_entity_field_alias, ARRAYSIZE( custom_entity_field_alias ) );
 
 	f = (entity_state_t *)from;
 	t = (entity_state_t *)to;
@@ -1759,30 +1943,33 @@ void Custom_Encode( struct delta_s *pFields, const unsigned char *from, const un
 
 	if( beamType != BEAM_POINTS && beamType != BEAM_ENTPOINT )
 	{
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN0].field );
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN1].field );
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ORIGIN2].field );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ORIGIN0 );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ORIGIN1 );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ORIGIN2 );
 	}
 
 	if( beamType != BEAM_POINTS )
 	{
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES0].field );
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES1].field );
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ANGLES2].field );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ANGLES0 );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ANGLES1 );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ANGLES2 );
 	}
 
 	if( beamType != BEAM_ENTS && beamType != BEAM_ENTPOINT )
 	{
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_SKIN].field );
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_SEQUENCE].field );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_SKIN );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_SEQUENCE );
 	}
 
 	// animtime is compared by rounding first
 	// see if we really shouldn't actually send it
 	if( (int)f->animtime == (int)t->animtime )
 	{
-		DELTA_UNSETBYINDEX( pFields, custom_entity_field_alias[CUSTOMFIELD_ANIMTIME].field );
+		ENCODE_UNSET( custom_entity_field_alias, CUSTOMFIELD_ANIMTIME );
 	}
+
+	if( sv_deltastats.value )
+		NetDelta_Record( NETDELTA_CUSTOM, f, t, custom_entity_field_alias, unset, forced );
 }
 
 /*
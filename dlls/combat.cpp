@@ -29,9 +29,12 @@
 #include "animation.h"
 #include "weapons.h"
 #include "func_break.h"
+#include "game.h"
+#include "sightcache.h"
 
 extern DLL_GLOBAL Vector		g_vecAttackDir;
 extern DLL_GLOBAL int			g_iSkillLevel;
+extern DLL_GLOBAL ULONG			g_ulFrameCount;
 
 extern Vector VecBModelOrigin( entvars_t *pevBModel );
 extern entvars_t *g_pevLastInflictor;
@@ -1009,16 +1012,146 @@ float CBaseMonster::DamageForce( float damage )
 	return force;
 }
 
+//=========================================================
+// Blast resolution
+//
+// Explosions of one server frame remember the line of sight
+// trace they did to each victim. A later blast whose centre
+// is within sv_blastshare units of an earlier one, on the same
+// side of the water line, reuses that trace for the same
+// victim instead of tracing again. Pipebombs detonated
+// together or grenades going off in a pile mostly trace the
+// same lines. Off by default, the shared line is an
+// approximation of this blast's own.
+//
+// Only clear traces are shared: a blocked one may have been
+// blocked by this blast's own inflictor, or by something a
+// blast has since broken. The end of a shared trace is moved
+// to this blast's own body target, so the distance and the
+// damage are this blast's. Once any blast kills or removes a
+// victim the world has changed, and the frame's traces are
+// dropped; so are they before each player's usercmd and
+// before a pusher moves.
+//=========================================================
+#define MAX_FRAME_BLASTS	32	// blasts per frame whose traces are kept
+#define MAX_BLAST_TRACES	64	// traces kept per blast
+#define MAX_BLAST_TARGETS	128	// victims gathered before damage is applied
+
+typedef struct blasttrace_s
+{
+	int		target;		// edict index
+	TraceResult	tr;
+} blasttrace_t;
+
+typedef struct blast_s
+{
+	Vector		vecSrc;
+	int		bInWater;
+	int		numtraces;
+	blasttrace_t	traces[MAX_BLAST_TRACES];
+} blast_t;
+
+static blast_t	s_FrameBlasts[MAX_FRAME_BLASTS];
+static int	s_nFrameBlasts;
+static ULONG	s_ulBlastFrame = (ULONG)-1;
+static int	s_nBlastKills;		// bumped when a blast kills or removes a victim
+
+// This frame's counters
+static int	s_nBlasts;
+static int	s_nBlastTraces;
+static int	s_nBlastTracesSaved;
+
+//
+// BlastBeginFrame - forget the previous frame's blasts, report its counters
+//
+static void BlastBeginFrame( void )
+{
+	if( s_ulBlastFrame == g_ulFrameCount )
+		return;
+
+	if( sv_blaststats.value && s_nBlasts )
+	{
+		ALERT( at_console, "frame %u: %i blasts, %i traces issued, %i saved\n",
+			s_ulBlastFrame, s_nBlasts, s_nBlastTraces, s_nBlastTracesSaved );
+	}
+
+	s_ulBlastFrame = g_ulFrameCount;
+	s_nFrameBlasts = 0;
+	s_nBlasts = 0;
+	s_nBlastTraces = 0;
+	s_nBlastTracesSaved = 0;
+}
+
+//
+// ClearBlastTraces - the world moved outside of a blast, nothing is shared past here
+//
+void ClearBlastTraces( void )
+{
+	s_nFrameBlasts = 0;
+}
+
+//
+// BlastFindShared - earlier blast of this frame close enough to share traces with
+//
+static blast_t *BlastFindShared( const Vector &vecSrc, int bInWater )
+{
+	float flShare = sv_blastshare.value;
+	int i;
+
+	if( flShare <= 0.0f )
+		return NULL;
+
+	for( i = 0; i < s_nFrameBlasts; i++ )
+	{
+		blast_t *pBlast = &s_FrameBlasts[i];
+
+		if( pBlast->bInWater != bInWater )
+			continue;
+
+		if( ( pBlast->vecSrc - vecSrc ).Length() <= flShare )
+			return pBlast;
+	}
+
+	return NULL;
+}
+
+static TraceResult *BlastFindTrace( blast_t *pBlast, int target )
+{
+	int i;
+
+	for( i = 0; i < pBlast->numtraces; i++ )
+	{
+		if( pBlast->traces[i].target != target )
+			continue;
+
+		TraceResult *tr = &pBlast->traces[i].tr;
+
+		if( tr->flFraction == 1.0f && !tr->fStartSolid && !tr->fAllSolid )
+			return tr;
+		return NULL;
+	}
+
+	return NULL;
+}
+
 //
 // RadiusDamage - this entity is exploding, or otherwise needs to inflict damage upon entities within a certain range.
 // 
 // only damage ents that can clearly be seen by the explosion!
+//
+// Victims are gathered first and then damaged in edict order, so
+// entities spawned or moved by the damage itself don't change who
+// this blast hits.
 void RadiusDamage( Vector vecSrc, entvars_t *pevInflictor, entvars_t *pevAttacker, float flDamage, float flRadius, int iClassIgnore, int bitsDamageType )
 {
-	CBaseEntity *pEntity = NULL;
-	TraceResult	tr;
+	CBaseEntity *pEntity;
+	edict_t		*pentScan, *pentResume;
+	EHANDLE		hTargets[MAX_BLAST_TARGETS];
+	blast_t		*pBlast, *pShared;
+	TraceResult	tr, *pShare;
 	float		flAdjustedDamage, falloff;
 	Vector		vecSpot;
+	int		i, count, target, kills;
 
 	if( flRadius )
 		falloff = flDamage / flRadius;
@@ -1032,29 +1165,88 @@ void RadiusDamage( Vector vecSrc, entvars_t *pevInflictor, entvars_t *pevAttacke
 	if( !pevAttacker )
 		pevAttacker = pevInflictor;
 
-	// iterate on all entities in the vicinity.
-	while( ( pEntity = UTIL_FindEntityInSphere( pEntity, vecSrc, flRadius ) ) != NULL )
+	BlastBeginFrame();
+
+	s_nBlasts++;
+	pShared = BlastFindShared( vecSrc, bInWater );
+
+	// Keep this blast's traces for the ones that follow
+	pBlast = NULL;
+	if( s_nFrameBlasts < MAX_FRAME_BLASTS )
+	{
+		pBlast = &s_FrameBlasts[s_nFrameBlasts++];
+		pBlast->vecSrc = vecSrc;
+		pBlast->bInWater = bInWater;
+		pBlast->numtraces = 0;
+	}
+
+	kills = s_nBlastKills;
+	pentResume = NULL;
+
+	do
 	{
-		if( pEntity->pev->takedamage != DAMAGE_NO )
+		// iterate on all entities in the vicinity.
+		count = 0;
+		pentScan = pentResume;
+		while( count < MAX_BLAST_TARGETS && ( pentScan = UTIL_FindEdictInSphere( pentScan, vecSrc, flRadius ) ) != NULL )
 		{
-			// UNDONE: this should check a damage mask, not an ignore
-			if( iClassIgnore != CLASS_NONE && pEntity->Classify() == iClassIgnore )
+			pEntity = CBaseEntity::Instance( pentScan );
+
+			if( pEntity && pEntity->pev->takedamage != DAMAGE_NO )
 			{
-				// houndeyes don't hurt other houndeyes with their attack
-				continue;
+				// UNDONE: this should check a damage mask, not an ignore
+				if( iClassIgnore != CLASS_NONE && pEntity->Classify() == iClassIgnore )
+				{
+					// houndeyes don't hurt other houndeyes with their attack
+					continue;
+				}
+
+				// blast's don't tavel into or out of water
+				if( bInWater && pEntity->pev->waterlevel == 0 )
+					continue;
+				if( !bInWater && pEntity->pev->waterlevel == 3 )
+					continue;
+
+				hTargets[count++] = pEntity;
 			}
+		}
 
-			// blast's don't tavel into or out of water
-			if( bInWater && pEntity->pev->waterlevel == 0 )
-				continue;
-			if( !bInWater && pEntity->pev->waterlevel == 3 )
+		// the edict, not the entity: it can be removed before the next batch
+		pentResume = pentScan;
+
+		for( i = 0; i < count; i++ )
+		{
+			CBaseEntity *pTarget = hTargets[i];
+
+			// Removed by an earlier victim's death
+			if( !pTarget || pTarget->pev->takedamage == DAMAGE_NO )
 				continue;
 
-			vecSpot = pEntity->BodyTarget( vecSrc );
+			vecSpot = pTarget->BodyTarget( vecSrc );
+			target = pTarget->entindex();
 
-			UTIL_TraceLine( vecSrc, vecSpot, dont_ignore_monsters, ENT( pevInflictor ), &tr );
+			pShare = pShared ? BlastFindTrace( pShared, target ) : NULL;
+			if( pShare )
+			{
+				// clear all the way, so it ends where this blast aimed
+				tr = *pShare;
+				tr.vecEndPos = vecSpot;
+				s_nBlastTracesSaved++;
+			}
+			else
+			{
+				UTIL_TraceLine( vecSrc, vecSpot, dont_ignore_monsters, ENT( pevInflictor ), &tr );
+				s_nBlastTraces++;
+			}
+
+			if( pBlast && pBlast->numtraces < MAX_BLAST_TRACES )
+			{
+				pBlast->traces[pBlast->numtraces].target = target;
+				pBlast->traces[pBlast->numtraces].tr = tr;
+				pBlast->numtraces++;
+			}
 
-			if( tr.flFraction == 1.0f || tr.pHit == pEntity->edict() )
+			if( tr.flFraction == 1.0f || tr.pHit == pTarget->edict() )
 			{
 				// the explosion can 'see' this entity, so hurt them!
 				if( tr.fStartSolid )
@@ -1073,20 +1265,35 @@ void RadiusDamage( Vector vecSrc, entvars_t *pevInflictor, entvars_t *pevAttacke
 					flAdjustedDamage = 0.0f;
 				}
 
-				// ALERT( at_console, "hit %s\n", STRING( pEntity->pev->classname ) );
+				// ALERT( at_console, "hit %s\n", STRING( pTarget->pev->classname ) );
 				if( tr.flFraction != 1.0f )
 				{
 					ClearMultiDamage();
-					pEntity->TraceAttack( pevInflictor, flAdjustedDamage, ( tr.vecEndPos - vecSrc ).Normalize(), &tr, bitsDamageType );
+					pTarget->TraceAttack( pevInflictor, flAdjustedDamage, ( tr.vecEndPos - vecSrc ).Normalize(), &tr, bitsDamageType );
 					ApplyMultiDamage( pevInflictor, pevAttacker );
 				}
 				else
 				{
-					pEntity->TakeDamage ( pevInflictor, pevAttacker, flAdjustedDamage, bitsDamageType );
+					pTarget->TakeDamage ( pevInflictor, pevAttacker, flAdjustedDamage, bitsDamageType );
 				}
+
+				pTarget = hTargets[i];
+				if( !pTarget || pTarget->pev->health <= 0.0f || ( pTarget->pev->flags & FL_KILLME ) )
+					s_nBlastKills++;
+			}
+
+			// this blast, or one set off by it, changed the world
+			if( kills != s_nBlastKills )
+			{
+				kills = s_nBlastKills;
+				s_nFrameBlasts = 0;
+				pBlast = NULL;
+				pShared = NULL;
 			}
 		}
-	}
+
+		// More victims than fit in one batch, carry on after the last one
+	} while( count == MAX_BLAST_TARGETS && pentResume != NULL );
 }
 
 void CBaseMonster::RadiusDamage( entvars_t *pevInflictor, entvars_t *pevAttacker, float flDamage, int iClassIgnore, int bitsDamageType )
@@ -1197,7 +1404,6 @@ BOOL CBaseMonster::FInViewCone( Vector *pOrigin )
 //=========================================================
 BOOL CBaseEntity::FVisible( CBaseEntity *pEntity )
 {
-	TraceResult tr;
 	Vector		vecLookerOrigin;
 	Vector		vecTargetOrigin;
 
@@ -1217,16 +1423,8 @@ BOOL CBaseEntity::FVisible( CBaseEntity *pEntity )
 	vecLookerOrigin = pev->origin + pev->view_ofs;//look through the caller's 'eyes'
 	vecTargetOrigin = pEntity->EyePosition();
 
-	UTIL_TraceLine( vecLookerOrigin, vecTargetOrigin, ignore_monsters, ignore_glass, ENT( pev )/*pentIgnore*/, &tr );
-
-	if( tr.flFraction != 1.0f )
-	{
-		return FALSE;// Line of sight is not established
-	}
-	else
-	{
-		return TRUE;// line of sight is valid.
-	}
+	// the same trace as pEntity looking back at us, if it did so this frame
+	return SightCache_Visible( ENT( pev ), vecLookerOrigin, pEntity->edict(), vecTargetOrigin );
 }
 
 //=========================================================
@@ -0,0 +1,570 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== entgrid.cpp ========================================================
+
+  Hashed uniform grid over the live edicts.
+
+  Every edict is linked into the cells covered by its absmin / absmax and
+  origin, grown by a margin plus the distance it can travel before the next
+  refresh. Edicts that would need more than ENTGRID_MAX_LINKS cells go on one
+  oversized list that every query walks. Links are refreshed from
+  UTIL_SetOrigin / UTIL_SetSize, for players after each PlayerPostThink and
+  for all edicts in StartFrame, an edict is only relinked once it leaves the
+  cells it is in. Queries hand back candidate indices in edict order, the
+  callers still run their exact tests on them.
+
+  The distance covered before the next refresh is taken from the velocity at
+  the time, but never less than one physics step at sv_maxvelocity, so an
+  edict that is given speed later in the frame, by its own think, a touch or
+  a knockback, is still in the cells it moves into. Players run usercmds of
+  any length between frames, which is why they relink after each one. Queries
+  can still miss an edict moved faster than that: basevelocity from conveyors
+  on top of sv_maxvelocity, MOVETYPE_FOLLOW edicts carried by a player, and
+  pushers faster than sv_maxvelocity.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entgrid.h"
+
+cvar_t sv_entgrid = { "sv_entgrid", "1", FCVAR_SERVER };	// 2 checks every query against a full scan
+
+typedef struct gridlink_s
+{
+	struct gridlink_s	*prev;
+	struct gridlink_s	*next;
+	int			ent;
+} gridlink_t;
+
+typedef struct grident_s
+{
+	gridlink_t	links[ENTGRID_MAX_LINKS];
+	int		numlinks;	// 0 when not in the grid
+	int		oversized;	// links[0] is on the oversized list
+	int		cmins[3];	// cells covered
+	int		cmaxs[3];
+	int		querymark;
+} grident_t;
+
+static gridlink_t	s_Buckets[ENTGRID_BUCKETS];
+static gridlink_t	s_Oversized;
+static grident_t	*s_pEnts;
+static int		*s_pCandidates;
+static int		s_nMaxEnts;
+static int		s_nQueryMark;
+static int		s_nSerial;
+static int		s_fActive;
+static int		s_fClientActive[ENTGRID_MAX_CLIENTS + 1];
+static float		s_flMaxStep;	// one physics step at sv_maxvelocity
+
+static inline unsigned int EntGrid_Hash( int x, int y, int z )
+{
+	return ( (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u ) & ( ENTGRID_BUCKETS - 1 );
+}
+
+static inline int EntGrid_Cell( float f )
+{
+	return (int)floor( f * ( 1.0f / ENTGRID_CELL_SIZE ) );
+}
+
+static void EntGrid_ResetLists( void )
+{
+	int i;
+
+	for( i = 0; i < ENTGRID_BUCKETS; i++ )
+		s_Buckets[i].prev = s_Buckets[i].next = &s_Buckets[i];
+
+	s_Oversized.prev = s_Oversized.next = &s_Oversized;
+}
+
+static void EntGrid_InsertLink( gridlink_t *head, gridlink_t *link )
+{
+	link->next = head->next;
+	link->prev = head;
+	head->next->prev = link;
+	head->next = link;
+}
+
+static void EntGrid_Unlink( grident_t *e )
+{
+	int i;
+
+	for( i = 0; i < e->numlinks; i++ )
+	{
+		e->links[i].prev->next = e->links[i].next;
+		e->links[i].next->prev = e->links[i].prev;
+	}
+
+	if( e->numlinks )
+		s_nSerial++;
+
+	e->numlinks = 0;
+	e->oversized = 0;
+}
+
+/*
+================
+EntGrid_Alloc
+
+Sized from maxEntities, everything is dropped if that changes
+================
+*/
+static int EntGrid_Alloc( void )
+{
+	if( s_pEnts && s_nMaxEnts == gpGlobals->maxEntities )
+		return 1;
+
+	delete[] s_pEnts;
+	delete[] s_pCandidates;
+
+	s_nMaxEnts = gpGlobals->maxEntities;
+	if( s_nMaxEnts <= 0 )
+	{
+		s_pEnts = NULL;
+		s_pCandidates = NULL;
+		return 0;
+	}
+
+	s_pEnts = new grident_t[s_nMaxEnts];
+	s_pCandidates = new int[s_nMaxEnts];
+	memset( s_pEnts, 0, s_nMaxEnts * sizeof( grident_t ) );
+
+	EntGrid_ResetLists();
+	s_fActive = 0;
+	s_nSerial++;
+
+	return 1;
+}
+
+/*
+================
+EntGrid_Relink
+
+Link index into the cells around its box, unless the box plus the distance
+it can cover before the next refresh still fits the cells it is linked in
+================
+*/
+static void EntGrid_Relink( int index, edict_t *pent )
+{
+	grident_t *e = &s_pEnts[index];
+	float lo[3], hi[3], lead, speed;
+	int clo[3], chi[3], cells;
+	int i, x, y, z;
+
+	if( pent->free )
+	{
+		EntGrid_Unlink( e );
+		return;
+	}
+
+	speed = pent->v.velocity.Length();
+	lead = gpGlobals->frametime * 2.0f;
+	if( lead < 0.05f )
+		lead = 0.05f;
+	lead *= speed;
+
+	// velocity can still be set after this, before the edict moves
+	if( lead < s_flMaxStep )
+		lead = s_flMaxStep;
+
+	for( i = 0; i < 3; i++ )
+	{
+		lo[i] = Q_min( pent->v.absmin[i], pent->v.origin[i] ) - lead;
+		hi[i] = Q_max( pent->v.absmax[i], pent->v.origin[i] ) + lead;
+	}
+
+	if( e->numlinks )
+	{
+		for( i = 0; i < 3; i++ )
+		{
+			if( EntGrid_Cell( lo[i] ) < e->cmins[i] || EntGrid_Cell( hi[i] ) > e->cmaxs[i] )
+				break;
+		}
+
+		// Still inside
+		if( i == 3 )
+			return;
+	}
+
+	EntGrid_Unlink( e );
+
+	cells = 1;
+	for( i = 0; i < 3; i++ )
+	{
+		clo[i] = EntGrid_Cell( lo[i] - ENTGRID_MARGIN );
+		chi[i] = EntGrid_Cell( hi[i] + ENTGRID_MARGIN );
+		e->cmins[i] = clo[i];
+		e->cmaxs[i] = chi[i];
+		cells *= chi[i] - clo[i] + 1;
+	}
+
+	s_nSerial++;
+
+	if( cells > ENTGRID_MAX_LINKS )
+	{
+		e->links[0].ent = index;
+		EntGrid_InsertLink( &s_Oversized, &e->links[0] );
+		e->numlinks = 1;
+		e->oversized = 1;
+		return;
+	}
+
+	for( z = clo[2]; z <= chi[2]; z++ )
+	{
+		for( y = clo[1]; y <= chi[1]; y++ )
+		{
+			for( x = clo[0]; x <= chi[0]; x++ )
+			{
+				gridlink_t *link = &e->links[e->numlinks++];
+
+				link->ent = index;
+				EntGrid_InsertLink( &s_Buckets[EntGrid_Hash( x, y, z )], link );
+			}
+		}
+	}
+}
+
+/*
+================
+EntGrid_Link
+
+================
+*/
+void EntGrid_Link( edict_t *pent )
+{
+	int index;
+
+	if( !s_fActive || !pent )
+		return;
+
+	index = ENTINDEX( pent );
+	if( index <= 0 || index >= s_nMaxEnts )
+		return;
+
+	EntGrid_Relink( index, pent );
+}
+
+/*
+================
+EntGrid_Drop
+
+Empty the grid, the next EntGrid_Frame links everything again
+================
+*/
+static void EntGrid_Drop( void )
+{
+	if( s_pEnts )
+		memset( s_pEnts, 0, s_nMaxEnts * sizeof( grident_t ) );
+
+	EntGrid_ResetLists();
+	s_fActive = 0;
+	s_nSerial++;
+}
+
+/*
+================
+EntGrid_Frame
+
+Catch up with everything the engine moved since the last frame
+================
+*/
+void EntGrid_Frame( void )
+{
+	edict_t *pEdict;
+	int i;
+
+	if( !sv_entgrid.value )
+	{
+		if( s_fActive )
+			EntGrid_Drop();
+		return;
+	}
+
+	if( !EntGrid_Alloc() )
+		return;
+
+	pEdict = INDEXENT( 0 );
+	if( !pEdict )
+		return;
+
+	s_flMaxStep = CVAR_GET_FLOAT( "sv_maxvelocity" ) * gpGlobals->frametime;
+
+	for( i = 1, pEdict++; i < s_nMaxEnts; i++, pEdict++ )
+		EntGrid_Relink( i, pEdict );
+
+	s_fActive = 1;
+}
+
+/*
+================
+EntGrid_Clear
+
+Map is going away
+================
+*/
+void EntGrid_Clear( void )
+{
+	EntGrid_Drop();
+
+	memset( s_fClientActive, 0, sizeof( s_fClientActive ) );
+}
+
+void EntGrid_ClientActive( edict_t *pent, int active )
+{
+	int index = ENTINDEX( pent );
+
+	if( index > 0 && index <= ENTGRID_MAX_CLIENTS )
+		s_fClientActive[index] = active;
+}
+
+int EntGrid_IsClientActive( int index )
+{
+	if( index > 0 && index <= ENTGRID_MAX_CLIENTS )
+		return s_fClientActive[index];
+
+	return 0;
+}
+
+int EntGrid_Active( void )
+{
+	return s_fActive && sv_entgrid.value;
+}
+
+int EntGrid_Serial( void )
+{
+	return s_nSerial;
+}
+
+static int EntGrid_CompareIndex( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+================
+EntGrid_Gather
+
+================
+*/
+int EntGrid_Gather( const Vector &mins, const Vector &maxs, int after, int **ppList )
+{
+	gridlink_t *head, *link;
+	grident_t *e;
+	int clo[3], chi[3];
+	int i, x, y, z, count, mark;
+
+	if( !EntGrid_Active() )
+		return -1;
+
+	for( i = 0; i < 3; i++ )
+	{
+		clo[i] = EntGrid_Cell( mins[i] );
+		chi[i] = EntGrid_Cell( maxs[i] );
+	}
+
+	if( ( chi[0] - clo[0] + 1 ) * ( chi[1] - clo[1] + 1 ) * ( chi[2] - clo[2] + 1 ) > ENTGRID_MAX_CELLS )
+		return -1;
+
+	mark = ++s_nQueryMark;
+	count = 0;
+
+	for( z = clo[2]; z <= chi[2]; z++ )
+	{
+		for( y = clo[1]; y <= chi[1]; y++ )
+		{
+			for( x = clo[0]; x <= chi[0]; x++ )
+			{
+				head = &s_Buckets[EntGrid_Hash( x, y, z )];
+				for( link = head->next; link != head; link = link->next )
+				{
+					if( link->ent <= after )
+						continue;
+
+					e = &s_pEnts[link->ent];
+					if( e->querymark == mark )
+						continue;
+
+					// Another cell that hashed here
+					if( x < e->cmins[0] || x > e->cmaxs[0] || y < e->cmins[1] || y > e->cmaxs[1] || z < e->cmins[2] || z > e->cmaxs[2] )
+						continue;
+
+					e->querymark = mark;
+					s_pCandidates[count++] = link->ent;
+				}
+			}
+		}
+	}
+
+	for( link = s_Oversized.next; link != &s_Oversized; link = link->next )
+	{
+		if( link->ent <= after )
+			continue;
+
+		e = &s_pEnts[link->ent];
+		if( e->querymark == mark )
+			continue;
+
+		if( clo[0] > e->cmaxs[0] || chi[0] < e->cmins[0] || clo[1] > e->cmaxs[1] || chi[1] < e->cmins[1] || clo[2] > e->cmaxs[2] || chi[2] < e->cmins[2] )
+			continue;
+
+		e->querymark = mark;
+		s_pCandidates[count++] = link->ent;
+	}
+
+	// Callers walk them in edict order, like the full scans did
+	qsort( s_pCandidates, count, sizeof( int ), EntGrid_CompareIndex );
+
+	*ppList = s_pCandidates;
+	return count;
+}
+
+/*
+================
+EntGrid_BenchQueries
+
+Microseconds per box, sphere and RadiusDamage style iteration
+================
+*/
+static void EntGrid_BenchQueries( int queries, const Vector *pCenters, double *results )
+{
+	CBaseEntity *pList[256];
+	CBaseEntity *pEntity;
+	Vector extent( 128, 128, 128 );
+	double start;
+	int i;
+
+	start = UTIL_PerfTime();
+	for( i = 0; i < queries; i++ )
+		UTIL_EntitiesInBox( pList, 256, pCenters[i] - extent, pCenters[i] + extent, 0 );
+	results[0] = ( UTIL_PerfTime() - start ) * 1e6 / queries;
+
+	start = UTIL_PerfTime();
+	for( i = 0; i < queries; i++ )
+		UTIL_MonstersInSphere( pList, 256, pCenters[i], 256 );
+	results[1] = ( UTIL_PerfTime() - start ) * 1e6 / queries;
+
+	start = UTIL_PerfTime();
+	for( i = 0; i < queries; i++ )
+	{
+		pEntity = NULL;
+		while( ( pEntity = UTIL_FindEntityInSphere( pEntity, pCenters[i], 256 ) ) != NULL )
+			;
+	}
+	results[2] = ( UTIL_PerfTime() - start ) * 1e6 / queries;
+}
+
+/*
+================
+EntGrid_Bench
+
+sv_entgrid_bench [extra entities] [queries]
+================
+*/
+static void EntGrid_Bench( void )
+{
+	CBaseEntity **pExtra = NULL;
+	edict_t *pWorld = INDEXENT( 0 );
+	Vector *pCenters;
+	Vector wmins, wmaxs;
+	double grid[3], scan[3];
+	int extra, queries, i, used;
+	float saved;
+
+	if( !pWorld || !EntGrid_Active() )
+	{
+		ALERT( at_console, "sv_entgrid_bench: needs a running map with sv_entgrid enabled\n" );
+		return;
+	}
+
+	extra = ( CMD_ARGC() > 1 ) ? atoi( CMD_ARGV( 1 ) ) : 0;
+	queries = ( CMD_ARGC() > 2 ) ? atoi( CMD_ARGV( 2 ) ) : 1000;
+	if( queries < 1 )
+		queries = 1;
+
+	wmins = pWorld->v.absmin;
+	wmaxs = pWorld->v.absmax;
+
+	// Scatter point entities over the map to scale the edict count
+	if( extra > 0 )
+	{
+		pExtra = new CBaseEntity *[extra];
+		for( i = 0; i < extra; i++ )
+		{
+			Vector origin( RANDOM_FLOAT( wmins.x, wmaxs.x ), RANDOM_FLOAT( wmins.y, wmaxs.y ), RANDOM_FLOAT( wmins.z, wmaxs.z ) );
+
+			pExtra[i] = CBaseEntity::Create( "info_target", origin, g_vecZero );
+			if( pExtra[i] )
+				UTIL_SetSize( pExtra[i]->pev, Vector( -8, -8, -8 ), Vector( 8, 8, 8 ) );
+		}
+	}
+
+	pCenters = new Vector[queries];
+	for( i = 0; i < queries; i++ )
+		pCenters[i] = Vector( RANDOM_FLOAT( wmins.x, wmaxs.x ), RANDOM_FLOAT( wmins.y, wmaxs.y ), RANDOM_FLOAT( wmins.z, wmaxs.z ) );
+
+	EntGrid_BenchQueries( queries, pCenters, grid );
+
+	saved = sv_entgrid.value;
+	sv_entgrid.value = 0;
+	EntGrid_BenchQueries( queries, pCenters, scan );
+	sv_entgrid.value = saved;
+
+	delete[] pCenters;
+
+	used = 0;
+	for( i = 1; i < s_nMaxEnts; i++ )
+	{
+		if( !pWorld[i].free )
+			used++;
+	}
+
+	ALERT( at_console, "%i edicts in use, %i queries, microseconds per query grid / scan:\n", used, queries );
+	ALERT( at_console, "  box    %8.2f / %8.2f\n", grid[0], scan[0] );
+	ALERT( at_console, "  sphere %8.2f / %8.2f\n", grid[1], scan[1] );
+	ALERT( at_console, "  find   %8.2f / %8.2f\n", grid[2], scan[2] );
+
+	if( pExtra )
+	{
+		for( i = 0; i < extra; i++ )
+		{
+			if( !pExtra[i] )
+				continue;
+
+			edict_t *pent = pExtra[i]->edict();
+			REMOVE_ENTITY( pent );
+			EntGrid_Link( pent );
+		}
+
+		delete[] pExtra;
+	}
+}
+
+/*
+================
+EntGrid_Init
+
+================
+*/
+void EntGrid_Init( void )
+{
+	CVAR_REGISTER( &sv_entgrid );
+	g_engfuncs.pfnAddServerCommand( "sv_entgrid_bench", EntGrid_Bench );
+
+	EntGrid_ResetLists();
+}
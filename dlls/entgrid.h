@@ -0,0 +1,55 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// entgrid.h - hashed uniform grid over the live edicts,
+// backs the box and sphere queries in util.cpp
+//=========================================================
+#pragma once
+#ifndef ENTGRID_H
+#define ENTGRID_H
+
+#define ENTGRID_CELL_SIZE	256	// world units per cell edge
+#define ENTGRID_BUCKETS		4096	// hash buckets, power of two
+#define ENTGRID_MAX_LINKS	8	// cells per edict before it goes on the oversized list
+#define ENTGRID_MARGIN		16	// slack around each box so small moves don't relink
+#define ENTGRID_MAX_CELLS	512	// larger queries just scan every edict
+#define ENTGRID_MAX_CLIENTS	32
+
+extern cvar_t sv_entgrid;
+
+void EntGrid_Init( void );
+void EntGrid_Clear( void );
+
+// Relink after an origin / size change or a player's usercmd, and refresh
+// every edict once a frame
+void EntGrid_Link( edict_t *pent );
+void EntGrid_Frame( void );
+
+// Client slots only count between ClientPutInServer and ClientDisconnect,
+// like the engine's FindEntityInSphere
+void EntGrid_ClientActive( edict_t *pent, int active );
+int EntGrid_IsClientActive( int index );
+
+// Non-zero once the grid is valid for the current map
+int EntGrid_Active( void );
+
+// Edict indices greater than after whose grid cells touch mins / maxs, in
+// increasing order. Returns -1 when the caller should scan every edict instead
+int EntGrid_Gather( const Vector &mins, const Vector &maxs, int after, int **ppList );
+
+// Bumped whenever a link changes, lets iterators keep their candidate list
+int EntGrid_Serial( void );
+
+#endif // ENTGRID_H
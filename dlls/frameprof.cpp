@@ -0,0 +1,498 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== frameprof.cpp ========================================================
+
+  Server frame profiler.
+
+  With sv_frameprof 1 the think, touch, use and blocked dispatchers in
+  cbase.cpp and PlayerPreThink / PlayerPostThink in client.cpp time every
+  callback with the CPU timestamp counter and charge it to the entity's
+  classname. Callbacks that run inside another one, a trigger touched
+  while a monster thinks, are taken out of the outer one's time. Traces
+  issued through the UTIL_Trace* wrappers are counted against the callback
+  that is running.
+
+  sv_frameprof_report prints the classes that cost the most. With
+  sv_frameprof_log N the numbers for every N seconds are also appended to
+  frameprof.csv in the game directory, one row per class and callback:
+
+	time,map,classname,callback,calls,msec,traces
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "frameprof.h"
+
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#include <intrin.h>
+#define FRAMEPROF_RDTSC
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+#include <x86intrin.h>
+#define FRAMEPROF_RDTSC
+#endif
+
+cvar_t sv_frameprof = { "sv_frameprof", "0", FCVAR_SERVER };	// time entity callbacks per classname
+cvar_t sv_frameprof_log = { "sv_frameprof_log", "0", FCVAR_SERVER };	// seconds between frameprof.csv rows, 0 for none
+
+int g_fFrameProf;
+
+typedef unsigned long long proftick_t;
+
+typedef struct
+{
+	char		name[32];
+	unsigned int	calls[FRAMEPROF_CALLBACKS];
+	proftick_t	ticks[FRAMEPROF_CALLBACKS];	// exclusive of nested callbacks
+	unsigned int	traces[FRAMEPROF_CALLBACKS];
+} profclass_t;
+
+typedef struct
+{
+	string_t	classname;
+	int		index;		// into s_ProfClasses, -1 for none
+} profent_t;
+
+typedef struct
+{
+	int		index;
+	int		callback;
+	proftick_t	start;
+	proftick_t	child;		// spent in callbacks nested inside this one
+} profframe_t;
+
+static const char *s_szProfCallbacks[FRAMEPROF_CALLBACKS] =
+{
+	"think", "touch", "use", "blocked", "prethink", "postthink"
+};
+
+static profclass_t	s_ProfClasses[FRAMEPROF_MAX_CLASSES];
+static profclass_t	s_ProfLogged[FRAMEPROF_MAX_CLASSES];	// totals at the last frameprof.csv rows
+static int		s_iNumProfClasses;
+static profent_t	*s_pProfEnts;
+static int		s_iProfEntsSize;
+
+static profframe_t	s_ProfStack[FRAMEPROF_MAX_DEPTH];
+static int		s_iProfDepth;
+static int		s_iProfOverflow;	// Begins past the bottom of the stack
+
+static unsigned int	s_uProfFrames;
+static unsigned int	s_uProfLooseTraces;	// issued outside any callback
+static double		s_flProfStartTime;
+static proftick_t	s_ProfStartTicks;
+static double		s_flProfLogTime;
+static proftick_t	s_ProfLogTicks;
+static float		s_flProfNextLog;
+
+static inline proftick_t FrameProf_Ticks( void )
+{
+#ifdef FRAMEPROF_RDTSC
+	return __rdtsc();
+#else
+	return (proftick_t)( UTIL_PerfTime() * 1e9 );
+#endif
+}
+
+/*
+================
+FrameProf_TicksPerSecond
+
+The counter's rate, measured over the time profiled so far
+================
+*/
+static double FrameProf_TicksPerSecond( void )
+{
+	double elapsed = UTIL_PerfTime() - s_flProfStartTime;
+
+	if( elapsed <= 0.0 )
+		return 0.0;
+
+	return ( FrameProf_Ticks() - s_ProfStartTicks ) / elapsed;
+}
+
+static void FrameProf_ResetEnts( void )
+{
+	int i;
+
+	for( i = 0; i < s_iProfEntsSize; i++ )
+		s_pProfEnts[i].index = -1;
+}
+
+static void FrameProf_Reset( void )
+{
+	s_iNumProfClasses = 0;
+	s_uProfFrames = 0;
+	s_uProfLooseTraces = 0;
+	s_flProfStartTime = s_flProfLogTime = UTIL_PerfTime();
+	s_ProfStartTicks = s_ProfLogTicks = FrameProf_Ticks();
+
+	FrameProf_ResetEnts();
+}
+
+/*
+================
+FrameProf_ClassFor
+
+Slot for pent's classname, looked up again only when the classname changes
+================
+*/
+static int FrameProf_ClassFor( edict_t *pent )
+{
+	static profent_t scratch;
+	const char *classname;
+	profent_t *cache;
+	int number, i;
+
+	number = pent ? ENTINDEX( pent ) : -1;
+	if( number < 0 || number >= gpGlobals->maxEntities )
+		return FRAMEPROF_MAX_CLASSES - 1;
+
+	if( number >= s_iProfEntsSize )
+	{
+		profent_t *pProfEnts = (profent_t *)realloc( s_pProfEnts, gpGlobals->maxEntities * sizeof( profent_t ) );
+
+		if( pProfEnts )
+		{
+			for( i = s_iProfEntsSize; i < gpGlobals->maxEntities; i++ )
+				pProfEnts[i].index = -1;
+			s_pProfEnts = pProfEnts;
+			s_iProfEntsSize = gpGlobals->maxEntities;
+		}
+	}
+
+	if( number < s_iProfEntsSize )
+	{
+		cache = &s_pProfEnts[number];
+		if( cache->index >= 0 && cache->classname == pent->v.classname )
+			return cache->index;
+	}
+	else
+	{
+		// out of memory, looked up by name every time
+		cache = &scratch;
+	}
+
+	classname = STRING( pent->v.classname );
+	if( !classname || !classname[0] )
+		classname = "<none>";
+
+	for( i = 0; i < s_iNumProfClasses; i++ )
+	{
+		if( !strcmp( s_ProfClasses[i].name, classname ) )
+			break;
+	}
+
+	if( i == s_iNumProfClasses )
+	{
+		// The last slot collects whatever doesn't fit
+		if( s_iNumProfClasses == FRAMEPROF_MAX_CLASSES - 1 )
+			classname = "<other>";
+
+		if( s_iNumProfClasses < FRAMEPROF_MAX_CLASSES )
+		{
+			memset( &s_ProfClasses[i], 0, sizeof( s_ProfClasses[i] ) );
+			memset( &s_ProfLogged[i], 0, sizeof( s_ProfLogged[i] ) );
+			strncpy( s_ProfClasses[i].name, classname, sizeof( s_ProfClasses[i].name ) - 1 );
+			s_iNumProfClasses++;
+		}
+		else
+		{
+			i = FRAMEPROF_MAX_CLASSES - 1;
+		}
+	}
+
+	cache->classname = pent->v.classname;
+	cache->index = i;
+
+	return i;
+}
+
+/*
+================
+FrameProf_Begin
+
+================
+*/
+void FrameProf_Begin( edict_t *pent, int callback )
+{
+	profframe_t *frame;
+
+	if( s_iProfDepth == FRAMEPROF_MAX_DEPTH )
+	{
+		s_iProfOverflow++;
+		return;
+	}
+
+	frame = &s_ProfStack[s_iProfDepth++];
+	frame->index = FrameProf_ClassFor( pent );
+	frame->callback = callback;
+	frame->child = 0;
+	frame->start = FrameProf_Ticks();
+}
+
+/*
+================
+FrameProf_End
+
+================
+*/
+void FrameProf_End( void )
+{
+	profframe_t *frame;
+	proftick_t elapsed;
+
+	elapsed = FrameProf_Ticks();
+
+	if( s_iProfOverflow )
+	{
+		s_iProfOverflow--;
+		return;
+	}
+
+	if( !s_iProfDepth )
+		return;
+
+	frame = &s_ProfStack[--s_iProfDepth];
+	elapsed -= frame->start;
+
+	s_ProfClasses[frame->index].calls[frame->callback]++;
+	s_ProfClasses[frame->index].ticks[frame->callback] += ( elapsed > frame->child ) ? elapsed - frame->child : 0;
+
+	if( s_iProfDepth )
+		s_ProfStack[s_iProfDepth - 1].child += elapsed;
+}
+
+void FrameProf_Trace( void )
+{
+	const profframe_t *frame;
+
+	if( !s_iProfDepth )
+	{
+		s_uProfLooseTraces++;
+		return;
+	}
+
+	frame = &s_ProfStack[s_iProfDepth - 1];
+	s_ProfClasses[frame->index].traces[frame->callback]++;
+}
+
+/*
+================
+FrameProf_WriteLog
+
+Rows for everything that ran since the last time
+================
+*/
+static void FrameProf_WriteLog( void )
+{
+	char szPath[256];
+	const profclass_t *pc;
+	profclass_t *pl;
+	double now, rate;
+	FILE *f;
+	int i, j;
+
+	now = UTIL_PerfTime();
+	rate = ( now > s_flProfLogTime ) ? ( FrameProf_Ticks() - s_ProfLogTicks ) / ( now - s_flProfLogTime ) : 0.0;
+
+	GET_GAME_DIR( szPath );
+	strcat( szPath, "/frameprof.csv" );
+
+	f = fopen( szPath, "a" );
+	if( !f )
+	{
+		ALERT( at_console, "sv_frameprof_log: can't write %s\n", szPath );
+		CVAR_SET_FLOAT( "sv_frameprof_log", 0 );
+		return;
+	}
+
+	fseek( f, 0, SEEK_END );
+	if( !ftell( f ) )
+		fprintf( f, "time,map,classname,callback,calls,msec,traces\n" );
+
+	for( i = 0; i < s_iNumProfClasses; i++ )
+	{
+		pc = &s_ProfClasses[i];
+		pl = &s_ProfLogged[i];
+
+		for( j = 0; j < FRAMEPROF_CALLBACKS; j++ )
+		{
+			if( pc->calls[j] == pl->calls[j] )
+				continue;
+
+			fprintf( f, "%.1f,%s,%s,%s,%u,%.3f,%u\n", gpGlobals->time, STRING( gpGlobals->mapname ), pc->name, s_szProfCallbacks[j],
+				pc->calls[j] - pl->calls[j], rate > 0.0 ? ( pc->ticks[j] - pl->ticks[j] ) * 1000.0 / rate : 0.0, pc->traces[j] - pl->traces[j] );
+		}
+
+		*pl = *pc;
+	}
+
+	fclose( f );
+
+	s_flProfLogTime = now;
+	s_ProfLogTicks = FrameProf_Ticks();
+}
+
+/*
+================
+FrameProf_Frame
+
+Picks up sv_frameprof, only here so Begin and End always pair up
+================
+*/
+void FrameProf_Frame( void )
+{
+	int active = sv_frameprof.value != 0.0f;
+
+	if( active && !g_fFrameProf )
+		FrameProf_Reset();
+
+	g_fFrameProf = active;
+	s_iProfDepth = 0;
+	s_iProfOverflow = 0;
+
+	if( !g_fFrameProf )
+		return;
+
+	s_uProfFrames++;
+
+	if( sv_frameprof_log.value > 0.0f && gpGlobals->time >= s_flProfNextLog )
+	{
+		if( s_flProfNextLog > 0.0f )
+			FrameProf_WriteLog();
+		s_flProfNextLog = gpGlobals->time + sv_frameprof_log.value;
+	}
+}
+
+/*
+================
+FrameProf_LevelInit
+
+================
+*/
+void FrameProf_LevelInit( void )
+{
+	// Classname strings belong to the old map
+	FrameProf_ResetEnts();
+
+	s_flProfNextLog = 0.0f;
+}
+
+static proftick_t FrameProf_Total( const profclass_t *pc )
+{
+	proftick_t total = 0;
+	int i;
+
+	for( i = 0; i < FRAMEPROF_CALLBACKS; i++ )
+		total += pc->ticks[i];
+
+	return total;
+}
+
+static int FrameProf_CompareClass( const void *a, const void *b )
+{
+	proftick_t ta = FrameProf_Total( &s_ProfClasses[*(const int *)a] );
+	proftick_t tb = FrameProf_Total( &s_ProfClasses[*(const int *)b] );
+
+	return ( ta < tb ) - ( ta > tb );
+}
+
+/*
+================
+FrameProf_Report
+
+sv_frameprof_report [classes]
+================
+*/
+static void FrameProf_Report( void )
+{
+	int order[FRAMEPROF_MAX_CLASSES];
+	const profclass_t *pc;
+	proftick_t total;
+	double rate, elapsed, msec;
+	unsigned int traces, alltraces;
+	int i, j, count;
+
+	count = ( CMD_ARGC() > 1 ) ? atoi( CMD_ARGV( 1 ) ) : 20;
+
+	if( !s_iNumProfClasses )
+	{
+		ALERT( at_console, "sv_frameprof_report: nothing recorded, set sv_frameprof 1\n" );
+		return;
+	}
+
+	rate = FrameProf_TicksPerSecond();
+	elapsed = UTIL_PerfTime() - s_flProfStartTime;
+	if( rate <= 0.0 || !s_uProfFrames )
+		return;
+
+	total = 0;
+	alltraces = s_uProfLooseTraces;
+	for( i = 0; i < s_iNumProfClasses; i++ )
+	{
+		order[i] = i;
+		total += FrameProf_Total( &s_ProfClasses[i] );
+		for( j = 0; j < FRAMEPROF_CALLBACKS; j++ )
+			alltraces += s_ProfClasses[i].traces[j];
+	}
+
+	qsort( order, s_iNumProfClasses, sizeof( int ), FrameProf_CompareClass );
+
+	ALERT( at_console, "%u frames over %.1f seconds, %.3f ms/frame in entity callbacks, %.1f traces/frame (%u outside callbacks)\n",
+		s_uProfFrames, elapsed, total * 1000.0 / rate / s_uProfFrames, alltraces / (double)s_uProfFrames, s_uProfLooseTraces );
+
+	if( count > s_iNumProfClasses )
+		count = s_iNumProfClasses;
+
+	for( i = 0; i < count; i++ )
+	{
+		pc = &s_ProfClasses[order[i]];
+
+		traces = 0;
+		for( j = 0; j < FRAMEPROF_CALLBACKS; j++ )
+			traces += pc->traces[j];
+
+		msec = FrameProf_Total( pc ) * 1000.0 / rate;
+		ALERT( at_console, "%-24s %8.3f ms/frame %5.1f%% %8.2f traces/frame\n", pc->name, msec / s_uProfFrames,
+			total ? FrameProf_Total( pc ) * 100.0 / total : 0.0, traces / (double)s_uProfFrames );
+
+		for( j = 0; j < FRAMEPROF_CALLBACKS; j++ )
+		{
+			if( !pc->calls[j] )
+				continue;
+
+			msec = pc->ticks[j] * 1000.0 / rate;
+			ALERT( at_console, "    %-10s %8u calls %8.2f us/call %8u traces\n", s_szProfCallbacks[j], pc->calls[j],
+				msec * 1000.0 / pc->calls[j], pc->traces[j] );
+		}
+	}
+}
+
+/*
+================
+FrameProf_Init
+
+================
+*/
+void FrameProf_Init( void )
+{
+	CVAR_REGISTER( &sv_frameprof );
+	CVAR_REGISTER( &sv_frameprof_log );
+	g_engfuncs.pfnAddServerCommand( "sv_frameprof_report", FrameProf_Report );
+	g_engfuncs.pfnAddServerCommand( "sv_frameprof_reset", FrameProf_Reset );
+}
@@ -0,0 +1,53 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// frameprof.h - server time spent in entity callbacks,
+// per classname
+//=========================================================
+#pragma once
+#ifndef FRAMEPROF_H
+#define FRAMEPROF_H
+
+// Callbacks the engine dispatches into the game dll
+#define FRAMEPROF_THINK		0
+#define FRAMEPROF_TOUCH		1
+#define FRAMEPROF_USE		2
+#define FRAMEPROF_BLOCKED	3
+#define FRAMEPROF_PRETHINK	4	// PlayerPreThink
+#define FRAMEPROF_POSTTHINK	5	// PlayerPostThink
+#define FRAMEPROF_CALLBACKS	6
+
+#define FRAMEPROF_MAX_CLASSES	256	// the last one collects the rest
+#define FRAMEPROF_MAX_DEPTH	32	// callbacks running inside other callbacks
+
+extern cvar_t sv_frameprof;
+extern cvar_t sv_frameprof_log;
+
+// Only changes in StartFrame, so a callback never ends on a different setting
+extern int g_fFrameProf;
+
+void FrameProf_Init( void );
+void FrameProf_LevelInit( void );
+void FrameProf_Frame( void );
+
+// Time from Begin to End is charged to pent's classname, minus whatever
+// other callbacks ran in between
+void FrameProf_Begin( edict_t *pent, int callback );
+void FrameProf_End( void );
+
+// A trace was issued, charged to the callback that is running
+void FrameProf_Trace( void );
+
+#endif // FRAMEPROF_H
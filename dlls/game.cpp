@@ -16,6 +16,14 @@
 #include "eiface.h"
 #include "util.h"
 #include "game.h"
+#include "entgrid.h"
+#include "frameprof.h"
+#include "hudbatch.h"
+#include "nameindex.h"
+#include "netdelta.h"
+#include "nodefile.h"
+#include "saveplan.h"
+#include "sightcache.h"
 
 cvar_t tfc_spam_penalty1 = { "tfc_spam_penalty1", "8.0" };
 cvar_t tfc_spam_penalty2 = { "tfc_spam_penalty2", "2.0" };
@@ -70,6 +78,15 @@ cvar_t cr_random	= { "cr_random", "0", FCVAR_SERVER };
 
 cvar_t mp_chattime	= { "mp_chattime","10", FCVAR_SERVER };
 
+cvar_t sv_blastshare	= { "sv_blastshare", "0", FCVAR_SERVER };	// blasts this close share line of sight traces, 0 disables
+cvar_t sv_blaststats	= { "sv_blaststats", "0" };			// print traces issued / saved each frame with blasts
+cvar_t sv_packstats	= { "sv_packstats", "0" };			// time AddToFullPack and count rejects by reason, once a second
+cvar_t sv_nodethreads	= { "sv_nodethreads", "0" };			// threads for the node graph routing tables, 0 uses every cpu
+cvar_t sv_nodeincremental = { "sv_nodeincremental", "0" };		// keep routes from the old .nod that link changes can't affect
+cvar_t sv_idtrace_interval = { "sv_idtrace_interval", "0.6", FCVAR_SERVER };	// longest a player's ID target trace is reused, 0 traces every update
+cvar_t sv_idtrace_move	= { "sv_idtrace_move", "4", FCVAR_SERVER };		// eye or target movement in units that traces again
+cvar_t sv_idtrace_turn	= { "sv_idtrace_turn", "0.5", FCVAR_SERVER };		// view turn in degrees that traces again
+
 // Engine Cvars
 cvar_t *g_psv_gravity;
 cvar_t *g_footsteps;
@@ -138,6 +155,27 @@ void GameDLLInit( void )
 	CVAR_REGISTER( &cr_random );
 
 	CVAR_REGISTER( &mp_chattime );
+
+	CVAR_REGISTER( &sv_blastshare );
+	CVAR_REGISTER( &sv_blaststats );
+	CVAR_REGISTER( &sv_packstats );
+	CVAR_REGISTER( &sv_nodethreads );
+	CVAR_REGISTER( &sv_nodeincremental );
+	CVAR_REGISTER( &sv_idtrace_interval );
+	CVAR_REGISTER( &sv_idtrace_move );
+	CVAR_REGISTER( &sv_idtrace_turn );
+	g_engfuncs.pfnAddServerCommand( "sv_idtrace_stats", IDTrace_Stats );
+
+	EntGrid_Init();
+	NameIndex_Init();
+	NetDelta_Init();
+	NodeFile_Init();
+	SavePlan_Init();
+	SOUND_Init();
+	SoundEnt_Init();
+	SightCache_Init();
+	FrameProf_Init();
+	HudBatch_Init();
 }
 
 void GameDLLShutdown( void )
@@ -63,6 +63,17 @@ extern cvar_t cr_spy;
 extern cvar_t cr_engineer;
 extern cvar_t cr_random;
 
+extern cvar_t sv_blastshare;
+extern cvar_t sv_blaststats;
+extern cvar_t sv_packstats;
+extern cvar_t sv_nodethreads;
+extern cvar_t sv_nodeincremental;
+extern cvar_t sv_idtrace_interval;
+extern cvar_t sv_idtrace_move;
+extern cvar_t sv_idtrace_turn;
+
+extern void IDTrace_Stats( void );
+
 // Engine Cvars
 extern cvar_t *g_psv_gravity;
 extern cvar_t *g_footsteps;
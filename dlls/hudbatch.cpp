@@ -0,0 +1,415 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== hudbatch.cpp ========================================================
+
+  HUD message batching.
+
+  Health, Battery, FlashBat, Train, Geiger, Damage and AmmoX each went
+  out as their own reliable message, several per player most frames, and
+  every message carries its own header. Clients that set cl_hudbatch in
+  their userinfo get the changed fields queued instead, and sent as one
+  HudBatch message from PlayerPostThink. Everyone else still gets the
+  legacy messages, written on the spot.
+
+  SetFOV and HideWeapon stay immediate: the client picks the crosshair
+  for a CurWeapon from the FOV it already has.
+
+  Queued fields keep only their latest value, a Damage message already
+  queued is sent before another one replaces it. sv_hudbatch_stats
+  compares what went out with what the legacy messages would have cost.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "cdll_dll.h"
+#include "hudbatch.h"
+
+#define HUDBATCH_MAX_CLIENTS	32
+
+// svc byte for every user message, plus a length byte for variable sized ones
+#define HUDBATCH_LEGACY_HEADER	1
+#define HUDBATCH_HEADER		2
+
+cvar_t sv_hudbatch = { "sv_hudbatch", "1", FCVAR_SERVER };	// pack HUD updates for clients that ask for it
+
+extern int gmsgHealth;
+extern int gmsgBattery;
+extern int gmsgFlashBattery;
+extern int gmsgTrain;
+extern int gmsgGeigerRange;
+extern int gmsgDamage;
+extern int gmsgAmmoX;
+
+typedef struct
+{
+	int		active;
+	int		batching;	// cl_hudbatch in the userinfo
+	int		pending;	// HUDBATCH_ bits queued
+	BYTE		bytes[4];	// the one byte fields, by HudBatch_ByteSlot
+	int		battery;
+	int		damageSave;
+	int		damageTake;
+	int		damageBits;
+	Vector		damageOrigin;
+	unsigned int	ammoPending;	// slots queued
+	BYTE		ammo[MAX_AMMO_SLOTS];
+
+	unsigned int	legacyMessages;	// what the legacy messages would have been
+	unsigned int	legacyBytes;
+	unsigned int	messages;	// what was sent
+	unsigned int	bytesSent;
+} hudclient_t;
+
+static hudclient_t	s_HudClients[HUDBATCH_MAX_CLIENTS + 1];
+static float		s_flHudStatsStart;
+
+static int HudBatch_ByteSlot( int field )
+{
+	switch( field )
+	{
+	case HUDBATCH_HEALTH:
+		return 0;
+	case HUDBATCH_FLASHBAT:
+		return 1;
+	case HUDBATCH_TRAIN:
+		return 2;
+	case HUDBATCH_GEIGER:
+		return 3;
+	}
+
+	return -1;
+}
+
+static int HudBatch_LegacyMessage( int field )
+{
+	switch( field )
+	{
+	case HUDBATCH_HEALTH:
+		return gmsgHealth;
+	case HUDBATCH_FLASHBAT:
+		return gmsgFlashBattery;
+	case HUDBATCH_TRAIN:
+		return gmsgTrain;
+	case HUDBATCH_GEIGER:
+		return gmsgGeigerRange;
+	}
+
+	return 0;
+}
+
+/*
+================
+HudBatch_Client
+
+The client's state, NULL for edicts that aren't clients
+================
+*/
+static hudclient_t *HudBatch_Client( entvars_t *pev )
+{
+	int index;
+
+	if( !pev )
+		return NULL;
+
+	index = ENTINDEX( ENT( pev ) );
+	if( index < 1 || index > HUDBATCH_MAX_CLIENTS )
+		return NULL;
+
+	return &s_HudClients[index];
+}
+
+/*
+================
+HudBatch_Queue
+
+Non-zero when the field should be queued rather than sent, counts
+the legacy message it stands for either way
+================
+*/
+static int HudBatch_Queue( entvars_t *pev, hudclient_t *cl, int size )
+{
+	if( !cl )
+		return 0;
+
+	cl->legacyMessages++;
+	cl->legacyBytes += HUDBATCH_LEGACY_HEADER + size;
+
+	if( cl->batching && sv_hudbatch.value && gmsgHudBatch )
+		return 1;
+
+	// anything queued before batching went off has to go out first
+	if( cl->pending )
+		HudBatch_Flush( ENT( pev ) );
+
+	cl->messages++;
+	cl->bytesSent += HUDBATCH_LEGACY_HEADER + size;
+
+	return 0;
+}
+
+void HudBatch_Byte( entvars_t *pev, int field, int value )
+{
+	hudclient_t *cl = HudBatch_Client( pev );
+
+	if( HudBatch_Queue( pev, cl, 1 ) )
+	{
+		cl->bytes[HudBatch_ByteSlot( field )] = (BYTE)value;
+		cl->pending |= field;
+		return;
+	}
+
+	MESSAGE_BEGIN( MSG_ONE, HudBatch_LegacyMessage( field ), NULL, pev );
+		WRITE_BYTE( value );
+	MESSAGE_END();
+}
+
+void HudBatch_Battery( entvars_t *pev, int armor )
+{
+	hudclient_t *cl = HudBatch_Client( pev );
+
+	if( HudBatch_Queue( pev, cl, 2 ) )
+	{
+		cl->battery = armor;
+		cl->pending |= HUDBATCH_BATTERY;
+		return;
+	}
+
+	MESSAGE_BEGIN( MSG_ONE, gmsgBattery, NULL, pev );
+		WRITE_SHORT( armor );
+	MESSAGE_END();
+}
+
+void HudBatch_Ammo( entvars_t *pev, int index, int amount )
+{
+	hudclient_t *cl = HudBatch_Client( pev );
+
+	if( index >= 0 && index < MAX_AMMO_SLOTS && HudBatch_Queue( pev, cl, 2 ) )
+	{
+		cl->ammo[index] = (BYTE)amount;
+		cl->ammoPending |= 1u << index;
+		cl->pending |= HUDBATCH_AMMO;
+		return;
+	}
+
+	MESSAGE_BEGIN( MSG_ONE, gmsgAmmoX, NULL, pev );
+		WRITE_BYTE( index );
+		WRITE_BYTE( amount );
+	MESSAGE_END();
+}
+
+void HudBatch_Damage( entvars_t *pev, int save, int take, int bits, const Vector &vecOrigin )
+{
+	hudclient_t *cl = HudBatch_Client( pev );
+
+	// a hit, not a value, the client has to see both
+	if( cl && ( cl->pending & HUDBATCH_DAMAGE ) )
+		HudBatch_Flush( ENT( pev ) );
+
+	if( HudBatch_Queue( pev, cl, 12 ) )
+	{
+		cl->damageSave = save;
+		cl->damageTake = take;
+		cl->damageBits = bits;
+		cl->damageOrigin = vecOrigin;
+		cl->pending |= HUDBATCH_DAMAGE;
+		return;
+	}
+
+	MESSAGE_BEGIN( MSG_ONE, gmsgDamage, NULL, pev );
+		WRITE_BYTE( save );
+		WRITE_BYTE( take );
+		WRITE_LONG( bits );
+		WRITE_COORD( vecOrigin.x );
+		WRITE_COORD( vecOrigin.y );
+		WRITE_COORD( vecOrigin.z );
+	MESSAGE_END();
+}
+
+/*
+================
+HudBatch_Flush
+
+================
+*/
+void HudBatch_Flush( edict_t *pEntity )
+{
+	hudclient_t *cl;
+	int size, count, i;
+
+	cl = HudBatch_Client( VARS( pEntity ) );
+	if( !cl || !cl->pending )
+		return;
+
+	size = 2;
+
+	MESSAGE_BEGIN( MSG_ONE, gmsgHudBatch, NULL, pEntity );
+		WRITE_SHORT( cl->pending );
+
+		for( i = 0; i < HUDBATCH_FIELDS; i++ )
+		{
+			int field = 1 << i;
+
+			if( !( cl->pending & field ) )
+				continue;
+
+			switch( field )
+			{
+			case HUDBATCH_BATTERY:
+				WRITE_SHORT( cl->battery );
+				size += 2;
+				break;
+			case HUDBATCH_DAMAGE:
+				WRITE_BYTE( cl->damageSave );
+				WRITE_BYTE( cl->damageTake );
+				WRITE_LONG( cl->damageBits );
+				WRITE_COORD( cl->damageOrigin.x );
+				WRITE_COORD( cl->damageOrigin.y );
+				WRITE_COORD( cl->damageOrigin.z );
+				size += 12;
+				break;
+			case HUDBATCH_AMMO:
+				count = 0;
+				for( int j = 0; j < MAX_AMMO_SLOTS; j++ )
+				{
+					if( cl->ammoPending & ( 1u << j ) )
+						count++;
+				}
+
+				WRITE_BYTE( count );
+				for( int j = 0; j < MAX_AMMO_SLOTS; j++ )
+				{
+					if( !( cl->ammoPending & ( 1u << j ) ) )
+						continue;
+
+					WRITE_BYTE( j );
+					WRITE_BYTE( cl->ammo[j] );
+				}
+				size += 1 + count * 2;
+				break;
+			default:
+				WRITE_BYTE( cl->bytes[HudBatch_ByteSlot( field )] );
+				size += 1;
+				break;
+			}
+		}
+	MESSAGE_END();
+
+	cl->messages++;
+	cl->bytesSent += HUDBATCH_HEADER + size;
+
+	cl->pending = 0;
+	cl->ammoPending = 0;
+}
+
+/*
+================
+HudBatch_UserInfo
+
+================
+*/
+void HudBatch_UserInfo( edict_t *pEntity, char *infobuffer )
+{
+	hudclient_t *cl = HudBatch_Client( VARS( pEntity ) );
+	const char *value;
+
+	if( !cl || !infobuffer )
+		return;
+
+	value = g_engfuncs.pfnInfoKeyValue( infobuffer, HUDBATCH_USERINFO );
+	cl->batching = ( value && atoi( value ) != 0 );
+}
+
+void HudBatch_ClientActive( edict_t *pEntity, int active )
+{
+	hudclient_t *cl = HudBatch_Client( VARS( pEntity ) );
+
+	if( !cl )
+		return;
+
+	// nothing queued for the last player in this slot goes to the next one
+	*cl = hudclient_t();
+	cl->active = active;
+
+	if( active )
+		HudBatch_UserInfo( pEntity, g_engfuncs.pfnGetInfoKeyBuffer( pEntity ) );
+}
+
+/*
+================
+HudBatch_Stats
+
+sv_hudbatch_stats, HUD message traffic per client since the last reset
+================
+*/
+static void HudBatch_Stats( void )
+{
+	unsigned int legacyBytes = 0, bytesSent = 0;
+	const hudclient_t *cl;
+	float elapsed;
+	int i;
+
+	elapsed = gpGlobals->time - s_flHudStatsStart;
+
+	ALERT( at_console, "HUD messages over %.1f seconds, sent / legacy:\n", elapsed );
+
+	for( i = 1; i <= gpGlobals->maxClients && i <= HUDBATCH_MAX_CLIENTS; i++ )
+	{
+		cl = &s_HudClients[i];
+		if( !cl->active && !cl->legacyMessages )
+			continue;
+
+		ALERT( at_console, "%2i %-20s %-7s %7u / %7u msgs %8u / %8u bytes %6.1f bytes/s\n", i, STRING( INDEXENT( i )->v.netname ),
+			cl->batching ? "batched" : "legacy", cl->messages, cl->legacyMessages, cl->bytesSent, cl->legacyBytes,
+			elapsed > 0.0f ? cl->bytesSent / elapsed : 0.0f );
+
+		legacyBytes += cl->legacyBytes;
+		bytesSent += cl->bytesSent;
+	}
+
+	if( legacyBytes )
+		ALERT( at_console, "%u / %u bytes, %.1f%% saved\n", bytesSent, legacyBytes, 100.0f - bytesSent * 100.0f / legacyBytes );
+}
+
+static void HudBatch_Reset( void )
+{
+	int i;
+
+	for( i = 1; i <= HUDBATCH_MAX_CLIENTS; i++ )
+	{
+		s_HudClients[i].legacyMessages = 0;
+		s_HudClients[i].legacyBytes = 0;
+		s_HudClients[i].messages = 0;
+		s_HudClients[i].bytesSent = 0;
+	}
+
+	s_flHudStatsStart = gpGlobals->time;
+}
+
+/*
+================
+HudBatch_Init
+
+================
+*/
+void HudBatch_Init( void )
+{
+	CVAR_REGISTER( &sv_hudbatch );
+	g_engfuncs.pfnAddServerCommand( "sv_hudbatch_stats", HudBatch_Stats );
+	g_engfuncs.pfnAddServerCommand( "sv_hudbatch_reset", HudBatch_Reset );
+}
@@ -0,0 +1,59 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// hudbatch.h - the small per player HUD messages, packed
+// into one HudBatch message a frame for clients that can
+// read it
+//=========================================================
+#pragma once
+#ifndef HUDBATCH_H
+#define HUDBATCH_H
+
+// HudBatch starts with a short of these bits, followed by the body of
+// each legacy message in this order. Ammo is a count byte and then the
+// AmmoX bodies. cl_dll/hud_msg.cpp reads it back the same way. SetFOV
+// and HideWeapon aren't here, the client has to see them before the
+// CurWeapon that follows them.
+#define HUDBATCH_HEALTH		( 1 << 0 )	// Health, byte
+#define HUDBATCH_BATTERY	( 1 << 1 )	// Battery, short
+#define HUDBATCH_FLASHBAT	( 1 << 2 )	// FlashBat, byte
+#define HUDBATCH_TRAIN		( 1 << 3 )	// Train, byte
+#define HUDBATCH_GEIGER		( 1 << 4 )	// Geiger, byte
+#define HUDBATCH_DAMAGE		( 1 << 5 )	// Damage, 12 bytes
+#define HUDBATCH_AMMO		( 1 << 6 )	// AmmoX, 2 bytes each
+#define HUDBATCH_FIELDS		7
+
+#define HUDBATCH_USERINFO	"cl_hudbatch"	// set by clients that hook HudBatch
+
+extern cvar_t sv_hudbatch;
+extern int gmsgHudBatch;
+
+void HudBatch_Init( void );
+
+// Client state, from ClientPutInServer, ClientUserInfoChanged and ClientDisconnect
+void HudBatch_ClientActive( edict_t *pEntity, int active );
+void HudBatch_UserInfo( edict_t *pEntity, char *infobuffer );
+
+// Queue a HUD field, or send the legacy message right away when the
+// client doesn't batch. The latest value of a field wins.
+void HudBatch_Byte( entvars_t *pev, int field, int value );
+void HudBatch_Battery( entvars_t *pev, int armor );
+void HudBatch_Ammo( entvars_t *pev, int index, int amount );
+void HudBatch_Damage( entvars_t *pev, int save, int take, int bits, const Vector &vecOrigin );
+
+// Send whatever is queued, once at the end of the player's frame
+void HudBatch_Flush( edict_t *pEntity );
+
+#endif // HUDBATCH_H
@@ -28,6 +28,7 @@
 #include "skill.h"
 #include "items.h"
 #include "gamerules.h"
+#include "nameindex.h"
 
 extern int gmsgItemPickup;
 
@@ -80,6 +81,7 @@ void CWorldItem::Spawn( void )
 	{
 		pEntity->pev->target = pev->target;
 		pEntity->pev->targetname = pev->targetname;
+		NameIndex_Link( pEntity->edict() );
 		pEntity->pev->spawnflags = pev->spawnflags;
 	}
 
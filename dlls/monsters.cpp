@@ -213,57 +213,42 @@ void CBaseMonster::Listen( void )
 		iMySounds &= m_pSchedule->iSoundMask;
 	}
 
-	iSound = CSoundEnt::ActiveList();
-
 	// UNDONE: Clear these here?
 	ClearConditions( bits_COND_HEAR_SOUND | bits_COND_SMELL_FOOD | bits_COND_SMELL );
 	hearingSensitivity = HearingSensitivity();
 
-	while( iSound != SOUNDLIST_EMPTY )
+	// the sounds the monster cares about that are close enough to hear
+	m_iAudibleList = CSoundEnt::AudibleList( EarPosition(), iMySounds, hearingSensitivity );
+
+	for( iSound = m_iAudibleList; iSound != SOUNDLIST_EMPTY; iSound = pCurrentSound->m_iNextAudible )
 	{
 		pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
+		if( !pCurrentSound )
+			break;
 
-		if( pCurrentSound &&
-			( pCurrentSound->m_iType & iMySounds )	&&
-			( pCurrentSound->m_vecOrigin - EarPosition() ).Length() <= pCurrentSound->m_iVolume * hearingSensitivity )
-
-		//if( ( g_pSoundEnt->m_SoundPool[iSound].m_iType & iMySounds ) && ( g_pSoundEnt->m_SoundPool[iSound].m_vecOrigin - EarPosition()).Length () <= g_pSoundEnt->m_SoundPool[iSound].m_iVolume * hearingSensitivity )
+		if( pCurrentSound->FIsSound() )
 		{
- 			// the monster cares about this sound, and it's close enough to hear.
-			//g_pSoundEnt->m_SoundPool[iSound].m_iNextAudible = m_iAudibleList;
-			pCurrentSound->m_iNextAudible = m_iAudibleList;
-
-			if( pCurrentSound->FIsSound() )
+			// this is an audible sound.
+			SetConditions( bits_COND_HEAR_SOUND );
+		}
+		else
+		{
+			// if not a sound, must be a smell - determine if it's just a scent, or if it's a food scent
+			if( pCurrentSound->m_iType & ( bits_SOUND_MEAT | bits_SOUND_CARCASS ) )
 			{
-				// this is an audible sound.
-				SetConditions( bits_COND_HEAR_SOUND );
+				// the detected scent is a food item, so set both conditions.
+				// !!!BUGBUG - maybe a virtual function to determine whether or not the scent is food?
+				SetConditions( bits_COND_SMELL_FOOD );
+				SetConditions( bits_COND_SMELL );
 			}
 			else
 			{
-				// if not a sound, must be a smell - determine if it's just a scent, or if it's a food scent
-				//if( g_pSoundEnt->m_SoundPool[iSound].m_iType & ( bits_SOUND_MEAT | bits_SOUND_CARCASS ) )
-				if( pCurrentSound->m_iType & ( bits_SOUND_MEAT | bits_SOUND_CARCASS ) )
-				{
-					// the detected scent is a food item, so set both conditions.
-					// !!!BUGBUG - maybe a virtual function to determine whether or not the scent is food?
-					SetConditions( bits_COND_SMELL_FOOD );
-					SetConditions( bits_COND_SMELL );
-				}
-				else
-				{
-					// just a normal scent. 
-					SetConditions( bits_COND_SMELL );
-				}
+				// just a normal scent. 
+				SetConditions( bits_COND_SMELL );
 			}
-			//m_afSoundTypes |= g_pSoundEnt->m_SoundPool[iSound].m_iType;
-			m_afSoundTypes |= pCurrentSound->m_iType;
-
-			m_iAudibleList = iSound;
 		}
 
-		//iSound = g_pSoundEnt->m_SoundPool[iSound].m_iNext;
-		if( pCurrentSound )
-			iSound = pCurrentSound->m_iNext;
+		m_afSoundTypes |= pCurrentSound->m_iType;
 	}
 }
 
@@ -329,7 +314,9 @@ void CBaseMonster::Look( int iDistance )
 			{
 				// the looker will want to consider this entity
 				// don't check anything else about an entity that can't be seen, or an entity that you don't care about.
-				if( IRelationship( pSightEnt ) != R_NO && FInViewCone( pSightEnt ) && !FBitSet( pSightEnt->pev->flags, FL_NOTARGET ) && FVisible( pSightEnt ) )
+				int iRelationship = IRelationship( pSightEnt );
+
+				if( iRelationship != R_NO && FInViewCone( pSightEnt ) && !FBitSet( pSightEnt->pev->flags, FL_NOTARGET ) && FVisible( pSightEnt ) )
 				{
 					if( pSightEnt->IsPlayer() )
 					{
@@ -365,7 +352,7 @@ void CBaseMonster::Look( int iDistance )
 
 					// don't add the Enemy's relationship to the conditions. We only want to worry about conditions when
 					// we see monsters other than the Enemy.
-					switch( IRelationship( pSightEnt ) )
+					switch( iRelationship )
 					{
 					case R_NM:
 						iSighted |= bits_COND_SEE_NEMESIS;		
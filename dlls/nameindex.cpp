@@ -0,0 +1,517 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== nameindex.cpp ========================================================
+
+  Live edicts by targetname and classname.
+
+  Each distinct name gets a group holding the indices of the edicts that
+  carry it, kept sorted so a search after a start edict is a binary search
+  and the results come back in the same order as the engine's scan. Edicts
+  are refiled from DispatchSpawn, DispatchKeyValue, DispatchRestore,
+  UTIL_SetOrigin and UTIL_Remove, and StartFrame catches whatever was
+  renamed by assigning pev fields directly. A group entry is only trusted
+  while the edict is in use and still holds the string_t it was filed
+  under, anything else is refiled on the spot.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entgrid.h"
+#include "nameindex.h"
+
+cvar_t sv_nameindex = { "sv_nameindex", "1", FCVAR_SERVER };	// 2 checks every search against a full scan
+
+typedef struct namegroup_s
+{
+	char			*name;
+	unsigned int		hash;
+	int			*ents;		// edict indices, increasing
+	int			count;
+	int			size;
+	struct namegroup_s	*next;
+} namegroup_t;
+
+typedef struct
+{
+	string_t	names[NAMEINDEX_FIELDS];	// what the edict was filed under
+	namegroup_t	*groups[NAMEINDEX_FIELDS];	// NULL for no name
+} nameent_t;
+
+static const char *s_szFields[NAMEINDEX_FIELDS] = { "targetname", "classname" };
+
+static namegroup_t	*s_pGroups[NAMEINDEX_FIELDS][NAMEINDEX_BUCKETS];
+static nameent_t	*s_pEnts;
+static int		s_nMaxEnts;
+static int		s_fActive;
+
+static inline unsigned int NameIndex_Hash( const char *pszName )
+{
+	unsigned int hash = 2166136261u;
+
+	while( *pszName )
+	{
+		hash ^= (unsigned char)*pszName++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline string_t NameIndex_Field( const edict_t *pent, int field )
+{
+	return ( field == NAMEINDEX_TARGETNAME ) ? pent->v.targetname : pent->v.classname;
+}
+
+static namegroup_t *NameIndex_Group( int field, const char *pszName, int create )
+{
+	namegroup_t *group;
+	unsigned int hash;
+
+	hash = NameIndex_Hash( pszName );
+
+	for( group = s_pGroups[field][hash & ( NAMEINDEX_BUCKETS - 1 )]; group; group = group->next )
+	{
+		if( group->hash == hash && !strcmp( group->name, pszName ) )
+			return group;
+	}
+
+	if( !create )
+		return NULL;
+
+	group = new namegroup_t;
+	group->name = new char[strlen( pszName ) + 1];
+	strcpy( group->name, pszName );
+	group->hash = hash;
+	group->ents = NULL;
+	group->count = 0;
+	group->size = 0;
+	group->next = s_pGroups[field][hash & ( NAMEINDEX_BUCKETS - 1 )];
+	s_pGroups[field][hash & ( NAMEINDEX_BUCKETS - 1 )] = group;
+
+	return group;
+}
+
+/*
+================
+NameIndex_Lower
+
+Position of the first index greater than after
+================
+*/
+static int NameIndex_Lower( const namegroup_t *group, int after )
+{
+	int lo = 0, hi = group->count, mid;
+
+	while( lo < hi )
+	{
+		mid = ( lo + hi ) >> 1;
+		if( group->ents[mid] <= after )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void NameIndex_Insert( namegroup_t *group, int index )
+{
+	int pos;
+
+	if( group->count == group->size )
+	{
+		int *ents;
+
+		group->size = group->size ? group->size * 2 : 4;
+		ents = new int[group->size];
+		if( group->count )
+			memcpy( ents, group->ents, group->count * sizeof( int ) );
+		delete[] group->ents;
+		group->ents = ents;
+	}
+
+	pos = NameIndex_Lower( group, index );
+	memmove( &group->ents[pos + 1], &group->ents[pos], ( group->count - pos ) * sizeof( int ) );
+	group->ents[pos] = index;
+	group->count++;
+}
+
+static void NameIndex_Remove( namegroup_t *group, int index )
+{
+	int pos;
+
+	pos = NameIndex_Lower( group, index - 1 );
+	if( pos >= group->count || group->ents[pos] != index )
+		return;
+
+	group->count--;
+	memmove( &group->ents[pos], &group->ents[pos + 1], ( group->count - pos ) * sizeof( int ) );
+}
+
+/*
+================
+NameIndex_Refile
+
+Move index to the groups of its current names, free edicts have none
+================
+*/
+static void NameIndex_Refile( int index, const edict_t *pent )
+{
+	nameent_t *e = &s_pEnts[index];
+	const char *pszName;
+	string_t name;
+	int field;
+
+	for( field = 0; field < NAMEINDEX_FIELDS; field++ )
+	{
+		name = pent->free ? 0 : NameIndex_Field( pent, field );
+		if( name == e->names[field] )
+			continue;
+
+		if( e->groups[field] )
+			NameIndex_Remove( e->groups[field], index );
+
+		e->names[field] = name;
+		e->groups[field] = NULL;
+
+		// the engine's scan matches "" against every unnamed edict, those searches aren't indexed
+		pszName = STRING( name );
+		if( !name || !pszName || !*pszName )
+			continue;
+
+		e->groups[field] = NameIndex_Group( field, pszName, 1 );
+		NameIndex_Insert( e->groups[field], index );
+	}
+}
+
+/*
+================
+NameIndex_Alloc
+
+Sized from maxEntities, everything is dropped if that changes
+================
+*/
+static int NameIndex_Alloc( void )
+{
+	if( s_pEnts && s_nMaxEnts == gpGlobals->maxEntities )
+		return 1;
+
+	NameIndex_Clear();
+	delete[] s_pEnts;
+
+	s_nMaxEnts = gpGlobals->maxEntities;
+	if( s_nMaxEnts <= 0 )
+	{
+		s_pEnts = NULL;
+		return 0;
+	}
+
+	s_pEnts = new nameent_t[s_nMaxEnts];
+	memset( s_pEnts, 0, s_nMaxEnts * sizeof( nameent_t ) );
+
+	return 1;
+}
+
+/*
+================
+NameIndex_Link
+
+================
+*/
+void NameIndex_Link( edict_t *pent )
+{
+	int index;
+
+	if( !s_fActive || !pent )
+		return;
+
+	index = ENTINDEX( pent );
+	if( index <= 0 || index >= s_nMaxEnts )
+		return;
+
+	NameIndex_Refile( index, pent );
+}
+
+/*
+================
+NameIndex_Frame
+
+Only compares string_t's for edicts nobody renamed, cheap next to a
+single strcmp scan over every edict
+================
+*/
+void NameIndex_Frame( void )
+{
+	edict_t *pEdict;
+	int i;
+
+	if( !sv_nameindex.value )
+	{
+		if( s_fActive )
+			NameIndex_Clear();
+		return;
+	}
+
+	if( !NameIndex_Alloc() )
+		return;
+
+	pEdict = INDEXENT( 0 );
+	if( !pEdict )
+		return;
+
+	for( i = 1, pEdict++; i < s_nMaxEnts; i++, pEdict++ )
+		NameIndex_Refile( i, pEdict );
+
+	s_fActive = 1;
+}
+
+/*
+================
+NameIndex_Clear
+
+Map is going away, the next NameIndex_Frame files everything again
+================
+*/
+void NameIndex_Clear( void )
+{
+	namegroup_t *group, *next;
+	int field, i;
+
+	for( field = 0; field < NAMEINDEX_FIELDS; field++ )
+	{
+		for( i = 0; i < NAMEINDEX_BUCKETS; i++ )
+		{
+			for( group = s_pGroups[field][i]; group; group = next )
+			{
+				next = group->next;
+				delete[] group->ents;
+				delete[] group->name;
+				delete group;
+			}
+
+			s_pGroups[field][i] = NULL;
+		}
+	}
+
+	if( s_pEnts )
+		memset( s_pEnts, 0, s_nMaxEnts * sizeof( nameent_t ) );
+
+	s_fActive = 0;
+}
+
+int NameIndex_Active( void )
+{
+	return s_fActive && sv_nameindex.value;
+}
+
+/*
+================
+NameIndex_Search
+
+Same answer as FIND_ENTITY_BY_STRING, including the world edict when
+nothing is found
+================
+*/
+static edict_t *NameIndex_Search( int field, edict_t *entStart, const char *pszName )
+{
+	edict_t *pEdicts = INDEXENT( 0 );
+	namegroup_t *group;
+	int start, pos, index;
+
+	// the engine starts over when handed an edict that is no longer in use
+	start = ( entStart && !entStart->free ) ? ENTINDEX( entStart ) : 0;
+
+	group = NameIndex_Group( field, pszName, 0 );
+	if( !group )
+		return pEdicts;
+
+	pos = NameIndex_Lower( group, start );
+	while( pos < group->count )
+	{
+		index = group->ents[pos];
+
+		if( !pEdicts[index].free && NameIndex_Field( &pEdicts[index], field ) == s_pEnts[index].names[field] )
+		{
+			// the engine skips clients not in the game, their edicts
+			// stay around as "player" after a disconnect
+			if( index < 1 || index > gpGlobals->maxClients || EntGrid_IsClientActive( index ) )
+				return &pEdicts[index];
+
+			pos++;
+			continue;
+		}
+
+		// freed or renamed since it was filed, this takes it out of the group
+		// or puts it straight back under a new string_t with the same text
+		NameIndex_Refile( index, &pEdicts[index] );
+	}
+
+	return pEdicts;
+}
+
+static edict_t *NameIndex_Find( int field, edict_t *entStart, const char *pszName )
+{
+	edict_t *pentFound, *pentScan;
+
+	if( !NameIndex_Active() || !pszName || !*pszName )
+		return FIND_ENTITY_BY_STRING( entStart, s_szFields[field], pszName );
+
+	pentFound = NameIndex_Search( field, entStart, pszName );
+
+	if( sv_nameindex.value == 2 )
+	{
+		pentScan = FIND_ENTITY_BY_STRING( entStart, s_szFields[field], pszName );
+		if( FNullEnt( pentScan ) != FNullEnt( pentFound ) || ( !FNullEnt( pentFound ) && pentScan != pentFound ) )
+			ALERT( at_console, "NameIndex_Find: %s \"%s\" index found %i, scan found %i\n", s_szFields[field], pszName, FNullEnt( pentFound ) ? 0 : ENTINDEX( pentFound ), FNullEnt( pentScan ) ? 0 : ENTINDEX( pentScan ) );
+		pentFound = pentScan;
+	}
+
+	return pentFound;
+}
+
+edict_t *NameIndex_FindTargetname( edict_t *entStart, const char *pszName )
+{
+	return NameIndex_Find( NAMEINDEX_TARGETNAME, entStart, pszName );
+}
+
+edict_t *NameIndex_FindClassname( edict_t *entStart, const char *pszName )
+{
+	return NameIndex_Find( NAMEINDEX_CLASSNAME, entStart, pszName );
+}
+
+/*
+================
+NameIndex_BenchFire
+
+Microseconds per FireTargets style walk over every edict with a name
+================
+*/
+static double NameIndex_BenchFire( int names, int lookups, int *pFound )
+{
+	edict_t *pent;
+	char szName[32];
+	double start;
+	int i;
+
+	*pFound = 0;
+	start = UTIL_PerfTime();
+
+	for( i = 0; i < lookups; i++ )
+	{
+		sprintf( szName, "nameindex_bench%i", i % names );
+
+		pent = NULL;
+		for( ; ; )
+		{
+			pent = FIND_ENTITY_BY_TARGETNAME( pent, szName );
+			if( FNullEnt( pent ) )
+				break;
+			( *pFound )++;
+		}
+	}
+
+	return ( UTIL_PerfTime() - start ) * 1e6 / lookups;
+}
+
+/*
+================
+NameIndex_Bench
+
+sv_nameindex_bench [named entities] [distinct names] [lookups]
+================
+*/
+static void NameIndex_Bench( void )
+{
+	CBaseEntity **pExtra;
+	edict_t *pWorld = INDEXENT( 0 );
+	char szName[32];
+	double indexed, scan;
+	int extra, names, lookups, i, used;
+	int foundIndexed, foundScan;
+	float saved;
+
+	if( !pWorld || !NameIndex_Active() )
+	{
+		ALERT( at_console, "sv_nameindex_bench: needs a running map with sv_nameindex enabled\n" );
+		return;
+	}
+
+	extra = ( CMD_ARGC() > 1 ) ? atoi( CMD_ARGV( 1 ) ) : 500;
+	names = ( CMD_ARGC() > 2 ) ? atoi( CMD_ARGV( 2 ) ) : 100;
+	lookups = ( CMD_ARGC() > 3 ) ? atoi( CMD_ARGV( 3 ) ) : 1000;
+	extra = Q_max( extra, 0 );
+	names = Q_max( names, 1 );
+	lookups = Q_max( lookups, 1 );
+
+	// Relays and managers sharing a handful of names each
+	pExtra = new CBaseEntity *[extra + 1];
+	for( i = 0; i < extra; i++ )
+	{
+		pExtra[i] = CBaseEntity::Create( "info_target", g_vecZero, g_vecZero );
+		if( !pExtra[i] )
+			continue;
+
+		sprintf( szName, "nameindex_bench%i", i % names );
+		pExtra[i]->pev->targetname = ALLOC_STRING( szName );
+		NameIndex_Link( pExtra[i]->edict() );
+	}
+
+	indexed = NameIndex_BenchFire( names, lookups, &foundIndexed );
+
+	saved = sv_nameindex.value;
+	sv_nameindex.value = 0;
+	scan = NameIndex_BenchFire( names, lookups, &foundScan );
+	sv_nameindex.value = saved;
+
+	used = 0;
+	for( i = 1; i < s_nMaxEnts; i++ )
+	{
+		if( !pWorld[i].free )
+			used++;
+	}
+
+	ALERT( at_console, "%i edicts in use, %i names, %i lookups\n", used, names, lookups );
+	ALERT( at_console, "  microseconds per target walk index / scan: %8.2f / %8.2f\n", indexed, scan );
+	if( foundIndexed != foundScan )
+		ALERT( at_console, "  index found %i targets, scan found %i\n", foundIndexed, foundScan );
+
+	for( i = 0; i < extra; i++ )
+	{
+		if( !pExtra[i] )
+			continue;
+
+		edict_t *pent = pExtra[i]->edict();
+		REMOVE_ENTITY( pent );
+		NameIndex_Link( pent );
+	}
+
+	delete[] pExtra;
+}
+
+/*
+================
+NameIndex_Init
+
+================
+*/
+void NameIndex_Init( void )
+{
+	CVAR_REGISTER( &sv_nameindex );
+	g_engfuncs.pfnAddServerCommand( "sv_nameindex_bench", NameIndex_Bench );
+}
@@ -0,0 +1,44 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// nameindex.h - live edicts by targetname and classname,
+// backs FIND_ENTITY_BY_TARGETNAME / FIND_ENTITY_BY_CLASSNAME
+//=========================================================
+#pragma once
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#define NAMEINDEX_TARGETNAME	0
+#define NAMEINDEX_CLASSNAME	1
+#define NAMEINDEX_FIELDS	2
+
+#define NAMEINDEX_BUCKETS	1024	// name groups per field, power of two
+
+extern cvar_t sv_nameindex;
+
+void NameIndex_Init( void );
+void NameIndex_Clear( void );
+
+// Refile an edict after its targetname or classname may have changed,
+// and pick up whatever was renamed without telling us once a frame
+void NameIndex_Link( edict_t *pent );
+void NameIndex_Frame( void );
+
+// Non-zero once the index is valid for the current map
+int NameIndex_Active( void );
+
+// NameIndex_FindTargetname / NameIndex_FindClassname are declared in util.h
+
+#endif // NAMEINDEX_H
@@ -0,0 +1,697 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== netdelta.cpp ========================================================
+
+  Delta encoder profiling and quantization.
+
+  With sv_deltastats 1 the encoders in client.cpp report every entity they
+  encode. The fields that go out are counted per classname, and each is
+  charged the bit width delta.lst gives it. sv_deltastats_report prints the
+  classes and fields that cost the most.
+
+  netquant.txt in the game directory rounds float fields per classname before
+  the state is delta compressed, one "classname field step" per line:
+
+	tf_rpg_rocket	angles		2.8125
+	tf_gl_grenade	origin[2]	0.5
+
+  A vector name covers all three components. The rounding happens when the
+  state is packed, so the stored baseline holds the same rounded value the
+  client got.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "entity_state.h"
+#include "netdelta.h"
+
+cvar_t sv_deltastats = { "sv_deltastats", "0" };	// count delta fields sent per classname
+
+#define ND_INT		0
+#define ND_FLOAT	1
+#define ND_ANGLE	2	// float that wraps at 360
+
+typedef struct
+{
+	const char	*name;	// as in delta.lst
+	int		offset;
+	int		size;
+	int		kind;
+} netfield_t;
+
+#define ND_FIELD( member, kind )	{ #member, (int)offsetof( entity_state_t, member ), (int)sizeof( ( (entity_state_t *)0 )->member ), kind }
+#define ND_ELEM( member, i, kind )	{ #member "[" #i "]", (int)( offsetof( entity_state_t, member ) + i * sizeof( ( (entity_state_t *)0 )->member[0] ) ), (int)sizeof( ( (entity_state_t *)0 )->member[0] ), kind }
+#define ND_VEC( member, kind )		ND_ELEM( member, 0, kind ), ND_ELEM( member, 1, kind ), ND_ELEM( member, 2, kind )
+#define ND_COLOR( c )			{ "rendercolor." #c, (int)( offsetof( entity_state_t, rendercolor ) + offsetof( color24, c ) ), 1, ND_INT }
+
+// Every entity_state_t field a delta description can send
+static const netfield_t s_NetFields[] =
+{
+	ND_VEC( origin, ND_FLOAT ),
+	ND_VEC( angles, ND_ANGLE ),
+	ND_FIELD( modelindex, ND_INT ),
+	ND_FIELD( sequence, ND_INT ),
+	ND_FIELD( frame, ND_FLOAT ),
+	ND_FIELD( colormap, ND_INT ),
+	ND_FIELD( skin, ND_INT ),
+	ND_FIELD( solid, ND_INT ),
+	ND_FIELD( effects, ND_INT ),
+	ND_FIELD( scale, ND_FLOAT ),
+	ND_FIELD( eflags, ND_INT ),
+	ND_FIELD( rendermode, ND_INT ),
+	ND_FIELD( renderamt, ND_INT ),
+	ND_COLOR( r ),
+	ND_COLOR( g ),
+	ND_COLOR( b ),
+	ND_FIELD( renderfx, ND_INT ),
+	ND_FIELD( movetype, ND_INT ),
+	ND_FIELD( animtime, ND_FLOAT ),
+	ND_FIELD( framerate, ND_FLOAT ),
+	ND_FIELD( body, ND_INT ),
+	ND_ELEM( controller, 0, ND_INT ),
+	ND_ELEM( controller, 1, ND_INT ),
+	ND_ELEM( controller, 2, ND_INT ),
+	ND_ELEM( controller, 3, ND_INT ),
+	ND_ELEM( blending, 0, ND_INT ),
+	ND_ELEM( blending, 1, ND_INT ),
+	ND_ELEM( blending, 2, ND_INT ),
+	ND_ELEM( blending, 3, ND_INT ),
+	ND_VEC( velocity, ND_FLOAT ),
+	ND_VEC( mins, ND_FLOAT ),
+	ND_VEC( maxs, ND_FLOAT ),
+	ND_FIELD( aiment, ND_INT ),
+	ND_FIELD( owner, ND_INT ),
+	ND_FIELD( friction, ND_FLOAT ),
+	ND_FIELD( gravity, ND_FLOAT ),
+	ND_FIELD( team, ND_INT ),
+	ND_FIELD( playerclass, ND_INT ),
+	ND_FIELD( health, ND_INT ),
+	ND_FIELD( spectator, ND_INT ),
+	ND_FIELD( weaponmodel, ND_INT ),
+	ND_FIELD( gaitsequence, ND_INT ),
+	ND_VEC( basevelocity, ND_FLOAT ),
+	ND_FIELD( usehull, ND_INT ),
+	ND_FIELD( oldbuttons, ND_INT ),
+	ND_FIELD( onground, ND_INT ),
+	ND_FIELD( iStepLeft, ND_INT ),
+	ND_FIELD( flFallVelocity, ND_FLOAT ),
+	ND_FIELD( fov, ND_FLOAT ),
+	ND_FIELD( weaponanim, ND_INT ),
+	ND_VEC( startpos, ND_FLOAT ),
+	ND_VEC( endpos, ND_FLOAT ),
+	ND_FIELD( impacttime, ND_FLOAT ),
+	ND_FIELD( starttime, ND_FLOAT ),
+	ND_FIELD( iuser1, ND_INT ),
+	ND_FIELD( iuser2, ND_INT ),
+	ND_FIELD( iuser3, ND_INT ),
+	ND_FIELD( iuser4, ND_INT ),
+	ND_FIELD( fuser1, ND_FLOAT ),
+	ND_FIELD( fuser2, ND_FLOAT ),
+	ND_FIELD( fuser3, ND_FLOAT ),
+	ND_FIELD( fuser4, ND_FLOAT ),
+	ND_VEC( vuser1, ND_FLOAT ),
+	ND_VEC( vuser2, ND_FLOAT ),
+	ND_VEC( vuser3, ND_FLOAT ),
+	ND_VEC( vuser4, ND_FLOAT ),
+};
+
+#define NETDELTA_FIELDS		(int)( sizeof( s_NetFields ) / sizeof( s_NetFields[0] ) )
+
+static const char *s_szNetTypes[NETDELTA_TYPES] =
+{
+	"entity_state_t",
+	"entity_state_player_t",
+	"custom_entity_state_t",
+};
+
+// Bit width of each field per description, -1 when the description doesn't send it
+static short s_NetBits[NETDELTA_TYPES][NETDELTA_FIELDS];
+static int s_bNetBitsLoaded;
+
+typedef struct
+{
+	char		name[32];
+	unsigned int	encodes;
+	unsigned int	changes[NETDELTA_FIELDS];
+	double		bits[NETDELTA_FIELDS];
+	double		total;
+} netclass_t;
+
+static netclass_t s_NetClasses[NETDELTA_MAX_CLASSES];
+static int s_iNumNetClasses;
+static float s_flNetStatsStart;
+
+// Last classname seen per entity number and the class it mapped to
+typedef struct
+{
+	string_t	classname;
+	int		index;
+} netentclass_t;
+
+static netentclass_t *s_pNetEntClass;
+static int s_iNetEntClassSize;
+
+typedef struct
+{
+	char	classname[32];
+	int	numsteps;
+	int	field[NETDELTA_MAX_STEPS];
+	float	step[NETDELTA_MAX_STEPS];
+} netpolicy_t;
+
+static netpolicy_t s_NetPolicies[NETDELTA_MAX_POLICIES];
+static int s_iNumNetPolicies;
+
+static int NetDelta_FindField( const char *name )
+{
+	int i;
+
+	for( i = 0; i < NETDELTA_FIELDS; i++ )
+	{
+		if( !strcmp( s_NetFields[i].name, name ) )
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+================
+NetDelta_LoadBits
+
+Pull the bit widths of the three entity descriptions out of delta.lst
+================
+*/
+static void NetDelta_LoadBits( void )
+{
+	char *pFile, *pData, *pEnd;
+	char line[256], word[64], name[64];
+	int length, type, field, bits, len, i;
+
+	memset( s_NetBits, 0, sizeof( s_NetBits ) );
+	s_bNetBitsLoaded = 0;
+
+	pFile = (char *)LOAD_FILE_FOR_ME( "delta.lst", &length );
+	if( !pFile )
+		return;
+
+	for( type = 0; type < NETDELTA_TYPES; type++ )
+	{
+		for( i = 0; i < NETDELTA_FIELDS; i++ )
+			s_NetBits[type][i] = -1;
+	}
+
+	type = -1;
+	pData = pFile;
+	pEnd = pFile + length;
+
+	while( pData < pEnd )
+	{
+		for( len = 0; pData < pEnd && *pData != '\n'; pData++ )
+		{
+			if( len < (int)sizeof( line ) - 1 )
+				line[len++] = *pData;
+		}
+		line[len] = '\0';
+		pData++;
+
+		if( sscanf( line, " %63s", word ) != 1 || !strncmp( word, "//", 2 ) || word[0] == '{' )
+			continue;
+
+		if( word[0] == '}' )
+		{
+			type = -1;
+			continue;
+		}
+
+		if( !strncmp( word, "DEFINE_DELTA", 12 ) )
+		{
+			char *p = strchr( line, '(' );
+
+			if( type < 0 || !p )
+				continue;
+
+			// DEFINE_DELTA( name, flags, bits, multiplier )
+			if( sscanf( p + 1, " %63[^, ] , %*[^,] , %d", name, &bits ) != 2 )
+				continue;
+
+			field = NetDelta_FindField( name );
+			if( field >= 0 )
+				s_NetBits[type][field] = bits;
+			continue;
+		}
+
+		// Header of the next description
+		for( type = 0; type < NETDELTA_TYPES; type++ )
+		{
+			if( !strcmp( word, s_szNetTypes[type] ) )
+				break;
+		}
+
+		if( type == NETDELTA_TYPES )
+			type = -1;
+	}
+
+	FREE_FILE( pFile );
+	s_bNetBitsLoaded = 1;
+}
+
+/*
+================
+NetDelta_LoadPolicies
+
+================
+*/
+static void NetDelta_LoadPolicies( void )
+{
+	char *pFile, *pData, *pEnd;
+	char line[256], classname[64], fieldname[64];
+	netpolicy_t *policy;
+	float step;
+	int length, len, i, j, found;
+
+	s_iNumNetPolicies = 0;
+
+	pFile = (char *)LOAD_FILE_FOR_ME( "netquant.txt", &length );
+	if( !pFile )
+		return;
+
+	pData = pFile;
+	pEnd = pFile + length;
+
+	while( pData < pEnd )
+	{
+		for( len = 0; pData < pEnd && *pData != '\n'; pData++ )
+		{
+			if( len < (int)sizeof( line ) - 1 )
+				line[len++] = *pData;
+		}
+		line[len] = '\0';
+		pData++;
+
+		if( sscanf( line, " %63s %63s %f", classname, fieldname, &step ) != 3 || !strncmp( classname, "//", 2 ) )
+			continue;
+
+		if( step <= 0.0f )
+		{
+			ALERT( at_console, "netquant.txt: bad step for %s %s\n", classname, fieldname );
+			continue;
+		}
+
+		for( i = 0; i < s_iNumNetPolicies; i++ )
+		{
+			if( !strcmp( s_NetPolicies[i].classname, classname ) )
+				break;
+		}
+
+		if( i == s_iNumNetPolicies )
+		{
+			if( s_iNumNetPolicies == NETDELTA_MAX_POLICIES )
+			{
+				ALERT( at_console, "netquant.txt: more than %d classnames\n", NETDELTA_MAX_POLICIES );
+				continue;
+			}
+
+			policy = &s_NetPolicies[s_iNumNetPolicies++];
+			strncpy( policy->classname, classname, sizeof( policy->classname ) - 1 );
+			policy->classname[sizeof( policy->classname ) - 1] = '\0';
+			policy->numsteps = 0;
+		}
+
+		policy = &s_NetPolicies[i];
+		len = strlen( fieldname );
+		found = 0;
+
+		// Exact name, or every component of a vector
+		for( j = 0; j < NETDELTA_FIELDS; j++ )
+		{
+			if( strcmp( s_NetFields[j].name, fieldname ) && ( strncmp( s_NetFields[j].name, fieldname, len ) || s_NetFields[j].name[len] != '[' ) )
+				continue;
+
+			if( s_NetFields[j].kind == ND_INT )
+				continue;
+
+			found = 1;
+			if( policy->numsteps == NETDELTA_MAX_STEPS )
+				break;
+
+			policy->field[policy->numsteps] = j;
+			policy->step[policy->numsteps] = step;
+			policy->numsteps++;
+		}
+
+		if( !found )
+			ALERT( at_console, "netquant.txt: %s is not a float field\n", fieldname );
+	}
+
+	FREE_FILE( pFile );
+
+	if( s_iNumNetPolicies )
+		ALERT( at_console, "netquant.txt: quantizing %d classnames\n", s_iNumNetPolicies );
+}
+
+/*
+================
+NetDelta_ClassFor
+
+================
+*/
+static netclass_t *NetDelta_ClassFor( int number )
+{
+	netentclass_t *cache = NULL;
+	const char *classname;
+	edict_t *pent;
+	int i;
+
+	if( number <= 0 || number >= gpGlobals->maxEntities )
+		return NULL;
+
+	if( number >= s_iNetEntClassSize )
+	{
+		s_pNetEntClass = (netentclass_t *)realloc( s_pNetEntClass, gpGlobals->maxEntities * sizeof( netentclass_t ) );
+		for( i = s_iNetEntClassSize; i < gpGlobals->maxEntities; i++ )
+			s_pNetEntClass[i].index = -1;
+		s_iNetEntClassSize = gpGlobals->maxEntities;
+	}
+
+	pent = INDEXENT( number );
+	if( !pent )
+		return NULL;
+
+	cache = &s_pNetEntClass[number];
+	if( cache->index >= 0 && cache->classname == pent->v.classname )
+		return &s_NetClasses[cache->index];
+
+	classname = STRING( pent->v.classname );
+	if( !classname || !classname[0] )
+		classname = "<none>";
+
+	for( i = 0; i < s_iNumNetClasses; i++ )
+	{
+		if( !strcmp( s_NetClasses[i].name, classname ) )
+			break;
+	}
+
+	if( i == s_iNumNetClasses )
+	{
+		// The last slot collects whatever doesn't fit
+		if( s_iNumNetClasses == NETDELTA_MAX_CLASSES - 1 )
+			classname = "<other>";
+
+		if( s_iNumNetClasses < NETDELTA_MAX_CLASSES )
+		{
+			memset( &s_NetClasses[i], 0, sizeof( s_NetClasses[i] ) );
+			strncpy( s_NetClasses[i].name, classname, sizeof( s_NetClasses[i].name ) - 1 );
+			s_iNumNetClasses++;
+		}
+		else
+		{
+			i = NETDELTA_MAX_CLASSES - 1;
+		}
+	}
+
+	cache->classname = pent->v.classname;
+	cache->index = i;
+
+	return &s_NetClasses[i];
+}
+
+/*
+================
+NetDelta_BindAliases
+
+================
+*/
+int NetDelta_BindAliases( struct delta_s *pFields, struct delta_s **ppBound, entity_field_alias_t *aliases, int count )
+{
+	int i;
+
+	if( *ppBound == pFields )
+		return 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		aliases[i].field = DELTA_FINDFIELD( pFields, aliases[i].name );
+		aliases[i].stat = NetDelta_FindField( aliases[i].name );
+	}
+
+	*ppBound = pFields;
+	return 1;
+}
+
+/*
+================
+NetDelta_Record
+
+================
+*/
+void NetDelta_Record( int type, const struct entity_state_s *from, const struct entity_state_s *to, const entity_field_alias_t *aliases, int unset, int forced )
+{
+	const unsigned char *f = (const unsigned char *)from;
+	const unsigned char *t = (const unsigned char *)to;
+	signed char sent[NETDELTA_FIELDS];
+	netclass_t *nc;
+	int i, bits;
+
+	nc = NetDelta_ClassFor( to->number );
+	if( !nc )
+		return;
+
+	if( !s_flNetStatsStart )
+		s_flNetStatsStart = gpGlobals->time;
+
+	for( i = 0; i < NETDELTA_FIELDS; i++ )
+		sent[i] = memcmp( f + s_NetFields[i].offset, t + s_NetFields[i].offset, s_NetFields[i].size ) != 0;
+
+	// What the encoder decided wins over the compare
+	for( i = 0; unset | forced; i++ )
+	{
+		if( aliases[i].stat >= 0 )
+		{
+			if( unset & ( 1 << i ) )
+				sent[aliases[i].stat] = 0;
+			else if( forced & ( 1 << i ) )
+				sent[aliases[i].stat] = 1;
+		}
+
+		unset &= ~( 1 << i );
+		forced &= ~( 1 << i );
+	}
+
+	nc->encodes++;
+
+	for( i = 0; i < NETDELTA_FIELDS; i++ )
+	{
+		if( !sent[i] )
+			continue;
+
+		bits = s_NetBits[type][i];
+		if( bits < 0 )
+			continue;	// not in this description, never goes out
+
+		nc->changes[i]++;
+		nc->bits[i] += bits;
+		nc->total += bits;
+	}
+}
+
+/*
+================
+NetDelta_Policy
+
+================
+*/
+int NetDelta_Policy( edict_t *ent )
+{
+	const char *classname;
+	int i;
+
+	if( !s_iNumNetPolicies )
+		return -1;
+
+	classname = STRING( ent->v.classname );
+
+	for( i = 0; i < s_iNumNetPolicies; i++ )
+	{
+		if( !strcmp( s_NetPolicies[i].classname, classname ) )
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+================
+NetDelta_Quantize
+
+================
+*/
+void NetDelta_Quantize( int policy, struct entity_state_s *state )
+{
+	const netpolicy_t *p = &s_NetPolicies[policy];
+	float *value;
+	int i;
+
+	for( i = 0; i < p->numsteps; i++ )
+	{
+		value = (float *)( (unsigned char *)state + s_NetFields[p->field[i]].offset );
+		*value = floor( *value / p->step[i] + 0.5f ) * p->step[i];
+	}
+}
+
+static int NetDelta_CompareClass( const void *a, const void *b )
+{
+	double ta = s_NetClasses[*(const int *)a].total;
+	double tb = s_NetClasses[*(const int *)b].total;
+
+	return ( ta < tb ) - ( ta > tb );
+}
+
+/*
+================
+NetDelta_ReportClass
+
+Fields that cost the most first, the top few unless all are wanted
+================
+*/
+static void NetDelta_ReportClass( const netclass_t *nc, double alltotal, int maxfields )
+{
+	int order[NETDELTA_FIELDS];
+	int i, j, count, swap;
+
+	ALERT( at_console, "%-24s %8u encodes %10.0f bits %5.1f%% %6.1f bits/encode\n", nc->name, nc->encodes, nc->total,
+		alltotal > 0.0 ? nc->total * 100.0 / alltotal : 0.0, nc->encodes ? nc->total / nc->encodes : 0.0 );
+
+	count = 0;
+	for( i = 0; i < NETDELTA_FIELDS; i++ )
+	{
+		if( nc->changes[i] )
+			order[count++] = i;
+	}
+
+	for( i = 1; i < count; i++ )
+	{
+		swap = order[i];
+		for( j = i; j > 0 && ( nc->bits[order[j - 1]] < nc->bits[swap] || ( nc->bits[order[j - 1]] == nc->bits[swap] && nc->changes[order[j - 1]] < nc->changes[swap] ) ); j-- )
+			order[j] = order[j - 1];
+		order[j] = swap;
+	}
+
+	if( count > maxfields )
+		count = maxfields;
+
+	for( i = 0; i < count; i++ )
+	{
+		j = order[i];
+		ALERT( at_console, "    %-16s %8u changes %5.1f%% of encodes %10.0f bits\n", s_NetFields[j].name, nc->changes[j],
+			nc->changes[j] * 100.0 / nc->encodes, nc->bits[j] );
+	}
+}
+
+/*
+================
+NetDelta_Report
+
+sv_deltastats_report [classname]
+================
+*/
+static void NetDelta_Report( void )
+{
+	int order[NETDELTA_MAX_CLASSES];
+	const char *only = NULL;
+	double total = 0.0;
+	float elapsed;
+	int i;
+
+	if( CMD_ARGC() > 1 )
+		only = CMD_ARGV( 1 );
+
+	if( !s_iNumNetClasses )
+	{
+		ALERT( at_console, "sv_deltastats_report: nothing recorded, set sv_deltastats 1\n" );
+		return;
+	}
+
+	for( i = 0; i < s_iNumNetClasses; i++ )
+	{
+		order[i] = i;
+		total += s_NetClasses[i].total;
+	}
+
+	qsort( order, s_iNumNetClasses, sizeof( int ), NetDelta_CompareClass );
+
+	elapsed = gpGlobals->time - s_flNetStatsStart;
+
+	if( !s_bNetBitsLoaded )
+		ALERT( at_console, "delta.lst not found, bit costs unknown\n" );
+
+	ALERT( at_console, "%.0f bits over %.1f seconds, %.0f bits/s to all clients\n", total, elapsed, elapsed > 0.0f ? total / elapsed : 0.0 );
+
+	for( i = 0; i < s_iNumNetClasses; i++ )
+	{
+		const netclass_t *nc = &s_NetClasses[order[i]];
+
+		if( only && strcmp( only, nc->name ) )
+			continue;
+
+		NetDelta_ReportClass( nc, total, only ? NETDELTA_FIELDS : 6 );
+	}
+}
+
+static void NetDelta_Reset( void )
+{
+	int i;
+
+	s_iNumNetClasses = 0;
+	s_flNetStatsStart = 0.0f;
+
+	for( i = 0; i < s_iNetEntClassSize; i++ )
+		s_pNetEntClass[i].index = -1;
+}
+
+/*
+================
+NetDelta_Init
+
+================
+*/
+void NetDelta_Init( void )
+{
+	CVAR_REGISTER( &sv_deltastats );
+	g_engfuncs.pfnAddServerCommand( "sv_deltastats_report", NetDelta_Report );
+	g_engfuncs.pfnAddServerCommand( "sv_deltastats_reset", NetDelta_Reset );
+}
+
+/*
+================
+NetDelta_LevelInit
+
+================
+*/
+void NetDelta_LevelInit( void )
+{
+	int i;
+
+	// Classname strings belong to the old map
+	for( i = 0; i < s_iNetEntClassSize; i++ )
+		s_pNetEntClass[i].index = -1;
+
+	NetDelta_LoadBits();
+	NetDelta_LoadPolicies();
+}
@@ -0,0 +1,59 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// netdelta.h - per class delta field statistics and
+// quantization policies for the entity encoders
+//=========================================================
+#pragma once
+#ifndef NETDELTA_H
+#define NETDELTA_H
+
+// Delta descriptions the game dll encodes, as named in delta.lst
+#define NETDELTA_ENTITY		0	// entity_state_t, Entity_Encode
+#define NETDELTA_PLAYER		1	// entity_state_player_t, Player_Encode
+#define NETDELTA_CUSTOM		2	// custom_entity_state_t, Custom_Encode
+#define NETDELTA_TYPES		3
+
+#define NETDELTA_MAX_CLASSES	128	// classnames tracked by sv_deltastats
+#define NETDELTA_MAX_POLICIES	32	// classnames with a quantization policy
+#define NETDELTA_MAX_STEPS	16	// quantized fields per policy
+
+typedef struct
+{
+	char name[32];
+	int field;	// index in the engine's delta description
+	int stat;	// index in the netdelta field table
+} entity_field_alias_t;
+
+extern cvar_t sv_deltastats;
+
+void NetDelta_Init( void );
+
+// Reread delta.lst bit widths and netquant.txt
+void NetDelta_LevelInit( void );
+
+// Look the aliases up again when the engine hands over a different description,
+// returns non-zero when it did
+int NetDelta_BindAliases( struct delta_s *pFields, struct delta_s **ppBound, entity_field_alias_t *aliases, int count );
+
+// Count the fields that go out for this encode, unset and forced are masks
+// of alias indices the encoder unset or set
+void NetDelta_Record( int type, const struct entity_state_s *from, const struct entity_state_s *to, const entity_field_alias_t *aliases, int unset, int forced );
+
+// Quantization policy for the entity's classname, -1 for none
+int NetDelta_Policy( edict_t *ent );
+void NetDelta_Quantize( int policy, struct entity_state_s *state );
+
+#endif // NETDELTA_H
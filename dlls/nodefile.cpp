@@ -0,0 +1,637 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== nodefile.cpp ========================================================
+
+  Memory mapped node graph cache.
+
+  maps/graphs/<map>.ngc holds the same nodes, links, routes and link hash as
+  the .nod file, laid out as lumps behind a header of offsets and counts. The
+  graph's arrays point straight into a copy-on-write mapping of the file, so a
+  map change costs a header check instead of a parse and copy, and pages stay
+  shared with the file cache until something writes to them. Only the entity
+  pointers of blocked links are ever written, the file lists those links so
+  FSetGraphPointers doesn't have to walk the whole pool.
+
+  The header carries a CRC of the BSP header and entity lump, and the size,
+  time and CRC of the .nod file it was converted from. A cache built for
+  another compile of the map, or from another .nod, is ignored. The .nod
+  file is still written and read as before and has to pass CheckNODFile
+  first; loading one writes the cache for the next time.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "nodes.h"
+#include "nodefile.h"
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+cvar_t sv_nodecache = { "sv_nodecache", "1" };	// 0 ignores and doesn't write the .ngc cache
+
+#define BSP_HEADER_SIZE		( 4 + 15 * 8 )	// version and lump directory
+#define BSP_MAX_ENTITIES	( 4 * 1024 * 1024 )
+#define ENTRY_STATE_EMPTY	-1
+
+typedef struct
+{
+	const CGraph	*pGraph;	// graph pointing into the mapping, NULL if none
+	byte		*base;
+	int		size;
+	const int	*linkents;
+	int		cLinkEnts;
+} nodemap_t;
+
+static nodemap_t s_NodeMap;
+
+static void NodeFile_Path( char *szPath, const char *szMapName, const char *szExtension )
+{
+	GET_GAME_DIR( szPath );
+	strcat( szPath, "/maps/graphs/" );
+	strcat( szPath, szMapName );
+	strcat( szPath, szExtension );
+}
+
+/*
+================
+NodeFile_Open
+
+Opens maps/... from the game directory, or from valve for a mod
+that uses its maps. Files that only live in a pak aren't cached.
+================
+*/
+static FILE *NodeFile_Open( const char *szName, struct stat *pStat )
+{
+	char szPath[MAX_PATH];
+	char *pDir;
+	FILE *f;
+
+	GET_GAME_DIR( szPath );
+	strcat( szPath, "/" );
+	strcat( szPath, szName );
+
+	f = fopen( szPath, "rb" );
+	if( !f )
+	{
+		GET_GAME_DIR( szPath );
+		pDir = strrchr( szPath, '/' );
+		if( !pDir )
+			pDir = strrchr( szPath, '\\' );
+		pDir = pDir ? pDir + 1 : szPath;
+
+		if( !stricmp( pDir, "valve" ) )
+			return NULL;
+
+		strcpy( pDir, "valve/" );
+		strcat( pDir, szName );
+
+		f = fopen( szPath, "rb" );
+		if( !f )
+			return NULL;
+	}
+
+	if( fstat( fileno( f ), pStat ) != 0 )
+	{
+		fclose( f );
+		return NULL;
+	}
+
+	return f;
+}
+
+/*
+================
+NodeFile_BspCRC
+
+CRC of the BSP's lump directory and entity lump, nothing else
+of the BSP is read
+================
+*/
+static int NodeFile_BspCRC( const char *szMapName, unsigned int *pCRC, int *pSize )
+{
+	char szName[MAX_PATH];
+	byte header[BSP_HEADER_SIZE];
+	byte *pEntities;
+	int entofs, entlen, size;
+	struct stat st;
+	CRC32_t crc;
+	FILE *f;
+
+	strcpy( szName, "maps/" );
+	strcat( szName, szMapName );
+	strcat( szName, ".bsp" );
+
+	f = NodeFile_Open( szName, &st );
+	if( !f )
+		return FALSE;
+
+	size = (int)st.st_size;
+	if( fread( header, 1, sizeof( header ), f ) != sizeof( header ) )
+	{
+		fclose( f );
+		return FALSE;
+	}
+
+	// Lump 0 is the entity string
+	memcpy( &entofs, header + 4, sizeof( int ) );
+	memcpy( &entlen, header + 8, sizeof( int ) );
+
+	if( entofs < 0 || entlen < 0 || entlen > BSP_MAX_ENTITIES || entofs > size - entlen )
+		entlen = 0;
+
+	CRC32_INIT( &crc );
+	CRC32_PROCESS_BUFFER( &crc, header, sizeof( header ) );
+
+	if( entlen && ( pEntities = (byte *)malloc( entlen ) ) != NULL )
+	{
+		fseek( f, entofs, SEEK_SET );
+		if( fread( pEntities, 1, entlen, f ) == (size_t)entlen )
+			CRC32_PROCESS_BUFFER( &crc, pEntities, entlen );
+		free( pEntities );
+	}
+
+	fclose( f );
+
+	*pCRC = CRC32_FINAL( crc );
+	*pSize = size;
+	return TRUE;
+}
+
+/*
+================
+NodeFile_NodSource
+
+Size, time and CRC of the .nod file the cache was converted from,
+so a replaced or deleted .nod isn't shadowed by an old cache
+================
+*/
+static int NodeFile_NodSource( const char *szMapName, unsigned int *pCRC, int *pSize, int *pTime )
+{
+	char szName[MAX_PATH];
+	byte buffer[16384];
+	struct stat st;
+	CRC32_t crc;
+	size_t count;
+	FILE *f;
+
+	strcpy( szName, "maps/graphs/" );
+	strcat( szName, szMapName );
+	strcat( szName, ".nod" );
+
+	f = NodeFile_Open( szName, &st );
+	if( !f )
+		return FALSE;
+
+	CRC32_INIT( &crc );
+	while( ( count = fread( buffer, 1, sizeof( buffer ), f ) ) > 0 )
+		CRC32_PROCESS_BUFFER( &crc, buffer, (int)count );
+
+	fclose( f );
+
+	*pCRC = CRC32_FINAL( crc );
+	*pSize = (int)st.st_size;
+	*pTime = (int)st.st_mtime;
+	return TRUE;
+}
+
+static byte *NodeFile_MapFile( const char *szPath, int *pSize )
+{
+	byte *base;
+#ifdef _WIN32
+	HANDLE hFile, hMapping;
+	DWORD size;
+
+	hFile = CreateFileA( szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( hFile == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	size = GetFileSize( hFile, NULL );
+	hMapping = size ? CreateFileMappingA( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL ) : NULL;
+	CloseHandle( hFile );
+
+	if( !hMapping )
+		return NULL;
+
+	// The view keeps the mapping alive
+	base = (byte *)MapViewOfFile( hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	CloseHandle( hMapping );
+#else
+	struct stat st;
+	int fd, size;
+
+	fd = open( szPath, O_RDONLY );
+	if( fd < 0 )
+		return NULL;
+
+	if( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	size = (int)st.st_size;
+	base = (byte *)mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if( base == (byte *)MAP_FAILED )
+		return NULL;
+#endif
+	*pSize = (int)size;
+	return base;
+}
+
+static void NodeFile_UnmapFile( byte *base, int size )
+{
+#ifdef _WIN32
+	UnmapViewOfFile( base );
+#else
+	munmap( base, size );
+#endif
+}
+
+static int NodeFile_LumpValid( const nodefileheader_t *header, int lump, int recsize )
+{
+	const nodelump_t *l = &header->lumps[lump];
+
+	if( l->offset < (int)sizeof( nodefileheader_t ) || ( l->offset & ( NODEFILE_ALIGN - 1 ) ) || l->count < 0 )
+		return FALSE;
+
+	return l->count <= ( header->filesize - l->offset ) / recsize;
+}
+
+/*
+================
+NodeFile_Validate
+
+Everything the graph code indexes with must stay inside the file,
+a damaged cache is thrown away rather than trusted
+================
+*/
+static int NodeFile_Validate( const byte *base, int size, const nodefileheader_t *source )
+{
+	const nodefileheader_t *header = (const nodefileheader_t *)base;
+	int i, j;
+
+	if( size < (int)sizeof( nodefileheader_t ) )
+		return FALSE;
+
+	if( header->ident != NODEFILE_IDENT || header->version != NODEFILE_VERSION || header->graphversion != GRAPH_VERSION
+		|| header->nodesize != (int)sizeof( CNode ) || header->linksize != (int)sizeof( CLink ) || header->filesize != size )
+		return FALSE;
+
+	if( header->bspcrc != source->bspcrc || header->bspsize != source->bspsize )
+	{
+		ALERT( at_aiconsole, "Node graph cache is for another build of the map\n" );
+		return FALSE;
+	}
+
+	if( header->nodcrc != source->nodcrc || header->nodsize != source->nodsize || header->nodtime != source->nodtime )
+	{
+		ALERT( at_aiconsole, "Node graph cache is for another .nod file\n" );
+		return FALSE;
+	}
+
+	if( !NodeFile_LumpValid( header, NODELUMP_NODES, sizeof( CNode ) ) || !NodeFile_LumpValid( header, NODELUMP_LINKS, sizeof( CLink ) )
+		|| !NodeFile_LumpValid( header, NODELUMP_ROUTES, 1 ) || !NodeFile_LumpValid( header, NODELUMP_HASHLINKS, sizeof( short ) )
+		|| !NodeFile_LumpValid( header, NODELUMP_LINKENTS, sizeof( int ) ) )
+		return FALSE;
+
+	int cNodes = header->lumps[NODELUMP_NODES].count;
+	int cLinks = header->lumps[NODELUMP_LINKS].count;
+	int nRouteInfo = header->lumps[NODELUMP_ROUTES].count;
+	const CNode *pNodes = (const CNode *)( base + header->lumps[NODELUMP_NODES].offset );
+	const CLink *pLinks = (const CLink *)( base + header->lumps[NODELUMP_LINKS].offset );
+	const short *pHashLinks = (const short *)( base + header->lumps[NODELUMP_HASHLINKS].offset );
+	const int *pLinkEnts = (const int *)( base + header->lumps[NODELUMP_LINKENTS].offset );
+
+	if( cNodes <= 0 || nRouteInfo <= 0 )
+		return FALSE;
+
+	for( i = 0; i < cNodes; i++ )
+	{
+		if( pNodes[i].m_iFirstLink < 0 || pNodes[i].m_cNumLinks < 0 || pNodes[i].m_iFirstLink > cLinks - pNodes[i].m_cNumLinks )
+			return FALSE;
+
+		for( j = 0; j < MAX_NODE_HULLS * 2; j++ )
+		{
+			int offset = pNodes[i].m_pNextBestNode[j >> 1][j & 1];
+			if( offset < 0 || offset >= nRouteInfo )
+				return FALSE;
+		}
+	}
+
+	for( i = 0; i < cLinks; i++ )
+	{
+		if( pLinks[i].m_iSrcNode < 0 || pLinks[i].m_iSrcNode >= cNodes || pLinks[i].m_iDestNode < 0 || pLinks[i].m_iDestNode >= cNodes )
+			return FALSE;
+	}
+
+	for( i = 0; i < header->lumps[NODELUMP_HASHLINKS].count; i++ )
+	{
+		if( pHashLinks[i] != ENTRY_STATE_EMPTY && ( pHashLinks[i] < 0 || pHashLinks[i] >= cLinks ) )
+			return FALSE;
+	}
+
+	for( i = 0; i < header->lumps[NODELUMP_LINKENTS].count; i++ )
+	{
+		if( pLinkEnts[i] < 0 || pLinkEnts[i] >= cLinks )
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+================
+NodeFile_Map
+
+================
+*/
+int NodeFile_Map( CGraph *pGraph, const char *szMapName )
+{
+	char szPath[MAX_PATH];
+	nodefileheader_t source;
+	int size;
+	byte *base;
+
+	if( !sv_nodecache.value )
+		return FALSE;
+
+	NodeFile_Release( pGraph );
+
+	if( !NodeFile_BspCRC( szMapName, &source.bspcrc, &source.bspsize )
+		|| !NodeFile_NodSource( szMapName, &source.nodcrc, &source.nodsize, &source.nodtime ) )
+		return FALSE;
+
+	NodeFile_Path( szPath, szMapName, NODEFILE_EXTENSION );
+
+	base = NodeFile_MapFile( szPath, &size );
+	if( !base )
+		return FALSE;
+
+	if( !NodeFile_Validate( base, size, &source ) )
+	{
+		NodeFile_UnmapFile( base, size );
+		return FALSE;
+	}
+
+	const nodefileheader_t *header = (const nodefileheader_t *)base;
+
+	// The graph was just cleared by InitGraph, nothing to free
+	pGraph->m_pNodes = (CNode *)( base + header->lumps[NODELUMP_NODES].offset );
+	pGraph->m_pLinkPool = (CLink *)( base + header->lumps[NODELUMP_LINKS].offset );
+	pGraph->m_pRouteInfo = (signed char *)( base + header->lumps[NODELUMP_ROUTES].offset );
+	pGraph->m_pHashLinks = (short *)( base + header->lumps[NODELUMP_HASHLINKS].offset );
+	pGraph->m_di = NULL;
+
+	pGraph->m_cNodes = header->lumps[NODELUMP_NODES].count;
+	pGraph->m_cLinks = header->lumps[NODELUMP_LINKS].count;
+	pGraph->m_nRouteInfo = header->lumps[NODELUMP_ROUTES].count;
+	pGraph->m_nHashLinks = header->lumps[NODELUMP_HASHLINKS].count;
+	memcpy( pGraph->m_HashPrimes, header->hashprimes, sizeof( pGraph->m_HashPrimes ) );
+	pGraph->m_CheckedCounter = 0;
+
+	pGraph->m_fGraphPresent = TRUE;
+	pGraph->m_fGraphPointersSet = FALSE;
+	pGraph->m_fRoutingComplete = TRUE;
+
+	s_NodeMap.pGraph = pGraph;
+	s_NodeMap.base = base;
+	s_NodeMap.size = size;
+	s_NodeMap.linkents = (const int *)( base + header->lumps[NODELUMP_LINKENTS].offset );
+	s_NodeMap.cLinkEnts = header->lumps[NODELUMP_LINKENTS].count;
+
+	return TRUE;
+}
+
+/*
+================
+NodeFile_Release
+
+================
+*/
+int NodeFile_Release( CGraph *pGraph )
+{
+	if( !s_NodeMap.pGraph || s_NodeMap.pGraph != pGraph )
+		return FALSE;
+
+	NodeFile_UnmapFile( s_NodeMap.base, s_NodeMap.size );
+	memset( &s_NodeMap, 0, sizeof( s_NodeMap ) );
+
+	pGraph->m_pNodes = NULL;
+	pGraph->m_pLinkPool = NULL;
+	pGraph->m_pRouteInfo = NULL;
+	pGraph->m_pHashLinks = NULL;
+
+	return TRUE;
+}
+
+int NodeFile_LinkEnts( const CGraph *pGraph, const int **ppLinks )
+{
+	if( !s_NodeMap.pGraph || s_NodeMap.pGraph != pGraph )
+		return -1;
+
+	*ppLinks = s_NodeMap.linkents;
+	return s_NodeMap.cLinkEnts;
+}
+
+static int NodeFile_Write( FILE *f, const void *data, int size, int *pOffset )
+{
+	static const byte pad[NODEFILE_ALIGN] = { 0 };
+	int padding = -*pOffset & ( NODEFILE_ALIGN - 1 );
+
+	if( padding && fwrite( pad, 1, padding, f ) != (size_t)padding )
+		return FALSE;
+
+	if( size && fwrite( data, 1, size, f ) != (size_t)size )
+		return FALSE;
+
+	*pOffset += padding + size;
+	return TRUE;
+}
+
+static int NodeFile_Align( int offset )
+{
+	return ( offset + NODEFILE_ALIGN - 1 ) & ~( NODEFILE_ALIGN - 1 );
+}
+
+/*
+================
+NodeFile_Save
+
+Goes to a temporary name first, a half written cache is never mapped
+================
+*/
+int NodeFile_Save( CGraph *pGraph, const char *szMapName )
+{
+	char szPath[MAX_PATH], szTemp[MAX_PATH];
+	nodefileheader_t header;
+	CLink *pLinks;
+	int *pLinkEnts;
+	int i, offset, ok;
+	FILE *f;
+
+	if( !sv_nodecache.value || !pGraph->m_fGraphPresent || !pGraph->m_pRouteInfo || s_NodeMap.pGraph == pGraph )
+		return FALSE;
+
+	memset( &header, 0, sizeof( header ) );
+
+	// A graph that isn't on disk as a .nod yet has nothing to tie the cache to
+	if( !NodeFile_BspCRC( szMapName, &header.bspcrc, &header.bspsize )
+		|| !NodeFile_NodSource( szMapName, &header.nodcrc, &header.nodsize, &header.nodtime ) )
+		return FALSE;
+
+	header.ident = NODEFILE_IDENT;
+	header.version = NODEFILE_VERSION;
+	header.graphversion = GRAPH_VERSION;
+	header.nodesize = sizeof( CNode );
+	header.linksize = sizeof( CLink );
+	memcpy( header.hashprimes, pGraph->m_HashPrimes, sizeof( header.hashprimes ) );
+
+	// Entity pointers mean nothing on disk, keep just whether there is one
+	pLinks = (CLink *)malloc( ( pGraph->m_cLinks + 1 ) * sizeof( CLink ) );
+	pLinkEnts = (int *)malloc( ( pGraph->m_cLinks + 1 ) * sizeof( int ) );
+	if( !pLinks || !pLinkEnts )
+	{
+		free( pLinks );
+		free( pLinkEnts );
+		return FALSE;
+	}
+
+	header.lumps[NODELUMP_LINKENTS].count = 0;
+	for( i = 0; i < pGraph->m_cLinks; i++ )
+	{
+		pLinks[i] = pGraph->m_pLinkPool[i];
+		if( pLinks[i].m_pLinkEnt )
+		{
+			pLinks[i].m_pLinkEnt = (entvars_t *)1;
+			pLinkEnts[header.lumps[NODELUMP_LINKENTS].count++] = i;
+		}
+	}
+
+	header.lumps[NODELUMP_NODES].count = pGraph->m_cNodes;
+	header.lumps[NODELUMP_LINKS].count = pGraph->m_cLinks;
+	header.lumps[NODELUMP_ROUTES].count = pGraph->m_nRouteInfo;
+	header.lumps[NODELUMP_HASHLINKS].count = pGraph->m_pHashLinks ? pGraph->m_nHashLinks : 0;
+
+	offset = sizeof( header );
+	offset = NodeFile_Align( offset );
+	header.lumps[NODELUMP_NODES].offset = offset;
+	offset = NodeFile_Align( offset + header.lumps[NODELUMP_NODES].count * sizeof( CNode ) );
+	header.lumps[NODELUMP_LINKS].offset = offset;
+	offset = NodeFile_Align( offset + header.lumps[NODELUMP_LINKS].count * sizeof( CLink ) );
+	header.lumps[NODELUMP_ROUTES].offset = offset;
+	offset = NodeFile_Align( offset + header.lumps[NODELUMP_ROUTES].count );
+	header.lumps[NODELUMP_HASHLINKS].offset = offset;
+	offset = NodeFile_Align( offset + header.lumps[NODELUMP_HASHLINKS].count * sizeof( short ) );
+	header.lumps[NODELUMP_LINKENTS].offset = offset;
+	header.filesize = offset + header.lumps[NODELUMP_LINKENTS].count * sizeof( int );
+
+	NodeFile_Path( szPath, szMapName, NODEFILE_EXTENSION );
+	NodeFile_Path( szTemp, szMapName, NODEFILE_EXTENSION ".tmp" );
+
+	f = fopen( szTemp, "wb" );
+	if( !f )
+	{
+		ALERT( at_aiconsole, "Couldn't Create: %s\n", szTemp );
+		free( pLinks );
+		free( pLinkEnts );
+		return FALSE;
+	}
+
+	offset = 0;
+	ok = NodeFile_Write( f, &header, sizeof( header ), &offset )
+		&& NodeFile_Write( f, pGraph->m_pNodes, header.lumps[NODELUMP_NODES].count * sizeof( CNode ), &offset )
+		&& NodeFile_Write( f, pLinks, header.lumps[NODELUMP_LINKS].count * sizeof( CLink ), &offset )
+		&& NodeFile_Write( f, pGraph->m_pRouteInfo, header.lumps[NODELUMP_ROUTES].count, &offset )
+		&& NodeFile_Write( f, pGraph->m_pHashLinks, header.lumps[NODELUMP_HASHLINKS].count * sizeof( short ), &offset )
+		&& NodeFile_Write( f, pLinkEnts, header.lumps[NODELUMP_LINKENTS].count * sizeof( int ), &offset );
+
+	ok = ( fclose( f ) == 0 ) && ok && offset == header.filesize;
+
+	free( pLinks );
+	free( pLinkEnts );
+
+	if( ok )
+	{
+#ifdef _WIN32
+		remove( szPath );
+#endif
+		ok = ( rename( szTemp, szPath ) == 0 );
+	}
+
+	if( !ok )
+	{
+		remove( szTemp );
+		ALERT( at_aiconsole, "Couldn't write node graph cache %s\n", szPath );
+		return FALSE;
+	}
+
+	ALERT( at_aiconsole, "Created: %s\n", szPath );
+	return TRUE;
+}
+
+/*
+================
+NodeFile_Convert
+
+sv_nodecache_convert [map], writes the cache for a level's .nod file
+================
+*/
+static void NodeFile_Convert( void )
+{
+	const char *szMapName = ( CMD_ARGC() > 1 ) ? CMD_ARGV( 1 ) : STRING( gpGlobals->mapname );
+	CGraph *pGraph;
+
+	if( !szMapName || !szMapName[0] )
+	{
+		ALERT( at_console, "usage: sv_nodecache_convert <map>\n" );
+		return;
+	}
+
+	pGraph = (CGraph *)calloc( 1, sizeof( CGraph ) );
+	if( !pGraph )
+		return;
+
+	if( !pGraph->FLoadGraph( szMapName ) )
+		ALERT( at_console, "Couldn't load maps/graphs/%s.nod\n", szMapName );
+	else if( NodeFile_Save( pGraph, szMapName ) )
+		ALERT( at_console, "Wrote maps/graphs/%s" NODEFILE_EXTENSION "\n", szMapName );
+	else
+		ALERT( at_console, "Couldn't write the cache for %s, is sv_nodecache 0?\n", szMapName );
+
+	pGraph->InitGraph();
+	free( pGraph );
+}
+
+/*
+================
+NodeFile_Init
+
+================
+*/
+void NodeFile_Init( void )
+{
+	CVAR_REGISTER( &sv_nodecache );
+	g_engfuncs.pfnAddServerCommand( "sv_nodecache_convert", NodeFile_Convert );
+}
@@ -0,0 +1,81 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// nodefile.h - memory mapped node graph cache, kept next to
+// the .nod file and tied to the BSP it was built for
+//=========================================================
+#pragma once
+#ifndef NODEFILE_H
+#define NODEFILE_H
+
+#define NODEFILE_IDENT		( ( 'C' << 24 ) + ( 'G' << 16 ) + ( 'N' << 8 ) + 'H' )	// "HNGC"
+#define NODEFILE_VERSION	2
+#define NODEFILE_EXTENSION	".ngc"
+#define NODEFILE_ALIGN		16
+
+#define NODELUMP_NODES		0	// CNode[m_cNodes]
+#define NODELUMP_LINKS		1	// CLink[m_cLinks], m_pLinkEnt is 1 where an entity blocks the link
+#define NODELUMP_ROUTES		2	// m_pRouteInfo bytes
+#define NODELUMP_HASHLINKS	3	// m_pHashLinks shorts
+#define NODELUMP_LINKENTS	4	// indices of the links with a blocking entity
+#define NODELUMP_COUNT		5
+
+typedef struct
+{
+	int		offset;		// from the start of the file
+	int		count;		// records, not bytes
+} nodelump_t;
+
+// Only offsets and counts, no pointers, so the file can be used
+// wherever it gets mapped. Record sizes are stored because CNode
+// and CLink differ between 32 and 64 bit builds.
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		graphversion;	// GRAPH_VERSION of the writer
+	int		nodesize;
+	int		linksize;
+	unsigned int	bspcrc;		// header and entity lump of the BSP
+	int		bspsize;
+	unsigned int	nodcrc;		// the .nod file the cache was converted from
+	int		nodsize;
+	int		nodtime;
+	int		hashprimes[16];
+	nodelump_t	lumps[NODELUMP_COUNT];
+	int		filesize;
+} nodefileheader_t;
+
+class CGraph;
+
+extern cvar_t sv_nodecache;
+
+void NodeFile_Init( void );
+
+// Point the graph's arrays into the level's cache file. Fails when
+// there is none, or it was built for another BSP, another .nod file
+// or another build.
+int NodeFile_Map( CGraph *pGraph, const char *szMapName );
+
+// Unmap the graph if it is mapped, its array pointers are NULL after
+int NodeFile_Release( CGraph *pGraph );
+
+// Write the cache for a graph in memory, legacy loaded or just built
+int NodeFile_Save( CGraph *pGraph, const char *szMapName );
+
+// Links with a blocking entity while the graph is mapped, -1 otherwise
+int NodeFile_LinkEnts( const CGraph *pGraph, const int **ppLinks );
+
+#endif // NODEFILE_H
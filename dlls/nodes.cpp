@@ -24,6 +24,8 @@
 #include	"nodes_compat.h"
 #include	"animation.h"
 #include	"doors.h"
+#include	"game.h"
+#include	"nodefile.h"
 
 #define	HULL_STEP_SIZE 16// how far the test hull moves on each step
 #define	NODE_HEIGHT	8	// how high to lift nodes off the ground after we drop them all (make stair/ramp mapping easier)
@@ -51,6 +53,379 @@ LINK_ENTITY_TO_CLASS( info_node_air, CNodeEnt )
 #define CreateDirectoryA(p, n) mkdir(p,777)
 #endif
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include <atomic>
+
+//=========================================================
+// Scratch state for FindShortestPath and FindNearestNode.
+// Kept out of CGraph, the class is written to the .nod file
+// as it is.
+//=========================================================
+#define NODEGRID_DIM		64	// grid cells per side at most
+#define NODEGRID_MIN_CELL	64.0f	// smallest cell edge in world units
+#define NODECACHE_SETS		64
+#define NODECACHE_WAYS		4
+#define NODECACHE_QUANTUM	8.0f	// query origins this close share an answer
+
+typedef struct
+{
+	int		key[3];		// quantized origin
+	int		afNodeTypes;
+	int		node;		// nearest node or -1
+	unsigned int	used;		// least recently used goes first, 0 is empty
+} nodecache_t;
+
+typedef struct
+{
+	const CNode	*pNodes;	// graph the grid was built for
+	int		cNodes;
+	float		mins[2];
+	float		cellsize;
+	int		dims[2];
+	int		*cellstart;	// dims[0] * dims[1] + 1 offsets into cellnodes
+	int		*cellnodes;
+
+	// Candidates by distance while a query runs
+	int		*heap;
+	float		*heapdist;
+	int		heapcount;
+
+	nodecache_t	cache[NODECACHE_SETS][NODECACHE_WAYS];
+	unsigned int	cacheclock;
+} nodegrid_t;
+
+typedef struct
+{
+	int		cNodes;		// room in the arrays
+	unsigned int	serial;		// bumped per search, entries from older searches are stale
+	unsigned int	*reached;	// serial of the search that last reached the node
+	float		*cost;		// from the start
+	float		*score;		// cost plus the straight line estimate to the goal
+	int		*previous;
+	int		*heap;		// open list, min-heap on score
+	int		*heapindex;	// position in heap, -1 once closed
+	int		heapcount;
+} nodesearch_t;
+
+static nodegrid_t	s_NodeGrid;
+static nodesearch_t	s_NodeSearch;
+
+static void NodeGrid_Free( void )
+{
+	free( s_NodeGrid.cellstart );
+	free( s_NodeGrid.cellnodes );
+	free( s_NodeGrid.heap );
+	free( s_NodeGrid.heapdist );
+
+	memset( &s_NodeGrid, 0, sizeof( s_NodeGrid ) );
+}
+
+static inline int NodeGrid_Cell( const nodegrid_t *grid, float v, int axis )
+{
+	int c = (int)( ( v - grid->mins[axis] ) / grid->cellsize );
+
+	if( c < 0 )
+		return 0;
+	if( c >= grid->dims[axis] )
+		return grid->dims[axis] - 1;
+	return c;
+}
+
+//=========================================================
+// NodeGrid_Build - buckets the nodes by x / y cell, the
+// search walks the cells outward from the query point.
+//=========================================================
+static int NodeGrid_Build( const CGraph *pGraph )
+{
+	nodegrid_t *grid = &s_NodeGrid;
+	float maxs[2], extent;
+	int i, cell, count;
+
+	NodeGrid_Free();
+
+	if( pGraph->m_cNodes <= 0 )
+		return FALSE;
+
+	grid->mins[0] = grid->mins[1] = 999999999.0f;
+	maxs[0] = maxs[1] = -999999999.0f;
+
+	for( i = 0; i < pGraph->m_cNodes; i++ )
+	{
+		const Vector &org = pGraph->m_pNodes[i].m_vecOriginPeek;
+
+		grid->mins[0] = Q_min( grid->mins[0], org.x );
+		grid->mins[1] = Q_min( grid->mins[1], org.y );
+		maxs[0] = Q_max( maxs[0], org.x );
+		maxs[1] = Q_max( maxs[1], org.y );
+	}
+
+	extent = Q_max( maxs[0] - grid->mins[0], maxs[1] - grid->mins[1] );
+	grid->cellsize = Q_max( extent / NODEGRID_DIM, NODEGRID_MIN_CELL );
+
+	for( i = 0; i < 2; i++ )
+		grid->dims[i] = Q_min( (int)( ( maxs[i] - grid->mins[i] ) / grid->cellsize ) + 1, NODEGRID_DIM );
+
+	count = grid->dims[0] * grid->dims[1];
+	grid->cellstart = (int *)calloc( count + 1, sizeof( int ) );
+	grid->cellnodes = (int *)malloc( pGraph->m_cNodes * sizeof( int ) );
+	grid->heap = (int *)malloc( pGraph->m_cNodes * sizeof( int ) );
+	grid->heapdist = (float *)malloc( pGraph->m_cNodes * sizeof( float ) );
+
+	if( !grid->cellstart || !grid->cellnodes || !grid->heap || !grid->heapdist )
+	{
+		ALERT( at_aiconsole, "Couldn't allocate the nearest node grid.\n" );
+		NodeGrid_Free();
+		return FALSE;
+	}
+
+	// Counting sort into the cells
+	for( i = 0; i < pGraph->m_cNodes; i++ )
+	{
+		const Vector &org = pGraph->m_pNodes[i].m_vecOriginPeek;
+
+		cell = NodeGrid_Cell( grid, org.y, 1 ) * grid->dims[0] + NodeGrid_Cell( grid, org.x, 0 );
+		grid->cellstart[cell + 1]++;
+	}
+
+	for( i = 0; i < count; i++ )
+		grid->cellstart[i + 1] += grid->cellstart[i];
+
+	for( i = 0; i < pGraph->m_cNodes; i++ )
+	{
+		const Vector &org = pGraph->m_pNodes[i].m_vecOriginPeek;
+
+		cell = NodeGrid_Cell( grid, org.y, 1 ) * grid->dims[0] + NodeGrid_Cell( grid, org.x, 0 );
+		grid->cellnodes[grid->cellstart[cell]++] = i;
+	}
+
+	// Filling advanced every start to the next cell's, shift them back
+	for( i = count; i > 0; i-- )
+		grid->cellstart[i] = grid->cellstart[i - 1];
+	grid->cellstart[0] = 0;
+
+	grid->pNodes = pGraph->m_pNodes;
+	grid->cNodes = pGraph->m_cNodes;
+
+	return TRUE;
+}
+
+static void NodeGrid_Push( nodegrid_t *grid, int iNode, float flDist )
+{
+	int i = grid->heapcount++;
+	int parent;
+
+	while( i > 0 )
+	{
+		parent = ( i - 1 ) >> 1;
+		if( grid->heapdist[parent] <= flDist )
+			break;
+
+		grid->heap[i] = grid->heap[parent];
+		grid->heapdist[i] = grid->heapdist[parent];
+		i = parent;
+	}
+
+	grid->heap[i] = iNode;
+	grid->heapdist[i] = flDist;
+}
+
+static int NodeGrid_Pop( nodegrid_t *grid )
+{
+	int iNode = grid->heap[0];
+	int last = --grid->heapcount;
+	float flDist = grid->heapdist[last];
+	int i = 0, child;
+
+	while( ( child = 2 * i + 1 ) < last )
+	{
+		if( child + 1 < last && grid->heapdist[child + 1] < grid->heapdist[child] )
+			child++;
+
+		if( flDist <= grid->heapdist[child] )
+			break;
+
+		grid->heap[i] = grid->heap[child];
+		grid->heapdist[i] = grid->heapdist[child];
+		i = child;
+	}
+
+	grid->heap[i] = grid->heap[last];
+	grid->heapdist[i] = flDist;
+
+	return iNode;
+}
+
+static void NodeGrid_AddCell( nodegrid_t *grid, const CNode *pNodes, int x, int y, const Vector &vecOrigin, int afNodeTypes )
+{
+	int cell = y * grid->dims[0] + x;
+	int i, iNode;
+
+	for( i = grid->cellstart[cell]; i < grid->cellstart[cell + 1]; i++ )
+	{
+		iNode = grid->cellnodes[i];
+		if( !( pNodes[iNode].m_afNodeInfo & afNodeTypes ) )
+			continue;
+
+		NodeGrid_Push( grid, iNode, ( vecOrigin - pNodes[iNode].m_vecOriginPeek ).Length() );
+	}
+}
+
+//=========================================================
+// NodeGrid_Search - walks rings of cells outward from the
+// query point. Once the candidates closer than anything
+// outside the rings walked so far are known, they are
+// traced in order of distance and the first one visible
+// is the nearest.
+//=========================================================
+static int NodeGrid_Search( const CNode *pNodes, const Vector &vecOrigin, int afNodeTypes )
+{
+	nodegrid_t *grid = &s_NodeGrid;
+	TraceResult tr;
+	int cx, cy, ring, maxring, x, y, iNode;
+	float flBound;
+
+	cx = NodeGrid_Cell( grid, vecOrigin.x, 0 );
+	cy = NodeGrid_Cell( grid, vecOrigin.y, 1 );
+
+	maxring = Q_max( Q_max( cx, grid->dims[0] - 1 - cx ), Q_max( cy, grid->dims[1] - 1 - cy ) );
+	grid->heapcount = 0;
+
+	for( ring = 0; ring <= maxring; ring++ )
+	{
+		for( y = cy - ring; y <= cy + ring; y++ )
+		{
+			if( y < 0 || y >= grid->dims[1] )
+				continue;
+
+			if( y == cy - ring || y == cy + ring )
+			{
+				for( x = Q_max( cx - ring, 0 ); x <= Q_min( cx + ring, grid->dims[0] - 1 ); x++ )
+					NodeGrid_AddCell( grid, pNodes, x, y, vecOrigin, afNodeTypes );
+			}
+			else
+			{
+				if( cx - ring >= 0 )
+					NodeGrid_AddCell( grid, pNodes, cx - ring, y, vecOrigin, afNodeTypes );
+				if( cx + ring < grid->dims[0] )
+					NodeGrid_AddCell( grid, pNodes, cx + ring, y, vecOrigin, afNodeTypes );
+			}
+		}
+
+		// Nodes not seen yet are outside these cells
+		flBound = 999999999.0f;
+		if( cx - ring > 0 )
+			flBound = Q_min( flBound, vecOrigin.x - ( grid->mins[0] + ( cx - ring ) * grid->cellsize ) );
+		if( cx + ring < grid->dims[0] - 1 )
+			flBound = Q_min( flBound, grid->mins[0] + ( cx + ring + 1 ) * grid->cellsize - vecOrigin.x );
+		if( cy - ring > 0 )
+			flBound = Q_min( flBound, vecOrigin.y - ( grid->mins[1] + ( cy - ring ) * grid->cellsize ) );
+		if( cy + ring < grid->dims[1] - 1 )
+			flBound = Q_min( flBound, grid->mins[1] + ( cy + ring + 1 ) * grid->cellsize - vecOrigin.y );
+
+		while( grid->heapcount && grid->heapdist[0] <= flBound )
+		{
+			iNode = NodeGrid_Pop( grid );
+
+			// make sure that vecOrigin can trace to this node!
+			UTIL_TraceLine( vecOrigin, pNodes[iNode].m_vecOriginPeek, ignore_monsters, 0, &tr );
+
+			if( tr.flFraction == 1.0f )
+				return iNode;
+		}
+	}
+
+	return -1;
+}
+
+static void NodeSearch_Free( nodesearch_t *ns )
+{
+	free( ns->reached );
+	free( ns->cost );
+	free( ns->score );
+	free( ns->previous );
+	free( ns->heap );
+	free( ns->heapindex );
+
+	memset( ns, 0, sizeof( *ns ) );
+}
+
+static int NodeSearch_Reserve( nodesearch_t *ns, int cNodes )
+{
+	if( ns->cNodes >= cNodes )
+		return TRUE;
+
+	NodeSearch_Free( ns );
+
+	ns->reached = (unsigned int *)calloc( cNodes, sizeof( unsigned int ) );
+	ns->cost = (float *)malloc( cNodes * sizeof( float ) );
+	ns->score = (float *)malloc( cNodes * sizeof( float ) );
+	ns->previous = (int *)malloc( cNodes * sizeof( int ) );
+	ns->heap = (int *)malloc( cNodes * sizeof( int ) );
+	ns->heapindex = (int *)malloc( cNodes * sizeof( int ) );
+
+	if( !ns->reached || !ns->cost || !ns->score || !ns->previous || !ns->heap || !ns->heapindex )
+	{
+		ALERT( at_aiconsole, "Couldn't allocate path search space for %d nodes.\n", cNodes );
+		NodeSearch_Free( ns );
+		return FALSE;
+	}
+
+	ns->cNodes = cNodes;
+	return TRUE;
+}
+
+static void NodeSearch_SiftUp( nodesearch_t *ns, int i )
+{
+	int iNode = ns->heap[i];
+	int parent;
+
+	while( i > 0 )
+	{
+		parent = ( i - 1 ) >> 1;
+		if( ns->score[ns->heap[parent]] <= ns->score[iNode] )
+			break;
+
+		ns->heap[i] = ns->heap[parent];
+		ns->heapindex[ns->heap[i]] = i;
+		i = parent;
+	}
+
+	ns->heap[i] = iNode;
+	ns->heapindex[iNode] = i;
+}
+
+static int NodeSearch_Pop( nodesearch_t *ns )
+{
+	int iNode = ns->heap[0];
+	int iLast = ns->heap[--ns->heapcount];
+	int i = 0, child;
+
+	ns->heapindex[iNode] = -1;
+
+	if( !ns->heapcount )
+		return iNode;
+
+	while( ( child = 2 * i + 1 ) < ns->heapcount )
+	{
+		if( child + 1 < ns->heapcount && ns->score[ns->heap[child + 1]] < ns->score[ns->heap[child]] )
+			child++;
+
+		if( ns->score[iLast] <= ns->score[ns->heap[child]] )
+			break;
+
+		ns->heap[i] = ns->heap[child];
+		ns->heapindex[ns->heap[i]] = i;
+		i = child;
+	}
+
+	ns->heap[i] = iLast;
+	ns->heapindex[iLast] = i;
+
+	return iNode;
+}
+
 //=========================================================
 // CGraph - InitGraph - prepares the graph for use. Frees any
 // memory currently in use by the world graph, NULLs 
@@ -64,6 +439,10 @@ void CGraph::InitGraph( void )
 	m_fGraphPointersSet = FALSE;
 	m_fRoutingComplete = FALSE;
 
+	// A mapped cache owns the arrays, not the heap
+	//
+	NodeFile_Release( this );
+
 	// Free the link pool
 	//
 	if( m_pLinkPool )
@@ -108,6 +487,8 @@ void CGraph::InitGraph( void )
 
 	m_iLastActiveIdleSearch = 0;
 	m_iLastCoverSearch = 0;
+
+	NodeGrid_Free();
 }
 	
 //=========================================================
@@ -647,8 +1028,9 @@ int CGraph::FindShortestPath( int *piPath, int iStart, int iDest, int iHull, int
 	}
 	else
 	{
+		nodesearch_t *ns = &s_NodeSearch;
+		Vector2D vecGoal = m_pNodes[iDest].m_vecOrigin.Make2D();
 		int i;
-		CQueuePriority queue;
 
 		switch( iHull )
 		{
@@ -666,25 +1048,32 @@ int CGraph::FindShortestPath( int *piPath, int iStart, int iDest, int iHull, int
 			break;
 		}
 
-		// Mark all the nodes as unvisited.
+		if( !NodeSearch_Reserve( ns, m_cNodes ) )
+			return 0;
+
+		// Entries left from earlier searches read as unvisited.
 		//
-		for ( i = 0; i < m_cNodes; i++)
+		if( ++ns->serial == 0 )
 		{
-			m_pNodes[i].m_flClosestSoFar = -1.0f;
+			memset( ns->reached, 0, ns->cNodes * sizeof( unsigned int ) );
+			ns->serial = 1;
 		}
 
-		m_pNodes[iStart].m_flClosestSoFar = 0.0;
-		m_pNodes[iStart].m_iPreviousNode = iStart;// tag this as the origin node
-		queue.Insert( iStart, 0.0 );// insert start node 
+		ns->reached[iStart] = ns->serial;
+		ns->cost[iStart] = 0.0f;
+		ns->score[iStart] = ( m_pNodes[iStart].m_vecOrigin.Make2D() - vecGoal ).Length();
+		ns->previous[iStart] = iStart;// tag this as the origin node
+		ns->heap[0] = iStart;
+		ns->heapindex[iStart] = 0;
+		ns->heapcount = 1;
 
-		while( !queue.Empty() )
+		while( ns->heapcount )
 		{
-			// now pull a node out of the queue
-			float flCurrentDistance;
-			iCurrentNode = queue.Remove( flCurrentDistance );
+			// now pull the node with the best estimate out of the queue
+			iCurrentNode = NodeSearch_Pop( ns );
 
-			// For straight-line weights, the following Shortcut works. For arbitrary weights,
-			// it doesn't.
+			// Link weights are the 2D distances between nodes, so the straight line
+			// estimate never overshoots and the destination comes out on a shortest path.
 			//
 			if( iCurrentNode == iDest )
 				break;
@@ -694,56 +1083,71 @@ int CGraph::FindShortestPath( int *piPath, int iStart, int iDest, int iHull, int
 			for( i = 0; i < pCurrentNode->m_cNumLinks; i++ )
 			{
 				// run through all of this node's neighbors
-				iVisitNode = INodeLink( iCurrentNode, i );
-				if( ( m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_afLinkInfo & iHullMask ) != iHullMask )
+				CLink *pLink = &m_pLinkPool[pCurrentNode->m_iFirstLink + i];
+
+				iVisitNode = pLink->m_iDestNode;
+				if( ( pLink->m_afLinkInfo & iHullMask ) != iHullMask )
 				{
 					// monster is too large to walk this connection
-					//ALERT( at_aiconsole, "fat ass %d/%d\n",m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_afLinkInfo, iMonsterHull );
 					continue;
 				}
 				// check the connection from the current node to the node we're about to mark visited and push into the queue				
-				if( m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_pLinkEnt != NULL )
+				if( pLink->m_pLinkEnt != NULL )
 				{
 					// there's a brush ent in the way! Don't mark this node or put it into the queue unless the monster can negotiate it
-					if( !HandleLinkEnt( iCurrentNode, m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_pLinkEnt, afCapMask, NODEGRAPH_STATIC ) )
+					if( !HandleLinkEnt( iCurrentNode, pLink->m_pLinkEnt, afCapMask, NODEGRAPH_STATIC ) )
 					{
 						// monster should not try to go this way.
 						continue;
 					}
 				}
-				float flOurDistance = flCurrentDistance + m_pLinkPool[m_pNodes[iCurrentNode].m_iFirstLink + i].m_flWeight;
-				if(  m_pNodes[iVisitNode].m_flClosestSoFar < -0.5f
-				   || flOurDistance < m_pNodes[iVisitNode].m_flClosestSoFar - 0.001f )
+				float flOurDistance = ns->cost[iCurrentNode] + pLink->m_flWeight;
+
+				if( ns->reached[iVisitNode] == ns->serial )
 				{
-					m_pNodes[iVisitNode].m_flClosestSoFar = flOurDistance;
-					m_pNodes[iVisitNode].m_iPreviousNode = iCurrentNode;
+					// already closed, or queued at least this close
+					if( ns->heapindex[iVisitNode] < 0 || flOurDistance >= ns->cost[iVisitNode] - 0.001f )
+						continue;
 
-					queue.Insert( iVisitNode, flOurDistance );
+					ns->score[iVisitNode] -= ns->cost[iVisitNode] - flOurDistance;
+					ns->cost[iVisitNode] = flOurDistance;
+					ns->previous[iVisitNode] = iCurrentNode;
+					NodeSearch_SiftUp( ns, ns->heapindex[iVisitNode] );
+				}
+				else
+				{
+					ns->reached[iVisitNode] = ns->serial;
+					ns->cost[iVisitNode] = flOurDistance;
+					ns->score[iVisitNode] = flOurDistance + ( m_pNodes[iVisitNode].m_vecOrigin.Make2D() - vecGoal ).Length();
+					ns->previous[iVisitNode] = iCurrentNode;
+
+					ns->heap[ns->heapcount] = iVisitNode;
+					NodeSearch_SiftUp( ns, ns->heapcount );
+					ns->heapcount++;
 				}
 			}
 		}
-		if( m_pNodes[iDest].m_flClosestSoFar < -0.5f )
+		if( ns->reached[iDest] != ns->serial )
 		{
 			// Destination is unreachable, no path found.
 			return 0;
 		}
 
-		// the queue is not empty
-		// now we must walk backwards through the m_iPreviousNode field, and count how many connections there are in the path
+		// now we must walk backwards through the previous nodes, and count how many connections there are in the path
 		iCurrentNode = iDest;
 		iNumPathNodes = 1;// count the dest
 
 		while( iCurrentNode != iStart )
 		{
 			iNumPathNodes++;
-			iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode;
+			iCurrentNode = ns->previous[iCurrentNode];
 		}
 
 		iCurrentNode = iDest;
 		for( i = iNumPathNodes - 1; i >= 0; i-- )
 		{
 			piPath[i] = iCurrentNode;
-			iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode;
+			iCurrentNode = ns->previous[iCurrentNode];
 		}
 	}
 #if 0
@@ -782,29 +1186,6 @@ int CGraph::FindShortestPath( int *piPath, int iStart, int iDest, int iHull, int
 	return iNumPathNodes;
 }
 
-inline ULONG Hash( void *p, int len )
-{
-	CRC32_t ulCrc;
-	CRC32_INIT( &ulCrc );
-	CRC32_PROCESS_BUFFER( &ulCrc, p, len );
-	return CRC32_FINAL( ulCrc );
-}
-
-void inline CalcBounds( int &Lower, int &Upper, int Goal, int Best )
-{
-	int Temp = 2 * Goal - Best;
-	if( Best > Goal )
-	{
-		Lower = Q_max( 0, Temp );
-		Upper = Best;
-	}
-	else
-	{
-		Upper = Q_min( 255, Temp );
-		Lower = Best;
-	}
-}
-
 // Convert from [-8192,8192] to [0, 255]
 //
 inline int CALC_RANGE( int x, int lower, int upper )
@@ -812,56 +1193,6 @@ inline int CALC_RANGE( int x, int lower, int upper )
 	return NUM_RANGES * ( x - lower ) / ( ( upper - lower + 1 ) );
 }
 
-void inline UpdateRange( int &minValue, int &maxValue, int Goal, int Best )
-{
-	int Lower, Upper;
-	CalcBounds( Lower, Upper, Goal, Best );
-	if( Upper < maxValue )
-		maxValue = Upper;
-	if( minValue < Lower )
-		minValue = Lower;
-}
-
-void CGraph::CheckNode( Vector vecOrigin, int iNode )
-{
-	// Have we already seen this point before?.
-	//
-	if( m_di[iNode].m_CheckedEvent == m_CheckedCounter )
-		return;
-
-	m_di[iNode].m_CheckedEvent = m_CheckedCounter;
-
-	float flDist = ( vecOrigin - m_pNodes[iNode].m_vecOriginPeek ).Length();
-
-	if( flDist < m_flShortest )
-	{
-		TraceResult tr;
-
-		// make sure that vecOrigin can trace to this node!
-		UTIL_TraceLine( vecOrigin, m_pNodes[iNode].m_vecOriginPeek, ignore_monsters, 0, &tr );
-
-		if( tr.flFraction == 1.0f )
-		{
-			m_iNearest = iNode;
-			m_flShortest = flDist;
-
-			UpdateRange( m_minX, m_maxX, CALC_RANGE( vecOrigin.x, m_RegionMin[0], m_RegionMax[0] ), m_pNodes[iNode].m_Region[0] );
-			UpdateRange( m_minY, m_maxY, CALC_RANGE( vecOrigin.y, m_RegionMin[1], m_RegionMax[1] ), m_pNodes[iNode].m_Region[1] );
-			UpdateRange( m_minZ, m_maxZ, CALC_RANGE( vecOrigin.z, m_RegionMin[2], m_RegionMax[2] ), m_pNodes[iNode].m_Region[2] );
-
-			// From maxCircle, calculate maximum bounds box. All points must be
-			// simultaneously inside all bounds of the box.
-			//
-			m_minBoxX = CALC_RANGE( vecOrigin.x - flDist, m_RegionMin[0], m_RegionMax[0] );
-			m_maxBoxX = CALC_RANGE( vecOrigin.x + flDist, m_RegionMin[0], m_RegionMax[0] );
-			m_minBoxY = CALC_RANGE( vecOrigin.y - flDist, m_RegionMin[1], m_RegionMax[1] );
-			m_maxBoxY = CALC_RANGE( vecOrigin.y + flDist, m_RegionMin[1], m_RegionMax[1] );
-			m_minBoxZ = CALC_RANGE( vecOrigin.z - flDist, m_RegionMin[2], m_RegionMax[2] );
-			m_maxBoxZ = CALC_RANGE( vecOrigin.z + flDist, m_RegionMin[2], m_RegionMax[2] );
-		}
-	}
-}
-
 //=========================================================
 // CGraph - FindNearestNode - returns the index of the node nearest
 // the given vector -1 is failure (couldn't find a valid
@@ -874,8 +1205,11 @@ int CGraph::FindNearestNode( const Vector &vecOrigin,  CBaseEntity *pEntity )
 
 int CGraph::FindNearestNode( const Vector &vecOrigin, int afNodeTypes )
 {
+	nodegrid_t *grid = &s_NodeGrid;
+	nodecache_t *pSet, *pEntry;
+	int key[3];
+	unsigned int hash;
 	int i;
-	TraceResult tr;
 
 	if( !m_fGraphPresent || !m_fGraphPointersSet )
 	{
@@ -884,264 +1218,103 @@ int CGraph::FindNearestNode( const Vector &vecOrigin, int afNodeTypes )
 		return -1;
 	}
 
-	// Check with the cache
-	//
-	ULONG iHash = ( CACHE_SIZE - 1 ) & Hash( (void *)(const float *)vecOrigin, sizeof(vecOrigin) );
-	if( m_Cache[iHash].v == vecOrigin )
-	{
-		//ALERT( at_aiconsole, "Cache Hit.\n" );
-		return m_Cache[iHash].n;
-	}
-/*	else
+	if( grid->pNodes != m_pNodes || grid->cNodes != m_cNodes )
 	{
-		//ALERT( at_aiconsole, "Cache Miss.\n" );
+		if( !NodeGrid_Build( this ) )
+			return -1;
 	}
-*/
-	// Mark all points as unchecked.
+
+	// Check with the cache
 	//
-	m_CheckedCounter++;
-	if( m_CheckedCounter == 0 )
+	for( i = 0; i < 3; i++ )
+		key[i] = (int)floor( vecOrigin[i] / NODECACHE_QUANTUM );
+
+	hash = (unsigned int)( key[0] * 73856093 ) ^ (unsigned int)( key[1] * 19349663 ) ^ (unsigned int)( key[2] * 83492791 ) ^ (unsigned int)afNodeTypes;
+	pSet = grid->cache[hash & ( NODECACHE_SETS - 1 )];
+
+	for( i = 0; i < NODECACHE_WAYS; i++ )
 	{
-		for( i = 0; i < m_cNodes; i++ )
+		pEntry = &pSet[i];
+		if( pEntry->used && pEntry->afNodeTypes == afNodeTypes
+			&& pEntry->key[0] == key[0] && pEntry->key[1] == key[1] && pEntry->key[2] == key[2] )
 		{
-			m_di[i].m_CheckedEvent = 0;
+			pEntry->used = ++grid->cacheclock;
+			return pEntry->node;
 		}
-		m_CheckedCounter++;
 	}
 
-	m_iNearest = -1;
-	m_flShortest = 999999.0f; // just a big number.
+	m_iNearest = NodeGrid_Search( m_pNodes, vecOrigin, afNodeTypes );
 
-	// If we can find a visible point, then let CalcBounds set the limits, but if
-	// we have no visible point at all to start with, then don't restrict the limits.
+#if 0
+	// Verify our answers.
 	//
-#if 1
-	m_minX = 0; m_maxX = 255;
-	m_minY = 0; m_maxY = 255;
-	m_minZ = 0; m_maxZ = 255;
-	m_minBoxX = 0; m_maxBoxX = 255;
-	m_minBoxY = 0; m_maxBoxY = 255;
-	m_minBoxZ = 0; m_maxBoxZ = 255;
-#else
-	m_minBoxX = CALC_RANGE( vecOrigin.x - flDist, m_RegionMin[0], m_RegionMax[0] );
-	m_maxBoxX = CALC_RANGE( vecOrigin.x + flDist, m_RegionMin[0], m_RegionMax[0] );
-	m_minBoxY = CALC_RANGE( vecOrigin.y - flDist, m_RegionMin[1], m_RegionMax[1] );
-	m_maxBoxY = CALC_RANGE( vecOrigin.y + flDist, m_RegionMin[1], m_RegionMax[1] );
-	m_minBoxZ = CALC_RANGE( vecOrigin.z - flDist, m_RegionMin[2], m_RegionMax[2] );
-	m_maxBoxZ = CALC_RANGE( vecOrigin.z + flDist, m_RegionMin[2], m_RegionMax[2] );
-	CalcBounds( m_minX, m_maxX, CALC_RANGE( vecOrigin.x, m_RegionMin[0], m_RegionMax[0] ), m_pNodes[m_iNearest].m_Region[0] );
-	CalcBounds( m_minY, m_maxY, CALC_RANGE( vecOrigin.y, m_RegionMin[1], m_RegionMax[1] ), m_pNodes[m_iNearest].m_Region[1] );
-	CalcBounds( m_minZ, m_maxZ, CALC_RANGE( vecOrigin.z, m_RegionMin[2], m_RegionMax[2] ), m_pNodes[m_iNearest].m_Region[2] );
-#endif
-	int halfX = ( m_minX + m_maxX ) / 2;
-	int halfY = ( m_minY + m_maxY ) / 2;
-	int halfZ = ( m_minZ + m_maxZ ) / 2;
-
-	int j;
+	TraceResult tr;
+	int iNearestCheck = -1;
+	m_flShortest = 999999.0f;
 
-	for( i = halfX; i >= m_minX; i-- )
+	for( i = 0; i < m_cNodes; i++ )
 	{
-		for( j = m_RangeStart[0][i]; j <= m_RangeEnd[0][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[0]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgY = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[1];
-			if( rgY > m_maxBoxY )
-				break;
-
-			if( rgY < m_minBoxY )
-				continue;
+		if( !( m_pNodes[i].m_afNodeInfo & afNodeTypes ) )
+			continue;
 
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[2];
-			if( rgZ < m_minBoxZ )
-				continue;
+		float flDist = ( vecOrigin - m_pNodes[i].m_vecOriginPeek ).Length();
 
-			if( rgZ > m_maxBoxZ )
-				continue;
+		if( flDist < m_flShortest )
+		{
+			// make sure that vecOrigin can trace to this node!
+			UTIL_TraceLine( vecOrigin, m_pNodes[i].m_vecOriginPeek, ignore_monsters, 0, &tr );
 
-			CheckNode( vecOrigin, m_di[j].m_SortedBy[0] );
+			if( tr.flFraction == 1.0f )
+			{
+				iNearestCheck = i;
+				m_flShortest = flDist;
+			}
 		}
 	}
 
-	for( i = Q_max( m_minY, halfY + 1 ); i <= m_maxY; i++ )
+	if( iNearestCheck != m_iNearest )
 	{
-		for( j = m_RangeStart[1][i]; j <= m_RangeEnd[1][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[1]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[2];
-			if( rgZ > m_maxBoxZ )
-				break;
+		ALERT( at_aiconsole, "NOT closest %d %d.\n", iNearestCheck, m_iNearest );
+	}
+#endif
+	// Replace the least recently used way
+	//
+	pEntry = &pSet[0];
+	for( i = 1; i < NODECACHE_WAYS; i++ )
+	{
+		if( pSet[i].used < pEntry->used )
+			pEntry = &pSet[i];
+	}
 
-			if( rgZ < m_minBoxZ )
-				continue;
+	pEntry->key[0] = key[0];
+	pEntry->key[1] = key[1];
+	pEntry->key[2] = key[2];
+	pEntry->afNodeTypes = afNodeTypes;
+	pEntry->node = m_iNearest;
+	pEntry->used = ++grid->cacheclock;
 
-			int rgX = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[0];
-			if( rgX < m_minBoxX )
-				continue;
+	return m_iNearest;
+}
 
-			if( rgX > m_maxBoxX )
-				continue;
+//=========================================================
+// CGraph - ShowNodeConnections - draws a line from the given node
+// to all connected nodes
+//=========================================================
+void CGraph::ShowNodeConnections( int iNode )
+{
+	Vector vecSpot;
+	CNode *pNode;
+	CNode *pLinkNode;
+	int i;
 
-			CheckNode( vecOrigin, m_di[j].m_SortedBy[1] );
-		}
+	if( !m_fGraphPresent || !m_fGraphPointersSet )
+	{
+		// protect us in the case that the node graph isn't available or built
+		ALERT( at_aiconsole, "Graph not ready!\n" );
+		return;
 	}
 
-	for( i = Q_min( m_maxZ, halfZ ); i >= m_minZ; i-- )
-	{
-		for( j = m_RangeStart[2][i]; j <= m_RangeEnd[2][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[2]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgX = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[0];
-			if( rgX > m_maxBoxX )
-				break;
-
-			if( rgX < m_minBoxX )
-				continue;
-
-			int rgY = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[1];
-			if( rgY < m_minBoxY )
-				continue;
-
-			if( rgY > m_maxBoxY )
-				continue;
-
-			CheckNode( vecOrigin, m_di[j].m_SortedBy[2] );
-		}
-	}
-
-	for( i = Q_max( m_minX, halfX + 1 ); i <= m_maxX; i++ )
-	{
-		for( j = m_RangeStart[0][i]; j <= m_RangeEnd[0][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[0]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgY = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[1];
-			if( rgY > m_maxBoxY )
-				break;
-			if( rgY < m_minBoxY )
-				continue;
-
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[2];
-			if( rgZ < m_minBoxZ )
-				continue;
-			if( rgZ > m_maxBoxZ )
-				continue;
-			CheckNode( vecOrigin, m_di[j].m_SortedBy[0] );
-		}
-	}
-
-	for( i = Q_min( m_maxY, halfY ); i >= m_minY; i-- )
-	{
-		for( j = m_RangeStart[1][i]; j <= m_RangeEnd[1][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[1]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[2];
-			if( rgZ > m_maxBoxZ )
-				break;
-			if( rgZ < m_minBoxZ )
-				continue;
-			int rgX = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[0];
-			if( rgX < m_minBoxX )
-				continue;
-			if( rgX > m_maxBoxX )
-				continue;
-			CheckNode( vecOrigin, m_di[j].m_SortedBy[1] );
-		}
-	}
-
-	for( i = Q_max( m_minZ, halfZ + 1 ); i <= m_maxZ; i++ )
-	{
-		for( j = m_RangeStart[2][i]; j <= m_RangeEnd[2][i]; j++ )
-		{
-			if( !( m_pNodes[m_di[j].m_SortedBy[2]].m_afNodeInfo & afNodeTypes ) )
-				continue;
-
-			int rgX = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[0];
-			if( rgX > m_maxBoxX )
-				break;
-			if( rgX < m_minBoxX )
-				continue;
-			int rgY = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[1];
-			if( rgY < m_minBoxY )
-				continue;
-			if( rgY > m_maxBoxY )
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[2]);
-		}
-	}
-
-#if 0
-	// Verify our answers.
-	//
-	int iNearestCheck = -1;
-	m_flShortest = 8192;// find nodes within this radius
-
-	for( i = 0; i < m_cNodes; i++ )
-	{
-		float flDist = ( vecOrigin - m_pNodes[i].m_vecOriginPeek ).Length();
-
-		if( flDist < m_flShortest )
-		{
-			// make sure that vecOrigin can trace to this node!
-			UTIL_TraceLine( vecOrigin, m_pNodes[i].m_vecOriginPeek, ignore_monsters, 0, &tr );
-
-			if( tr.flFraction == 1.0 )
-			{
-				iNearestCheck = i;
-				m_flShortest = flDist;
-			}
-		}
-	}
-
-	if( iNearestCheck != m_iNearest )
-	{
-		ALERT( at_aiconsole, "NOT closest %d(%f,%f,%f) %d(%f,%f,%f).\n",
-			iNearestCheck,
-			m_pNodes[iNearestCheck].m_vecOriginPeek.x,
-			m_pNodes[iNearestCheck].m_vecOriginPeek.y,
-			m_pNodes[iNearestCheck].m_vecOriginPeek.z,
-			m_iNearest,
-			( m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.x ),
-			( m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.y ),
-			( m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.z ) );
-	}
-	if( m_iNearest == -1 )
-	{
-		ALERT( at_aiconsole, "All that work for nothing.\n" );
-	}
-#endif
-	m_Cache[iHash].v = vecOrigin;
-	m_Cache[iHash].n = m_iNearest;
-	return m_iNearest;
-}
-
-//=========================================================
-// CGraph - ShowNodeConnections - draws a line from the given node
-// to all connected nodes
-//=========================================================
-void CGraph::ShowNodeConnections( int iNode )
-{
-	Vector vecSpot;
-	CNode *pNode;
-	CNode *pLinkNode;
-	int i;
-
-	if( !m_fGraphPresent || !m_fGraphPointersSet )
-	{
-		// protect us in the case that the node graph isn't available or built
-		ALERT( at_aiconsole, "Graph not ready!\n" );
-		return;
-	}
-
-	if( iNode < 0 )
+	if( iNode < 0 )
 	{
 		ALERT( at_aiconsole, "Can't show connections for node %d\n", iNode );
 		return;
@@ -2111,6 +2284,7 @@ void CTestHull::BuildNodeGraph( void )
 
 	// save the node graph for this level	
 	WorldGraph.FSaveGraph( STRING( gpGlobals->mapname ) );
+	NodeFile_Save( &WorldGraph, STRING( gpGlobals->mapname ) );
 	ALERT( at_console, "Done.\n" );
 }
 
@@ -2645,11 +2819,18 @@ int CGraph::FSaveGraph( const char *szMapName )
 //=========================================================
 int CGraph::FSetGraphPointers( void )
 {
-	int i;
+	int i, iLink, cLinkEnts;
+	const int *piLinkEnts;
 	edict_t	*pentLinkEnt;
 
-	for( i = 0; i < m_cLinks; i++ )
+	// A mapped cache lists the links that have an entity, others are all walked
+	//
+	cLinkEnts = NodeFile_LinkEnts( this, &piLinkEnts );
+
+	for( iLink = 0; iLink < ( cLinkEnts >= 0 ? cLinkEnts : m_cLinks ); iLink++ )
 	{
+		i = ( cLinkEnts >= 0 ) ? piLinkEnts[iLink] : iLink;
+
 		// go through all of the links
 		if( m_pLinkPool[i].m_pLinkEnt != NULL )
 		{
@@ -2682,6 +2863,9 @@ int CGraph::FSetGraphPointers( void )
 		}
 	}
 
+	// Node positions are final now, index them again on the next query
+	NodeGrid_Free();
+
 	// the pointers are now set.
 	m_fGraphPointersSet = TRUE;
 	return TRUE;
@@ -3125,6 +3309,633 @@ void CGraph::BuildRegionTables( void )
 	memset( m_Cache, 0, sizeof(m_Cache) );
 }
 
+//=========================================================
+// Static routing build. Every destination is one job: a
+// search backwards over the links from the destination
+// gives each node its next hop towards it, one column of
+// the route matrix. Columns don't depend on each other, so
+// they go out to worker threads, and the rows are
+// compressed in order once all of them are in. The .nod
+// output doesn't depend on the number of threads.
+//
+// Workers only read the graph and the per link pass bits
+// that are worked out up front, HandleLinkEnt and the
+// engine are never called off the main thread.
+//=========================================================
+#define NODEROUTE_MAXTHREADS	16
+#define NODEROUTE_SLACK		0.1f	// added links this close to a route's length redo its column
+#define NODEROUTE_FAR		1e30f	// length of a route that doesn't arrive
+
+static const int s_afHullLinkMask[MAX_NODE_HULLS] =
+{
+	bits_LINK_SMALL_HULL,
+	bits_LINK_HUMAN_HULL,
+	bits_LINK_LARGE_HULL,
+	bits_LINK_FLY_HULL,
+};
+
+static const int s_afRouteCapMask[2] =
+{
+	0,
+	bits_CAP_OPEN_DOORS | bits_CAP_AUTO_DOORS | bits_CAP_USE,
+};
+
+typedef struct
+{
+	const CGraph	*pGraph;
+	int		*instart;	// m_cNodes + 1 offsets into inlinks
+	int		*inlinks;	// link pool indices grouped by destination node
+	unsigned char	*linkpass;	// per link, bit ( iHull * 2 + iCap ) if the pass may use it
+	int		pass;
+
+	short		*routes;	// [from * m_cNodes + to], next node on the way
+	const int	*jobs;		// destination columns to compute
+	int		count;
+	std::atomic<int> next;
+
+	nodesearch_t	search[NODEROUTE_MAXTHREADS];
+} noderoute_t;
+
+static noderoute_t s_NodeRoute;
+
+static void NodeRoute_Free( noderoute_t *nr )
+{
+	int i;
+
+	free( nr->instart );
+	free( nr->inlinks );
+	free( nr->linkpass );
+	nr->instart = NULL;
+	nr->inlinks = NULL;
+	nr->linkpass = NULL;
+
+	for( i = 0; i < NODEROUTE_MAXTHREADS; i++ )
+		NodeSearch_Free( &nr->search[i] );
+}
+
+//=========================================================
+// NodeRoute_Init - incoming links per node, and which
+// passes can use each link.
+//=========================================================
+static int NodeRoute_Init( noderoute_t *nr, CGraph *pGraph )
+{
+	int cNodes = pGraph->m_cNodes;
+	int i, iHull, iCap;
+
+	nr->pGraph = pGraph;
+	nr->instart = (int *)calloc( cNodes + 1, sizeof( int ) );
+	nr->inlinks = (int *)malloc( ( pGraph->m_cLinks + 1 ) * sizeof( int ) );
+	nr->linkpass = (unsigned char *)calloc( pGraph->m_cLinks + 1, 1 );
+
+	if( !nr->instart || !nr->inlinks || !nr->linkpass )
+		return FALSE;
+
+	for( i = 0; i < pGraph->m_cLinks; i++ )
+		nr->instart[pGraph->m_pLinkPool[i].m_iDestNode + 1]++;
+
+	for( i = 0; i < cNodes; i++ )
+		nr->instart[i + 1] += nr->instart[i];
+
+	// Pool order within each node keeps the searches reproducible
+	for( i = 0; i < pGraph->m_cLinks; i++ )
+		nr->inlinks[nr->instart[pGraph->m_pLinkPool[i].m_iDestNode]++] = i;
+
+	for( i = cNodes; i > 0; i-- )
+		nr->instart[i] = nr->instart[i - 1];
+	nr->instart[0] = 0;
+
+	for( i = 0; i < pGraph->m_cLinks; i++ )
+	{
+		CLink *pLink = &pGraph->m_pLinkPool[i];
+
+		for( iHull = 0; iHull < MAX_NODE_HULLS; iHull++ )
+		{
+			if( ( pLink->m_afLinkInfo & s_afHullLinkMask[iHull] ) != s_afHullLinkMask[iHull] )
+				continue;
+
+			for( iCap = 0; iCap < 2; iCap++ )
+			{
+				if( pLink->m_pLinkEnt != NULL && !pGraph->HandleLinkEnt( pLink->m_iSrcNode, pLink->m_pLinkEnt, s_afRouteCapMask[iCap], CGraph::NODEGRAPH_STATIC ) )
+					continue;
+
+				nr->linkpass[i] |= 1 << ( iHull * 2 + iCap );
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+//=========================================================
+// NodeRoute_Column - next hop towards iDest for every node
+//=========================================================
+static void NodeRoute_Column( noderoute_t *nr, nodesearch_t *ns, int iDest )
+{
+	const CGraph *pGraph = nr->pGraph;
+	int cNodes = pGraph->m_cNodes;
+	int passbit = 1 << nr->pass;
+	int iCurrentNode, iVisitNode, i;
+
+	if( ++ns->serial == 0 )
+	{
+		memset( ns->reached, 0, ns->cNodes * sizeof( unsigned int ) );
+		ns->serial = 1;
+	}
+
+	ns->reached[iDest] = ns->serial;
+	ns->cost[iDest] = 0.0f;
+	ns->score[iDest] = 0.0f;
+	ns->previous[iDest] = iDest;
+	ns->heap[0] = iDest;
+	ns->heapindex[iDest] = 0;
+	ns->heapcount = 1;
+
+	while( ns->heapcount )
+	{
+		iCurrentNode = NodeSearch_Pop( ns );
+
+		for( i = nr->instart[iCurrentNode]; i < nr->instart[iCurrentNode + 1]; i++ )
+		{
+			const CLink *pLink = &pGraph->m_pLinkPool[nr->inlinks[i]];
+
+			if( !( nr->linkpass[nr->inlinks[i]] & passbit ) )
+				continue;
+
+			iVisitNode = pLink->m_iSrcNode;
+			float flOurDistance = ns->cost[iCurrentNode] + pLink->m_flWeight;
+
+			if( ns->reached[iVisitNode] == ns->serial )
+			{
+				if( ns->heapindex[iVisitNode] < 0 || flOurDistance >= ns->cost[iVisitNode] - 0.001f )
+					continue;
+
+				ns->cost[iVisitNode] = ns->score[iVisitNode] = flOurDistance;
+				ns->previous[iVisitNode] = iCurrentNode;
+				NodeSearch_SiftUp( ns, ns->heapindex[iVisitNode] );
+			}
+			else
+			{
+				ns->reached[iVisitNode] = ns->serial;
+				ns->cost[iVisitNode] = ns->score[iVisitNode] = flOurDistance;
+				ns->previous[iVisitNode] = iCurrentNode;
+
+				ns->heap[ns->heapcount] = iVisitNode;
+				NodeSearch_SiftUp( ns, ns->heapcount );
+				ns->heapcount++;
+			}
+		}
+	}
+
+	// Nodes that can't get there point at themselves
+	for( i = 0; i < cNodes; i++ )
+		nr->routes[i * cNodes + iDest] = ( ns->reached[i] == ns->serial ) ? ns->previous[i] : i;
+}
+
+static void NodeRoute_Work( int thread )
+{
+	int job;
+
+	while( ( job = s_NodeRoute.next++ ) < s_NodeRoute.count )
+		NodeRoute_Column( &s_NodeRoute, &s_NodeRoute.search[thread], s_NodeRoute.jobs[job] );
+}
+
+#ifdef _WIN32
+static DWORD WINAPI NodeRoute_Thread( LPVOID param )
+{
+	NodeRoute_Work( (int)(size_t)param );
+	return 0;
+}
+#else
+static void *NodeRoute_Thread( void *param )
+{
+	NodeRoute_Work( (int)(size_t)param );
+	return NULL;
+}
+#endif
+
+static int NodeRoute_NumThreads( void )
+{
+	int count = (int)sv_nodethreads.value;
+
+	if( count <= 0 )
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		count = (int)info.dwNumberOfProcessors;
+#else
+		count = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+	}
+
+	if( count < 1 )
+		count = 1;
+	else if( count > NODEROUTE_MAXTHREADS )
+		count = NODEROUTE_MAXTHREADS;
+
+	return count;
+}
+
+//=========================================================
+// NodeRoute_Run - compute the listed columns, the calling
+// thread takes part. Threads that fail to start just leave
+// more jobs for the others.
+//=========================================================
+static void NodeRoute_Run( noderoute_t *nr, const int *jobs, int count, int numthreads )
+{
+	int i, started = 0;
+#ifdef _WIN32
+	HANDLE threads[NODEROUTE_MAXTHREADS];
+#else
+	pthread_t threads[NODEROUTE_MAXTHREADS];
+#endif
+
+	nr->jobs = jobs;
+	nr->count = count;
+	nr->next = 0;
+
+	if( numthreads > count )
+		numthreads = count;
+
+	for( i = 1; i < numthreads; i++ )
+	{
+#ifdef _WIN32
+		threads[started] = CreateThread( NULL, 0, NodeRoute_Thread, (LPVOID)(size_t)i, 0, NULL );
+		if( !threads[started] )
+			break;
+#else
+		if( pthread_create( &threads[started], NULL, NodeRoute_Thread, (void *)(size_t)i ) != 0 )
+			break;
+#endif
+		started++;
+	}
+
+	NodeRoute_Work( 0 );
+
+	for( i = 0; i < started; i++ )
+	{
+#ifdef _WIN32
+		WaitForSingleObject( threads[i], INFINITE );
+		CloseHandle( threads[i] );
+#else
+		pthread_join( threads[i], NULL );
+#endif
+	}
+}
+
+//=========================================================
+// NodeRoute_Expand - unpack one node's compressed routing
+// row, the inverse of the compression in
+// ComputeStaticRoutingTables. Returns FALSE if the row runs
+// past the route info.
+//=========================================================
+static int NodeRoute_Expand( const CGraph *pGraph, int iNode, int iHull, int iCap, short *row )
+{
+	const signed char *pRoute = pGraph->m_pRouteInfo + pGraph->m_pNodes[iNode].m_pNextBestNode[iHull][iCap];
+	const signed char *pEnd = pGraph->m_pRouteInfo + pGraph->m_nRouteInfo;
+	int cNodes = pGraph->m_cNodes;
+	int i = 0, n, iNext;
+
+	while( i < cNodes )
+	{
+		if( pRoute >= pEnd )
+			return FALSE;
+
+		n = *pRoute++;
+		if( n < 0 )
+		{
+			// Sequence phrase
+			for( n = -n; n > 0 && i < cNodes; n--, i++ )
+				row[i] = i;
+		}
+		else
+		{
+			// Repeat phrase
+			if( pRoute >= pEnd )
+				return FALSE;
+
+			iNext = iNode + *pRoute++;
+			if( iNext >= cNodes )
+				iNext -= cNodes;
+			else if( iNext < 0 )
+				iNext += cNodes;
+
+			if( iNext < 0 || iNext >= cNodes )
+				return FALSE;
+
+			for( n = n + 1; n > 0 && i < cNodes; n--, i++ )
+				row[i] = iNext;
+		}
+	}
+
+	return TRUE;
+}
+
+//=========================================================
+// NodeRoute_Find - first of the cStarts offsets in the
+// route info where the compressed row is already stored,
+// cStarts when there is none. Horspool's skip table, a
+// plain scan compares at every offset and gets quadratic
+// in the number of nodes.
+//=========================================================
+static int NodeRoute_Find( const signed char *pRouteInfo, int cStarts, const signed char *pRoute, int nRoute )
+{
+	const unsigned char *pHay = (const unsigned char *)pRouteInfo;
+	const unsigned char *pNeedle = (const unsigned char *)pRoute;
+	int skip[256];
+	int i, last = nRoute - 1;
+
+	if( cStarts <= 0 || nRoute <= 0 )
+		return cStarts > 0 ? 0 : cStarts;
+
+	for( i = 0; i < 256; i++ )
+		skip[i] = nRoute;
+	for( i = 0; i < last; i++ )
+		skip[pNeedle[i]] = last - i;
+
+	for( i = 0; i < cStarts; i += skip[pHay[i + last]] )
+	{
+		if( pHay[i + last] == pNeedle[last] && memcmp( pHay + i, pNeedle, last ) == 0 )
+			return i;
+	}
+
+	return cStarts;
+}
+
+//=========================================================
+// Incremental rebuild. When the level's .nod file has the
+// same nodes as the graph that was just built, its routes
+// are kept for every destination none of the link changes
+// can affect: a removed link matters to destinations whose
+// route went over it, an added one to destinations it may
+// make shorter to reach.
+//=========================================================
+typedef struct
+{
+	CGraph		*pPrev;		// graph read from the old .nod
+	int		*oldindex;	// node in pPrev for each node
+	int		*newindex;	// and back
+	unsigned char	*changed;	// per link, not in pPrev in the same form
+	int		*removed;	// src / dest pairs of links that went away or changed
+	int		cRemoved;
+} nodeprev_t;
+
+static void NodePrev_Free( nodeprev_t *np )
+{
+	if( np->pPrev )
+	{
+		np->pPrev->InitGraph();
+		free( np->pPrev );
+	}
+
+	free( np->oldindex );
+	free( np->newindex );
+	free( np->changed );
+	free( np->removed );
+
+	memset( np, 0, sizeof( *np ) );
+}
+
+// Link from iSrcNode to iDestNode in the graph, or NULL
+static CLink *NodePrev_FindLink( const CGraph *pGraph, int iSrcNode, int iDestNode )
+{
+	CNode *pNode = &pGraph->m_pNodes[iSrcNode];
+	int i;
+
+	for( i = 0; i < pNode->m_cNumLinks; i++ )
+	{
+		CLink *pLink = &pGraph->m_pLinkPool[pNode->m_iFirstLink + i];
+		if( pLink->m_iDestNode == iDestNode )
+			return pLink;
+	}
+
+	return NULL;
+}
+
+//=========================================================
+// NodePrev_Load - read the old graph for the level and
+// match it up with the new one. Links with a brush entity
+// in the way always count as changed, the entity may not
+// be what it was.
+//=========================================================
+static int NodePrev_Load( nodeprev_t *np, const CGraph *pGraph, const char *szMapName )
+{
+	int cNodes = pGraph->m_cNodes;
+	int i, j;
+
+	memset( np, 0, sizeof( *np ) );
+
+	np->pPrev = (CGraph *)calloc( 1, sizeof( CGraph ) );
+	if( !np->pPrev )
+		return FALSE;
+
+	if( !np->pPrev->FLoadGraph( szMapName ) || np->pPrev->m_cNodes != cNodes || !np->pPrev->m_pRouteInfo )
+	{
+		NodePrev_Free( np );
+		return FALSE;
+	}
+
+	const CNode *pOldNodes = np->pPrev->m_pNodes;
+
+	np->oldindex = (int *)malloc( cNodes * sizeof( int ) );
+	np->newindex = (int *)malloc( cNodes * sizeof( int ) );
+	np->changed = (unsigned char *)calloc( pGraph->m_cLinks + 1, 1 );
+	np->removed = (int *)malloc( ( pGraph->m_cLinks + np->pPrev->m_cLinks + 1 ) * 2 * sizeof( int ) );
+
+	if( !np->oldindex || !np->newindex || !np->changed || !np->removed )
+	{
+		NodePrev_Free( np );
+		return FALSE;
+	}
+
+	// Node order comes from the links, so match the nodes up by position
+	for( i = 0; i < cNodes; i++ )
+		np->newindex[i] = -1;
+
+	for( i = 0; i < cNodes; i++ )
+	{
+		const CNode *pNode = &pGraph->m_pNodes[i];
+
+		for( j = 0; j < cNodes; j++ )
+		{
+			if( np->newindex[j] < 0 && pOldNodes[j].m_afNodeInfo == pNode->m_afNodeInfo
+				&& ( pOldNodes[j].m_vecOrigin - pNode->m_vecOrigin ).Length() < 1.0f )
+				break;
+		}
+
+		if( j == cNodes )
+		{
+			NodePrev_Free( np );
+			return FALSE;
+		}
+
+		np->oldindex[i] = j;
+		np->newindex[j] = i;
+	}
+
+	for( i = 0; i < cNodes; i++ )
+	{
+		const CNode *pNode = &pGraph->m_pNodes[i];
+		const CNode *pOldNode = &pOldNodes[np->oldindex[i]];
+
+		for( j = 0; j < pNode->m_cNumLinks; j++ )
+		{
+			int iLink = pNode->m_iFirstLink + j;
+			const CLink *pLink = &pGraph->m_pLinkPool[iLink];
+			const CLink *pOldLink = NodePrev_FindLink( np->pPrev, np->oldindex[i], np->oldindex[pLink->m_iDestNode] );
+
+			if( pOldLink && pOldLink->m_afLinkInfo == pLink->m_afLinkInfo && !pOldLink->m_pLinkEnt && !pLink->m_pLinkEnt )
+				continue;
+
+			np->changed[iLink] = TRUE;
+
+			if( pOldLink )
+			{
+				np->removed[np->cRemoved * 2] = i;
+				np->removed[np->cRemoved * 2 + 1] = pLink->m_iDestNode;
+				np->cRemoved++;
+			}
+		}
+
+		for( j = 0; j < pOldNode->m_cNumLinks; j++ )
+		{
+			const CLink *pOldLink = &np->pPrev->m_pLinkPool[pOldNode->m_iFirstLink + j];
+			int iDestNode = np->newindex[pOldLink->m_iDestNode];
+
+			if( !NodePrev_FindLink( pGraph, i, iDestNode ) )
+			{
+				np->removed[np->cRemoved * 2] = i;
+				np->removed[np->cRemoved * 2 + 1] = iDestNode;
+				np->cRemoved++;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+//=========================================================
+// NodePrev_Routes - fill the route matrix from the old
+// graph for one pass and list the columns that have to be
+// searched again. Returns the number of columns listed.
+//=========================================================
+static int NodePrev_Routes( nodeprev_t *np, noderoute_t *nr, int iHull, int iCap, int *jobs )
+{
+	const CGraph *pGraph = nr->pGraph;
+	int cNodes = pGraph->m_cNodes;
+	short *Routes = nr->routes;
+	int passbit = 1 << ( iHull * 2 + iCap );
+	int iFrom, iTo, i, count;
+
+	short *row = new short[cNodes];
+	unsigned char *dirty = new unsigned char[cNodes];
+	float *dist = new float[cNodes];
+	int *stack = new int[cNodes];
+
+	memset( dirty, 0, cNodes );
+
+	for( iFrom = 0; iFrom < cNodes; iFrom++ )
+	{
+		if( !NodeRoute_Expand( np->pPrev, np->oldindex[iFrom], iHull, iCap, row ) )
+		{
+			// Damaged routes, search everything
+			memset( dirty, 1, cNodes );
+			break;
+		}
+
+		for( i = 0; i < cNodes; i++ )
+			Routes[iFrom * cNodes + np->newindex[i]] = np->newindex[row[i]];
+	}
+
+	// Destinations whose route used a link that is gone
+	for( i = 0; i < np->cRemoved; i++ )
+	{
+		iFrom = np->removed[i * 2];
+
+		for( iTo = 0; iTo < cNodes; iTo++ )
+		{
+			if( iTo != iFrom && Routes[iFrom * cNodes + iTo] == np->removed[i * 2 + 1] )
+				dirty[iTo] = TRUE;
+		}
+	}
+
+	// Destinations a new link may bring closer. Route lengths
+	// follow the old next hops, -1 while unknown.
+	for( iTo = 0; iTo < cNodes; iTo++ )
+	{
+		if( dirty[iTo] )
+			continue;
+
+		for( i = 0; i < cNodes; i++ )
+			dist[i] = -1.0f;
+		dist[iTo] = 0.0f;
+
+		for( i = 0; i < pGraph->m_cLinks && !dirty[iTo]; i++ )
+		{
+			if( !np->changed[i] || !( nr->linkpass[i] & passbit ) )
+				continue;
+
+			const CLink *pLink = &pGraph->m_pLinkPool[i];
+			float flSrc, flDest;
+			int k;
+
+			for( k = 0; k < 2; k++ )
+			{
+				int iNode = k ? pLink->m_iDestNode : pLink->m_iSrcNode;
+				int cStack = 0, iNext;
+				float flDist;
+
+				while( dist[iNode] < 0.0f )
+				{
+					iNext = Routes[iNode * cNodes + iTo];
+					if( iNext == iNode || cStack == cNodes )
+						break;
+
+					stack[cStack++] = iNode;
+					iNode = iNext;
+				}
+
+				// Unreachable, or a loop in the old table that wants redoing
+				if( cStack == cNodes )
+					dirty[iTo] = TRUE;
+
+				flDist = ( dist[iNode] < 0.0f ) ? NODEROUTE_FAR : dist[iNode];
+
+				while( cStack-- )
+				{
+					int iPrev = stack[cStack];
+
+					if( flDist < NODEROUTE_FAR )
+						flDist += ( pGraph->m_pNodes[iNode].m_vecOrigin - pGraph->m_pNodes[iPrev].m_vecOrigin ).Make2D().Length();
+					dist[iPrev] = flDist;
+					iNode = iPrev;
+				}
+
+				if( k )
+					flDest = dist[pLink->m_iDestNode] < 0.0f ? NODEROUTE_FAR : dist[pLink->m_iDestNode];
+				else
+					flSrc = dist[pLink->m_iSrcNode] < 0.0f ? NODEROUTE_FAR : dist[pLink->m_iSrcNode];
+			}
+
+			if( flDest < NODEROUTE_FAR && ( flSrc == NODEROUTE_FAR || flDest + pLink->m_flWeight <= flSrc + NODEROUTE_SLACK ) )
+				dirty[iTo] = TRUE;
+		}
+	}
+
+	for( iTo = 0, count = 0; iTo < cNodes; iTo++ )
+	{
+		if( dirty[iTo] )
+			jobs[count++] = iTo;
+	}
+
+	delete[] row;
+	delete[] dirty;
+	delete[] dist;
+	delete[] stack;
+
+	return count;
+}
+
 void CGraph::ComputeStaticRoutingTables( void )
 {
 	int iFrom;
@@ -3132,87 +3943,60 @@ void CGraph::ComputeStaticRoutingTables( void )
 #define FROM_TO(x,y) ( ( x ) * m_cNodes + ( y ) )
 	short *Routes = new short[nRoutes];
 
-	int *pMyPath = new int[m_cNodes];
+	int *pJobs = new int[m_cNodes];
 	unsigned short *BestNextNodes = new unsigned short[m_cNodes];
 	signed char *pRoute = new signed char[m_cNodes*2];
 
-	if( Routes && pMyPath && BestNextNodes && pRoute )
+	noderoute_t *nr = &s_NodeRoute;
+	nodeprev_t prev;
+	int numthreads = NodeRoute_NumThreads();
+	int nSearched = 0;
+	double flStart = UTIL_PerfTime();
+
+	memset( &prev, 0, sizeof( prev ) );
+
+	if( Routes && pJobs && BestNextNodes && pRoute && NodeRoute_Init( nr, this ) )
 	{
 		int nTotalCompressedSize = 0;
-		for( int iHull = 0; iHull < MAX_NODE_HULLS; iHull++ )
+		int nRouteAlloc = m_nRouteInfo;
+		int i;
+
+		for( i = 0; i < numthreads; i++ )
+		{
+			if( !NodeSearch_Reserve( &nr->search[i], m_cNodes ) )
+				break;
+		}
+		numthreads = i;
+
+		if( sv_nodeincremental.value && numthreads > 0 )
+		{
+			if( NodePrev_Load( &prev, this, STRING( gpGlobals->mapname ) ) )
+				ALERT( at_aiconsole, "Reusing routes from the previous graph\n" );
+		}
+
+		nr->routes = Routes;
+
+		for( int iHull = 0; iHull < MAX_NODE_HULLS && numthreads > 0; iHull++ )
 		{
 			for( int iCap = 0; iCap < 2; iCap++ )
 			{
-				int iCapMask;
-				switch( iCap )
-				{
-				case 0:
-					iCapMask = 0;
-					break;
-				case 1:
-					iCapMask = bits_CAP_OPEN_DOORS | bits_CAP_AUTO_DOORS | bits_CAP_USE;
-					break;
-				}
+				int cJobs;
 
-				// Initialize Routing table to uncalculated.
-				//
-				for( iFrom = 0; iFrom < m_cNodes; iFrom++ )
+				nr->pass = iHull * 2 + iCap;
+
+				if( prev.pPrev )
 				{
-					for( int iTo = 0; iTo < m_cNodes; iTo++ )
-					{
-						Routes[FROM_TO( iFrom, iTo )] = -1;
-					}
+					cJobs = NodePrev_Routes( &prev, nr, iHull, iCap, pJobs );
 				}
-
-				for( iFrom = 0; iFrom < m_cNodes; iFrom++ )
+				else
 				{
-					for( int iTo = m_cNodes - 1; iTo >= 0; iTo-- )
-					{
-						if( Routes[FROM_TO( iFrom, iTo )] != -1 )
-							continue;
-
-						int cPathSize = FindShortestPath( pMyPath, iFrom, iTo, iHull, iCapMask );
-
-						// Use the computed path to update the routing table.
-						//
-						if( cPathSize > 1 )
-						{
-							for( int iNode = 0; iNode < cPathSize - 1; iNode++ )
-							{
-								int iStart = pMyPath[iNode];
-								int iNext  = pMyPath[iNode + 1];
-								for( int iNode1 = iNode + 1; iNode1 < cPathSize; iNode1++ )
-								{
-									int iEnd = pMyPath[iNode1];
-									Routes[FROM_TO(iStart, iEnd)] = iNext;
-								}
-							}
-#if 0
-							// Well, at first glance, this should work, but actually it's safer
-							// to be told explictly that you can take a series of node in a
-							// particular direction. Some links don't appear to have links in
-							// the opposite direction.
-							//
-							for( iNode = cPathSize-1; iNode >= 1; iNode-- )
-							{
-								int iStart = pMyPath[iNode];
-								int iNext = pMyPath[iNode - 1];
-								for( int iNode1 = iNode-1; iNode1 >= 0; iNode1-- )
-								{
-									int iEnd = pMyPath[iNode1];
-									Routes[FROM_TO( iStart, iEnd )] = iNext;
-								}
-							}
-#endif
-						}
-						else
-						{
-							Routes[FROM_TO( iFrom, iTo )] = iFrom;
-							Routes[FROM_TO( iTo, iFrom )] = iTo;
-						}
-					}
+					for( cJobs = 0; cJobs < m_cNodes; cJobs++ )
+						pJobs[cJobs] = cJobs;
 				}
 
+				NodeRoute_Run( nr, pJobs, cJobs, numthreads );
+				nSearched += cJobs;
+
 				for( iFrom = 0; iFrom < m_cNodes; iFrom++ )
 				{
 					for( int iTo = 0; iTo < m_cNodes; iTo++ )
@@ -3375,24 +4159,19 @@ void CGraph::ComputeStaticRoutingTables( void )
 					int nRoute = p - pRoute;
 					if( m_pRouteInfo )
 					{
-						int i;
-						for( i = 0; i < m_nRouteInfo - nRoute; i++ )
-						{
-							if( memcmp( m_pRouteInfo + i, pRoute, nRoute ) == 0 )
-							{
-								break;
-							}
-						}
+						int i = NodeRoute_Find( m_pRouteInfo, m_nRouteInfo - nRoute, pRoute, nRoute );
 						if( i < m_nRouteInfo - nRoute )
 						{
 							m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = i;
 						}
 						else
 						{
-							signed char *Tmp = (signed char *)calloc( sizeof(signed char), ( m_nRouteInfo + nRoute ) );
-							memcpy( Tmp, m_pRouteInfo, m_nRouteInfo );
-							free( m_pRouteInfo );
-							m_pRouteInfo = Tmp;
+							if( m_nRouteInfo + nRoute > nRouteAlloc )
+							{
+								// Grow geometrically, only the first m_nRouteInfo bytes get saved
+								nRouteAlloc = ( m_nRouteInfo + nRoute ) * 2;
+								m_pRouteInfo = (signed char *)realloc( m_pRouteInfo, nRouteAlloc );
+							}
 							memcpy( m_pRouteInfo + m_nRouteInfo, pRoute, nRoute );
 							m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = m_nRouteInfo;
 							m_nRouteInfo += nRoute;
@@ -3402,6 +4181,7 @@ void CGraph::ComputeStaticRoutingTables( void )
 					else
 					{
 						m_nRouteInfo = nRoute;
+						nRouteAlloc = nRoute;
 						m_pRouteInfo = (signed char *)calloc( sizeof(signed char), nRoute );
 						memcpy( m_pRouteInfo, pRoute, nRoute );
 						m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = 0;
@@ -3412,18 +4192,25 @@ void CGraph::ComputeStaticRoutingTables( void )
 		}
 		ALERT( at_aiconsole, "Size of Routes = %d\n", nTotalCompressedSize );
 	}
+
+	ALERT( at_console, "Routing tables: %d nodes, %d of %d searches on %d threads, %.2f seconds\n",
+		m_cNodes, nSearched, m_cNodes * MAX_NODE_HULLS * 2, numthreads, UTIL_PerfTime() - flStart );
+
+	NodePrev_Free( &prev );
+	NodeRoute_Free( nr );
+
 	if( Routes )
 		delete[] Routes;
 	if( BestNextNodes )
 		delete[] BestNextNodes;
 	if( pRoute )
 		delete[] pRoute;
-	if( pMyPath )
-		delete[] pMyPath;
+	if( pJobs )
+		delete[] pJobs;
 	Routes = 0;
 	BestNextNodes = 0;
 	pRoute = 0;
-	pMyPath = 0;
+	pJobs = 0;
 #if 0
 	TestRoutingTables();
 #endif
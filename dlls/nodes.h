@@ -190,7 +190,6 @@ public:
 	int		FLoadGraph(const char *szMapName);
 	int		FSaveGraph(const char *szMapName);
 	int		FSetGraphPointers(void);
-	void	CheckNode(Vector vecOrigin, int iNode);
 
 	void    BuildRegionTables(void);
 	void    ComputeStaticRoutingTables(void);
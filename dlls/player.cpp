@@ -36,6 +36,7 @@
 #include "game.h"
 #include "pm_shared.h"
 #include "hltv.h"
+#include "hudbatch.h"
 
 #include "tf_defs.h"
 
@@ -202,6 +203,7 @@ int gmsgAllowSpec;
 int gmsgSpecFade;
 int gmsgResetFade;
 int gmsgGeigerRange;
+int gmsgHudBatch;
 
 void LinkUserMessages( void )
 {
@@ -265,6 +267,7 @@ void LinkUserMessages( void )
 	gmsgVGUIMenu = REG_USER_MSG( "VGUIMenu", -1 );
 	gmsgBuildState = REG_USER_MSG( "BuildSt", 2 );
 	gmsgRandomPC = REG_USER_MSG( "RandomPC", 1 );
+	gmsgHudBatch = REG_USER_MSG( "HudBatch", -1 );
 }
 
 LINK_ENTITY_TO_CLASS( player, CBasePlayer )
@@ -940,9 +943,7 @@ void CBasePlayer::Killed( entvars_t *pevInflictor, entvars_t *pevAttacker, int i
 
 	// send "health" update message to zero
 	m_iClientHealth = 0;
-	MESSAGE_BEGIN( MSG_ONE, gmsgHealth, NULL, pev );
-		WRITE_BYTE( m_iClientHealth );
-	MESSAGE_END();
+	HudBatch_Byte( pev, HUDBATCH_HEALTH, m_iClientHealth );
 
 	// Tell Ammo Hud that the player is dead
 	MESSAGE_BEGIN( MSG_ONE, gmsgCurWeapon, NULL, pev );
@@ -1735,84 +1736,147 @@ void CBasePlayer::AddPointsToTeam( int score, BOOL bAllowNegativeScore )
 }
 
 //Player ID
+static const char *s_SbarText[] =
+{
+	"",						// SBAR_TEXT_NONE
+	"1 %p1\n2 Health: %i2%%\n3 Armor: %i3%%",	// SBAR_TEXT_ID
+};
+
+static unsigned int s_nIDTraces;
+static unsigned int s_nIDTracesSkipped;
+
 void CBasePlayer::InitStatusBar()
 {
 	m_flStatusBarDisappearDelay = 0;
-	m_SbarString1[0] = m_SbarString0[0] = 0; 
+	m_iSbarText[1] = m_iSbarText[0] = SBAR_TEXT_NONE;
+	m_flNextIDTraceTime = 0;
 }
 
-void CBasePlayer::UpdateStatusBar()
+/*
+================
+IDTrace_Stats
+
+sv_idtrace_stats, ID target traces run and reused since the last call
+================
+*/
+void IDTrace_Stats( void )
 {
-	int newSBarState[SBAR_END] = {0};
-	char sbuf0[SBAR_STRING_SIZE];
-	char sbuf1[ SBAR_STRING_SIZE ];
+	unsigned int total = s_nIDTraces + s_nIDTracesSkipped;
 
-	strcpy( sbuf0, m_SbarString0 );
-	strcpy( sbuf1, m_SbarString1 );
+	ALERT( at_console, "%u status bar updates, %u traced, %u skipped (%.1f%%)\n", total, s_nIDTraces, s_nIDTracesSkipped,
+		total ? s_nIDTracesSkipped * 100.0f / total : 0.0f );
 
-	// Find an ID Target
-	TraceResult tr;
-	UTIL_MakeVectors( pev->v_angle + pev->punchangle );
+	s_nIDTraces = 0;
+	s_nIDTracesSkipped = 0;
+}
+
+/*
+================
+UpdateIDTarget
+
+Traces for the ID target only when the eyes or the target moved past
+sv_idtrace_move, the view turned past sv_idtrace_turn, or
+sv_idtrace_interval ran out. Otherwise the last trace stands.
+================
+*/
+void CBasePlayer::UpdateIDTarget()
+{
+	Vector vecAngles = pev->v_angle + pev->punchangle;
 	Vector vecSrc = EyePosition();
-	Vector vecEnd = vecSrc + ( gpGlobals->v_forward * MAX_ID_RANGE );
-	UTIL_TraceLine( vecSrc, vecEnd, dont_ignore_monsters, edict(), &tr );
 
-	if( tr.flFraction != 1.0f )
+	if( m_flNextIDTraceTime > gpGlobals->time
+		&& ( vecSrc - m_vecIDTraceSrc ).Length() <= sv_idtrace_move.value
+		&& ( vecAngles - m_vecIDTraceAngles ).Length() <= sv_idtrace_turn.value )	// wrapping around 360 only costs a trace
 	{
-		if( !FNullEnt( tr.pHit ) )
+		CBaseEntity *pTarget = m_hLastIDTarget;
+
+		// the target went away, stopped blocking the trace, or walked off
+		if( m_iIDTraceResult != IDTRACE_ENTITY || ( pTarget && pTarget->pev->solid != SOLID_NOT
+			&& ( pTarget->pev->origin - m_vecIDTargetOrigin ).Length() <= sv_idtrace_move.value ) )
 		{
-			CBaseEntity *pEntity = CBaseEntity::Instance( tr.pHit );
+			s_nIDTracesSkipped++;
+			return;
+		}
+	}
 
-			if( pEntity->Classify() == CLASS_PLAYER )
-			{
-				newSBarState[SBAR_ID_TARGETNAME] = ENTINDEX( pEntity->edict() );
-				strcpy( sbuf1, "1 %p1\n2 Health: %i2%%\n3 Armor: %i3%%" );
+	TraceResult tr;
+	UTIL_MakeVectors( vecAngles );
+	Vector vecEnd = vecSrc + ( gpGlobals->v_forward * MAX_ID_RANGE );
+	UTIL_TraceLine( vecSrc, vecEnd, dont_ignore_monsters, edict(), &tr );
 
-				// allies and medics get to see the targets health
-				if( g_pGameRules->PlayerRelationship( this, pEntity ) == GR_TEAMMATE )
-				{
-					newSBarState[SBAR_ID_TARGETHEALTH] = (int)( 100 * ( pEntity->pev->health / pEntity->pev->max_health ) );
-					newSBarState[SBAR_ID_TARGETARMOR] = (int)pEntity->pev->armorvalue; //No need to get it % based since 100 it's the max.
-				}
+	s_nIDTraces++;
 
-				m_flStatusBarDisappearDelay = gpGlobals->time + 1.0f;
-			}
-		}
-		else if( m_flStatusBarDisappearDelay > gpGlobals->time )
-		{
-			// hold the values for a short amount of time after viewing the object
-			newSBarState[SBAR_ID_TARGETNAME] = m_izSBarState[SBAR_ID_TARGETNAME];
-			newSBarState[SBAR_ID_TARGETHEALTH] = m_izSBarState[SBAR_ID_TARGETHEALTH];
-			newSBarState[SBAR_ID_TARGETARMOR] = m_izSBarState[SBAR_ID_TARGETARMOR];
-		}
+	m_vecIDTraceSrc = vecSrc;
+	m_vecIDTraceAngles = vecAngles;
+	m_flNextIDTraceTime = gpGlobals->time + sv_idtrace_interval.value;
+	m_hLastIDTarget = NULL;
+
+	if( tr.flFraction == 1.0f )
+		m_iIDTraceResult = IDTRACE_NONE;
+	else if( FNullEnt( tr.pHit ) )
+		m_iIDTraceResult = IDTRACE_WORLD;
+	else
+	{
+		m_iIDTraceResult = IDTRACE_ENTITY;
+		m_hLastIDTarget = CBaseEntity::Instance( tr.pHit );
+		m_vecIDTargetOrigin = tr.pHit->v.origin;
 	}
+}
 
-	BOOL bForceResend = FALSE;
+void CBasePlayer::UpdateStatusBar()
+{
+	int newSBarState[SBAR_END] = {0};
+	int newSbarText[2];
+
+	newSbarText[0] = m_iSbarText[0];
+	newSbarText[1] = m_iSbarText[1];
+
+	// Find an ID Target
+	UpdateIDTarget();
 
-	if( strcmp( sbuf0, m_SbarString0 ) )
+	if( m_iIDTraceResult == IDTRACE_ENTITY )
 	{
-		MESSAGE_BEGIN( MSG_ONE, gmsgStatusText, NULL, pev );
-			WRITE_BYTE( 0 );
-			WRITE_STRING( sbuf0 );
-		MESSAGE_END();
+		CBaseEntity *pEntity = m_hLastIDTarget;
 
-		strcpy( m_SbarString0, sbuf0 );
+		if( pEntity && pEntity->Classify() == CLASS_PLAYER )
+		{
+			newSBarState[SBAR_ID_TARGETNAME] = ENTINDEX( pEntity->edict() );
+			newSbarText[1] = SBAR_TEXT_ID;
 
-		// make sure everything's resent
-		bForceResend = TRUE;
+			// allies and medics get to see the targets health
+			if( g_pGameRules->PlayerRelationship( this, pEntity ) == GR_TEAMMATE )
+			{
+				newSBarState[SBAR_ID_TARGETHEALTH] = (int)( 100 * ( pEntity->pev->health / pEntity->pev->max_health ) );
+				newSBarState[SBAR_ID_TARGETARMOR] = (int)pEntity->pev->armorvalue; //No need to get it % based since 100 it's the max.
+			}
+
+			m_flStatusBarDisappearDelay = gpGlobals->time + 1.0f;
+		}
+	}
+	else if( m_iIDTraceResult == IDTRACE_WORLD && m_flStatusBarDisappearDelay > gpGlobals->time )
+	{
+		// hold the values for a short amount of time after viewing the object
+		newSBarState[SBAR_ID_TARGETNAME] = m_izSBarState[SBAR_ID_TARGETNAME];
+		newSBarState[SBAR_ID_TARGETHEALTH] = m_izSBarState[SBAR_ID_TARGETHEALTH];
+		newSBarState[SBAR_ID_TARGETARMOR] = m_izSBarState[SBAR_ID_TARGETARMOR];
 	}
 
-	if( strcmp( sbuf1, m_SbarString1 ) )
+	BOOL bForceResend = FALSE;
+
+	for( int i = 0; i < 2; i++ )
 	{
-		MESSAGE_BEGIN( MSG_ONE, gmsgStatusText, NULL, pev );
-			WRITE_BYTE( 1 );
-			WRITE_STRING( sbuf1 );
-		MESSAGE_END();
+		if( newSbarText[i] != m_iSbarText[i] )
+		{
+			MESSAGE_BEGIN( MSG_ONE, gmsgStatusText, NULL, pev );
+				WRITE_BYTE( i );
+				WRITE_STRING( s_SbarText[newSbarText[i]] );
+			MESSAGE_END();
 
-		strcpy( m_SbarString1, sbuf1 );
+			m_iSbarText[i] = newSbarText[i];
 
-		// make sure everything's resent
-		bForceResend = TRUE;
+			// make sure everything's resent
+			bForceResend = TRUE;
+		}
 	}
 
 	// Check values and send if they don't match
@@ -2230,9 +2294,7 @@ void CBasePlayer::UpdateGeigerCounter( void )
 	{
 		m_igeigerRangePrev = range;
 
-		MESSAGE_BEGIN( MSG_ONE, gmsgGeigerRange, NULL, pev );
-			WRITE_BYTE( range );
-		MESSAGE_END();
+		HudBatch_Byte( pev, HUDBATCH_GEIGER, range );
 	}
 
 	// reset counter and semaphore
@@ -3877,10 +3939,7 @@ void CBasePlayer::SendAmmoUpdate( void )
 			ASSERT( m_rgAmmo[i] < 255 );
 
 			// send "Ammo" update message
-			MESSAGE_BEGIN( MSG_ONE, gmsgAmmoX, NULL, pev );
-				WRITE_BYTE( i );
-				WRITE_BYTE( Q_max( Q_min( m_rgAmmo[i], 254 ), 0 ) );  // clamp the value to one byte
-			MESSAGE_END();
+			HudBatch_Ammo( pev, i, Q_max( Q_min( m_rgAmmo[i], 254 ), 0 ) );  // clamp the value to one byte
 		}
 	}
 }
@@ -3932,9 +3991,7 @@ void CBasePlayer::UpdateClientData( void )
 		MESSAGE_END();
 
 		// Vit_amiN: the geiger state could run out of sync, too
-		MESSAGE_BEGIN( MSG_ONE, gmsgGeigerRange, NULL, pev );
-			WRITE_BYTE( 0 );
-		MESSAGE_END();
+		HudBatch_Byte( pev, HUDBATCH_GEIGER, 0 );
 
 		InitStatusBar();
 	}
@@ -3974,9 +4031,7 @@ void CBasePlayer::UpdateClientData( void )
 			iHealth = 1;
 
 		// send "health" update message
-		MESSAGE_BEGIN( MSG_ONE, gmsgHealth, NULL, pev );
-			WRITE_BYTE( iHealth );
-		MESSAGE_END();
+		HudBatch_Byte( pev, HUDBATCH_HEALTH, iHealth );
 
 		m_iClientHealth = (int)pev->health;
 	}
@@ -3988,9 +4043,7 @@ void CBasePlayer::UpdateClientData( void )
 		ASSERT( gmsgBattery > 0 );
 
 		// send "health" update message
-		MESSAGE_BEGIN( MSG_ONE, gmsgBattery, NULL, pev );
-			WRITE_SHORT( (int)pev->armorvalue );
-		MESSAGE_END();
+		HudBatch_Battery( pev, (int)pev->armorvalue );
 	}
 
 	if( pev->dmg_take || pev->dmg_save || m_bitsHUDDamage != m_bitsDamageType )
@@ -4010,14 +4063,7 @@ void CBasePlayer::UpdateClientData( void )
 		// only send down damage type that have hud art
 		int visibleDamageBits = m_bitsDamageType & DMG_SHOWNHUD;
 
-		MESSAGE_BEGIN( MSG_ONE, gmsgDamage, NULL, pev );
-			WRITE_BYTE( (int)pev->dmg_save );
-			WRITE_BYTE( (int)pev->dmg_take );
-			WRITE_LONG( visibleDamageBits );
-			WRITE_COORD( damageOrigin.x );
-			WRITE_COORD( damageOrigin.y );
-			WRITE_COORD( damageOrigin.z );
-		MESSAGE_END();
+		HudBatch_Damage( pev, (int)pev->dmg_save, (int)pev->dmg_take, visibleDamageBits, damageOrigin );
 
 		pev->dmg_take = 0;
 		pev->dmg_save = 0;
@@ -4052,9 +4098,7 @@ void CBasePlayer::UpdateClientData( void )
 				m_flFlashLightTime = 0;
 		}
 
-		MESSAGE_BEGIN( MSG_ONE, gmsgFlashBattery, NULL, pev );
-			WRITE_BYTE( m_iFlashBattery );
-		MESSAGE_END();
+		HudBatch_Byte( pev, HUDBATCH_FLASHBAT, m_iFlashBattery );
 	}
 
 	if( m_iTrain & TRAIN_NEW )
@@ -4062,9 +4106,7 @@ void CBasePlayer::UpdateClientData( void )
 		ASSERT( gmsgTrain > 0 );
 
 		// send "health" update message
-		MESSAGE_BEGIN( MSG_ONE, gmsgTrain, NULL, pev );
-			WRITE_BYTE( m_iTrain & 0xF );
-		MESSAGE_END();
+		HudBatch_Byte( pev, HUDBATCH_TRAIN, m_iTrain & 0xF );
 
 		m_iTrain &= ~TRAIN_NEW;
 	}
@@ -74,6 +74,15 @@ typedef enum
 #define MAX_ID_RANGE     2048
 #define SBAR_STRING_SIZE 128
 
+// Status bar text lines, sent as strings only when the index changes
+#define SBAR_TEXT_NONE	0
+#define SBAR_TEXT_ID	1	// target name, health and armor
+
+// What the ID target trace hit
+#define IDTRACE_NONE	0	// nothing within MAX_ID_RANGE
+#define IDTRACE_WORLD	1
+#define IDTRACE_ENTITY	2	// m_hLastIDTarget
+
 enum sbar_data
 {
 	SBAR_ID_TARGETNAME = 1,
@@ -232,8 +241,7 @@ public:
 	int m_MenuSelectionBuffer;
 	float m_MenuUpdateTime;
 
-	char m_SbarString0[SBAR_STRING_SIZE];
-	char m_SbarString1[SBAR_STRING_SIZE];
+	int m_iSbarText[2];	// SBAR_TEXT_ last sent for status lines 0 and 1
 	char m_SbarString2[SBAR_STRING_SIZE];
 
 	virtual void Spawn( void );
@@ -388,6 +396,7 @@ public:
 	// Player ID
 	void TeamFortress_InitStatusBar( void );
 	void TeamFortress_UpdateStatusBar( void );
+	void UpdateIDTarget( void );
 
 	CBaseEntity *GetTeleporter( int type );
 
@@ -501,6 +510,11 @@ public:
 	float m_flStatusBarDisappearDelay;
 
 	EHANDLE m_hLastIDTarget;
+	int m_iIDTraceResult;		// IDTRACE_ from the last ID target trace
+	Vector m_vecIDTraceSrc;		// where it was traced from
+	Vector m_vecIDTraceAngles;
+	Vector m_vecIDTargetOrigin;	// m_hLastIDTarget's origin at the time
+	float m_flNextIDTraceTime;	// reused until then unless the view moves
 	BOOL m_bUpdatedCommandMenu;
 	int m_iClientIsFeigning;
 	int m_iClientIsDetpacking;
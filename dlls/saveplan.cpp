@@ -0,0 +1,503 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== saveplan.cpp ========================================================
+
+  Field plans for save/restore.
+
+  Every TYPEDESCRIPTION table that goes through CSave::WriteFields or
+  CRestore::ReadFields is compiled once into a plan: the byte size of each
+  field for the empty checks, the memory to clear before a restore with
+  neighbouring fields merged into one run, and a hash of the field names so
+  a restore can find a field without comparing names down the table. The
+  field names are also pre-hashed for CSaveRestoreBuffer::TokenHash, which
+  remembers the slot each one got in the token table.
+
+  Plans never change what goes into the save file, sv_saveplan 0 falls back
+  to the plain table walk and sv_saveplan_bench compares the two.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "saverestore.h"
+#include "saveplan.h"
+
+cvar_t sv_saveplan = { "sv_saveplan", "1", FCVAR_SERVER };
+
+extern int gSizes[FIELD_TYPECOUNT];
+
+static saveplan_t	*s_pPlans[SAVEPLAN_BUCKETS];
+static savename_t	s_Names[SAVEPLAN_NAMES];
+static int		s_nNames;
+
+static unsigned int SavePlan_PointerHash( const void *p )
+{
+	return (unsigned int)( (size_t)p >> 3 ) * 2654435761u;
+}
+
+unsigned int SavePlan_HashString( const char *pszToken )
+{
+	unsigned int hash = 0;
+
+	while( *pszToken )
+		hash = ( ( hash >> 4 ) | ( hash << 28 ) ) ^ *pszToken++;
+
+	return hash;
+}
+
+int SavePlan_Empty( const char *pdata, int size )
+{
+	int word;
+
+	for( ; size >= (int)sizeof(int); size -= sizeof(int), pdata += sizeof(int) )
+	{
+		memcpy( &word, pdata, sizeof(int) );
+		if( word )
+			return 0;
+	}
+
+	for( ; size > 0; size--, pdata++ )
+	{
+		if( *pdata )
+			return 0;
+	}
+	return 1;
+}
+
+savename_t *SavePlan_Name( const char *pszToken )
+{
+	int i;
+
+	if( !sv_saveplan.value || !s_nNames )
+		return NULL;
+
+	for( i = SavePlan_PointerHash( pszToken ) & ( SAVEPLAN_NAMES - 1 ); s_Names[i].name; i = ( i + 1 ) & ( SAVEPLAN_NAMES - 1 ) )
+	{
+		if( s_Names[i].name == pszToken )
+			return &s_Names[i];
+	}
+	return NULL;
+}
+
+static void SavePlan_AddName( const char *pszToken )
+{
+	int i;
+
+	// Keep the table at most half full so misses stay short
+	if( s_nNames >= SAVEPLAN_NAMES / 2 )
+		return;
+
+	for( i = SavePlan_PointerHash( pszToken ) & ( SAVEPLAN_NAMES - 1 ); s_Names[i].name; i = ( i + 1 ) & ( SAVEPLAN_NAMES - 1 ) )
+	{
+		if( s_Names[i].name == pszToken )
+			return;
+	}
+
+	s_Names[i].name = pszToken;
+	s_Names[i].hash = SavePlan_HashString( pszToken );
+	s_Names[i].slot = -1;
+	s_nNames++;
+}
+
+static int SavePlan_CompareRuns( const void *a, const void *b )
+{
+	return ( (const saverun_t *)a )->offset - ( (const saverun_t *)b )->offset;
+}
+
+/*
+================
+SavePlan_Runs
+
+Memory ReadFields zeroes, fields with any of skipFlags left out.
+Overlapping and touching fields become one run, gaps stay.
+================
+*/
+static saverun_t *SavePlan_Runs( const saveplan_t *pPlan, int skipFlags, int *pCount )
+{
+	saverun_t *pRuns;
+	int i, count, end;
+
+	pRuns = (saverun_t *)malloc( sizeof(saverun_t) * pPlan->fieldCount );
+	count = 0;
+
+	for( i = 0; i < pPlan->fieldCount; i++ )
+	{
+		if( ( pPlan->pFields[i].flags & skipFlags ) || !pPlan->fields[i].size )
+			continue;
+		pRuns[count++] = pPlan->fields[i];
+	}
+
+	qsort( pRuns, count, sizeof(saverun_t), SavePlan_CompareRuns );
+
+	for( i = 1, end = 0; i < count; i++ )
+	{
+		if( pRuns[i].offset <= pRuns[end].offset + pRuns[end].size )
+		{
+			pRuns[end].size = Q_max( pRuns[end].size, pRuns[i].offset + pRuns[i].size - pRuns[end].offset );
+			continue;
+		}
+		pRuns[++end] = pRuns[i];
+	}
+
+	*pCount = count ? end + 1 : 0;
+	return pRuns;
+}
+
+/*
+================
+SavePlan_Compile
+
+================
+*/
+static saveplan_t *SavePlan_Compile( const TYPEDESCRIPTION *pFields, int fieldCount )
+{
+	saveplan_t *pPlan;
+	int i, j, size;
+
+	for( i = 0; i < fieldCount; i++ )
+	{
+		if( pFields[i].fieldType < 0 || pFields[i].fieldType >= FIELD_TYPECOUNT || !pFields[i].fieldName )
+			return NULL;
+	}
+
+	pPlan = (saveplan_t *)calloc( 1, sizeof(saveplan_t) );
+	pPlan->pFields = pFields;
+	pPlan->fieldCount = fieldCount;
+
+	pPlan->fields = (saverun_t *)malloc( sizeof(saverun_t) * fieldCount );
+	for( i = 0; i < fieldCount; i++ )
+	{
+		pPlan->fields[i].offset = pFields[i].fieldOffset;
+		pPlan->fields[i].size = pFields[i].fieldSize * gSizes[pFields[i].fieldType];
+	}
+
+	pPlan->clear = SavePlan_Runs( pPlan, 0, &pPlan->clearCount );
+	pPlan->clearLocal = SavePlan_Runs( pPlan, FTYPEDESC_GLOBAL, &pPlan->clearLocalCount );
+
+	// Names, open addressing at most half full
+	for( size = 16; size < fieldCount * 2; size <<= 1 )
+		;
+	pPlan->names = (short *)malloc( sizeof(short) * size );
+	pPlan->namesMask = size - 1;
+	memset( pPlan->names, -1, sizeof(short) * size );
+
+	for( i = 0; i < fieldCount; i++ )
+	{
+		for( j = SavePlan_HashString( pFields[i].fieldName ) & pPlan->namesMask; pPlan->names[j] != -1; j = ( j + 1 ) & pPlan->namesMask )
+			;
+		pPlan->names[j] = i;
+
+		SavePlan_AddName( pFields[i].fieldName );
+	}
+
+	// ReadField takes the first name that matches ignoring case, the hash
+	// only gives the same answer when there is just one
+	pPlan->exact = 1;
+	for( i = 0; i < fieldCount && pPlan->exact; i++ )
+	{
+		for( j = i + 1; j < fieldCount; j++ )
+		{
+			if( !stricmp( pFields[i].fieldName, pFields[j].fieldName ) )
+			{
+				pPlan->exact = 0;
+				break;
+			}
+		}
+	}
+
+	return pPlan;
+}
+
+const saveplan_t *SavePlan_Get( const TYPEDESCRIPTION *pFields, int fieldCount )
+{
+	saveplan_t *pPlan;
+	int bucket;
+
+	if( !sv_saveplan.value || !pFields || fieldCount <= 0 || fieldCount > SAVEPLAN_MAX_FIELDS )
+		return NULL;
+
+	bucket = SavePlan_PointerHash( pFields ) & ( SAVEPLAN_BUCKETS - 1 );
+	for( pPlan = s_pPlans[bucket]; pPlan; pPlan = pPlan->next )
+	{
+		if( pPlan->pFields == pFields && pPlan->fieldCount == fieldCount )
+			return pPlan;
+	}
+
+	pPlan = SavePlan_Compile( pFields, fieldCount );
+	if( !pPlan )
+		return NULL;
+
+	pPlan->next = s_pPlans[bucket];
+	s_pPlans[bucket] = pPlan;
+	return pPlan;
+}
+
+int SavePlan_Match( const saveplan_t *pPlan, int startField, const char *pszName )
+{
+	const char *pszField;
+	int i, j;
+
+	if( !pszName )
+		return -1;
+
+	// Fields come back in the order they were written, this is
+	// the first one ReadField would have tried anyway
+	i = startField % pPlan->fieldCount;
+	pszField = pPlan->pFields[i].fieldName;
+	if( pszField == pszName || !strcmp( pszField, pszName ) )
+		return i;
+
+	if( !pPlan->exact )
+		return -1;
+
+	for( j = SavePlan_HashString( pszName ) & pPlan->namesMask; ( i = pPlan->names[j] ) != -1; j = ( j + 1 ) & pPlan->namesMask )
+	{
+		if( !strcmp( pPlan->pFields[i].fieldName, pszName ) )
+			return i;
+	}
+
+	// Not spelled the same, ReadField still matches ignoring case
+	return -1;
+}
+
+//=========================================================
+// sv_saveplan_bench
+//=========================================================
+typedef struct
+{
+	float	flNextAttack;
+	float	flSpeed;
+	Vector	vecGoal;
+	Vector	vecMoveDir;
+	int	iState;
+	int	fActive;
+	short	rgsCounts[8];
+	char	szTag[16];
+	float	rgflHistory[12];
+	int	iSpare;
+	float	flSpare;
+} savebench_t;
+
+static TYPEDESCRIPTION s_BenchFields[] =
+{
+	DEFINE_FIELD( savebench_t, flNextAttack, FIELD_TIME ),
+	DEFINE_FIELD( savebench_t, flSpeed, FIELD_FLOAT ),
+	DEFINE_FIELD( savebench_t, vecGoal, FIELD_POSITION_VECTOR ),
+	DEFINE_FIELD( savebench_t, vecMoveDir, FIELD_VECTOR ),
+	DEFINE_FIELD( savebench_t, iState, FIELD_INTEGER ),
+	DEFINE_FIELD( savebench_t, fActive, FIELD_BOOLEAN ),
+	DEFINE_ARRAY( savebench_t, rgsCounts, FIELD_SHORT, 8 ),
+	DEFINE_ARRAY( savebench_t, szTag, FIELD_CHARACTER, 16 ),
+	DEFINE_ARRAY( savebench_t, rgflHistory, FIELD_FLOAT, 12 ),
+	DEFINE_FIELD( savebench_t, iSpare, FIELD_INTEGER ),
+	DEFINE_FIELD( savebench_t, flSpare, FIELD_FLOAT ),
+};
+
+typedef struct
+{
+	entvars_t	pev;
+	savebench_t	data;
+} savebenchent_t;
+
+static void SavePlan_BenchFill( savebenchent_t *pEnt )
+{
+	entvars_t *pev = &pEnt->pev;
+	savebench_t *pData = &pEnt->data;
+	int i;
+
+	*pEnt = savebenchent_t();
+
+	// What a monster or a door has set, strings and entity links stay empty
+	pev->origin = Vector( RANDOM_FLOAT( -4096, 4096 ), RANDOM_FLOAT( -4096, 4096 ), RANDOM_FLOAT( -4096, 4096 ) );
+	pev->angles = Vector( 0, RANDOM_FLOAT( 0, 360 ), 0 );
+	pev->mins = Vector( -16, -16, 0 );
+	pev->maxs = Vector( 16, 16, 72 );
+	pev->size = pev->maxs - pev->mins;
+	pev->absmin = pev->origin + pev->mins;
+	pev->absmax = pev->origin + pev->maxs;
+	if( RANDOM_LONG( 0, 1 ) )
+		pev->velocity = Vector( RANDOM_FLOAT( -320, 320 ), RANDOM_FLOAT( -320, 320 ), 0 );
+	pev->movetype = RANDOM_LONG( 0, 10 );
+	pev->solid = RANDOM_LONG( 0, 4 );
+	pev->health = RANDOM_LONG( 1, 200 );
+	pev->max_health = 200;
+	pev->takedamage = RANDOM_LONG( 0, 2 );
+	pev->flags = RANDOM_LONG( 0, 0xffff );
+	pev->spawnflags = RANDOM_LONG( 0, 3 );
+	pev->nextthink = RANDOM_FLOAT( 0.1, 10 );
+	pev->frame = RANDOM_FLOAT( 0, 255 );
+	pev->framerate = 1.0;
+	pev->sequence = RANDOM_LONG( 0, 20 );
+	pev->renderamt = RANDOM_LONG( 0, 1 ) ? 255 : 0;
+	pev->scale = 1.0;
+
+	pData->flNextAttack = RANDOM_FLOAT( 0.1, 10 );
+	pData->flSpeed = RANDOM_FLOAT( 0, 400 );
+	pData->vecGoal = Vector( RANDOM_FLOAT( -4096, 4096 ), RANDOM_FLOAT( -4096, 4096 ), 0 );
+	pData->iState = RANDOM_LONG( 0, 7 );
+	pData->fActive = RANDOM_LONG( 0, 1 );
+	for( i = 0; i < 8; i++ )
+		pData->rgsCounts[i] = RANDOM_LONG( 0, 3 );
+	strcpy( pData->szTag, RANDOM_LONG( 0, 1 ) ? "squad_alpha" : "" );
+	for( i = RANDOM_LONG( 0, 12 ); i < 12; i++ )
+		pData->rgflHistory[i] = RANDOM_FLOAT( -1, 1 );
+}
+
+// Microseconds per entity, pData holds the last pass
+static double SavePlan_BenchWrite( SAVERESTOREDATA *pData, savebenchent_t *pEnts, int count, int passes )
+{
+	double start = UTIL_PerfTime();
+	int i, pass;
+
+	for( pass = 0; pass < passes; pass++ )
+	{
+		CSave save( pData );
+
+		pData->pCurrentData = pData->pBaseData;
+		pData->size = 0;
+
+		for( i = 0; i < count; i++ )
+		{
+			save.WriteEntVars( "ENTVARS", &pEnts[i].pev );
+			save.WriteFields( "BENCH", &pEnts[i].data, s_BenchFields, ARRAYSIZE( s_BenchFields ) );
+		}
+	}
+
+	return ( UTIL_PerfTime() - start ) * 1000000.0 / ( (double)count * passes );
+}
+
+static double SavePlan_BenchRead( SAVERESTOREDATA *pData, savebenchent_t *pEnts, int count, int passes )
+{
+	double start = UTIL_PerfTime();
+	int i, pass;
+
+	for( pass = 0; pass < passes; pass++ )
+	{
+		CRestore restore( pData );
+
+		pData->pCurrentData = pData->pBaseData;
+		pData->size = 0;
+		for( i = 0; i < count; i++ )
+			pEnts[i] = savebenchent_t();
+
+		for( i = 0; i < count; i++ )
+		{
+			restore.ReadEntVars( "ENTVARS", &pEnts[i].pev );
+			restore.ReadFields( "BENCH", &pEnts[i].data, s_BenchFields, ARRAYSIZE( s_BenchFields ) );
+		}
+	}
+
+	return ( UTIL_PerfTime() - start ) * 1000000.0 / ( (double)count * passes );
+}
+
+/*
+================
+SavePlan_Bench
+
+sv_saveplan_bench [entities] [passes]
+
+Saves and restores a made up population with and without the
+plans, the save files and the restored entities have to match.
+================
+*/
+static void SavePlan_Bench( void )
+{
+	SAVERESTOREDATA save, restore;
+	savebenchent_t *pEnts, *pRestored;
+	char *pBuffers[2], **pCopies;
+	int sizes[2];
+	double times[2][2];
+	int count, passes, mode, i, same;
+	float saved;
+
+	count = ( CMD_ARGC() > 1 ) ? atoi( CMD_ARGV( 1 ) ) : 1000;
+	passes = ( CMD_ARGC() > 2 ) ? atoi( CMD_ARGV( 2 ) ) : 20;
+	count = Q_max( count, 1 );
+	passes = Q_max( passes, 1 );
+
+	pEnts = new savebenchent_t[count];
+	pRestored = new savebenchent_t[count * 2];
+	for( i = 0; i < count; i++ )
+		SavePlan_BenchFill( &pEnts[i] );
+
+	save = SAVERESTOREDATA();
+	save.bufferSize = count * ( sizeof(savebenchent_t) * 2 + 1024 );
+	save.tokenCount = 0xfff;	// what the engine hands out
+	save.pTokens = (char **)calloc( save.tokenCount, sizeof(char *) );
+
+	// The engine restores with its own copies of the token strings
+	restore = SAVERESTOREDATA();
+	restore.tokenCount = save.tokenCount;
+	restore.pTokens = (char **)calloc( restore.tokenCount, sizeof(char *) );
+	pCopies = (char **)calloc( restore.tokenCount, sizeof(char *) );
+
+	saved = sv_saveplan.value;
+	for( mode = 0; mode < 2; mode++ )
+	{
+		sv_saveplan.value = mode;
+
+		memset( save.pTokens, 0, sizeof(char *) * save.tokenCount );
+		pBuffers[mode] = (char *)malloc( save.bufferSize );
+		save.pBaseData = pBuffers[mode];
+		times[mode][0] = SavePlan_BenchWrite( &save, pEnts, count, passes );
+		sizes[mode] = save.size;
+
+		for( i = 0; i < save.tokenCount; i++ )
+		{
+			free( pCopies[i] );
+			pCopies[i] = save.pTokens[i] ? strdup( save.pTokens[i] ) : NULL;
+			restore.pTokens[i] = pCopies[i];
+		}
+
+		restore.pBaseData = pBuffers[mode];
+		restore.bufferSize = sizes[mode];
+		times[mode][1] = SavePlan_BenchRead( &restore, &pRestored[mode * count], count, passes );
+	}
+	sv_saveplan.value = saved;
+
+	same = sizes[0] == sizes[1] && !memcmp( pBuffers[0], pBuffers[1], sizes[0] )
+		&& !memcmp( pRestored, pEnts, sizeof(savebenchent_t) * count )
+		&& !memcmp( &pRestored[count], pEnts, sizeof(savebenchent_t) * count );
+
+	ALERT( at_console, "%i entities, %i passes, %i bytes, microseconds per entity plan / table:\n", count, passes, sizes[1] );
+	ALERT( at_console, "  save    %8.3f / %8.3f\n", times[1][0], times[0][0] );
+	ALERT( at_console, "  restore %8.3f / %8.3f\n", times[1][1], times[0][1] );
+	ALERT( at_console, "  %s\n", same ? "saves and restored entities match" : "MISMATCH between plan and table" );
+
+	for( i = 0; i < restore.tokenCount; i++ )
+		free( pCopies[i] );
+	free( pCopies );
+	free( restore.pTokens );
+	free( save.pTokens );
+	free( pBuffers[0] );
+	free( pBuffers[1] );
+	delete[] pRestored;
+	delete[] pEnts;
+}
+
+/*
+================
+SavePlan_Init
+
+================
+*/
+void SavePlan_Init( void )
+{
+	CVAR_REGISTER( &sv_saveplan );
+	g_engfuncs.pfnAddServerCommand( "sv_saveplan_bench", SavePlan_Bench );
+}
@@ -0,0 +1,75 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// saveplan.h - TYPEDESCRIPTION tables compiled into field
+// plans for CSave::WriteFields and CRestore::ReadFields
+//=========================================================
+#pragma once
+#ifndef SAVEPLAN_H
+#define SAVEPLAN_H
+
+#define SAVEPLAN_MAX_FIELDS	1024	// larger tables use the plain TYPEDESCRIPTION walk
+#define SAVEPLAN_BUCKETS	256	// plans by table pointer
+#define SAVEPLAN_NAMES		8192	// pre-hashed field names, keyed on the name pointer
+
+typedef struct
+{
+	int	offset;		// from the start of the block
+	int	size;		// bytes in memory, fieldSize * gSizes[fieldType]
+} saverun_t;
+
+typedef struct saveplan_s
+{
+	const TYPEDESCRIPTION	*pFields;	// table the plan was compiled from
+	int			fieldCount;
+	saverun_t		*fields;	// one per TYPEDESCRIPTION, for the empty checks
+	saverun_t		*clear;		// zeroed before a restore, adjacent fields merged
+	int			clearCount;
+	saverun_t		*clearLocal;	// the same without the FTYPEDESC_GLOBAL fields
+	int			clearLocalCount;
+	short			*names;		// field index by HashString of the name, -1 for none
+	int			namesMask;
+	int			exact;		// no two names are equal ignoring case
+	struct saveplan_s	*next;
+} saveplan_t;
+
+extern cvar_t sv_saveplan;
+
+void SavePlan_Init( void );
+
+// Plan for a table, compiled the first time it is asked for.
+// NULL with sv_saveplan 0 or for tables the plan can't take.
+const saveplan_t *SavePlan_Get( const TYPEDESCRIPTION *pFields, int fieldCount );
+
+// Field the restore buffer's name belongs to, trying startField first.
+// -1 when the plan can't tell and the caller has to search by name.
+int SavePlan_Match( const saveplan_t *pPlan, int startField, const char *pszName );
+
+int SavePlan_Empty( const char *pdata, int size );
+
+// CSaveRestoreBuffer::HashString
+unsigned int SavePlan_HashString( const char *pszToken );
+
+// Token slot cache for field names the plans have seen, NULL for any other pointer
+typedef struct
+{
+	const char	*name;
+	unsigned int	hash;		// SavePlan_HashString( name )
+	int		slot;		// where it went in the last token table, check before use
+} savename_t;
+
+savename_t *SavePlan_Name( const char *pszToken );
+
+#endif // SAVEPLAN_H
@@ -69,6 +69,7 @@ public:
 	int		WriteFields( const char *pname, void *pBaseData, TYPEDESCRIPTION *pFields, int fieldCount );
 
 private:
+	void	WriteField( const TYPEDESCRIPTION *pTest, void *pOutputData );
 	int		DataEmpty( const char *pdata, int size );
 	void	BufferField( const char *pname, int size, const char *pdata );
 	void	BufferString( char *pdata, int len );
@@ -99,6 +100,8 @@ public:
 	void	PrecacheMode( BOOL mode ) { m_precache = mode; }
 
 private:
+	void	ReadFieldData( void *pBaseData, const TYPEDESCRIPTION *pTest, void *pData );
+
 	char	*BufferPointer( void );
 	void	BufferReadBytes( char *pOutput, int size );
 	void	BufferSkipBytes( int bytes );
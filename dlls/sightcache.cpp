@@ -0,0 +1,325 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+/*
+
+===== sightcache.cpp ========================================================
+
+  Line of sight results shared by both ends of a pair for one frame.
+
+  Two monsters that look at each other in the same frame trace the same
+  segment, once each way. The sight trace ignores monsters, so the looker
+  it skips only matters for brush entities; for everything else the
+  result of one direction answers the other. Pairs are keyed on the lower
+  and higher edict index together with both eye positions, so an end that
+  moved since the trace misses and traces again. A trace that starts or
+  stays in solid isn't kept, the reverse one needn't agree with it.
+  StartFrame starts a new generation, which drops everything from the
+  frame before.
+
+*/
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "sightcache.h"
+
+cvar_t sv_sightcache = { "sv_sightcache", "1", FCVAR_SERVER };	// 2 traces anyway and reports disagreements
+
+typedef struct
+{
+	int		serial;		// frame generation the pair was traced in
+	int		lo;		// lower edict index
+	int		hi;
+	Vector		vecLo;		// eyes of lo at the time
+	Vector		vecHi;
+	int		visible;
+} sightpair_t;
+
+static sightpair_t	s_Pairs[SIGHTCACHE_SLOTS];
+static int		s_nSerial = 1;
+static int		s_nLookups;
+static int		s_nTraces;
+
+static inline unsigned int SightCache_Hash( int lo, int hi )
+{
+	return ( (unsigned int)lo * 73856093u ^ (unsigned int)hi * 19349663u ) & ( SIGHTCACHE_SLOTS - 1 );
+}
+
+// pSolid is set when the trace started or stayed in solid, the other
+// direction can come out differently then
+static BOOL SightCache_Trace( edict_t *pLooker, const Vector &vecLookerEye, const Vector &vecTargetEye, BOOL *pSolid )
+{
+	TraceResult tr;
+
+	s_nTraces++;
+	UTIL_TraceLine( vecLookerEye, vecTargetEye, ignore_monsters, ignore_glass, pLooker, &tr );
+
+	if( pSolid )
+		*pSolid = tr.fStartSolid || tr.fAllSolid;
+
+	return tr.flFraction == 1.0f;
+}
+
+/*
+================
+SightCache_Frame
+
+================
+*/
+void SightCache_Frame( void )
+{
+	s_nSerial++;
+}
+
+/*
+================
+SightCache_Visible
+
+================
+*/
+BOOL SightCache_Visible( edict_t *pLooker, const Vector &vecLookerEye, edict_t *pTarget, const Vector &vecTargetEye )
+{
+	sightpair_t *pair, *pFree;
+	const Vector *pLo, *pHi;
+	unsigned int slot;
+	int looker, target, lo, hi, i;
+	BOOL visible, solid;
+
+	s_nLookups++;
+
+	if( !sv_sightcache.value || !pLooker || !pTarget )
+		return SightCache_Trace( pLooker, vecLookerEye, vecTargetEye, NULL );
+
+	// brush entities block the trace even with ignore_monsters, and the
+	// two directions skip a different one
+	if( pLooker->v.solid == SOLID_BSP || pTarget->v.solid == SOLID_BSP )
+		return SightCache_Trace( pLooker, vecLookerEye, vecTargetEye, NULL );
+
+	looker = ENTINDEX( pLooker );
+	target = ENTINDEX( pTarget );
+
+	if( looker < target )
+	{
+		lo = looker;
+		hi = target;
+		pLo = &vecLookerEye;
+		pHi = &vecTargetEye;
+	}
+	else
+	{
+		lo = target;
+		hi = looker;
+		pLo = &vecTargetEye;
+		pHi = &vecLookerEye;
+	}
+
+	pFree = NULL;
+	slot = SightCache_Hash( lo, hi );
+
+	for( i = 0; i < SIGHTCACHE_PROBES; i++ )
+	{
+		pair = &s_Pairs[( slot + i ) & ( SIGHTCACHE_SLOTS - 1 )];
+
+		if( pair->serial != s_nSerial )
+		{
+			if( !pFree )
+				pFree = pair;
+			continue;
+		}
+
+		if( pair->lo != lo || pair->hi != hi )
+			continue;
+
+		if( pair->vecLo == *pLo && pair->vecHi == *pHi )
+		{
+			if( sv_sightcache.value == 2 )
+			{
+				visible = SightCache_Trace( pLooker, vecLookerEye, vecTargetEye, NULL );
+				if( visible != pair->visible )
+					ALERT( at_console, "SightCache_Visible: %i -> %i cached %i, traced %i\n", looker, target, pair->visible, visible );
+				return visible;
+			}
+
+			return pair->visible;
+		}
+
+		// one of them moved, the new positions take this slot over
+		pFree = pair;
+		break;
+	}
+
+	visible = SightCache_Trace( pLooker, vecLookerEye, vecTargetEye, &solid );
+
+	if( solid )
+	{
+		// don't hand it to the other end, and don't let an older result answer
+		if( pFree && pFree->serial == s_nSerial )
+			pFree->serial = 0;
+	}
+	else if( pFree )
+	{
+		pFree->serial = s_nSerial;
+		pFree->lo = lo;
+		pFree->hi = hi;
+		pFree->vecLo = *pLo;
+		pFree->vecHi = *pHi;
+		pFree->visible = visible;
+	}
+
+	return visible;
+}
+
+/*
+================
+SightCache_BenchPass
+
+Every pair looks both ways, one frame's worth of Look() sight checks
+================
+*/
+static double SightCache_BenchPass( CBaseEntity **pEnts, int count, float flDist, unsigned char *pResults, int *pTraces )
+{
+	double start;
+	int i, j, traces, n;
+
+	SightCache_Frame();
+
+	traces = s_nTraces;
+	start = UTIL_PerfTime();
+	n = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		for( j = i + 1; j < count; j++ )
+		{
+			if( ( pEnts[i]->pev->origin - pEnts[j]->pev->origin ).Length() > flDist )
+				continue;
+
+			pResults[n++] = pEnts[i]->FVisible( pEnts[j] );
+			pResults[n++] = pEnts[j]->FVisible( pEnts[i] );
+		}
+	}
+
+	*pTraces = s_nTraces - traces;
+
+	return ( UTIL_PerfTime() - start ) * 1e6;
+}
+
+/*
+================
+SightCache_Bench
+
+sv_sightcache_bench [distance]
+================
+*/
+static void SightCache_Bench( void )
+{
+	CBaseEntity *pEnts[512];
+	unsigned char *pCached, *pTraced;
+	edict_t *pEdict;
+	double cached, traced;
+	int count, pairs, i, j, tracesCached, tracesTraced, mismatches;
+	float flDist, saved;
+
+	pEdict = INDEXENT( 0 );
+	if( !pEdict )
+	{
+		ALERT( at_console, "sv_sightcache_bench: needs a running map\n" );
+		return;
+	}
+
+	flDist = ( CMD_ARGC() > 1 ) ? atof( CMD_ARGV( 1 ) ) : 2048.0f;
+
+	// Whatever Look() would consider, monsters and clients alive on the map
+	count = 0;
+	for( i = 1; i < gpGlobals->maxEntities && count < (int)ARRAYSIZE( pEnts ); i++ )
+	{
+		if( pEdict[i].free || !( pEdict[i].v.flags & ( FL_MONSTER | FL_CLIENT ) ) || pEdict[i].v.health <= 0 )
+			continue;
+
+		CBaseEntity *pEntity = CBaseEntity::Instance( &pEdict[i] );
+		if( pEntity )
+			pEnts[count++] = pEntity;
+	}
+
+	pairs = 0;
+	for( i = 0; i < count; i++ )
+	{
+		for( j = i + 1; j < count; j++ )
+		{
+			if( ( pEnts[i]->pev->origin - pEnts[j]->pev->origin ).Length() <= flDist )
+				pairs++;
+		}
+	}
+
+	if( !pairs )
+	{
+		ALERT( at_console, "sv_sightcache_bench: no monsters within %.0f units of each other\n", flDist );
+		return;
+	}
+
+	pCached = new unsigned char[pairs * 2];
+	pTraced = new unsigned char[pairs * 2];
+
+	saved = sv_sightcache.value;
+	sv_sightcache.value = 1;
+	cached = SightCache_BenchPass( pEnts, count, flDist, pCached, &tracesCached );
+	sv_sightcache.value = 0;
+	traced = SightCache_BenchPass( pEnts, count, flDist, pTraced, &tracesTraced );
+	sv_sightcache.value = saved;
+
+	mismatches = 0;
+	for( i = 0; i < pairs * 2; i++ )
+	{
+		if( pCached[i] != pTraced[i] )
+			mismatches++;
+	}
+
+	delete[] pCached;
+	delete[] pTraced;
+
+	ALERT( at_console, "%i monsters and clients, %i pairs within %.0f units\n", count, pairs, flDist );
+	ALERT( at_console, "  traces cached / uncached: %i / %i\n", tracesCached, tracesTraced );
+	ALERT( at_console, "  microseconds per frame:   %.1f / %.1f\n", cached, traced );
+	if( mismatches )
+		ALERT( at_console, "  %i sight checks disagree\n", mismatches );
+}
+
+/*
+================
+SightCache_Stats
+
+sv_sightcache_stats, lookups and traces since the last call
+================
+*/
+static void SightCache_Stats( void )
+{
+	ALERT( at_console, "%i sight checks, %i traced (%.1f%%)\n", s_nLookups, s_nTraces, s_nLookups ? s_nTraces * 100.0f / s_nLookups : 0.0f );
+
+	s_nLookups = 0;
+	s_nTraces = 0;
+}
+
+/*
+================
+SightCache_Init
+
+================
+*/
+void SightCache_Init( void )
+{
+	CVAR_REGISTER( &sv_sightcache );
+	g_engfuncs.pfnAddServerCommand( "sv_sightcache_bench", SightCache_Bench );
+	g_engfuncs.pfnAddServerCommand( "sv_sightcache_stats", SightCache_Stats );
+}
@@ -0,0 +1,38 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+//=========================================================
+// sightcache.h - eye to eye line of sight traces shared
+// between both ends of a pair for one server frame
+//=========================================================
+#pragma once
+#ifndef SIGHTCACHE_H
+#define SIGHTCACHE_H
+
+#define SIGHTCACHE_SLOTS	4096	// pairs per frame, power of two
+#define SIGHTCACHE_PROBES	8	// slots tried before tracing without caching
+
+extern cvar_t sv_sightcache;
+
+void SightCache_Init( void );
+
+// New server frame, everything cached so far is stale
+void SightCache_Frame( void );
+
+// The CBaseEntity::FVisible trace from pLooker's eyes to pTarget's. Reuses
+// the result of the reverse trace when pTarget already looked at pLooker
+// this frame and neither has moved since
+BOOL SightCache_Visible( edict_t *pLooker, const Vector &vecLookerEye, edict_t *pTarget, const Vector &vecTargetEye );
+
+#endif // SIGHTCACHE_H
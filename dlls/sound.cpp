@@ -991,9 +991,16 @@ typedef struct sentenceg
 	char szgroupname[CBSENTENCENAME_MAX];
 	int count;
 	unsigned char rgblru[CSENTENCE_LRU_MAX];
+	int ilru;						// next rgblru entry to pick, the ones before it are used
 } SENTENCEG;
 
 #define CSENTENCEG_MAX 200					// max number of sentence groups
+
+// open addressing, power of two and at least twice the entries
+#define CSENTENCEG_HASH		512
+#define CSENTENCE_HASH		4096
+#define CTEXTURE_HASH		1024
+
 // globals
 
 SENTENCEG rgsentenceg[CSENTENCEG_MAX];
@@ -1002,6 +1009,84 @@ int fSentencesInit = FALSE;
 char gszallsentencenames[CVOXFILESENTENCEMAX][CBSENTENCENAME_MAX];
 int gcallsentences = 0;
 
+// Open addressing index over an array of names, slots hold the array
+// index or -1. Equal names keep the first index, like the scans did.
+typedef struct
+{
+	short		*slots;
+	int		size;		// power of two, at least twice the names
+	const char	*names;		// first name in the array
+	int		stride;		// bytes from one name to the next
+	int		fold;		// names match ignoring case
+	int		len;		// characters that count
+} soundhash_t;
+
+static short rgisentencegHash[CSENTENCEG_HASH];
+static short rgisentenceHash[CSENTENCE_HASH];
+
+static soundhash_t gSentenceGroupHash = { rgisentencegHash, CSENTENCEG_HASH, rgsentenceg[0].szgroupname, sizeof(SENTENCEG), FALSE, 512 };
+static soundhash_t gSentenceHash = { rgisentenceHash, CSENTENCE_HASH, gszallsentencenames[0], CBSENTENCENAME_MAX, TRUE, 512 };
+
+// lookup counters for sv_soundlookups
+static unsigned int gcSentenceGroupLookups, gcSentenceLookups, gcTextureLookups;
+static unsigned int gcSentenceGroupMisses, gcSentenceMisses, gcTextureMisses;
+
+static unsigned int USOUND_HashName( const soundhash_t *phash, const char *name )
+{
+	unsigned int hash = 2166136261u;
+	int c, len;
+
+	// FNV-1a
+	for( len = phash->len; len > 0 && *name; len--, name++ )
+	{
+		c = phash->fold ? tolower( (unsigned char)*name ) : (unsigned char)*name;
+		hash = ( hash ^ c ) * 16777619u;
+	}
+
+	return hash;
+}
+
+static int USOUND_HashCompare( const soundhash_t *phash, int index, const char *name )
+{
+	const char *entry = phash->names + index * phash->stride;
+
+	if( phash->fold )
+		return strnicmp( entry, name, phash->len );
+	return strncmp( entry, name, phash->len );
+}
+
+static void USOUND_HashClear( soundhash_t *phash )
+{
+	memset( phash->slots, -1, phash->size * sizeof(short) );
+}
+
+static void USOUND_HashAdd( soundhash_t *phash, int index )
+{
+	const char *name = phash->names + index * phash->stride;
+	int i;
+
+	for( i = USOUND_HashName( phash, name ) & ( phash->size - 1 ); phash->slots[i] != -1; i = ( i + 1 ) & ( phash->size - 1 ) )
+	{
+		if( !USOUND_HashCompare( phash, phash->slots[i], name ) )
+			return;
+	}
+
+	phash->slots[i] = index;
+}
+
+static int USOUND_HashFind( const soundhash_t *phash, const char *name )
+{
+	int i;
+
+	for( i = USOUND_HashName( phash, name ) & ( phash->size - 1 ); phash->slots[i] != -1; i = ( i + 1 ) & ( phash->size - 1 ) )
+	{
+		if( !USOUND_HashCompare( phash, phash->slots[i], name ) )
+			return phash->slots[i];
+	}
+
+	return -1;
+}
+
 // randomize list of sentence name indices
 
 void USENTENCEG_InitLRU( unsigned char *plru, int count )
@@ -1072,19 +1157,15 @@ int USENTENCEG_PickSequential( int isentenceg, char *szfound, int ipick, int fre
 // pick a random sentence from rootname0 to rootnameX.
 // picks from the rgsentenceg[isentenceg] least
 // recently used, modifies lru array. returns the sentencename.
-// note, lru must be seeded with 0-n randomized sentence numbers, with the
-// rest of the lru filled with -1. The first integer in the lru is
-// actually the size of the list.  Returns ipick, the ordinal
-// of the picked sentence within the group.
+// note, lru must be seeded with 0-n randomized sentence numbers,
+// ilru walks it and it is shuffled again once ilru reaches the end.
+// Returns ipick, the ordinal of the picked sentence within the group.
 
 int USENTENCEG_Pick( int isentenceg, char *szfound )
 {
-	const char *szgroupname;
-	unsigned char *plru;
-	unsigned char i;
+	SENTENCEG *pgroup;
 	unsigned char count;
 	unsigned char ipick;
-	int ffound = FALSE;
 
 	if( !fSentencesInit )
 		return -1;
@@ -1092,31 +1173,21 @@ int USENTENCEG_Pick( int isentenceg, char *szfound )
 	if( isentenceg < 0 )
 		return -1;
 
-	szgroupname = rgsentenceg[isentenceg].szgroupname;
-	count = rgsentenceg[isentenceg].count;
-	plru = rgsentenceg[isentenceg].rgblru;
+	pgroup = &rgsentenceg[isentenceg];
+	count = Q_min( pgroup->count, CSENTENCE_LRU_MAX );
+	if( !count )
+		return -1;
 
-	while( !ffound )
+	if( pgroup->ilru >= count )
 	{
-		for(i = 0; i < count; i++ )
-			if( plru[i] != 0xFF )
-			{
-				ipick = plru[i];
-				plru[i] = 0xFF;
-				ffound = TRUE;
-				break;
-			}
+		USENTENCEG_InitLRU( pgroup->rgblru, count );
+		pgroup->ilru = 0;
+	}
 
-		if( !ffound )
-			USENTENCEG_InitLRU( plru, count );
-		else
-		{
-			sprintf( szfound, "!%s%d", szgroupname, ipick );
+	ipick = pgroup->rgblru[pgroup->ilru++];
+	sprintf( szfound, "!%s%d", pgroup->szgroupname, ipick );
 
-			return ipick;
-		}
-	}
-	return -1;
+	return ipick;
 }
 
 // ===================== SENTENCE GROUPS, MAIN ROUTINES ========================
@@ -1131,16 +1202,13 @@ int SENTENCEG_GetIndex( const char *szgroupname )
 	if( !fSentencesInit || !szgroupname )
 		return -1;
 
-	// search rgsentenceg for match on szgroupname
-	i = 0;
-	while( rgsentenceg[i].count )
-	{
-		if( !strcmp( szgroupname, rgsentenceg[i].szgroupname ) )
-			return i;
-	i++;
-	}
+	gcSentenceGroupLookups++;
 
-	return -1;
+	i = USOUND_HashFind( &gSentenceGroupHash, szgroupname );
+	if( i < 0 )
+		gcSentenceGroupMisses++;
+
+	return i;
 }
 
 // given sentence group index, play random sentence for given entity.
@@ -1252,6 +1320,9 @@ void SENTENCEG_Init()
 	memset( rgsentenceg, 0, CSENTENCEG_MAX * sizeof(SENTENCEG) );
 	isentencegs = -1;
 
+	USOUND_HashClear( &gSentenceGroupHash );
+	USOUND_HashClear( &gSentenceHash );
+
 	int filePos = 0, fileSize;
 	byte *pMemFile = g_engfuncs.pfnLoadFileForMe( "sound/sentences.txt", &fileSize );
 	if( !pMemFile )
@@ -1294,7 +1365,8 @@ void SENTENCEG_Init()
 		if( strlen( pString ) >= CBSENTENCENAME_MAX )
 			ALERT( at_warning, "Sentence %s longer than %d letters\n", pString, CBSENTENCENAME_MAX - 1 );
 
-		strcpy( gszallsentencenames[gcallsentences++], pString );
+		strcpy( gszallsentencenames[gcallsentences], pString );
+		USOUND_HashAdd( &gSentenceHash, gcallsentences++ );
 
 		j--;
 		if( j <= i )
@@ -1343,13 +1415,14 @@ void SENTENCEG_Init()
 
 	fSentencesInit = TRUE;
 
-	// init lru lists
-
+	// init lru lists and index the groups, a group name that comes
+	// back later in the file still finds the first group
 	i = 0;
 
-	while( rgsentenceg[i].count && i < CSENTENCEG_MAX )
+	while( i < CSENTENCEG_MAX && rgsentenceg[i].count )
 	{
 		USENTENCEG_InitLRU( &( rgsentenceg[i].rgblru[0] ), rgsentenceg[i].count );
+		USOUND_HashAdd( &gSentenceGroupHash, i );
 		i++;
 	}
 }
@@ -1360,19 +1433,26 @@ int SENTENCEG_Lookup( const char *sample, char *sentencenum )
 {
 	int i;
 
+	if( !gcallsentences )
+		return -1;
+
+	gcSentenceLookups++;
+
 	// this is a sentence name; lookup sentence number
 	// and give to engine as string.
-	for( i = 0; i < gcallsentences; i++ )
-		if( !stricmp( gszallsentencenames[i], sample + 1 ) )
-		{
-			if( sentencenum )
-			{
-				sprintf(sentencenum, "!%d", i);
-			}
-			return i;
-		}
-	// sentence name not found!
-	return -1;
+	i = USOUND_HashFind( &gSentenceHash, sample + 1 );
+	if( i < 0 )
+	{
+		// sentence name not found!
+		gcSentenceMisses++;
+		return -1;
+	}
+
+	if( sentencenum )
+	{
+		sprintf(sentencenum, "!%d", i);
+	}
+	return i;
 }
 
 void EMIT_SOUND_DYN( edict_t *entity, int channel, const char *sample, float volume, float attenuation, int flags, int pitch )
@@ -1448,6 +1528,9 @@ int gcTextures = 0;
 char grgszTextureName[CTEXTURESMAX][CBTEXTURENAMEMAX]; // texture names
 char grgchTextureType[CTEXTURESMAX];                   // parallel array of texture types
 
+static short grgiTextureHash[CTEXTURE_HASH];
+static soundhash_t gTextureHash = { grgiTextureHash, CTEXTURE_HASH, grgszTextureName[0], CBTEXTURENAMEMAX, TRUE, CBTEXTURENAMEMAX - 1 };
+
 // open materials.txt,  get size, alloc space, 
 // save in array.  Only works first time called, 
 // ignored on subsequent calls.
@@ -1515,6 +1598,8 @@ void TEXTURETYPE_Init()
 	gcTextures = 0;
 	memset( buffer, 0, 512 );
 
+	USOUND_HashClear( &gTextureHash );
+
 	pMemFile = g_engfuncs.pfnLoadFileForMe( "sound/materials.txt", &fileSize );
 	if ( !pMemFile )
 		return;
@@ -1555,7 +1640,8 @@ void TEXTURETYPE_Init()
 		// null-terminate name and save in sentences array
 		j = min( j, CBTEXTURENAMEMAX - 1 + i );
 		buffer[j] = 0;
-		strcpy( &( grgszTextureName[gcTextures++][0] ), &( buffer[i] ) );
+		strcpy( &( grgszTextureName[gcTextures][0] ), &( buffer[i] ) );
+		USOUND_HashAdd( &gTextureHash, gcTextures++ );
 	}
 
 	g_engfuncs.pfnFreeFile( pMemFile );
@@ -1571,15 +1657,65 @@ void TEXTURETYPE_Init()
 
 char TEXTURETYPE_Find( char *name )
 {
-	// CONSIDER: pre-sort texture names and perform faster binary search here
+	int i;
+
+	if( !gcTextures )
+		return CHAR_TEX_CONCRETE;
 
-	for ( int i = 0; i < gcTextures; i++ )
+	gcTextureLookups++;
+
+	i = USOUND_HashFind( &gTextureHash, name );
+	if( i < 0 )
 	{
-		if ( !strnicmp( name, &( grgszTextureName[i][0] ), CBTEXTURENAMEMAX - 1 ) )
-			return ( grgchTextureType[i] );
+		gcTextureMisses++;
+		return CHAR_TEX_CONCRETE;
 	}
 
-	return CHAR_TEX_CONCRETE;
+	return grgchTextureType[i];
+}
+
+/*
+================
+SOUND_Lookups
+
+sv_soundlookups, sentence and texture lookups since the last call
+================
+*/
+static void SOUND_Lookups( void )
+{
+	static double flLast;
+	static unsigned int cLast[3];
+	unsigned int counts[3] = { gcSentenceGroupLookups, gcSentenceLookups, gcTextureLookups };
+	unsigned int misses[3] = { gcSentenceGroupMisses, gcSentenceMisses, gcTextureMisses };
+	const char *names[3] = { "sentence groups", "sentences", "textures" };
+	double now, elapsed;
+	int i, groups;
+
+	now = UTIL_PerfTime();
+	elapsed = flLast ? now - flLast : 0;
+
+	for( groups = 0; groups < CSENTENCEG_MAX && rgsentenceg[groups].count; groups++ )
+		;
+
+	ALERT( at_console, "%i sentence groups, %i sentences, %i textures loaded\n", groups, gcallsentences, gcTextures );
+	for( i = 0; i < 3; i++ )
+	{
+		ALERT( at_console, "  %-16s %10u lookups %8u misses", names[i], counts[i], misses[i] );
+		if( elapsed > 0 )
+			ALERT( at_console, " %10.1f/s", ( counts[i] - cLast[i] ) / elapsed );
+		ALERT( at_console, "\n" );
+		cLast[i] = counts[i];
+	}
+
+	if( !elapsed )
+		ALERT( at_console, "run it again for lookups per second\n" );
+
+	flLast = now;
+}
+
+void SOUND_Init()
+{
+	g_engfuncs.pfnAddServerCommand( "sv_soundlookups", SOUND_Lookups );
 }
 
 // play a strike sound based on the texture that was hit by the attack traceline.  VecSrc/VecEnd are the
@@ -23,6 +23,24 @@ LINK_ENTITY_TO_CLASS( soundent, CSoundEnt )
 
 CSoundEnt *pSoundEnt;
 
+cvar_t sv_soundgrid = { "sv_soundgrid", "1", FCVAR_SERVER };	// 0 walks the whole active list for every listener
+
+static int SoundEnt_Cell( float flCoord )
+{
+	return (int)floor( flCoord / SOUNDENT_CELL_SIZE );
+}
+
+static int SoundEnt_Hash( int x, int y )
+{
+	return ( ( x * 73856093 ) ^ ( y * 19349663 ) ) & ( SOUNDENT_BUCKETS - 1 );
+}
+
+// the test CBaseMonster::Listen has always used
+static inline BOOL SoundEnt_Hears( const CSound *pSound, const Vector &vecEar, int iMask, float flSensitivity )
+{
+	return ( pSound->m_iType & iMask ) && ( pSound->m_vecOrigin - vecEar ).Length() <= pSound->m_iVolume * flSensitivity;
+}
+
 //=========================================================
 // CSound - Clear - zeros all fields for a sound
 //=========================================================
@@ -34,6 +52,13 @@ void CSound::Clear( void )
 	m_flExpireTime = 0;
 	m_iNext = SOUNDLIST_EMPTY;
 	m_iNextAudible = 0;
+	m_iPrev = SOUNDLIST_EMPTY;
+	m_iBucket = SOUNDLIST_EMPTY;
+	m_iBucketNext = SOUNDLIST_EMPTY;
+	m_iBucketPrev = SOUNDLIST_EMPTY;
+	m_iWheelSlot = SOUNDLIST_EMPTY;
+	m_iWheelNext = SOUNDLIST_EMPTY;
+	m_iWheelPrev = SOUNDLIST_EMPTY;
 }
 
 //=========================================================
@@ -45,7 +70,6 @@ void CSound::Reset( void )
 	m_vecOrigin = g_vecZero;
 	m_iType = 0;
 	m_iVolume = 0;
-	m_iNext = SOUNDLIST_EMPTY;
 }
 
 //=========================================================
@@ -86,37 +110,14 @@ void CSoundEnt::Spawn( void )
 }
 
 //=========================================================
-// Think - at interval, the entire active sound list is checked
-// for sounds that have ExpireTimes less than or equal
-// to the current world time, and these sounds are deallocated.
+// Think - at interval, sounds with ExpireTimes less than or
+// equal to the current world time are deallocated.
 //=========================================================
 void CSoundEnt::Think( void )
 {
-	int iSound;
-	int iPreviousSound;
-
 	pev->nextthink = gpGlobals->time + 0.3f;// how often to check the sound list.
 
-	iPreviousSound = SOUNDLIST_EMPTY;
-	iSound = m_iActiveSound; 
-
-	while( iSound != SOUNDLIST_EMPTY )
-	{
-		if( m_SoundPool[ iSound ].m_flExpireTime <= gpGlobals->time && m_SoundPool[ iSound ].m_flExpireTime != SOUND_NEVER_EXPIRE )
-		{
-			int iNext = m_SoundPool[ iSound ].m_iNext;
-
-			// move this sound back into the free list
-			FreeSound( iSound, iPreviousSound );
-
-			iSound = iNext;
-		}
-		else
-		{
-			iPreviousSound = iSound;
-			iSound = m_SoundPool[ iSound ].m_iNext;
-		}
-	}
+	ExpireSounds();
 
 	if( m_fShowReport )
 	{
@@ -132,34 +133,154 @@ void CSoundEnt::Precache( void )
 {
 }
 
+//=========================================================
+// ExpireSounds - frees the sounds in the wheel slots from
+// the last tick looked at up to now. A slot also holds
+// sounds that expire a whole turn of the wheel later, they
+// stay. The current tick is looked at again next time.
+//=========================================================
+void CSoundEnt::ExpireSounds( void )
+{
+	int iTick, iSlot, iSound, iNext;
+	int i;
+
+	iTick = (int)( gpGlobals->time / SOUNDENT_WHEEL_TICK );
+
+	for( i = m_iWheelTick; i <= iTick && i - m_iWheelTick < SOUNDENT_WHEEL_SLOTS; i++ )
+	{
+		iSlot = i & ( SOUNDENT_WHEEL_SLOTS - 1 );
+
+		for( iSound = m_iWheel[iSlot]; iSound != SOUNDLIST_EMPTY; iSound = iNext )
+		{
+			iNext = m_SoundPool[iSound].m_iWheelNext;
+
+			if( m_SoundPool[iSound].m_flExpireTime <= gpGlobals->time )
+			{
+				// move this sound back into the free list
+				FreeSound( iSound, m_SoundPool[iSound].m_iPrev );
+			}
+		}
+	}
+
+	m_iWheelTick = iTick;
+}
+
+//=========================================================
+// LinkWheel - files an expiring sound under the tick it
+// expires in, or the current one if that has gone by.
+//=========================================================
+void CSoundEnt::LinkWheel( int iSound )
+{
+	CSound *pSound = &m_SoundPool[iSound];
+	int iTick;
+
+	if( pSound->m_flExpireTime == SOUND_NEVER_EXPIRE )
+		return;
+
+	iTick = (int)( pSound->m_flExpireTime / SOUNDENT_WHEEL_TICK );
+	if( iTick < m_iWheelTick )
+		iTick = m_iWheelTick;
+
+	pSound->m_iWheelSlot = iTick & ( SOUNDENT_WHEEL_SLOTS - 1 );
+	pSound->m_iWheelPrev = SOUNDLIST_EMPTY;
+	pSound->m_iWheelNext = m_iWheel[pSound->m_iWheelSlot];
+	if( pSound->m_iWheelNext != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iWheelNext].m_iWheelPrev = iSound;
+	m_iWheel[pSound->m_iWheelSlot] = iSound;
+}
+
+void CSoundEnt::UnlinkWheel( int iSound )
+{
+	CSound *pSound = &m_SoundPool[iSound];
+
+	if( pSound->m_iWheelSlot == SOUNDLIST_EMPTY )
+		return;
+
+	if( pSound->m_iWheelPrev != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iWheelPrev].m_iWheelNext = pSound->m_iWheelNext;
+	else
+		m_iWheel[pSound->m_iWheelSlot] = pSound->m_iWheelNext;
+
+	if( pSound->m_iWheelNext != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iWheelNext].m_iWheelPrev = pSound->m_iWheelPrev;
+
+	pSound->m_iWheelSlot = pSound->m_iWheelNext = pSound->m_iWheelPrev = SOUNDLIST_EMPTY;
+}
+
+//=========================================================
+// LinkBucket - puts an active sound in a grid bucket or
+// one of the lists every listener checks.
+//=========================================================
+void CSoundEnt::LinkBucket( int iSound, int iBucket )
+{
+	CSound *pSound = &m_SoundPool[iSound];
+
+	pSound->m_iBucket = iBucket;
+	pSound->m_iBucketPrev = SOUNDLIST_EMPTY;
+	pSound->m_iBucketNext = m_iBuckets[iBucket];
+	if( pSound->m_iBucketNext != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iBucketNext].m_iBucketPrev = iSound;
+	m_iBuckets[iBucket] = iSound;
+}
+
+void CSoundEnt::UnlinkBucket( int iSound )
+{
+	CSound *pSound = &m_SoundPool[iSound];
+
+	if( pSound->m_iBucket == SOUNDLIST_EMPTY )
+		return;
+
+	if( pSound->m_iBucketPrev != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iBucketPrev].m_iBucketNext = pSound->m_iBucketNext;
+	else
+		m_iBuckets[pSound->m_iBucket] = pSound->m_iBucketNext;
+
+	if( pSound->m_iBucketNext != SOUNDLIST_EMPTY )
+		m_SoundPool[pSound->m_iBucketNext].m_iBucketPrev = pSound->m_iBucketPrev;
+
+	pSound->m_iBucket = pSound->m_iBucketNext = pSound->m_iBucketPrev = SOUNDLIST_EMPTY;
+}
+
 //=========================================================
 // FreeSound - clears the passed active sound and moves it 
 // to the top of the free list. TAKE CARE to only call this
 // function for sounds in the Active list!!
+// The active list is linked both ways, iPrevious has to
+// match the sound's m_iPrev.
 //=========================================================
 void CSoundEnt::FreeSound( int iSound, int iPrevious )
 {
+	CSound *pSound;
+
 	if( !pSoundEnt )
 	{
 		// no sound ent!
 		return;
 	}
 
+	pSound = &pSoundEnt->m_SoundPool[iSound];
+
+	pSoundEnt->UnlinkBucket( iSound );
+	pSoundEnt->UnlinkWheel( iSound );
+
 	if( iPrevious != SOUNDLIST_EMPTY )
 	{
 		// iSound is not the head of the active list, so
 		// must fix the index for the Previous sound
-		//pSoundEnt->m_SoundPool[iPrevious].m_iNext = m_SoundPool[iSound].m_iNext;
-		pSoundEnt->m_SoundPool[iPrevious].m_iNext = pSoundEnt->m_SoundPool[iSound].m_iNext;
+		pSoundEnt->m_SoundPool[iPrevious].m_iNext = pSound->m_iNext;
 	}
 	else 
 	{
 		// the sound we're freeing IS the head of the active list.
-		pSoundEnt->m_iActiveSound = pSoundEnt->m_SoundPool[iSound].m_iNext;
+		pSoundEnt->m_iActiveSound = pSound->m_iNext;
 	}
 
+	if( pSound->m_iNext != SOUNDLIST_EMPTY )
+		pSoundEnt->m_SoundPool[pSound->m_iNext].m_iPrev = iPrevious;
+
 	// make iSound the head of the Free list.
-	pSoundEnt->m_SoundPool[iSound].m_iNext = pSoundEnt->m_iFreeSound;
+	pSound->m_iPrev = SOUNDLIST_EMPTY;
+	pSound->m_iNext = pSoundEnt->m_iFreeSound;
 	pSoundEnt->m_iFreeSound = iSound;
 }
 
@@ -186,6 +307,9 @@ int CSoundEnt::IAllocSound( void )
 	m_iFreeSound = m_SoundPool[m_iFreeSound].m_iNext;// move the index down into the free list. 
 
 	m_SoundPool[iNewSound].m_iNext = m_iActiveSound;// point the new sound at the top of the active list.
+	m_SoundPool[iNewSound].m_iPrev = SOUNDLIST_EMPTY;
+	if( m_iActiveSound != SOUNDLIST_EMPTY )
+		m_SoundPool[m_iActiveSound].m_iPrev = iNewSound;
 
 	m_iActiveSound = iNewSound;// now make the new sound the top of the active list. You're done.
 
@@ -218,6 +342,13 @@ void CSoundEnt::InsertSound( int iType, const Vector &vecOrigin, int iVolume, fl
 	pSoundEnt->m_SoundPool[iThisSound].m_iType = iType;
 	pSoundEnt->m_SoundPool[iThisSound].m_iVolume = iVolume;
 	pSoundEnt->m_SoundPool[iThisSound].m_flExpireTime = gpGlobals->time + flDuration;
+
+	if( iVolume > SOUNDENT_CELL_VOLUME )
+		pSoundEnt->LinkBucket( iThisSound, SOUNDBUCKET_LOUD );
+	else
+		pSoundEnt->LinkBucket( iThisSound, SoundEnt_Hash( SoundEnt_Cell( vecOrigin.x ), SoundEnt_Cell( vecOrigin.y ) ) );
+
+	pSoundEnt->LinkWheel( iThisSound );
 }
 
 //=========================================================
@@ -233,6 +364,15 @@ void CSoundEnt::Initialize( void )
 	m_iFreeSound = 0;
 	m_iActiveSound = SOUNDLIST_EMPTY;
 
+	for( i = 0; i < SOUNDBUCKET_COUNT; i++ )
+		m_iBuckets[i] = SOUNDLIST_EMPTY;
+	for( i = 0; i < SOUNDENT_BUCKETS; i++ )
+		m_iBucketMarks[i] = 0;
+	for( i = 0; i < SOUNDENT_WHEEL_SLOTS; i++ )
+		m_iWheel[i] = SOUNDLIST_EMPTY;
+	m_iQueryMark = 0;
+	m_iWheelTick = (int)( gpGlobals->time / SOUNDENT_WHEEL_TICK );
+
 	for( i = 0; i < MAX_WORLD_SOUNDS; i++ )
 	{
 		// clear all sounds, and link them into the free sound list.
@@ -254,6 +394,9 @@ void CSoundEnt::Initialize( void )
 		}
 
 		pSoundEnt->m_SoundPool[iSound].m_flExpireTime = SOUND_NEVER_EXPIRE;
+
+		// player.cpp moves these around every frame
+		pSoundEnt->LinkBucket( iSound, SOUNDBUCKET_CLIENT );
 	}
 
 	if( CVAR_GET_FLOAT( "displaysoundlist" ) == 1 )
@@ -376,3 +519,251 @@ int CSoundEnt::ClientSoundIndex( edict_t *pClient )
 
 	return iReturn;
 }
+
+//=========================================================
+// AddAudible - links the sounds in a bucket that can be
+// heard at vecEar in front of iAudible, returns the new head
+//=========================================================
+int CSoundEnt::AddAudible( int iBucket, int iAudible, const Vector &vecEar, int iMask, float flSensitivity )
+{
+	CSound *pSound;
+	int iSound;
+
+	for( iSound = m_iBuckets[iBucket]; iSound != SOUNDLIST_EMPTY; iSound = pSound->m_iBucketNext )
+	{
+		pSound = &m_SoundPool[iSound];
+
+		if( SoundEnt_Hears( pSound, vecEar, iMask, flSensitivity ) )
+		{
+			pSound->m_iNextAudible = iAudible;
+			iAudible = iSound;
+		}
+	}
+
+	return iAudible;
+}
+
+//=========================================================
+// AudibleList - the client and loud sounds, and the grid
+// cells a sound of SOUNDENT_CELL_VOLUME could be heard from
+//=========================================================
+int CSoundEnt::AudibleList( const Vector &vecEar, int iMask, float flSensitivity )
+{
+	int iAudible, iBucket;
+	int x, y, x0, y0, x1, y1;
+	float flRadius;
+
+	if( !pSoundEnt )
+	{
+		return SOUNDLIST_EMPTY;
+	}
+
+	if( !sv_soundgrid.value )
+	{
+		return AudibleListScan( vecEar, iMask, flSensitivity );
+	}
+
+	iAudible = pSoundEnt->AddAudible( SOUNDBUCKET_CLIENT, SOUNDLIST_EMPTY, vecEar, iMask, flSensitivity );
+	iAudible = pSoundEnt->AddAudible( SOUNDBUCKET_LOUD, iAudible, vecEar, iMask, flSensitivity );
+
+	flRadius = SOUNDENT_CELL_VOLUME * flSensitivity;
+	if( flRadius < 0 )
+	{
+		return iAudible;
+	}
+
+	if( flRadius > SOUNDENT_CELL_SIZE * SOUNDENT_BUCKETS )
+	{
+		x0 = y0 = 0;
+		x1 = y1 = SOUNDENT_BUCKETS;
+	}
+	else
+	{
+		x0 = SoundEnt_Cell( vecEar.x - flRadius );
+		x1 = SoundEnt_Cell( vecEar.x + flRadius );
+		y0 = SoundEnt_Cell( vecEar.y - flRadius );
+		y1 = SoundEnt_Cell( vecEar.y + flRadius );
+	}
+
+	if( ( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) >= SOUNDENT_BUCKETS )
+	{
+		// hearing this far takes in the whole grid anyway
+		for( iBucket = 0; iBucket < SOUNDENT_BUCKETS; iBucket++ )
+			iAudible = pSoundEnt->AddAudible( iBucket, iAudible, vecEar, iMask, flSensitivity );
+		return iAudible;
+	}
+
+	// cells can share a bucket, only walk each one once
+	pSoundEnt->m_iQueryMark++;
+
+	for( x = x0; x <= x1; x++ )
+	{
+		for( y = y0; y <= y1; y++ )
+		{
+			iBucket = SoundEnt_Hash( x, y );
+			if( pSoundEnt->m_iBucketMarks[iBucket] == pSoundEnt->m_iQueryMark )
+				continue;
+
+			pSoundEnt->m_iBucketMarks[iBucket] = pSoundEnt->m_iQueryMark;
+			iAudible = pSoundEnt->AddAudible( iBucket, iAudible, vecEar, iMask, flSensitivity );
+		}
+	}
+
+	return iAudible;
+}
+
+//=========================================================
+// AudibleListScan - the same list from the whole active
+// list, what Listen did before the grid
+//=========================================================
+int CSoundEnt::AudibleListScan( const Vector &vecEar, int iMask, float flSensitivity )
+{
+	CSound *pSound;
+	int iSound, iAudible;
+
+	if( !pSoundEnt )
+	{
+		return SOUNDLIST_EMPTY;
+	}
+
+	iAudible = SOUNDLIST_EMPTY;
+
+	for( iSound = pSoundEnt->m_iActiveSound; iSound != SOUNDLIST_EMPTY; iSound = pSound->m_iNext )
+	{
+		pSound = &pSoundEnt->m_SoundPool[iSound];
+
+		if( SoundEnt_Hears( pSound, vecEar, iMask, flSensitivity ) )
+		{
+			pSound->m_iNextAudible = iAudible;
+			iAudible = iSound;
+		}
+	}
+
+	return iAudible;
+}
+
+//=========================================================
+// sv_soundent_bench [listeners] [sounds] [rounds]
+//
+// Fills the free part of the sound pool with short lived
+// sounds over the map and has that many listeners with
+// mixed hearing masks query them, grid against full scan.
+// The sounds go at the soundent's next think.
+//=========================================================
+static int SoundEnt_BenchMasks[] =
+{
+	bits_SOUND_WORLD | bits_SOUND_COMBAT | bits_SOUND_PLAYER | bits_SOUND_DANGER,
+	bits_SOUND_COMBAT | bits_SOUND_PLAYER | bits_SOUND_DANGER,
+	bits_SOUND_CARCASS | bits_SOUND_MEAT | bits_SOUND_GARBAGE | bits_SOUND_DANGER,
+	bits_SOUND_DANGER,
+};
+
+static int SoundEnt_BenchCount( int iSound, unsigned int *pSum )
+{
+	CSound *pSound;
+	int count = 0;
+
+	for( ; iSound != SOUNDLIST_EMPTY; iSound = pSound->m_iNextAudible )
+	{
+		pSound = CSoundEnt::SoundPointerForIndex( iSound );
+		*pSum += iSound * 2654435761u;
+		count++;
+	}
+
+	return count;
+}
+
+static void SoundEnt_Bench( void )
+{
+	edict_t *pWorld = INDEXENT( 0 );
+	Vector wmins, wmaxs, *pEars;
+	int listeners, sounds, rounds;
+	int i, j, inserted, heard[2], mismatches;
+	unsigned int sum;
+	double start, times[2];
+
+	if( !pSoundEnt || !pWorld )
+	{
+		ALERT( at_console, "sv_soundent_bench: needs a running map\n" );
+		return;
+	}
+
+	listeners = ( CMD_ARGC() > 1 ) ? atoi( CMD_ARGV( 1 ) ) : 200;
+	sounds = ( CMD_ARGC() > 2 ) ? atoi( CMD_ARGV( 2 ) ) : MAX_WORLD_SOUNDS;
+	rounds = ( CMD_ARGC() > 3 ) ? atoi( CMD_ARGV( 3 ) ) : 50;
+	listeners = Q_max( listeners, 1 );
+	rounds = Q_max( rounds, 1 );
+
+	wmins = pWorld->v.absmin;
+	wmaxs = pWorld->v.absmax;
+
+	sounds = Q_min( sounds, pSoundEnt->ISoundsInList( SOUNDLISTTYPE_FREE ) );
+	for( i = 0; i < sounds; i++ )
+	{
+		Vector origin( RANDOM_FLOAT( wmins.x, wmaxs.x ), RANDOM_FLOAT( wmins.y, wmaxs.y ), RANDOM_FLOAT( wmins.z, wmaxs.z ) );
+
+		// mostly footsteps and gunfire, some explosions
+		CSoundEnt::InsertSound( 1 << RANDOM_LONG( 0, 6 ), origin, RANDOM_LONG( 0, 9 ) ? RANDOM_LONG( 64, 1000 ) : RANDOM_LONG( 1024, 2048 ), 0 );
+	}
+	inserted = pSoundEnt->ISoundsInList( SOUNDLISTTYPE_ACTIVE );
+
+	pEars = new Vector[listeners];
+	for( i = 0; i < listeners; i++ )
+		pEars[i] = Vector( RANDOM_FLOAT( wmins.x, wmaxs.x ), RANDOM_FLOAT( wmins.y, wmaxs.y ), RANDOM_FLOAT( wmins.z, wmaxs.z ) );
+
+	for( j = 0; j < 2; j++ )
+	{
+		heard[j] = 0;
+		sum = 0;
+		start = UTIL_PerfTime();
+
+		for( int round = 0; round < rounds; round++ )
+		{
+			for( i = 0; i < listeners; i++ )
+			{
+				int iMask = SoundEnt_BenchMasks[i % ARRAYSIZE( SoundEnt_BenchMasks )];
+				float flSensitivity = ( i & 7 ) ? 1.0f : 2.0f;
+				int iList;
+
+				if( j )
+					iList = CSoundEnt::AudibleListScan( pEars[i], iMask, flSensitivity );
+				else
+					iList = CSoundEnt::AudibleList( pEars[i], iMask, flSensitivity );
+
+				if( !round )
+					heard[j] += SoundEnt_BenchCount( iList, &sum );
+			}
+		}
+
+		times[j] = ( UTIL_PerfTime() - start ) * 1000000.0 / ( (double)listeners * rounds );
+	}
+
+	// same sets, the order within a list can differ
+	mismatches = 0;
+	for( i = 0; i < listeners; i++ )
+	{
+		int iMask = SoundEnt_BenchMasks[i % ARRAYSIZE( SoundEnt_BenchMasks )];
+		float flSensitivity = ( i & 7 ) ? 1.0f : 2.0f;
+		unsigned int grid = 0, scan = 0;
+
+		SoundEnt_BenchCount( CSoundEnt::AudibleList( pEars[i], iMask, flSensitivity ), &grid );
+		SoundEnt_BenchCount( CSoundEnt::AudibleListScan( pEars[i], iMask, flSensitivity ), &scan );
+		if( grid != scan )
+			mismatches++;
+	}
+
+	delete[] pEars;
+
+	ALERT( at_console, "%i active sounds, %i listeners, %.1f audible per listener\n", inserted, listeners, heard[1] / (float)listeners );
+	ALERT( at_console, "  microseconds per listener grid / scan: %8.3f / %8.3f\n", times[0], times[1] );
+	ALERT( at_console, "  %i mismatched listeners\n", mismatches );
+}
+
+//=========================================================
+// SoundEnt_Init
+//=========================================================
+void SoundEnt_Init( void )
+{
+	CVAR_REGISTER( &sv_soundgrid );
+	g_engfuncs.pfnAddServerCommand( "sv_soundent_bench", SoundEnt_Bench );
+}
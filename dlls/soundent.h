@@ -21,7 +21,17 @@
 #ifndef SOUNDENT_H
 #define SOUNDENT_H
 
-#define	MAX_WORLD_SOUNDS	64 // maximum number of sounds handled by the world at one time.
+#define	MAX_WORLD_SOUNDS	256 // maximum number of sounds handled by the world at one time.
+
+#define SOUNDENT_CELL_SIZE	512	// world sounds are bucketed by origin on a grid this coarse
+#define SOUNDENT_BUCKETS	256	// hashed grid cells, power of two
+#define SOUNDENT_CELL_VOLUME	1024	// louder sounds skip the grid and every listener checks them
+#define SOUNDENT_WHEEL_SLOTS	128	// expiry wheel, power of two
+#define SOUNDENT_WHEEL_TICK	0.1f	// seconds per wheel slot
+
+#define SOUNDBUCKET_LOUD	SOUNDENT_BUCKETS		// sounds louder than SOUNDENT_CELL_VOLUME
+#define SOUNDBUCKET_CLIENT	( SOUNDENT_BUCKETS + 1 )	// client reserved sounds, moved every frame
+#define SOUNDBUCKET_COUNT	( SOUNDENT_BUCKETS + 2 )
 
 #define bits_SOUND_NONE		0
 #define	bits_SOUND_COMBAT	( 1 << 0 )// gunshots, explosions
@@ -57,6 +67,14 @@ public:
 	int		m_iNext;		// index of next sound in this list ( Active or Free )
 	int		m_iNextAudible;	// temporary link that monsters use to build a list of audible sounds
 
+	int		m_iPrev;		// previous sound in the active list
+	int		m_iBucket;		// SOUNDBUCKET_ or grid bucket while active, SOUNDLIST_EMPTY otherwise
+	int		m_iBucketNext;
+	int		m_iBucketPrev;
+	int		m_iWheelSlot;	// expiry wheel slot, SOUNDLIST_EMPTY for sounds that never expire
+	int		m_iWheelNext;
+	int		m_iWheelPrev;
+
 	BOOL	FIsSound( void );
 	BOOL	FIsScent( void );
 };
@@ -81,6 +99,11 @@ public:
 	static CSound*	SoundPointerForIndex( int iIndex );// return a pointer for this index in the sound list
 	static int		ClientSoundIndex ( edict_t *pClient );
 
+	// Sounds of the iMask types that can be heard at vecEar, linked through
+	// m_iNextAudible. Returns the first one or SOUNDLIST_EMPTY.
+	static int		AudibleList( const Vector &vecEar, int iMask, float flSensitivity );
+	static int		AudibleListScan( const Vector &vecEar, int iMask, float flSensitivity );
+
 	BOOL	IsEmpty( void ) { return m_iActiveSound == SOUNDLIST_EMPTY; }
 	int		ISoundsInList ( int iListType );
 	int		IAllocSound ( void );
@@ -92,6 +115,22 @@ public:
 	BOOL	m_fShowReport; // if true, dump information about free/active sounds.
 
 private:
+	void	LinkBucket( int iSound, int iBucket );
+	void	UnlinkBucket( int iSound );
+	void	LinkWheel( int iSound );
+	void	UnlinkWheel( int iSound );
+	void	ExpireSounds( void );
+	int		AddAudible( int iBucket, int iAudible, const Vector &vecEar, int iMask, float flSensitivity );
+
 	CSound		m_SoundPool[ MAX_WORLD_SOUNDS ];
+
+	int		m_iBuckets[ SOUNDBUCKET_COUNT ];	// first sound in each bucket
+	int		m_iBucketMarks[ SOUNDENT_BUCKETS ];	// query that last walked the bucket
+	int		m_iQueryMark;
+	int		m_iWheel[ SOUNDENT_WHEEL_SLOTS ];	// first sound expiring in each slot
+	int		m_iWheelTick;		// oldest tick the wheel still has to look at
 };
+
+extern cvar_t sv_soundgrid;
+
 #endif // SOUNDENT_H
@@ -30,6 +30,10 @@
 #include "player.h"
 #include "weapons.h"
 #include "gamerules.h"
+#include "entgrid.h"
+#include "nameindex.h"
+#include "frameprof.h"
+#include "saveplan.h"
 
 float UTIL_WeaponTimeBase( void )
 {
@@ -40,6 +44,23 @@ float UTIL_WeaponTimeBase( void )
 #endif
 }
 
+// Wall clock seconds from a monotonic high resolution counter, for timing server code
+double UTIL_PerfTime( void )
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &count );
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
 static unsigned int glSeed = 0; 
 
 unsigned int seed_table[256] =
@@ -394,19 +415,26 @@ void UTIL_MoveToOrigin( edict_t *pent, const Vector &vecGoal, float flDist, int
 	MOVE_TO_ORIGIN( pent, rgfl, flDist, iMoveType ); 
 }
 
-int UTIL_EntitiesInBox( CBaseEntity **pList, int listMax, const Vector &mins, const Vector &maxs, int flagMask )
+// pIndices lists the edicts to test in increasing order, NULL tests all of them
+static int UTIL_EntitiesInBoxList( CBaseEntity **pList, int listMax, const Vector &mins, const Vector &maxs, int flagMask, const int *pIndices, int numIndices )
 {
-	edict_t *pEdict = g_engfuncs.pfnPEntityOfEntIndex( 1 );
+	edict_t *pEdicts = g_engfuncs.pfnPEntityOfEntIndex( 1 );
+	edict_t *pEdict;
 	CBaseEntity *pEntity;
 	int count;
 
 	count = 0;
 
-	if( !pEdict )
+	if( !pEdicts )
 		return count;
 
-	for( int i = 1; i < gpGlobals->maxEntities; i++, pEdict++ )
+	if( !pIndices )
+		numIndices = gpGlobals->maxEntities - 1;
+
+	for( int k = 0; k < numIndices; k++ )
 	{
+		pEdict = pEdicts + ( pIndices ? pIndices[k] - 1 : k );
+
 		if( pEdict->free )	// Not in use
 			continue;
 
@@ -435,9 +463,10 @@ int UTIL_EntitiesInBox( CBaseEntity **pList, int listMax, const Vector &mins, co
 	return count;
 }
 
-int UTIL_MonstersInSphere( CBaseEntity **pList, int listMax, const Vector &center, float radius )
+static int UTIL_MonstersInSphereList( CBaseEntity **pList, int listMax, const Vector &center, float radius, const int *pIndices, int numIndices )
 {
-	edict_t *pEdict = g_engfuncs.pfnPEntityOfEntIndex( 1 );
+	edict_t *pEdicts = g_engfuncs.pfnPEntityOfEntIndex( 1 );
+	edict_t *pEdict;
 	CBaseEntity *pEntity;
 	int		count;
 	float		distance, delta;
@@ -445,11 +474,16 @@ int UTIL_MonstersInSphere( CBaseEntity **pList, int listMax, const Vector &cente
 	count = 0;
 	float radiusSquared = radius * radius;
 
-	if( !pEdict )
+	if( !pEdicts )
 		return count;
 
-	for( int i = 1; i < gpGlobals->maxEntities; i++, pEdict++ )
+	if( !pIndices )
+		numIndices = gpGlobals->maxEntities - 1;
+
+	for( int k = 0; k < numIndices; k++ )
 	{
+		pEdict = pEdicts + ( pIndices ? pIndices[k] - 1 : k );
+
 		if( pEdict->free )	// Not in use
 			continue;
 
@@ -495,18 +529,185 @@ int UTIL_MonstersInSphere( CBaseEntity **pList, int listMax, const Vector &cente
 	return count;
 }
 
-CBaseEntity *UTIL_FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
+// sv_entgrid 2, compare a grid backed result with a full scan
+static void UTIL_EntGridCheck( const char *pszQuery, CBaseEntity **pGrid, int gridCount, CBaseEntity **pScan, int scanCount )
 {
-	edict_t	*pentEntity;
+	if( gridCount == scanCount && !memcmp( pGrid, pScan, gridCount * sizeof( CBaseEntity * ) ) )
+		return;
 
-	if( pStartEntity )
-		pentEntity = pStartEntity->edict();
-	else
-		pentEntity = NULL;
+	ALERT( at_console, "%s: grid found %i, scan found %i\n", pszQuery, gridCount, scanCount );
+}
+
+int UTIL_EntitiesInBox( CBaseEntity **pList, int listMax, const Vector &mins, const Vector &maxs, int flagMask )
+{
+	CBaseEntity **pCheck;
+	int *pIndices;
+	int num, count, checkCount;
+
+	num = EntGrid_Gather( mins, maxs, 0, &pIndices );
+	if( num < 0 )
+		return UTIL_EntitiesInBoxList( pList, listMax, mins, maxs, flagMask, NULL, 0 );
+
+	count = UTIL_EntitiesInBoxList( pList, listMax, mins, maxs, flagMask, pIndices, num );
+
+	if( sv_entgrid.value == 2 )
+	{
+		pCheck = new CBaseEntity *[listMax];
+		checkCount = UTIL_EntitiesInBoxList( pCheck, listMax, mins, maxs, flagMask, NULL, 0 );
+		UTIL_EntGridCheck( "UTIL_EntitiesInBox", pList, count, pCheck, checkCount );
+		delete[] pCheck;
+	}
+
+	return count;
+}
+
+int UTIL_MonstersInSphere( CBaseEntity **pList, int listMax, const Vector &center, float radius )
+{
+	CBaseEntity **pCheck;
+	Vector extent( radius, radius, radius );
+	int *pIndices;
+	int num, count, checkCount;
+
+	num = EntGrid_Gather( center - extent, center + extent, 0, &pIndices );
+	if( num < 0 )
+		return UTIL_MonstersInSphereList( pList, listMax, center, radius, NULL, 0 );
+
+	count = UTIL_MonstersInSphereList( pList, listMax, center, radius, pIndices, num );
+
+	if( sv_entgrid.value == 2 )
+	{
+		pCheck = new CBaseEntity *[listMax];
+		checkCount = UTIL_MonstersInSphereList( pCheck, listMax, center, radius, NULL, 0 );
+		UTIL_EntGridCheck( "UTIL_MonstersInSphere", pList, count, pCheck, checkCount );
+		delete[] pCheck;
+	}
+
+	return count;
+}
+
+// Candidates of the last UTIL_FindEntityInSphere call, so a loop over the
+// results only gathers them once
+static struct
+{
+	Vector	center;
+	float	radius;
+	int	serial;
+	int	last;		// index returned last, 0 once exhausted
+	int	pos;
+	int	count;
+	int	max;
+	int	*pIndices;
+} s_SphereIter;
+
+static edict_t *UTIL_FindEntityInSphereGrid( edict_t *pentStart, const Vector &vecCenter, float flRadius )
+{
+	edict_t *pEdicts = g_engfuncs.pfnPEntityOfEntIndex( 0 );
+	edict_t *pEdict;
+	float radiusSquared, distance, delta;
+	int start, index, num, j;
+	int *pIndices;
+
+	start = pentStart ? ENTINDEX( pentStart ) : 0;
+
+	if( !start || start != s_SphereIter.last || s_SphereIter.serial != EntGrid_Serial() || s_SphereIter.radius != flRadius || s_SphereIter.center != vecCenter )
+	{
+		Vector extent( flRadius, flRadius, flRadius );
+
+		num = EntGrid_Gather( vecCenter - extent, vecCenter + extent, start, &pIndices );
+		if( num < 0 )
+			return FIND_ENTITY_IN_SPHERE( pentStart, vecCenter, flRadius );
+
+		// The gather buffer is shared, other queries can run inside the loop
+		if( num > s_SphereIter.max )
+		{
+			delete[] s_SphereIter.pIndices;
+			s_SphereIter.max = gpGlobals->maxEntities;
+			s_SphereIter.pIndices = new int[s_SphereIter.max];
+		}
+		memcpy( s_SphereIter.pIndices, pIndices, num * sizeof( int ) );
+
+		s_SphereIter.center = vecCenter;
+		s_SphereIter.radius = flRadius;
+		s_SphereIter.serial = EntGrid_Serial();
+		s_SphereIter.pos = 0;
+		s_SphereIter.count = num;
+	}
+
+	s_SphereIter.last = 0;
+	radiusSquared = flRadius * flRadius;
+
+	// Same tests as the engine's search, nearest point of the box
+	while( s_SphereIter.pos < s_SphereIter.count )
+	{
+		index = s_SphereIter.pIndices[s_SphereIter.pos++];
+		pEdict = pEdicts + index;
+
+		if( pEdict->free )
+			continue;
+
+		if( !pEdict->v.classname )
+			continue;
+
+		// Ignore clients not in the game
+		if( index <= gpGlobals->maxClients && !EntGrid_IsClientActive( index ) )
+			continue;
+
+		distance = 0.0f;
+		for( j = 0; j < 3 && distance <= radiusSquared; j++ )
+		{
+			if( vecCenter[j] < pEdict->v.absmin[j] )
+				delta = vecCenter[j] - pEdict->v.absmin[j];
+			else if( vecCenter[j] > pEdict->v.absmax[j] )
+				delta = vecCenter[j] - pEdict->v.absmax[j];
+			else
+				delta = 0.0f;
+
+			distance += delta * delta;
+		}
+
+		if( distance > radiusSquared )
+			continue;
+
+		s_SphereIter.last = index;
+		return pEdict;
+	}
+
+	return NULL;
+}
+
+// Same search by edict, for callers whose start entity may have been removed
+edict_t *UTIL_FindEdictInSphere( edict_t *pentStart, const Vector &vecCenter, float flRadius )
+{
+	edict_t	*pentEntity = pentStart;
 
-	pentEntity = FIND_ENTITY_IN_SPHERE( pentEntity, vecCenter, flRadius );
+	if( EntGrid_Active() )
+	{
+		edict_t *pentGrid = UTIL_FindEntityInSphereGrid( pentEntity, vecCenter, flRadius );
+
+		if( sv_entgrid.value == 2 )
+		{
+			pentEntity = FIND_ENTITY_IN_SPHERE( pentEntity, vecCenter, flRadius );
+			if( FNullEnt( pentEntity ) != FNullEnt( pentGrid ) || ( !FNullEnt( pentGrid ) && pentEntity != pentGrid ) )
+				ALERT( at_console, "UTIL_FindEntityInSphere: grid found %i, scan found %i\n", pentGrid ? ENTINDEX( pentGrid ) : 0, FNullEnt( pentEntity ) ? 0 : ENTINDEX( pentEntity ) );
+		}
+
+		pentEntity = pentGrid;
+	}
+	else
+		pentEntity = FIND_ENTITY_IN_SPHERE( pentEntity, vecCenter, flRadius );
 
 	if( !FNullEnt( pentEntity ) )
+		return pentEntity;
+	return NULL;
+}
+
+CBaseEntity *UTIL_FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
+{
+	edict_t	*pentEntity;
+
+	pentEntity = UTIL_FindEdictInSphere( pStartEntity ? pStartEntity->edict() : NULL, vecCenter, flRadius );
+
+	if( pentEntity )
 		return CBaseEntity::Instance( pentEntity );
 	return NULL;
 }
@@ -520,7 +721,12 @@ CBaseEntity *UTIL_FindEntityByString( CBaseEntity *pStartEntity, const char *szK
 	else
 		pentEntity = NULL;
 
-	pentEntity = FIND_ENTITY_BY_STRING( pentEntity, szKeyword, szValue );
+	if( !strcmp( szKeyword, "classname" ) )
+		pentEntity = FIND_ENTITY_BY_CLASSNAME( pentEntity, szValue );
+	else if( !strcmp( szKeyword, "targetname" ) )
+		pentEntity = FIND_ENTITY_BY_TARGETNAME( pentEntity, szValue );
+	else
+		pentEntity = FIND_ENTITY_BY_STRING( pentEntity, szKeyword, szValue );
 
 	if( !FNullEnt( pentEntity ) )
 		return CBaseEntity::Instance( pentEntity );
@@ -915,21 +1121,33 @@ void UTIL_ShowMessageAll( const char *pString )
 // Overloaded to add IGNORE_GLASS
 void UTIL_TraceLine( const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, IGNORE_GLASS ignoreGlass, edict_t *pentIgnore, TraceResult *ptr )
 {
+	if( g_fFrameProf )
+		FrameProf_Trace();
+
 	TRACE_LINE( vecStart, vecEnd, ( igmon == ignore_monsters ? TRUE : FALSE ) | ( ignoreGlass ? 0x100 : 0 ), pentIgnore, ptr );
 }
 
 void UTIL_TraceLine( const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, edict_t *pentIgnore, TraceResult *ptr )
 {
+	if( g_fFrameProf )
+		FrameProf_Trace();
+
 	TRACE_LINE( vecStart, vecEnd, ( igmon == ignore_monsters ? TRUE : FALSE ), pentIgnore, ptr );
 }
 
 void UTIL_TraceHull( const Vector &vecStart, const Vector &vecEnd, IGNORE_MONSTERS igmon, int hullNumber, edict_t *pentIgnore, TraceResult *ptr )
 {
+	if( g_fFrameProf )
+		FrameProf_Trace();
+
 	TRACE_HULL( vecStart, vecEnd, ( igmon == ignore_monsters ? TRUE : FALSE ), hullNumber, pentIgnore, ptr );
 }
 
 void UTIL_TraceModel( const Vector &vecStart, const Vector &vecEnd, int hullNumber, edict_t *pentModel, TraceResult *ptr )
 {
+	if( g_fFrameProf )
+		FrameProf_Trace();
+
 	g_engfuncs.pfnTraceModel( vecStart, vecEnd, hullNumber, pentModel, ptr );
 }
 
@@ -953,6 +1171,7 @@ TraceResult UTIL_GetGlobalTrace( )
 void UTIL_SetSize( entvars_t *pev, const Vector &vecMin, const Vector &vecMax )
 {
 	SET_SIZE( ENT( pev ), vecMin, vecMax );
+	EntGrid_Link( ENT( pev ) );
 }
 	
 float UTIL_VecToYaw( const Vector &vec )
@@ -964,7 +1183,11 @@ void UTIL_SetOrigin( entvars_t *pev, const Vector &vecOrigin )
 {
 	edict_t *ent = ENT( pev );
 	if( ent )
+	{
 		SET_ORIGIN( ent, vecOrigin );
+		EntGrid_Link( ent );
+		NameIndex_Link( ent );
+	}
 }
 
 void UTIL_ParticleEffect( const Vector &vecOrigin, const Vector &vecDirection, ULONG ulColor, ULONG ulCount )
@@ -1506,6 +1729,7 @@ void UTIL_Remove( CBaseEntity *pEntity )
 	pEntity->UpdateOnRemove();
 	pEntity->pev->flags |= FL_KILLME;
 	pEntity->pev->targetname = 0;
+	NameIndex_Link( pEntity->edict() );
 }
 
 BOOL UTIL_IsValidEntity( edict_t *pent )
@@ -1583,7 +1807,7 @@ void UTIL_StripToken( const char *pKey, char *pDest )
 // CSave
 //
 // --------------------------------------------------------------
-static int gSizes[FIELD_TYPECOUNT] =
+int gSizes[FIELD_TYPECOUNT] =
 {
 	sizeof(float),		// FIELD_FLOAT
 	sizeof(string_t),		// FIELD_STRING
@@ -1733,38 +1957,30 @@ void CSaveRestoreBuffer::BufferRewind( int size )
 extern "C" {
 unsigned _rotr( unsigned val, int shift )
 {
-	unsigned lobit;	/* non-zero means lo bit set */
-	unsigned num = val;	/* number to rotate */
-
 	shift &= 0x1f;			/* modulo 32 -- this will also make
 	                                   negative shifts work */
+	if( !shift )
+		return val;
 
-	while( shift-- )
-	{
-		lobit = num & 1;	/* get high bit */
-		num >>= 1;		/* shift right one bit */
-		if( lobit )
-		num |= 0x80000000;	/* set hi bit if lo bit was set */
-	}
-
-	return num;
+	return ( val >> shift ) | ( val << ( 32 - shift ) );
 }
 }
 #endif
 
 unsigned int CSaveRestoreBuffer::HashString( const char *pszToken )
 {
-	unsigned int hash = 0;
-
-	while( *pszToken )
-		hash = _rotr( hash, 4 ) ^ *pszToken++;
-
-	return hash;
+	return SavePlan_HashString( pszToken );
 }
 
 unsigned short CSaveRestoreBuffer::TokenHash( const char *pszToken )
 {
-	unsigned short hash = (unsigned short)( HashString( pszToken ) % (unsigned)m_pdata->tokenCount );
+	// Field names from the save plans are hashed already, and still
+	// in the slot they got last time unless this is another table
+	savename_t *pName = SavePlan_Name( pszToken );
+	if( pName && pName->slot >= 0 && pName->slot < m_pdata->tokenCount && m_pdata->pTokens[pName->slot] == pszToken )
+		return pName->slot;
+
+	unsigned short hash = (unsigned short)( ( pName ? pName->hash : HashString( pszToken ) ) % (unsigned)m_pdata->tokenCount );
 #if _DEBUG
 	static int tokensparsed = 0;
 	tokensparsed++;
@@ -1788,6 +2004,8 @@ unsigned short CSaveRestoreBuffer::TokenHash( const char *pszToken )
 		if( !m_pdata->pTokens[index] || strcmp( pszToken, m_pdata->pTokens[index] ) == 0 )
 		{
 			m_pdata->pTokens[index] = (char *)pszToken;
+			if( pName )
+				pName->slot = index;
 			return index;
 		}
 	}
@@ -1975,9 +2193,33 @@ int CSave::WriteEntVars( const char *pname, entvars_t *pev )
 
 int CSave::WriteFields( const char *pname, void *pBaseData, TYPEDESCRIPTION *pFields, int fieldCount )
 {
-	int i, j, actualCount, emptyCount;
+	int i, actualCount, emptyCount;
 	TYPEDESCRIPTION	*pTest;
-	int entityArray[MAX_ENTITYARRAY];
+	const saveplan_t *pPlan;
+
+	pPlan = SavePlan_Get( pFields, fieldCount );
+	if( pPlan )
+	{
+		char empty[SAVEPLAN_MAX_FIELDS];
+
+		// One pass over the plan's sizes for the empty fields
+		emptyCount = 0;
+		for( i = 0; i < fieldCount; i++ )
+		{
+			empty[i] = SavePlan_Empty( (const char *)pBaseData + pPlan->fields[i].offset, pPlan->fields[i].size );
+			emptyCount += empty[i];
+		}
+
+		actualCount = fieldCount - emptyCount;
+		WriteInt( pname, &actualCount, 1 );
+
+		for( i = 0; i < fieldCount; i++ )
+		{
+			if( !empty[i] )
+				WriteField( &pFields[i], (char *)pBaseData + pPlan->fields[i].offset );
+		}
+		return 1;
+	}
 
 	// Precalculate the number of empty fields
 	emptyCount = 0;
@@ -2003,80 +2245,88 @@ int CSave::WriteFields( const char *pname, void *pBaseData, TYPEDESCRIPTION *pFi
 		if( DataEmpty( (const char *)pOutputData, pTest->fieldSize * gSizes[pTest->fieldType] ) )
 			continue;
 
-		switch( pTest->fieldType )
+		WriteField( pTest, pOutputData );
+	}
+
+	return 1;
+}
+
+void CSave::WriteField( const TYPEDESCRIPTION *pTest, void *pOutputData )
+{
+	int j;
+	int entityArray[MAX_ENTITYARRAY];
+
+	switch( pTest->fieldType )
+	{
+	case FIELD_FLOAT:
+		WriteFloat( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_TIME:
+		WriteTime( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_MODELNAME:
+	case FIELD_SOUNDNAME:
+	case FIELD_STRING:
+		WriteString( pTest->fieldName, (string_t *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_CLASSPTR:
+	case FIELD_EVARS:
+	case FIELD_EDICT:
+	case FIELD_ENTITY:
+	case FIELD_EHANDLE:
+		if( pTest->fieldSize > MAX_ENTITYARRAY )
+			ALERT( at_error, "Can't save more than %d entities in an array!!!\n", MAX_ENTITYARRAY );
+		for( j = 0; j < pTest->fieldSize; j++ )
 		{
-		case FIELD_FLOAT:
-			WriteFloat( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_TIME:
-			WriteTime( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_MODELNAME:
-		case FIELD_SOUNDNAME:
-		case FIELD_STRING:
-			WriteString( pTest->fieldName, (string_t *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_CLASSPTR:
-		case FIELD_EVARS:
-		case FIELD_EDICT:
-		case FIELD_ENTITY:
-		case FIELD_EHANDLE:
-			if( pTest->fieldSize > MAX_ENTITYARRAY )
-				ALERT( at_error, "Can't save more than %d entities in an array!!!\n", MAX_ENTITYARRAY );
-			for( j = 0; j < pTest->fieldSize; j++ )
+			switch( pTest->fieldType )
 			{
-				switch( pTest->fieldType )
-				{
-					case FIELD_EVARS:
-						entityArray[j] = EntityIndex( ( (entvars_t **)pOutputData )[j] );
-						break;
-					case FIELD_CLASSPTR:
-						entityArray[j] = EntityIndex( ( (CBaseEntity **)pOutputData )[j] );
-						break;
-					case FIELD_EDICT:
-						entityArray[j] = EntityIndex( ( (edict_t **)pOutputData )[j] );
-						break;
-					case FIELD_ENTITY:
-						entityArray[j] = EntityIndex( ( (EOFFSET *)pOutputData )[j] );
-						break;
-					case FIELD_EHANDLE:
-						entityArray[j] = EntityIndex( (CBaseEntity *)( ( (EHANDLE *)pOutputData)[j] ) );
-						break;
-					default:
-						break;
-				}
+				case FIELD_EVARS:
+					entityArray[j] = EntityIndex( ( (entvars_t **)pOutputData )[j] );
+					break;
+				case FIELD_CLASSPTR:
+					entityArray[j] = EntityIndex( ( (CBaseEntity **)pOutputData )[j] );
+					break;
+				case FIELD_EDICT:
+					entityArray[j] = EntityIndex( ( (edict_t **)pOutputData )[j] );
+					break;
+				case FIELD_ENTITY:
+					entityArray[j] = EntityIndex( ( (EOFFSET *)pOutputData )[j] );
+					break;
+				case FIELD_EHANDLE:
+					entityArray[j] = EntityIndex( (CBaseEntity *)( ( (EHANDLE *)pOutputData)[j] ) );
+					break;
+				default:
+					break;
 			}
-			WriteInt( pTest->fieldName, entityArray, pTest->fieldSize );
-			break;
-		case FIELD_POSITION_VECTOR:
-			WritePositionVector( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_VECTOR:
-			WriteVector( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_BOOLEAN:
-		case FIELD_INTEGER:
-			WriteInt( pTest->fieldName, (int *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_SHORT:
-			WriteData( pTest->fieldName, 2 * pTest->fieldSize, ( (char *)pOutputData ) );
-			break;
-		case FIELD_CHARACTER:
-			WriteData( pTest->fieldName, pTest->fieldSize, ( (char *)pOutputData ) );
-			break;
-		// For now, just write the address out, we're not going to change memory while doing this yet!
-		case FIELD_POINTER:
-			WriteInt( pTest->fieldName, (int *)(char *)pOutputData, pTest->fieldSize );
-			break;
-		case FIELD_FUNCTION:
-			WriteFunction( pTest->fieldName, (void **)pOutputData, pTest->fieldSize );
-			break;
-		default:
-			ALERT( at_error, "Bad field type\n" );
 		}
+		WriteInt( pTest->fieldName, entityArray, pTest->fieldSize );
+		break;
+	case FIELD_POSITION_VECTOR:
+		WritePositionVector( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_VECTOR:
+		WriteVector( pTest->fieldName, (float *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_BOOLEAN:
+	case FIELD_INTEGER:
+		WriteInt( pTest->fieldName, (int *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_SHORT:
+		WriteData( pTest->fieldName, 2 * pTest->fieldSize, ( (char *)pOutputData ) );
+		break;
+	case FIELD_CHARACTER:
+		WriteData( pTest->fieldName, pTest->fieldSize, ( (char *)pOutputData ) );
+		break;
+	// For now, just write the address out, we're not going to change memory while doing this yet!
+	case FIELD_POINTER:
+		WriteInt( pTest->fieldName, (int *)(char *)pOutputData, pTest->fieldSize );
+		break;
+	case FIELD_FUNCTION:
+		WriteFunction( pTest->fieldName, (void **)pOutputData, pTest->fieldSize );
+		break;
+	default:
+		ALERT( at_error, "Bad field type\n" );
 	}
-
-	return 1;
 }
 
 void CSave::BufferString( char *pdata, int len )
@@ -2136,8 +2386,32 @@ void CSave::BufferData( const char *pdata, int size )
 // --------------------------------------------------------------
 int CRestore::ReadField( void *pBaseData, TYPEDESCRIPTION *pFields, int fieldCount, int startField, int size, char *pName, void *pData )
 {
-	int i, j, stringCount, fieldNumber, entityIndex;
+	int i, fieldNumber;
 	TYPEDESCRIPTION *pTest;
+
+	for( i = 0; i < fieldCount; i++ )
+	{
+		fieldNumber = ( i + startField ) % fieldCount;
+		pTest = &pFields[fieldNumber];
+		if( !stricmp( pTest->fieldName, pName ) )
+		{
+			if( !m_global || !(pTest->flags & FTYPEDESC_GLOBAL ) )
+				ReadFieldData( pBaseData, pTest, pData );
+#if 0
+			else
+			{
+				ALERT( at_console, "Skipping global field %s\n", pName );
+			}
+#endif
+			return fieldNumber;
+		}
+	}
+	return -1;
+}
+
+void CRestore::ReadFieldData( void *pBaseData, const TYPEDESCRIPTION *pTest, void *pData )
+{
+	int j, stringCount, entityIndex;
 	float time, timeData;
 	Vector position;
 	edict_t	*pent;
@@ -2153,164 +2427,145 @@ int CRestore::ReadField( void *pBaseData, TYPEDESCRIPTION *pFields, int fieldCou
 			position = m_pdata->vecLandmarkOffset;
 	}
 
-	for( i = 0; i < fieldCount; i++ )
+	for( j = 0; j < pTest->fieldSize; j++ )
 	{
-		fieldNumber = ( i + startField ) % fieldCount;
-		pTest = &pFields[fieldNumber];
-		if( !stricmp( pTest->fieldName, pName ) )
+		void *pOutputData = ( (char *)pBaseData + pTest->fieldOffset + ( j * gSizes[pTest->fieldType] ) );
+		void *pInputData = (char *)pData + j * gInputSizes[pTest->fieldType];
+
+		switch( pTest->fieldType )
 		{
-			if( !m_global || !(pTest->flags & FTYPEDESC_GLOBAL ) )
+		case FIELD_TIME:
+		#ifdef __VFP_FP__
+			memcpy( &timeData, pInputData, 4 );
+			// Re-base time variables
+			timeData += time;
+			memcpy( pOutputData, &timeData, 4 );
+		#else
+			timeData = *(float *)pInputData;
+			// Re-base time variables
+			timeData += time;
+			*( (float *)pOutputData ) = timeData;
+		#endif
+			break;
+		case FIELD_FLOAT:
+			memcpy( pOutputData, pInputData, 4 );
+			break;
+		case FIELD_MODELNAME:
+		case FIELD_SOUNDNAME:
+		case FIELD_STRING:
+			// Skip over j strings
+			pString = (char *)pData;
+			for( stringCount = 0; stringCount < j; stringCount++ )
+			{
+				while( *pString )
+					pString++;
+				pString++;
+			}
+			pInputData = pString;
+			if( ( (char *)pInputData )[0] == '\0' )
+				*( (string_t *)pOutputData ) = 0;
+			else
 			{
-				for( j = 0; j < pTest->fieldSize; j++ )
+				string_t string;
+
+				string = ALLOC_STRING( (char *)pInputData );
+
+				*( (string_t *)pOutputData ) = string;
+
+				if( !FStringNull( string ) && m_precache )
 				{
-					void *pOutputData = ( (char *)pBaseData + pTest->fieldOffset + ( j * gSizes[pTest->fieldType] ) );
-					void *pInputData = (char *)pData + j * gInputSizes[pTest->fieldType];
-
-					switch( pTest->fieldType )
-					{
-					case FIELD_TIME:
-					#ifdef __VFP_FP__
-						memcpy( &timeData, pInputData, 4 );
-						// Re-base time variables
-						timeData += time;
-						memcpy( pOutputData, &timeData, 4 );
-					#else
-						timeData = *(float *)pInputData;
-						// Re-base time variables
-						timeData += time;
-						*( (float *)pOutputData ) = timeData;
-					#endif
-						break;
-					case FIELD_FLOAT:
-						memcpy( pOutputData, pInputData, 4 );
-						break;
-					case FIELD_MODELNAME:
-					case FIELD_SOUNDNAME:
-					case FIELD_STRING:
-						// Skip over j strings
-						pString = (char *)pData;
-						for( stringCount = 0; stringCount < j; stringCount++ )
-						{
-							while( *pString )
-								pString++;
-							pString++;
-						}
-						pInputData = pString;
-						if( ( (char *)pInputData )[0] == '\0' )
-							*( (string_t *)pOutputData ) = 0;
-						else
-						{
-							string_t string;
-
-							string = ALLOC_STRING( (char *)pInputData );
-
-							*( (string_t *)pOutputData ) = string;
-
-							if( !FStringNull( string ) && m_precache )
-							{
-								if( pTest->fieldType == FIELD_MODELNAME )
-									PRECACHE_MODEL( STRING( string ) );
-								else if( pTest->fieldType == FIELD_SOUNDNAME )
-									PRECACHE_SOUND( STRING( string ) );
-							}
-						}
-						break;
-					case FIELD_EVARS:
-						entityIndex = *( int *)pInputData;
-						pent = EntityFromIndex( entityIndex );
-						if( pent )
-							*( (entvars_t **)pOutputData ) = VARS( pent );
-						else
-							*( (entvars_t **)pOutputData ) = NULL;
-						break;
-					case FIELD_CLASSPTR:
-						entityIndex = *( int *)pInputData;
-						pent = EntityFromIndex( entityIndex );
-						if( pent )
-							*( (CBaseEntity **)pOutputData ) = CBaseEntity::Instance( pent );
-						else
-							*( (CBaseEntity **)pOutputData ) = NULL;
-						break;
-					case FIELD_EDICT:
-						entityIndex = *(int *)pInputData;
-						pent = EntityFromIndex( entityIndex );
-						*( (edict_t **)pOutputData ) = pent;
-						break;
-					case FIELD_EHANDLE:
-						// Input and Output sizes are different!
-						pOutputData = (char *)pOutputData + j * ( sizeof(EHANDLE) - gSizes[pTest->fieldType] );
-						entityIndex = *(int *)pInputData;
-						pent = EntityFromIndex( entityIndex );
-						if( pent )
-							*( (EHANDLE *)pOutputData ) = CBaseEntity::Instance( pent );
-						else
-							*( (EHANDLE *)pOutputData ) = NULL;
-						break;
-					case FIELD_ENTITY:
-						entityIndex = *(int *)pInputData;
-						pent = EntityFromIndex( entityIndex );
-						if( pent )
-							*( (EOFFSET *)pOutputData ) = OFFSET( pent );
-						else
-							*( (EOFFSET *)pOutputData ) = 0;
-						break;
-					case FIELD_VECTOR:
-						#ifdef __VFP_FP__
-						memcpy( pOutputData, pInputData, sizeof( Vector ) );
-						#else
-						( (float *)pOutputData )[0] = ( (float *)pInputData )[0];
-						( (float *)pOutputData )[1] = ( (float *)pInputData )[1];
-						( (float *)pOutputData )[2] = ( (float *)pInputData )[2];
-						#endif
-						break;
-					case FIELD_POSITION_VECTOR:
-						#ifdef  __VFP_FP__
-						{
-							Vector tmp;
-							memcpy( &tmp, pInputData, sizeof( Vector ) );
-							tmp = tmp + position;
-							memcpy( pOutputData, &tmp, sizeof( Vector ) );
-						}
-						#else
-						( (float *)pOutputData )[0] = ( (float *)pInputData )[0] + position.x;
-						( (float *)pOutputData )[1] = ( (float *)pInputData )[1] + position.y;
-						( (float *)pOutputData )[2] = ( (float *)pInputData )[2] + position.z;
-						#endif
-						break;
-					case FIELD_BOOLEAN:
-					case FIELD_INTEGER:
-						*( (int *)pOutputData ) = *(int *)pInputData;
-						break;
-					case FIELD_SHORT:
-						*( (short *)pOutputData ) = *(short *)pInputData;
-						break;
-					case FIELD_CHARACTER:
-						*( (char *)pOutputData ) = *(char *)pInputData;
-						break;
-					case FIELD_POINTER:
-						*( (void**)pOutputData ) = *(void **)pInputData;
-						break;
-					case FIELD_FUNCTION:
-						if( ( (char *)pInputData )[0] == '\0' )
-							*( (void**)pOutputData ) = 0;
-						else
-							*( (void**)pOutputData ) = (void*)FUNCTION_FROM_NAME( (char *)pInputData );
-						break;
-					default:
-						ALERT( at_error, "Bad field type\n" );
-					}
+					if( pTest->fieldType == FIELD_MODELNAME )
+						PRECACHE_MODEL( STRING( string ) );
+					else if( pTest->fieldType == FIELD_SOUNDNAME )
+						PRECACHE_SOUND( STRING( string ) );
 				}
 			}
-#if 0
+			break;
+		case FIELD_EVARS:
+			entityIndex = *( int *)pInputData;
+			pent = EntityFromIndex( entityIndex );
+			if( pent )
+				*( (entvars_t **)pOutputData ) = VARS( pent );
+			else
+				*( (entvars_t **)pOutputData ) = NULL;
+			break;
+		case FIELD_CLASSPTR:
+			entityIndex = *( int *)pInputData;
+			pent = EntityFromIndex( entityIndex );
+			if( pent )
+				*( (CBaseEntity **)pOutputData ) = CBaseEntity::Instance( pent );
+			else
+				*( (CBaseEntity **)pOutputData ) = NULL;
+			break;
+		case FIELD_EDICT:
+			entityIndex = *(int *)pInputData;
+			pent = EntityFromIndex( entityIndex );
+			*( (edict_t **)pOutputData ) = pent;
+			break;
+		case FIELD_EHANDLE:
+			// Input and Output sizes are different!
+			pOutputData = (char *)pOutputData + j * ( sizeof(EHANDLE) - gSizes[pTest->fieldType] );
+			entityIndex = *(int *)pInputData;
+			pent = EntityFromIndex( entityIndex );
+			if( pent )
+				*( (EHANDLE *)pOutputData ) = CBaseEntity::Instance( pent );
+			else
+				*( (EHANDLE *)pOutputData ) = NULL;
+			break;
+		case FIELD_ENTITY:
+			entityIndex = *(int *)pInputData;
+			pent = EntityFromIndex( entityIndex );
+			if( pent )
+				*( (EOFFSET *)pOutputData ) = OFFSET( pent );
 			else
+				*( (EOFFSET *)pOutputData ) = 0;
+			break;
+		case FIELD_VECTOR:
+			#ifdef __VFP_FP__
+			memcpy( pOutputData, pInputData, sizeof( Vector ) );
+			#else
+			( (float *)pOutputData )[0] = ( (float *)pInputData )[0];
+			( (float *)pOutputData )[1] = ( (float *)pInputData )[1];
+			( (float *)pOutputData )[2] = ( (float *)pInputData )[2];
+			#endif
+			break;
+		case FIELD_POSITION_VECTOR:
+			#ifdef  __VFP_FP__
 			{
-				ALERT( at_console, "Skipping global field %s\n", pName );
+				Vector tmp;
+				memcpy( &tmp, pInputData, sizeof( Vector ) );
+				tmp = tmp + position;
+				memcpy( pOutputData, &tmp, sizeof( Vector ) );
 			}
-#endif
-			return fieldNumber;
+			#else
+			( (float *)pOutputData )[0] = ( (float *)pInputData )[0] + position.x;
+			( (float *)pOutputData )[1] = ( (float *)pInputData )[1] + position.y;
+			( (float *)pOutputData )[2] = ( (float *)pInputData )[2] + position.z;
+			#endif
+			break;
+		case FIELD_BOOLEAN:
+		case FIELD_INTEGER:
+			*( (int *)pOutputData ) = *(int *)pInputData;
+			break;
+		case FIELD_SHORT:
+			*( (short *)pOutputData ) = *(short *)pInputData;
+			break;
+		case FIELD_CHARACTER:
+			*( (char *)pOutputData ) = *(char *)pInputData;
+			break;
+		case FIELD_POINTER:
+			*( (void**)pOutputData ) = *(void **)pInputData;
+			break;
+		case FIELD_FUNCTION:
+			if( ( (char *)pInputData )[0] == '\0' )
+				*( (void**)pOutputData ) = 0;
+			else
+				*( (void**)pOutputData ) = (void*)FUNCTION_FROM_NAME( (char *)pInputData );
+			break;
+		default:
+			ALERT( at_error, "Bad field type\n" );
 		}
 	}
-	return -1;
 }
 
 int CRestore::ReadEntVars( const char *pname, entvars_t *pev )
@@ -2321,8 +2576,11 @@ int CRestore::ReadEntVars( const char *pname, entvars_t *pev )
 int CRestore::ReadFields( const char *pname, void *pBaseData, TYPEDESCRIPTION *pFields, int fieldCount )
 {
 	unsigned short i, token;
-	int lastField, fileCount;
+	int lastField, fileCount, fieldNumber, runCount;
+	const saveplan_t *pPlan;
+	const saverun_t *pRun;
 	HEADER header;
+	char *pName;
 
 	i = ReadShort();
 	ASSERT( i == sizeof(int) );			// First entry should be an int
@@ -2342,18 +2600,42 @@ int CRestore::ReadFields( const char *pname, void *pBaseData, TYPEDESCRIPTION *p
 
 	lastField = 0;								// Make searches faster, most data is read/written in the same order
 
+	pPlan = SavePlan_Get( pFields, fieldCount );
+
 	// Clear out base data
-	for( i = 0; i < fieldCount; i++ )
+	if( pPlan )
 	{
 		// Don't clear global fields
-		if( !m_global || !( pFields[i].flags & FTYPEDESC_GLOBAL ) )
-			memset( ( (char *)pBaseData + pFields[i].fieldOffset ), 0, pFields[i].fieldSize * gSizes[pFields[i].fieldType] );
+		pRun = m_global ? pPlan->clearLocal : pPlan->clear;
+		runCount = m_global ? pPlan->clearLocalCount : pPlan->clearCount;
+
+		for( ; runCount > 0; runCount--, pRun++ )
+			memset( (char *)pBaseData + pRun->offset, 0, pRun->size );
+	}
+	else
+	{
+		for( i = 0; i < fieldCount; i++ )
+		{
+			// Don't clear global fields
+			if( !m_global || !( pFields[i].flags & FTYPEDESC_GLOBAL ) )
+				memset( ( (char *)pBaseData + pFields[i].fieldOffset ), 0, pFields[i].fieldSize * gSizes[pFields[i].fieldType] );
+		}
 	}
 
 	for( i = 0; i < fileCount; i++ )
 	{
 		BufferReadHeader( &header );
-		lastField = ReadField( pBaseData, pFields, fieldCount, lastField, header.size, m_pdata->pTokens[header.token], header.pData );
+		pName = m_pdata->pTokens[header.token];
+
+		fieldNumber = pPlan ? SavePlan_Match( pPlan, lastField, pName ) : -1;
+		if( fieldNumber >= 0 )
+		{
+			if( !m_global || !( pFields[fieldNumber].flags & FTYPEDESC_GLOBAL ) )
+				ReadFieldData( pBaseData, &pFields[fieldNumber], header.pData );
+			lastField = fieldNumber;
+		}
+		else
+			lastField = ReadField( pBaseData, pFields, fieldCount, lastField, header.size, pName, header.pData );
 		lastField++;
 	}
 	
@@ -48,14 +48,18 @@ static inline int MAKE_STRING(const char *szValue)
 }
 #endif
 
+// nameindex.cpp, the engine's scan when the index is off
+edict_t *NameIndex_FindClassname( edict_t *entStart, const char *pszName );
+edict_t *NameIndex_FindTargetname( edict_t *entStart, const char *pszName );
+
 inline edict_t *FIND_ENTITY_BY_CLASSNAME(edict_t *entStart, const char *pszName) 
 {
-	return FIND_ENTITY_BY_STRING(entStart, "classname", pszName);
+	return NameIndex_FindClassname(entStart, pszName);
 }
 
 inline edict_t *FIND_ENTITY_BY_TARGETNAME(edict_t *entStart, const char *pszName) 
 {
-	return FIND_ENTITY_BY_STRING(entStart, "targetname", pszName);
+	return NameIndex_FindTargetname(entStart, pszName);
 }
 
 // for doing a reverse lookup. Say you have a door, and want to find its button.
@@ -238,6 +242,7 @@ extern float		UTIL_AngleMod			(float a);
 extern float		UTIL_AngleDiff			( float destAngle, float srcAngle );
 
 extern CBaseEntity	*UTIL_FindEntityInSphere(CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius);
+extern edict_t		*UTIL_FindEdictInSphere( edict_t *pentStart, const Vector &vecCenter, float flRadius );
 extern CBaseEntity	*UTIL_FindEntityByString(CBaseEntity *pStartEntity, const char *szKeyword, const char *szValue );
 extern CBaseEntity	*UTIL_FindEntityByClassname(CBaseEntity *pStartEntity, const char *szName );
 extern CBaseEntity	*UTIL_FindEntityByTargetname(CBaseEntity *pStartEntity, const char *szName );
@@ -528,6 +533,9 @@ void TEXTURETYPE_Init();
 char TEXTURETYPE_Find(char *name);
 float TEXTURETYPE_PlaySound(TraceResult *ptr,  Vector vecSrc, Vector vecEnd, int iBulletType);
 
+void SOUND_Init();
+void SoundEnt_Init( void );
+
 // NOTE: use EMIT_SOUND_DYN to set the pitch of a sound. Pitch of 100
 // is no pitch shift.  Pitch > 100 up to 255 is a higher pitch, pitch < 100
 // down to 1 is a lower pitch.   150 to 70 is the realistic range.
@@ -586,4 +594,5 @@ int UTIL_SharedRandomLong( unsigned int seed, int low, int high );
 float UTIL_SharedRandomFloat( unsigned int seed, float low, float high );
 
 float UTIL_WeaponTimeBase( void );
+double UTIL_PerfTime( void );
 #endif // UTIL_H
@@ -24,6 +24,7 @@
 #include "util.h"
 #include "cbase.h"
 #include "nodes.h"
+#include "nodefile.h"
 #include "soundent.h"
 #include "client.h"
 #include "decals.h"
@@ -668,6 +669,11 @@ void CWorld::Precache( void )
 		// NOD file is not present, or is older than the BSP file.
 		WorldGraph.AllocNodes();
 	}
+	// use the mapped cache if it was built from this .NOD and BSP
+	else if( NodeFile_Map( &WorldGraph, STRING( gpGlobals->mapname ) ) )
+	{
+		ALERT( at_console, "\n*Graph Loaded!\n" );
+	}
 	else
 	{
 		// Load the node graph for this level
@@ -680,6 +686,9 @@ void CWorld::Precache( void )
 		else
 		{
 			ALERT( at_console, "\n*Graph Loaded!\n" );
+
+			// convert it, the next load maps the cache instead
+			NodeFile_Save( &WorldGraph, STRING( gpGlobals->mapname ) );
 		}
 	}
 
@@ -837,6 +846,10 @@ int DispatchPhysicsEntity( edict_t *pEdict )
 	}
 
 	// NOTE: at this point pEntity assume to be valid
+
+	// a moving pusher carries things in and out of blasts' lines of sight
+	if( pEdict->v.movetype == MOVETYPE_PUSH && ( pEdict->v.velocity != g_vecZero || pEdict->v.avelocity != g_vecZero ) )
+		ClearBlastTraces();
 /*
 #ifdef CUSTOM_PHYSICS_TEST
 	// test alien controller without physics, thinking only
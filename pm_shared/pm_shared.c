@@ -62,7 +62,6 @@ playermove_t *pmove = NULL;
 #define VEC_VIEW           28
 #define STOP_EPSILON       0.1f
 
-#define CTEXTURESMAX     512 // max number of textures loaded
 #define CBTEXTURENAMEMAX 13  // only load first n chars of name
 
 #define CHAR_TEX_CONCRETE 'C' // texture types
@@ -125,46 +124,67 @@ playermove_t *pmove = NULL;
 static vec3_t rgv3tStuckTable[54];
 static int rgStuckLast[MAX_CLIENTS][2];
 
-// Texture names
+// Texture names, open addressing table keyed on the case folded name
+typedef struct pmtexture_s
+{
+	unsigned int hash;
+	char name[CBTEXTURENAMEMAX]; // lower case, empty if the slot is free
+	char type;
+} pmtexture_t;
+
 static int gcTextures = 0;
-static char grgszTextureName[CTEXTURESMAX][CBTEXTURENAMEMAX];
-static char grgchTextureType[CTEXTURESMAX];
+static int gcTextureSlots = 0; // power of two
+static pmtexture_t *grgTextures = NULL;
 
 int g_onladder = 0;
 
-void PM_SwapTextures( int i, int j )
-{
-	char chTemp;
-	char szTemp[CBTEXTURENAMEMAX];
+/*
+================
+PM_FoldTextureName
 
-	strcpy( szTemp, grgszTextureName[i] );
-	chTemp = grgchTextureType[i];
+Lower case copy of the part of a texture name that is compared,
+returns its FNV-1a hash
+================
+*/
+static unsigned int PM_FoldTextureName( const char *name, char *folded )
+{
+	unsigned int hash = 2166136261u;
+	int i;
 
-	strcpy( grgszTextureName[i], grgszTextureName[j] );
-	grgchTextureType[i] = grgchTextureType[j];
+	for ( i = 0; i < CBTEXTURENAMEMAX - 1 && name[i]; i++ )
+	{
+		folded[i] = tolower( (unsigned char)name[i] );
+		hash = ( hash ^ (unsigned char)folded[i] ) * 16777619u;
+	}
+	folded[i] = 0;
 
-	strcpy( grgszTextureName[j], szTemp );
-	grgchTextureType[j] = chTemp;
+	return hash;
 }
 
-void PM_SortTextures( void )
+/*
+================
+PM_AddTextureType
+
+The first entry of a name wins
+================
+*/
+static void PM_AddTextureType( const char *name, char type )
 {
-	// Bubble sort, yuck, but this only occurs at startup and it's only 512 elements...
-	//
-	int i, j;
+	char folded[CBTEXTURENAMEMAX];
+	unsigned int hash, i;
 
-	for ( i = 0; i < gcTextures; i++ )
+	hash = PM_FoldTextureName( name, folded );
+
+	for ( i = hash & ( gcTextureSlots - 1 ); grgTextures[i].name[0]; i = ( i + 1 ) & ( gcTextureSlots - 1 ) )
 	{
-		for ( j = i + 1; j < gcTextures; j++ )
-		{
-			if ( stricmp( grgszTextureName[i], grgszTextureName[j] ) > 0 )
-			{
-				// Swap
-				//
-				PM_SwapTextures( i, j );
-			}
-		}
+		if ( grgTextures[i].hash == hash && !strcmp( grgTextures[i].name, folded ) )
+			return;
 	}
+
+	grgTextures[i].hash = hash;
+	strcpy( grgTextures[i].name, folded );
+	grgTextures[i].type = type;
+	gcTextures++;
 }
 
 void PM_InitTextureTypes()
@@ -173,24 +193,40 @@ void PM_InitTextureTypes()
 	int i, j;
 	byte *pMemFile;
 	int fileSize, filePos = 0;
+	char chType;
 	static qboolean bTextureTypeInit = false;
 
 	if ( bTextureTypeInit )
 		return;
 
-	memset( &( grgszTextureName[0][0] ), 0, sizeof( grgszTextureName ) );
-	memset( grgchTextureType, 0, sizeof( grgchTextureType ) );
-
 	gcTextures = 0;
 
 	pMemFile = pmove->COM_LoadFile( "sound/materials.txt", 5, &fileSize );
 	if ( !pMemFile )
 		return;
 
+	// at most one texture per line read, keep the table at most half full
+	for ( i = 0, j = 1 + fileSize / 511; i < fileSize; i++ )
+	{
+		if ( pMemFile[i] == '\n' )
+			j++;
+	}
+
+	for ( gcTextureSlots = 64; gcTextureSlots < j * 2; gcTextureSlots <<= 1 )
+		;
+
+	free( grgTextures );
+	grgTextures = (pmtexture_t *)calloc( gcTextureSlots, sizeof( pmtexture_t ) );
+	if ( !grgTextures )
+	{
+		pmove->COM_FreeFile( pMemFile );
+		return;
+	}
+
 	memset( buffer, 0, sizeof( buffer ) );
 
 	// for each line in the file...
-	while ( pmove->memfgets( pMemFile, fileSize, &filePos, buffer, 511 ) != NULL && ( gcTextures < CTEXTURESMAX ) )
+	while ( pmove->memfgets( pMemFile, fileSize, &filePos, buffer, 511 ) != NULL )
 	{
 		// skip whitespace
 		i = 0;
@@ -205,7 +241,7 @@ void PM_InitTextureTypes()
 			continue;
 
 		// get texture type
-		grgchTextureType[gcTextures] = toupper( buffer[i++] );
+		chType = toupper( buffer[i++] );
 
 		// skip whitespace
 		while ( buffer[i] && isspace( buffer[i] ) )
@@ -225,49 +261,149 @@ void PM_InitTextureTypes()
 		// null-terminate name and save in sentences array
 		j = min( j, CBTEXTURENAMEMAX - 1 + i );
 		buffer[j] = 0;
-		strcpy( &( grgszTextureName[gcTextures++][0] ), &( buffer[i] ) );
+		PM_AddTextureType( &( buffer[i] ), chType );
 	}
 
 	// Must use engine to free since we are in a .dll
 	pmove->COM_FreeFile( pMemFile );
 
-	PM_SortTextures();
-
 	bTextureTypeInit = true;
 }
 
 char PM_FindTextureType( char *name )
 {
-	int left, right, pivot;
-	int val;
+	char folded[CBTEXTURENAMEMAX];
+	unsigned int hash, i;
 
 	assert( pm_shared_initialized );
 
+	if ( !gcTextures )
+		return CHAR_TEX_CONCRETE;
+
+	hash = PM_FoldTextureName( name, folded );
+
+	for ( i = hash & ( gcTextureSlots - 1 ); grgTextures[i].name[0]; i = ( i + 1 ) & ( gcTextureSlots - 1 ) )
+	{
+		if ( grgTextures[i].hash == hash && !strcmp( grgTextures[i].name, folded ) )
+			return grgTextures[i].type;
+	}
+
+	return CHAR_TEX_CONCRETE;
+}
+
+/*
+================
+PM_TextureTypeBenchmark
+
+Times PM_FindTextureType against a binary search over the sorted names,
+the lookup it replaced, for every loaded name, an upper case copy and a
+miss
+================
+*/
+#define PM_TEXBENCH_ROUNDS 1000
+
+static int PM_CompareTextureNames( const void *a, const void *b )
+{
+	return stricmp( ( (const pmtexture_t *)a )->name, ( (const pmtexture_t *)b )->name );
+}
+
+static char PM_FindSortedTextureType( const pmtexture_t *sorted, int count, const char *name )
+{
+	int left, right, pivot;
+	int val;
+
 	left = 0;
-	right = gcTextures - 1;
+	right = count - 1;
 
 	while ( left <= right )
 	{
 		pivot = ( left + right ) / 2;
 
-		val = strnicmp( name, grgszTextureName[pivot], CBTEXTURENAMEMAX - 1 );
+		val = strnicmp( name, sorted[pivot].name, CBTEXTURENAMEMAX - 1 );
 		if ( val == 0 )
-		{
-			return grgchTextureType[pivot];
-		}
+			return sorted[pivot].type;
 		else if ( val > 0 )
-		{
 			left = pivot + 1;
-		}
-		else if ( val < 0 )
-		{
+		else
 			right = pivot - 1;
-		}
 	}
 
 	return CHAR_TEX_CONCRETE;
 }
 
+void PM_TextureTypeBenchmark( void )
+{
+	pmtexture_t *sorted;
+	char( *names )[CBTEXTURENAMEMAX];
+	int i, j, count, numnames, mismatches;
+	unsigned int sum;
+	double start, sortedtime, hashedtime;
+
+	if ( !pmove || !gcTextures )
+		return;
+
+	sorted = (pmtexture_t *)malloc( gcTextures * sizeof( *sorted ) );
+	names = (char( * )[CBTEXTURENAMEMAX])malloc( gcTextures * 3 * sizeof( *names ) );
+	if ( !sorted || !names )
+	{
+		free( sorted );
+		free( names );
+		return;
+	}
+
+	for ( i = 0, count = 0; i < gcTextureSlots; i++ )
+	{
+		if ( grgTextures[i].name[0] )
+			sorted[count++] = grgTextures[i];
+	}
+
+	qsort( sorted, count, sizeof( *sorted ), PM_CompareTextureNames );
+
+	for ( i = 0, numnames = 0; i < count; i++ )
+	{
+		strcpy( names[numnames++], sorted[i].name );
+
+		for ( j = 0; sorted[i].name[j]; j++ )
+			names[numnames][j] = toupper( (unsigned char)sorted[i].name[j] );
+		names[numnames++][j] = 0;
+
+		strcpy( names[numnames], sorted[i].name );
+		names[numnames++][0] = '~';
+	}
+
+	sum = 0;
+	start = pmove->Sys_FloatTime();
+	for ( i = 0; i < PM_TEXBENCH_ROUNDS; i++ )
+	{
+		for ( j = 0; j < numnames; j++ )
+			sum += PM_FindSortedTextureType( sorted, count, names[j] );
+	}
+	sortedtime = pmove->Sys_FloatTime() - start;
+
+	start = pmove->Sys_FloatTime();
+	for ( i = 0; i < PM_TEXBENCH_ROUNDS; i++ )
+	{
+		for ( j = 0; j < numnames; j++ )
+			sum -= PM_FindTextureType( names[j] );
+	}
+	hashedtime = pmove->Sys_FloatTime() - start;
+
+	for ( j = 0, mismatches = 0; j < numnames; j++ )
+	{
+		if ( PM_FindSortedTextureType( sorted, count, names[j] ) != PM_FindTextureType( names[j] ) )
+			mismatches++;
+	}
+
+	pmove->Con_Printf( "%d texture types, %d slots: sorted %.1f ns, hashed %.1f ns per lookup (%d mismatches, %u)\n",
+		count, gcTextureSlots,
+		sortedtime * 1e9 / ( (double)PM_TEXBENCH_ROUNDS * numnames ),
+		hashedtime * 1e9 / ( (double)PM_TEXBENCH_ROUNDS * numnames ),
+		mismatches, sum );
+
+	free( sorted );
+	free( names );
+}
+
 void PM_PlayStepSound( int step, float fvol )
 {
 	static int iSkipStep = 0;
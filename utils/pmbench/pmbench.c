@@ -0,0 +1,861 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+// pmbench.c
+// Runs pm_shared outside the engine against a box world, replays usercmd
+// streams and reports time per command, engine callback counts and a
+// checksum of the player state after every command.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "mathlib.h"
+#include "const.h"
+#include "com_model.h"
+#include "usercmd.h"
+#include "pm_defs.h"
+#include "pm_shared.h"
+#include "pm_movevars.h"
+
+#define PITCH 0
+#define YAW   1
+#define ROLL  2
+
+#define DIST_EPSILON ( 1.0f / 32.0f )
+
+#define PMB_MAXBOXES 64
+#define PMB_MAXCMDS  ( 1 << 20 )
+
+/*
+==============================================================================
+
+WORLD
+
+==============================================================================
+*/
+
+typedef struct pmbbox_s
+{
+	vec3_t mins, maxs;
+	int contents;
+} pmbbox_t;
+
+static pmbbox_t g_boxes[PMB_MAXBOXES];
+static int g_numboxes;
+
+static void PMB_AddBox( float x1, float y1, float z1, float x2, float y2, float z2, int contents )
+{
+	pmbbox_t *box = &g_boxes[g_numboxes++];
+
+	box->mins[0] = x1;
+	box->mins[1] = y1;
+	box->mins[2] = z1;
+	box->maxs[0] = x2;
+	box->maxs[1] = y2;
+	box->maxs[2] = z2;
+	box->contents = contents;
+}
+
+/*
+================
+PMB_BuildWorld
+
+A walled floor with stairs, crates, a low tunnel that needs ducking
+and a pool
+================
+*/
+static void PMB_BuildWorld( void )
+{
+	int i;
+
+	g_numboxes = 0;
+
+	// floor and walls
+	PMB_AddBox( -1024, -1024, -32, 1024, 1024, 0, CONTENTS_SOLID );
+	PMB_AddBox( -1056, -1024, 0, -1024, 1024, 512, CONTENTS_SOLID );
+	PMB_AddBox( 1024, -1024, 0, 1056, 1024, 512, CONTENTS_SOLID );
+	PMB_AddBox( -1024, -1056, 0, 1024, -1024, 512, CONTENTS_SOLID );
+	PMB_AddBox( -1024, 1024, 0, 1024, 1056, 512, CONTENTS_SOLID );
+
+	// stairs up to a platform along +x
+	for ( i = 0; i < 8; i++ )
+		PMB_AddBox( 256 + i * 32, -256, 0, 1024, 256, ( i + 1 ) * 16, CONTENTS_SOLID );
+
+	// crates
+	PMB_AddBox( -512, -512, 0, -448, -448, 64, CONTENTS_SOLID );
+	PMB_AddBox( -300, 200, 0, -236, 264, 40, CONTENTS_SOLID );
+	PMB_AddBox( 100, -700, 0, 164, -636, 17, CONTENTS_SOLID );
+
+	// low tunnel roof
+	PMB_AddBox( -900, -600, 56, -600, -300, 96, CONTENTS_SOLID );
+
+	// pool
+	PMB_AddBox( -800, 400, 0, -400, 800, 96, CONTENTS_WATER );
+}
+
+/*
+==============================================================================
+
+ENGINE STAND-INS
+
+==============================================================================
+*/
+
+static playermove_t g_pmove;
+static movevars_t g_movevars;
+
+static double g_time;
+static unsigned int g_random;
+
+static int g_traces;
+static int g_contents;
+static int g_positiontests;
+
+/*
+================
+PMB_TraceBox
+
+Clip the move against one box expanded by the hull, same rules as the
+engine brush tracer
+================
+*/
+static void PMB_TraceBox( const pmbbox_t *box, const float *mins, const float *maxs, const float *start, const float *end, pmtrace_t *tr )
+{
+	float enterfrac = -1.0f, leavefrac = 1.0f;
+	vec3_t clipnormal = { 0, 0, 0 };
+	int startout = 0, getout = 0;
+	int i, side;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		for ( side = 0; side < 2; side++ )
+		{
+			float d1, d2, f;
+
+			if ( side )
+			{
+				d1 = start[i] - ( box->maxs[i] - mins[i] );
+				d2 = end[i] - ( box->maxs[i] - mins[i] );
+			}
+			else
+			{
+				d1 = ( box->mins[i] - maxs[i] ) - start[i];
+				d2 = ( box->mins[i] - maxs[i] ) - end[i];
+			}
+
+			if ( d2 > 0 )
+				getout = 1;
+			if ( d1 > 0 )
+				startout = 1;
+
+			// completely in front of this face
+			if ( d1 > 0 && ( d2 >= DIST_EPSILON || d2 >= d1 ) )
+				return;
+
+			if ( d1 <= 0 && d2 <= 0 )
+				continue;
+
+			if ( d1 > d2 )
+			{
+				f = ( d1 - DIST_EPSILON ) / ( d1 - d2 );
+				if ( f < 0 )
+					f = 0;
+				if ( f > enterfrac )
+				{
+					enterfrac = f;
+					VectorClear( clipnormal );
+					clipnormal[i] = side ? 1.0f : -1.0f;
+				}
+			}
+			else
+			{
+				f = ( d1 + DIST_EPSILON ) / ( d1 - d2 );
+				if ( f > 1 )
+					f = 1;
+				if ( f < leavefrac )
+					leavefrac = f;
+			}
+		}
+	}
+
+	if ( !startout )
+	{
+		tr->startsolid = true;
+		tr->ent = 0;
+		if ( !getout )
+		{
+			tr->allsolid = true;
+			tr->fraction = 0;
+		}
+		return;
+	}
+
+	if ( enterfrac < leavefrac && enterfrac > -1 && enterfrac < tr->fraction )
+	{
+		tr->fraction = enterfrac < 0 ? 0 : enterfrac;
+		VectorCopy( clipnormal, tr->plane.normal );
+		tr->ent = 0;
+	}
+}
+
+static pmtrace_t PMB_Trace( float *start, float *end, const float *mins, const float *maxs )
+{
+	pmtrace_t tr;
+	int i;
+
+	memset( &tr, 0, sizeof( tr ) );
+	tr.fraction = 1.0f;
+	tr.ent = -1;
+	tr.inopen = true;
+
+	for ( i = 0; i < g_numboxes; i++ )
+	{
+		if ( g_boxes[i].contents == CONTENTS_SOLID )
+			PMB_TraceBox( &g_boxes[i], mins, maxs, start, end, &tr );
+	}
+
+	if ( tr.allsolid )
+	{
+		VectorCopy( start, tr.endpos );
+	}
+	else
+	{
+		for ( i = 0; i < 3; i++ )
+			tr.endpos[i] = start[i] + tr.fraction * ( end[i] - start[i] );
+	}
+
+	tr.plane.dist = DotProduct( tr.endpos, tr.plane.normal );
+
+	return tr;
+}
+
+static pmtrace_t PMB_PlayerTrace( float *start, float *end, int traceFlags, int ignore_pe )
+{
+	g_traces++;
+	return PMB_Trace( start, end, g_pmove.player_mins[g_pmove.usehull], g_pmove.player_maxs[g_pmove.usehull] );
+}
+
+static struct pmtrace_s *PMB_TraceLine( float *start, float *end, int flags, int usehull, int ignore_pe )
+{
+	static pmtrace_t tr;
+
+	g_traces++;
+	tr = PMB_Trace( start, end, g_pmove.player_mins[usehull], g_pmove.player_maxs[usehull] );
+	return &tr;
+}
+
+static int PMB_TestPlayerPosition( float *pos, pmtrace_t *ptrace )
+{
+	pmtrace_t tr;
+
+	g_positiontests++;
+
+	tr = PMB_Trace( pos, pos, g_pmove.player_mins[g_pmove.usehull], g_pmove.player_maxs[g_pmove.usehull] );
+	if ( ptrace )
+		*ptrace = tr;
+
+	return tr.startsolid ? tr.ent : -1;
+}
+
+static int PMB_PointContents( float *p, int *truecontents )
+{
+	int i, contents = CONTENTS_EMPTY;
+
+	g_contents++;
+
+	for ( i = 0; i < g_numboxes; i++ )
+	{
+		const pmbbox_t *box = &g_boxes[i];
+
+		if ( p[0] < box->mins[0] || p[0] > box->maxs[0] || p[1] < box->mins[1] || p[1] > box->maxs[1] || p[2] < box->mins[2] || p[2] > box->maxs[2] )
+			continue;
+
+		contents = box->contents;
+		if ( contents == CONTENTS_SOLID )
+			break;
+	}
+
+	if ( truecontents )
+		*truecontents = contents;
+
+	return contents;
+}
+
+static int PMB_TruePointContents( float *p )
+{
+	return PMB_PointContents( p, NULL );
+}
+
+static int PMB_HullPointContents( struct hull_s *hull, int num, float *p )
+{
+	return CONTENTS_EMPTY;
+}
+
+static const char *PMB_Info_ValueForKey( const char *s, const char *key )
+{
+	static char value[MAX_PHYSINFO_STRING];
+	char pkey[MAX_PHYSINFO_STRING];
+	char *o;
+
+	if ( *s == '\\' )
+		s++;
+
+	while ( *s )
+	{
+		o = pkey;
+		while ( *s && *s != '\\' )
+			*o++ = *s++;
+		*o = 0;
+
+		if ( !*s )
+			break;
+		s++;
+
+		o = value;
+		while ( *s && *s != '\\' )
+			*o++ = *s++;
+		*o = 0;
+
+		if ( !strcmp( key, pkey ) )
+			return value;
+
+		if ( *s )
+			s++;
+	}
+
+	return "";
+}
+
+static void PMB_Printf( char *fmt, ... )
+{
+	va_list args;
+
+	va_start( args, fmt );
+	vprintf( fmt, args );
+	va_end( args );
+}
+
+static void PMB_DPrintf( char *fmt, ... )
+{
+}
+
+static double PMB_FloatTime( void )
+{
+	return g_time;
+}
+
+static int PMB_RandomLong( int lLow, int lHigh )
+{
+	g_random = g_random * 1103515245u + 12345u;
+
+	if ( lHigh <= lLow )
+		return lLow;
+
+	return lLow + (int)( ( g_random >> 8 ) % (unsigned int)( lHigh - lLow + 1 ) );
+}
+
+static float PMB_RandomFloat( float flLow, float flHigh )
+{
+	g_random = g_random * 1103515245u + 12345u;
+
+	return flLow + ( g_random >> 8 ) * ( 1.0f / 16777216.0f ) * ( flHigh - flLow );
+}
+
+static void PMB_StuckTouch( int hitent, pmtrace_t *ptraceresult )
+{
+}
+
+static void PMB_PlaySound( int channel, const char *sample, float volume, float attenuation, int fFlags, int pitch )
+{
+}
+
+static const char *PMB_TraceTexture( int ground, float *vstart, float *vend )
+{
+	return "generic";
+}
+
+static int PMB_GetModelType( struct model_s *mod )
+{
+	return mod_brush;
+}
+
+static void PMB_GetModelBounds( struct model_s *mod, float *mins, float *maxs )
+{
+	VectorClear( mins );
+	VectorClear( maxs );
+}
+
+static void *PMB_HullForBsp( physent_t *pe, float *offset )
+{
+	return NULL;
+}
+
+static float PMB_TraceModel( physent_t *pEnt, float *start, float *end, trace_t *trace )
+{
+	return 1.0f;
+}
+
+static byte *PMB_LoadFile( char *path, int usehunk, int *pLength )
+{
+	return NULL;
+}
+
+static void PMB_FreeFile( void *buffer )
+{
+}
+
+/*
+================
+PMB_InitMove
+
+Engine side playermove setup for one player standing on the floor
+================
+*/
+static void PMB_InitMove( const char *physinfo )
+{
+	playermove_t *pm = &g_pmove;
+	int i;
+
+	memset( pm, 0, sizeof( *pm ) );
+	memset( &g_movevars, 0, sizeof( g_movevars ) );
+
+	g_movevars.gravity = 800;
+	g_movevars.stopspeed = 100;
+	g_movevars.maxspeed = 500;
+	g_movevars.spectatormaxspeed = 500;
+	g_movevars.accelerate = 10;
+	g_movevars.airaccelerate = 10;
+	g_movevars.wateraccelerate = 10;
+	g_movevars.friction = 4;
+	g_movevars.edgefriction = 2;
+	g_movevars.waterfriction = 1;
+	g_movevars.entgravity = 1;
+	g_movevars.bounce = 1;
+	g_movevars.stepsize = 18;
+	g_movevars.maxvelocity = 2000;
+	g_movevars.zmax = 4096;
+	g_movevars.footsteps = 1;
+
+	pm->movevars = &g_movevars;
+	pm->multiplayer = true;
+	pm->runfuncs = true;
+	pm->movetype = MOVETYPE_WALK;
+	pm->onground = -1;
+	pm->gravity = 1.0f;
+	pm->friction = 1.0f;
+	pm->maxspeed = 500;
+	pm->clientmaxspeed = 400;
+	pm->origin[2] = 37;
+	pm->view_ofs[2] = 28;
+
+	// standing, ducked, point and large hulls
+	for ( i = 0; i < 2; i++ )
+	{
+		pm->player_mins[0][i] = pm->player_mins[1][i] = -16;
+		pm->player_maxs[0][i] = pm->player_maxs[1][i] = 16;
+		pm->player_mins[3][i] = -32;
+		pm->player_maxs[3][i] = 32;
+	}
+	pm->player_mins[0][2] = -36;
+	pm->player_maxs[0][2] = 36;
+	pm->player_mins[1][2] = -18;
+	pm->player_maxs[1][2] = 18;
+	pm->player_mins[3][2] = -32;
+	pm->player_maxs[3][2] = 32;
+
+	pm->numphysent = 1;
+	strcpy( pm->physents[0].name, "world" );
+
+	strncpy( pm->physinfo, physinfo, sizeof( pm->physinfo ) - 1 );
+
+	pm->PM_Info_ValueForKey = PMB_Info_ValueForKey;
+	pm->PM_TestPlayerPosition = PMB_TestPlayerPosition;
+	pm->Con_DPrintf = PMB_DPrintf;
+	pm->Con_Printf = PMB_Printf;
+	pm->Sys_FloatTime = PMB_FloatTime;
+	pm->PM_StuckTouch = PMB_StuckTouch;
+	pm->PM_PointContents = PMB_PointContents;
+	pm->PM_TruePointContents = PMB_TruePointContents;
+	pm->PM_HullPointContents = PMB_HullPointContents;
+	pm->PM_PlayerTrace = PMB_PlayerTrace;
+	pm->PM_TraceLine = PMB_TraceLine;
+	pm->RandomLong = PMB_RandomLong;
+	pm->RandomFloat = PMB_RandomFloat;
+	pm->PM_GetModelType = PMB_GetModelType;
+	pm->PM_GetModelBounds = PMB_GetModelBounds;
+	pm->PM_HullForBsp = PMB_HullForBsp;
+	pm->PM_TraceModel = PMB_TraceModel;
+	pm->COM_LoadFile = PMB_LoadFile;
+	pm->COM_FreeFile = PMB_FreeFile;
+	pm->PM_PlaySound = PMB_PlaySound;
+	pm->PM_TraceTexture = PMB_TraceTexture;
+}
+
+/*
+==============================================================================
+
+USERCMD STREAMS
+
+==============================================================================
+*/
+
+static usercmd_t *g_cmds;
+static int g_numcmds;
+
+/*
+================
+PMB_GenerateCmds
+
+Deterministic mix of running, strafing, jumping, ducking and turning
+================
+*/
+static void PMB_GenerateCmds( int count, unsigned int seed )
+{
+	usercmd_t *cmd;
+	int i, left = 0, action = 0;
+	float yaw = 0, turn = 0;
+
+	g_random = seed;
+
+	for ( i = 0; i < count; i++ )
+	{
+		if ( left-- <= 0 )
+		{
+			left = PMB_RandomLong( 20, 120 );
+			action = PMB_RandomLong( 0, 6 );
+			turn = PMB_RandomFloat( -2.0f, 2.0f );
+		}
+
+		yaw = anglemod( yaw + turn );
+
+		cmd = &g_cmds[i];
+		memset( cmd, 0, sizeof( *cmd ) );
+		cmd->msec = PMB_RandomLong( 0, 7 ) ? 10 : 16;
+		cmd->viewangles[PITCH] = PMB_RandomFloat( -10.0f, 10.0f );
+		cmd->viewangles[YAW] = yaw;
+
+		switch ( action )
+		{
+		case 0: // idle
+			break;
+		case 1:
+			cmd->forwardmove = 400;
+			break;
+		case 2:
+			cmd->forwardmove = 400;
+			cmd->sidemove = PMB_RandomLong( 0, 1 ) ? 400 : -400;
+			break;
+		case 3:
+			cmd->forwardmove = -400;
+			break;
+		case 4: // bunny hop
+			cmd->forwardmove = 400;
+			if ( PMB_RandomLong( 0, 3 ) )
+				cmd->buttons |= IN_JUMP;
+			break;
+		case 5:
+			cmd->forwardmove = 400;
+			cmd->buttons |= IN_DUCK;
+			break;
+		case 6:
+			cmd->sidemove = 400;
+			cmd->upmove = 400;
+			break;
+		}
+
+		if ( cmd->forwardmove > 0 )
+			cmd->buttons |= IN_FORWARD;
+		else if ( cmd->forwardmove < 0 )
+			cmd->buttons |= IN_BACK;
+	}
+
+	g_numcmds = count;
+}
+
+/*
+================
+PMB_LoadCmds
+
+One command per line:
+msec forwardmove sidemove upmove buttons pitch yaw roll
+================
+*/
+static int PMB_LoadCmds( const char *filename )
+{
+	FILE *f;
+	char line[256];
+	usercmd_t *cmd;
+	int msec, buttons;
+
+	f = fopen( filename, "r" );
+	if ( !f )
+		return 0;
+
+	g_numcmds = 0;
+
+	while ( fgets( line, sizeof( line ), f ) && g_numcmds < PMB_MAXCMDS )
+	{
+		if ( line[0] == '#' )
+			continue;
+
+		cmd = &g_cmds[g_numcmds];
+		memset( cmd, 0, sizeof( *cmd ) );
+
+		if ( sscanf( line, "%d %f %f %f %d %f %f %f", &msec, &cmd->forwardmove, &cmd->sidemove, &cmd->upmove, &buttons, &cmd->viewangles[0], &cmd->viewangles[1], &cmd->viewangles[2] ) != 8 )
+			continue;
+
+		cmd->msec = msec;
+		cmd->buttons = buttons;
+		g_numcmds++;
+	}
+
+	fclose( f );
+	return 1;
+}
+
+static int PMB_SaveCmds( const char *filename )
+{
+	FILE *f;
+	usercmd_t *cmd;
+	int i;
+
+	f = fopen( filename, "w" );
+	if ( !f )
+		return 0;
+
+	fprintf( f, "# msec forwardmove sidemove upmove buttons pitch yaw roll\n" );
+
+	for ( i = 0; i < g_numcmds; i++ )
+	{
+		cmd = &g_cmds[i];
+		fprintf( f, "%d %.9g %.9g %.9g %d %.9g %.9g %.9g\n", cmd->msec, cmd->forwardmove, cmd->sidemove, cmd->upmove, cmd->buttons, cmd->viewangles[0], cmd->viewangles[1], cmd->viewangles[2] );
+	}
+
+	fclose( f );
+	return 1;
+}
+
+/*
+==============================================================================
+
+REPLAY
+
+==============================================================================
+*/
+
+static double PMB_Clock( void )
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceCounter( &count );
+	QueryPerformanceFrequency( &freq );
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static unsigned int PMB_Hash( unsigned int hash, const void *data, size_t size )
+{
+	const byte *p = (const byte *)data;
+	size_t i;
+
+	for ( i = 0; i < size; i++ )
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+================
+PMB_Run
+
+Replay the whole stream once from the spawn point, returns the checksum
+of the state after every command
+================
+*/
+static unsigned int PMB_Run( const char *physinfo, double *elapsed )
+{
+	playermove_t *pm = &g_pmove;
+	unsigned int hash = 2166136261u;
+	double start, total = 0;
+	int i;
+
+	PMB_InitMove( physinfo );
+	g_random = 1;
+
+	for ( i = 0; i < g_numcmds; i++ )
+	{
+		pm->cmd = g_cmds[i];
+		VectorCopy( pm->cmd.viewangles, pm->angles );
+
+		// the engine keeps time across runs, so stuck checks behave the same
+		g_time += pm->cmd.msec * 0.001;
+		pm->time = (float)( g_time * 1000.0 );
+
+		start = PMB_Clock();
+		PM_Move( pm, true );
+		total += PMB_Clock() - start;
+
+		hash = PMB_Hash( hash, pm->origin, sizeof( pm->origin ) );
+		hash = PMB_Hash( hash, pm->velocity, sizeof( pm->velocity ) );
+		hash = PMB_Hash( hash, &pm->flags, sizeof( pm->flags ) );
+		hash = PMB_Hash( hash, &pm->usehull, sizeof( pm->usehull ) );
+		hash = PMB_Hash( hash, &pm->onground, sizeof( pm->onground ) );
+		hash = PMB_Hash( hash, &pm->waterlevel, sizeof( pm->waterlevel ) );
+	}
+
+	*elapsed = total;
+	return hash;
+}
+
+static void PMB_Usage( void )
+{
+	printf( "usage: pmbench [options]\n"
+			"  -cmds <n>          generate n commands (default 100000)\n"
+			"  -seed <n>          seed for generated commands (default 1)\n"
+			"  -replay <file>     replay a recorded usercmd stream instead\n"
+			"  -record <file>     write the command stream to a file\n"
+			"  -runs <n>          replay the stream n times, report the best (default 5)\n"
+			"  -physinfo <str>    physics info string (default \\tfc\\1)\n"
+			"  -expect <hex>      exit with 1 if the state checksum differs\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const char *replay = NULL, *record = NULL;
+	const char *physinfo = "\\tfc\\1";
+	int numcmds = 100000, runs = 5;
+	unsigned int seed = 1, expect = 0, checksum = 0, hash;
+	int hasexpect = 0, diverged = 0;
+	double elapsed, best = 0;
+	int i, traces, contents, positiontests;
+
+	for ( i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[i], "-cmds" ) && i + 1 < argc )
+			numcmds = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-seed" ) && i + 1 < argc )
+			seed = (unsigned int)strtoul( argv[++i], NULL, 0 );
+		else if ( !strcmp( argv[i], "-replay" ) && i + 1 < argc )
+			replay = argv[++i];
+		else if ( !strcmp( argv[i], "-record" ) && i + 1 < argc )
+			record = argv[++i];
+		else if ( !strcmp( argv[i], "-runs" ) && i + 1 < argc )
+			runs = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-physinfo" ) && i + 1 < argc )
+			physinfo = argv[++i];
+		else if ( !strcmp( argv[i], "-expect" ) && i + 1 < argc )
+		{
+			expect = (unsigned int)strtoul( argv[++i], NULL, 16 );
+			hasexpect = 1;
+		}
+		else
+		{
+			PMB_Usage();
+			return 2;
+		}
+	}
+
+	if ( numcmds < 1 )
+		numcmds = 1;
+	if ( numcmds > PMB_MAXCMDS )
+		numcmds = PMB_MAXCMDS;
+	if ( runs < 1 )
+		runs = 1;
+
+	g_cmds = (usercmd_t *)calloc( PMB_MAXCMDS, sizeof( usercmd_t ) );
+	if ( !g_cmds )
+		return 2;
+
+	if ( replay )
+	{
+		if ( !PMB_LoadCmds( replay ) || !g_numcmds )
+		{
+			printf( "pmbench: couldn't read %s\n", replay );
+			return 2;
+		}
+	}
+	else
+	{
+		PMB_GenerateCmds( numcmds, seed );
+	}
+
+	if ( record && !PMB_SaveCmds( record ) )
+	{
+		printf( "pmbench: couldn't write %s\n", record );
+		return 2;
+	}
+
+	PMB_BuildWorld();
+
+	PMB_InitMove( physinfo );
+	g_time = 1000.0;
+	PM_Init( &g_pmove );
+
+	for ( i = 0; i < runs; i++ )
+	{
+		g_traces = g_contents = g_positiontests = 0;
+
+		hash = PMB_Run( physinfo, &elapsed );
+
+		if ( !i )
+			checksum = hash;
+		else if ( hash != checksum )
+			diverged = 1;
+
+		if ( !i || elapsed < best )
+			best = elapsed;
+	}
+
+	traces = g_traces;
+	contents = g_contents;
+	positiontests = g_positiontests;
+
+	printf( "pmbench: %d cmds x %d runs, best %.1f ns/cmd, %.2f traces/cmd, %.2f contents/cmd, %.2f position tests/cmd, checksum %08x\n",
+		g_numcmds, runs, best * 1e9 / g_numcmds,
+		(double)traces / g_numcmds, (double)contents / g_numcmds, (double)positiontests / g_numcmds, checksum );
+
+	if ( diverged )
+	{
+		printf( "pmbench: runs disagree, movement is not deterministic\n" );
+		return 1;
+	}
+
+	if ( hasexpect && checksum != expect )
+	{
+		printf( "pmbench: checksum mismatch, expected %08x\n", expect );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,323 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+// schedbench.cpp
+// Drives the server browser's detail query scheduler outside the client
+// against a local UDP responder stand-in. The responder plays a master list
+// of servers with their own latency, some of them dead, over a lossy link,
+// and answers on the loopback. Runs the old fixed burst of 21 queries with
+// a 2 second timeout, then the adaptive scheduler at each window asked for.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "hud_servers_sched.h"
+
+#define SB_MAXSERVERS 65536
+#define SB_MAXWINDOWS 8
+#define SB_LEGACY_WINDOW 21 // MAX_QUERIES 20, checked after the send
+
+typedef struct sbpacket_s
+{
+	int context;
+	int server;
+} sbpacket_t;
+
+typedef struct sbdelayed_s
+{
+	sbpacket_t packet;
+	double due;
+} sbdelayed_t;
+
+static double g_latency[SB_MAXSERVERS];
+static int g_dead[SB_MAXSERVERS];
+static int g_numservers = 1500;
+static int g_loss = 5;
+
+static int g_serversock = -1;
+static int g_clientsock = -1;
+static struct sockaddr_in g_serveraddr;
+static struct sockaddr_in g_clientaddr;
+
+static sbdelayed_t *g_delayed;
+static int g_numdelayed;
+static int g_maxdelayed;
+
+static int g_context;
+
+static double SB_Time( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+==============================================================================
+
+RESPONDER
+
+==============================================================================
+*/
+
+static int SB_OpenSocket( struct sockaddr_in *addr )
+{
+	socklen_t len = sizeof( *addr );
+	int sock;
+
+	sock = socket( AF_INET, SOCK_DGRAM, 0 );
+	if ( sock < 0 )
+		return -1;
+
+	memset( addr, 0, sizeof( *addr ) );
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	if ( bind( sock, (struct sockaddr *)addr, sizeof( *addr ) ) < 0 || getsockname( sock, (struct sockaddr *)addr, &len ) < 0 )
+	{
+		close( sock );
+		return -1;
+	}
+
+	fcntl( sock, F_SETFL, O_NONBLOCK );
+
+	return sock;
+}
+
+// Take requests off the wire, the live ones that aren't lost get answered
+// once their server's latency has passed
+static void SB_RespondRequests( double now )
+{
+	sbpacket_t packet;
+
+	while ( recv( g_serversock, &packet, sizeof( packet ), 0 ) == sizeof( packet ) )
+	{
+		if ( packet.server < 0 || packet.server >= g_numservers || g_dead[packet.server] )
+			continue;
+
+		if ( rand() % 100 < g_loss )
+			continue;
+
+		if ( g_numdelayed >= g_maxdelayed )
+		{
+			g_maxdelayed = g_maxdelayed ? g_maxdelayed * 2 : 1024;
+			g_delayed = (sbdelayed_t *)realloc( g_delayed, g_maxdelayed * sizeof( sbdelayed_t ) );
+			if ( !g_delayed )
+			{
+				printf( "schedbench: out of memory\n" );
+				exit( 2 );
+			}
+		}
+
+		g_delayed[g_numdelayed].packet = packet;
+		g_delayed[g_numdelayed].due = now + g_latency[packet.server];
+		g_numdelayed++;
+	}
+
+	for ( int i = 0; i < g_numdelayed; )
+	{
+		if ( g_delayed[i].due > now )
+		{
+			i++;
+			continue;
+		}
+
+		sendto( g_serversock, &g_delayed[i].packet, sizeof( sbpacket_t ), 0, (struct sockaddr *)&g_clientaddr, sizeof( g_clientaddr ) );
+		g_delayed[i] = g_delayed[--g_numdelayed];
+	}
+}
+
+/*
+==============================================================================
+
+SCHEDULER CALLBACKS
+
+==============================================================================
+*/
+
+static int SB_Send( void *owner, const netadr_t *adr, double timeout )
+{
+	sbpacket_t packet;
+
+	packet.context = ++g_context;
+	memcpy( &packet.server, adr->ip, sizeof( packet.server ) );
+
+	sendto( g_clientsock, &packet, sizeof( packet ), 0, (struct sockaddr *)&g_serveraddr, sizeof( g_serveraddr ) );
+
+	return packet.context;
+}
+
+// An answer to a cancelled context is just not ours any more
+static void SB_Cancel( void *owner, int context )
+{
+}
+
+/*
+==============================================================================
+
+RUNS
+
+==============================================================================
+*/
+
+static void SB_Run( int window, int tries, int legacy )
+{
+	querysched_t sched;
+	sbpacket_t packet;
+	netadr_t adr;
+	double start, now;
+	int i;
+
+	// Nothing left over from the last run
+	g_numdelayed = 0;
+	while ( recv( g_clientsock, &packet, sizeof( packet ), 0 ) > 0 )
+		;
+	while ( recv( g_serversock, &packet, sizeof( packet ), 0 ) > 0 )
+		;
+
+	Sched_Init( &sched, SB_Send, SB_Cancel, NULL );
+
+	for ( i = 0; i < g_numservers; i++ )
+	{
+		memset( &adr, 0, sizeof( adr ) );
+		memcpy( adr.ip, &i, sizeof( i ) );
+		Sched_Queue( &sched, &adr );
+	}
+
+	start = SB_Time();
+	Sched_Start( &sched, window, tries, 0.0 );
+
+	while ( Sched_Remaining( &sched ) )
+	{
+		now = SB_Time();
+		SB_RespondRequests( now );
+
+		while ( recv( g_clientsock, &packet, sizeof( packet ), 0 ) == sizeof( packet ) )
+			Sched_Response( &sched, packet.context, 1, SB_Time() - start );
+
+		// The old browser: a fixed window and the engine's 2 second timeout
+		if ( legacy )
+		{
+			sched.window = (float)window;
+			sched.rtt = 0.0;
+		}
+
+		Sched_Think( &sched, SB_Time() - start );
+		usleep( 500 );
+	}
+
+	printf( "%-8s window %3i tries %i: %5i answered %5i failed in %6.2f s, sent %5i, timeouts %5i, retries %5i, peak window %3i, rtt %3.0f ms\n",
+		legacy ? "legacy" : "adaptive", window, tries, sched.stats.answered, sched.stats.failed,
+		sched.stats.finished - sched.stats.started, sched.stats.sent, sched.stats.timeouts,
+		sched.stats.retries, sched.stats.maxwindow, sched.rtt * 1000.0 );
+
+	Sched_Clear( &sched );
+}
+
+static void SB_Usage( void )
+{
+	printf( "usage: schedbench [-servers n] [-dead pct] [-loss pct] [-latency min max] [-tries n] [-seed n] [-window n ...]\n" );
+	printf( "  -servers   servers in the list, default 1500\n" );
+	printf( "  -dead      percentage that never answer, default 15\n" );
+	printf( "  -loss      percentage of requests dropped, default 5\n" );
+	printf( "  -latency   response time range in ms, default 20 220\n" );
+	printf( "  -tries     sends per server for the adaptive runs, default 2\n" );
+	printf( "  -window    adaptive window to run, repeatable, default 48 64 128\n" );
+}
+
+int main( int argc, char **argv )
+{
+	int windows[SB_MAXWINDOWS];
+	int numwindows = 0, tries = 2, dead = 15;
+	int minlatency = 20, maxlatency = 220;
+	unsigned int seed = 1;
+	int i;
+
+	for ( i = 1; i < argc; i++ )
+	{
+		if ( !strcmp( argv[i], "-servers" ) && i + 1 < argc )
+			g_numservers = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-dead" ) && i + 1 < argc )
+			dead = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-loss" ) && i + 1 < argc )
+			g_loss = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-latency" ) && i + 2 < argc )
+		{
+			minlatency = atoi( argv[++i] );
+			maxlatency = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-tries" ) && i + 1 < argc )
+			tries = atoi( argv[++i] );
+		else if ( !strcmp( argv[i], "-seed" ) && i + 1 < argc )
+			seed = (unsigned int)strtoul( argv[++i], NULL, 0 );
+		else if ( !strcmp( argv[i], "-window" ) && i + 1 < argc && numwindows < SB_MAXWINDOWS )
+			windows[numwindows++] = atoi( argv[++i] );
+		else
+		{
+			SB_Usage();
+			return 2;
+		}
+	}
+
+	if ( g_numservers < 1 )
+		g_numservers = 1;
+	if ( g_numservers > SB_MAXSERVERS )
+		g_numservers = SB_MAXSERVERS;
+	if ( maxlatency < minlatency )
+		maxlatency = minlatency;
+
+	if ( !numwindows )
+	{
+		windows[numwindows++] = 48;
+		windows[numwindows++] = 64;
+		windows[numwindows++] = 128;
+	}
+
+	srand( seed );
+
+	for ( i = 0; i < g_numservers; i++ )
+	{
+		g_latency[i] = ( minlatency + rand() % ( maxlatency - minlatency + 1 ) ) / 1000.0;
+		g_dead[i] = rand() % 100 < dead;
+	}
+
+	g_serversock = SB_OpenSocket( &g_serveraddr );
+	g_clientsock = SB_OpenSocket( &g_clientaddr );
+	if ( g_serversock < 0 || g_clientsock < 0 )
+	{
+		printf( "schedbench: couldn't open loopback sockets\n" );
+		return 2;
+	}
+
+	printf( "%i servers, %i%% dead, %i%% loss, %i-%i ms\n", g_numservers, dead, g_loss, minlatency, maxlatency );
+
+	SB_Run( SB_LEGACY_WINDOW, 1, 1 );
+
+	for ( i = 0; i < numwindows; i++ )
+		SB_Run( windows[i], tries, 0 );
+
+	close( g_serversock );
+	close( g_clientsock );
+	free( g_delayed );
+
+	return 0;
+}